@@ -0,0 +1,708 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+//
+// Micro-benchmarks of the acquisition hot path.
+// Every case is run at 1376, 5000 and 13340 bytes per line and reports the best of
+// several repetitions as ns/line and MB/s of line bytes.
+//
+//     scansonar_bench [--filter NAME] [--min-time MS]
+//
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "SonarStructures.h"
+#include "FrameScanner.h"
+#include "FrameAssembler.h"
+#include "SerialRxBuffer.h"
+#include "SonarData.h"
+#include "LineRecorder.h"
+#include "RecordingReader.h"
+#include "ScanConverter.h"
+#include "Uncompand.h"
+#include "Tvg.h"
+#include "LineDetector.h"
+#include "ChangeDetector.h"
+#include "B64Encode.h"
+#include "Crc32.h"
+#include "LzCodec.h"
+
+namespace
+{
+    constexpr int LINE_SIZES[] = { 1376, 5000, 13340 };
+    constexpr int REPETITIONS = 5;
+    constexpr int MAX_LINE_SIZE = 20400;
+    constexpr int LINES_PER_TURN = 3200;
+    constexpr std::size_t RECORDER_BYTES_PER_RUN = 64U << 20;
+    constexpr int RECORDING_INDEX_LINES = 4 * LINES_PER_TURN;
+
+    const char *RECORDER_FILE = "scansonar_bench.tmp";
+
+    /**
+     *  @class MemoryTransport
+     *  Endless stream of prepared bytes, feeds the frame assembler without a port
+     */
+    class MemoryTransport final : public Transport
+    {
+    public:
+
+        MemoryTransport(const std::vector<uint8_t> &Stream) :
+            stream(Stream),
+            position(0)
+        {
+        }
+
+        std::size_t Read(uint8_t *dst, std::size_t size) override
+        {
+            std::size_t copied = 0;
+
+            while (copied < size)
+            {
+                std::size_t chunk = std::min(size - copied, stream.size() - position);
+                std::memcpy(&dst[copied], &stream[position], chunk);
+
+                copied += chunk;
+                position = (position + chunk) % stream.size();
+            }
+
+            return copied;
+        }
+
+        std::size_t Write(const uint8_t *src, std::size_t size) override
+        {
+            (void)src;
+            return size;
+        }
+
+        std::size_t Available() override
+        {
+            return stream.size() - position;
+        }
+
+        bool WaitReadable(int64_t timeoutms) override
+        {
+            (void)timeoutms;
+            return true;
+        }
+
+        uint32_t GetBaudrate() const override
+        {
+            return 115200;
+        }
+
+    private:
+
+        std::vector<uint8_t> stream;
+        std::size_t position;
+    };
+
+    struct BenchOptions
+    {
+        std::string filter;
+        int64_t mintimems = 200;
+    };
+
+    volatile uint64_t sink;
+
+    std::vector<uint8_t> MakeLine(int linesize, int headersize, uint32_t angle)
+    {
+        std::vector<uint8_t> line(linesize, 0);
+
+        DATAHEADERV3 header{};
+        header.magic = FRAME_MAGIC_DATA;
+        header.dataoffset = headersize;
+        header.datasize = 1;
+        header.samples = linesize;
+        header.angle = angle;
+
+        std::memcpy(line.data(), &header, headersize);
+
+        for (int i = headersize; i < linesize - static_cast<int>(sizeof(DATAFOOTER)); i++)
+        {
+            line[i] = static_cast<uint8_t>(i * 31 + (i >> 7));
+        }
+
+        DATAFOOTER footer = { 0, FRAME_MAGIC_END0 };
+        std::memcpy(&line[linesize - sizeof(DATAFOOTER)], &footer, sizeof(DATAFOOTER));
+
+        return line;
+    }
+
+    /**
+     *   @brief Run body (one call processes one line) until mintimems elapses, best of REPETITIONS
+     *   @return ns per call
+     */
+    double Measure(const std::function<void()> &body, int64_t mintimems, uint64_t maxcalls = UINT64_MAX)
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Calibrate the number of calls per repetition
+        uint64_t calls = 1;
+
+        for (;;)
+        {
+            auto start = clock::now();
+
+            for (uint64_t i = 0; i < calls; i++)
+            {
+                body();
+            }
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count();
+
+            if ((elapsed >= mintimems / 4) || (calls >= maxcalls))
+            {
+                break;
+            }
+
+            calls *= 2;
+        }
+
+        calls = std::min(calls * 4, maxcalls);
+
+        double best = 1e30;
+
+        for (int r = 0; r < REPETITIONS; r++)
+        {
+            auto start = clock::now();
+
+            for (uint64_t i = 0; i < calls; i++)
+            {
+                body();
+            }
+
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / static_cast<double>(calls);
+            best = std::min(best, ns);
+        }
+
+        return best;
+    }
+
+    void Report(const char *name, int linesize, double ns, double bytesperline)
+    {
+        std::printf("%-28s %8d %12.1f %10.1f\n", name, linesize, ns, bytesperline / ns * 1000.0);
+    }
+
+    bool Selected(const BenchOptions &options, const char *name)
+    {
+        return options.filter.empty() || (std::string::npos != std::string(name).find(options.filter));
+    }
+
+    void BenchAssembly(const BenchOptions &options, const char *name, FrameParseMode mode, int linesize)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        std::vector<uint8_t> stream;
+
+        for (int i = 0; i < 64; i++)
+        {
+            auto line = MakeLine(linesize, sizeof(DATAHEADERV3), i * 9);
+            stream.insert(stream.end(), line.begin(), line.end());
+        }
+
+        SerialRxBuffer rxbuffer(std::make_shared<MemoryTransport>(stream), 65536, MAX_LINE_SIZE);
+        FrameAssembler assembler(rxbuffer, mode);
+
+        std::vector<uint8_t> linebuffer(MAX_LINE_SIZE);
+
+        double ns = Measure([&]()
+        {
+            sink += assembler.GetLine(linebuffer.data(), linebuffer.size());
+        }, options.mintimems);
+
+        Report(name, linesize, ns, linesize);
+    }
+
+    void BenchUncompand(const BenchOptions &options, int linesize)
+    {
+        const char *name = "uncompand";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint16_t> samples(count);
+
+        double ns = Measure([&]()
+        {
+            Uncompand_Line(&line[sizeof(DATAHEADERV3)], samples.data(), count);
+            sink += samples[count / 2];
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count);
+    }
+
+    TvgSonarSettings BenchTvgSettings()
+    {
+        return { 100000.0F, 1500.0F, 0.0F, 0.0F, 80.0F };
+    }
+
+    void BenchTvg(const BenchOptions &options, int linesize)
+    {
+        const char *name = "tvg";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint16_t> samples(count);
+
+        TvgModel model = { TvgSpreading::TSpreading_20LogR, TvgAbsorption::TAbsorption_None, 0.0F, false };
+        auto gain = Tvg_BuildTable(model, BenchTvgSettings(), count);
+
+        Uncompand_Line(&line[sizeof(DATAHEADERV3)], samples.data(), count);
+
+        // Samples saturate after a few runs, the kernel has no data dependent branches
+        double ns = Measure([&]()
+        {
+            Tvg_Apply(samples.data(), gain.data(), count);
+            sink += samples[count / 2];
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count * sizeof(uint16_t));
+    }
+
+    void BenchDetect(const BenchOptions &options, const char *name, DetectMode mode, int linesize)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint16_t> samples(count);
+
+        Uncompand_Line(&line[sizeof(DATAHEADERV3)], samples.data(), count);
+
+        // Target at the last sample, every sample before it is searched
+        uint16_t target = 4095;
+        std::replace(samples.begin(), samples.end(), target, static_cast<uint16_t>(target - 1));
+        samples[count - 1] = target;
+
+        LineDetector detector(1);
+        detector.SetSettings({ mode, 1.0F, 0.0F, 0.0F, 1500.0F, 100000.0F });
+        Detection detection;
+
+        double ns = Measure([&]()
+        {
+            detector.ProcessLine(0, 0, samples.data(), count);
+            detector.Read(&detection, 1);
+            sink += detection.amplitude;
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count * sizeof(uint16_t));
+    }
+
+    /**
+     *   @brief Compare a line with a learned background having a few changed segments, reported per line
+     */
+    void BenchChange(const BenchOptions &options, int linesize)
+    {
+        const char *name = "change_detect";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint16_t> samples(count);
+
+        Uncompand_Line(&line[sizeof(DATAHEADERV3)], samples.data(), count);
+
+        ChangeDetector detector(4096);
+        detector.SetSettings({ true, 400, 0.05F, 0.0F, 0.0F, 0.0F, 1500.0F, 100000.0F });
+        detector.ProcessLine(0, 1, 0, 0, samples.data(), count);
+
+        for (int i = 0; i < count; i += count / 8)
+        {
+            samples[i] = 4095;
+        }
+
+        ChangeSegment segments[ChangeDetector::MAX_LINE_SEGMENTS];
+
+        double ns = Measure([&]()
+        {
+            detector.ProcessLine(0, 1, 0, 0, samples.data(), count);
+            sink += detector.Read(segments, ChangeDetector::MAX_LINE_SEGMENTS);
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count * sizeof(uint16_t));
+    }
+
+    void BenchWriteLine(const BenchOptions &options, int linesize)
+    {
+        const char *name = "sonardata_writeline";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        SonarData sonardata(linesize, LINES_PER_TURN);
+        int row = 0;
+
+        double ns = Measure([&]()
+        {
+            sonardata.WriteLine(row, &line[sizeof(DATAHEADERV3)], count);
+            row = (row + 1) % LINES_PER_TURN;
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count);
+    }
+
+    void BenchFillGap(const BenchOptions &options, int linesize)
+    {
+        const char *name = "sonardata_fillgap";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        // Stepping mode 4: every received line fills 3 skipped rows
+        constexpr int step = 4;
+
+        SonarData sonardata(linesize, LINES_PER_TURN);
+        int row = 0;
+
+        double ns = Measure([&]()
+        {
+            int next = row + step;
+            sonardata.FillGap(row, next, next);
+            row = (next + step < LINES_PER_TURN) ? next : 0;
+        }, options.mintimems);
+
+        // Reported per filled row
+        Report(name, linesize, ns / (step - 1), linesize * sizeof(uint16_t));
+    }
+
+    /**
+     *   @brief Store lines received every step rows, either with WriteLine + FillGap or with the fused IngestLine
+     */
+    void BenchStoreLine(const BenchOptions &options, const char *name, int step, bool fused, int linesize,
+                        int pyramidlevels = 0, DecimationMode decimation = DecimationMode::DMode_Max, bool tvg = false,
+                        PersistenceMode persistence = PersistenceMode::PMode_Off)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        SonarData sonardata(MAX_LINE_SIZE, LINES_PER_TURN, pyramidlevels, decimation, { persistence, 0.25F, 16 });
+        int row = 0;
+
+        TvgModel model = { TvgSpreading::TSpreading_20LogR, TvgAbsorption::TAbsorption_None, 0.0F, false };
+        auto table = Tvg_BuildTable(model, BenchTvgSettings(), MAX_LINE_SIZE);
+        const uint16_t *gain = (false != tvg) ? table.data() : nullptr;
+
+        double ns = Measure([&]()
+        {
+            int next = (row + step < LINES_PER_TURN) ? row + step : 0;
+
+            if (false != fused)
+            {
+                sonardata.IngestLine(next, &line[sizeof(DATAHEADERV3)], count, row, next, gain);
+            }
+            else
+            {
+                sonardata.WriteLine(next, &line[sizeof(DATAHEADERV3)], count);
+                sonardata.FillGap(row, next, next);
+            }
+
+            row = next;
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count);
+    }
+
+    /**
+     *   @brief Convert a full image of linesize lines to 1024 x 1024 pixels, reported per conversion
+     */
+    void BenchScanConvert(const BenchOptions &options, const char *name, bool bilinear, int linesize)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        constexpr int size = 1024;
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        SonarData sonardata(count, LINES_PER_TURN);
+
+        for (int i = 0; i < LINES_PER_TURN; i++)
+        {
+            sonardata.IngestLine(i, &line[sizeof(DATAHEADERV3)], count, i, i);
+        }
+
+        ScanConverter converter(size, size, 0, LINES_PER_TURN, bilinear);
+        converter.Convert(sonardata);
+
+        double ns = Measure([&]()
+        {
+            sink += converter.Convert(sonardata)[size * size / 2];
+        }, options.mintimems);
+
+        Report(name, linesize, ns, size * size * sizeof(uint16_t));
+    }
+
+    /**
+     *   @brief Store one line and redraw the changed pixels of 1024 x 1024 image, reported per line
+     */
+    void BenchScanConvertChanged(const BenchOptions &options, const char *name, bool bilinear, int linesize)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        constexpr int size = 1024;
+
+        int count = linesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        SonarData sonardata(count, LINES_PER_TURN);
+
+        ScanConverter converter(size, size, 0, LINES_PER_TURN, bilinear);
+        converter.Convert(sonardata);
+
+        int row = 0;
+
+        double ns = Measure([&]()
+        {
+            sonardata.IngestLine(row, &line[sizeof(DATAHEADERV3)], count, row, row);
+            sink += converter.ConvertChanged(sonardata)[size * size / 2];
+            row = (row + 1) % LINES_PER_TURN;
+        }, options.mintimems);
+
+        Report(name, linesize, ns, count * sizeof(uint16_t));
+    }
+
+    void BenchRecorder(const BenchOptions &options, const char *name, int headersize, int linesize)
+    {
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        auto line = MakeLine(linesize, headersize, 0);
+        LineRecorder recorder(std::make_unique<WriteBehind>(RECORDER_FILE));
+
+        // Sustained rate: the processing thread waits for the disk instead of dropping lines
+        recorder.SetBacklogPolicy(BacklogPolicy::BPolicy_Wait);
+
+        // Bounded so the temporary file stays small
+        double ns = Measure([&]()
+        {
+            recorder.Write(line.data());
+        }, options.mintimems, RECORDER_BYTES_PER_RUN / linesize);
+
+        Report(name, linesize, ns, linesize);
+    }
+
+    void BenchRecordingIndex(const BenchOptions &options, int linesize)
+    {
+        const char *name = "recording_index";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        {
+            LineRecorder recorder(std::make_unique<WriteBehind>(RECORDER_FILE));
+            recorder.SetBacklogPolicy(BacklogPolicy::BPolicy_Wait);
+
+            for (int i = 0; i < RECORDING_INDEX_LINES; i++)
+            {
+                recorder.Write(MakeLine(linesize, sizeof(DATAHEADERV3), (i % LINES_PER_TURN) * 9).data());
+            }
+        }
+
+        // Mapping and indexing the whole recording, reported per line
+        double ns = Measure([&]()
+        {
+            RecordingReader reader(RECORDER_FILE);
+            sink += reader.GetLinesCount();
+        }, options.mintimems);
+
+        Report(name, linesize, ns / RECORDING_INDEX_LINES, linesize);
+    }
+
+    void BenchLzCompress(const BenchOptions &options, int linesize)
+    {
+        const char *name = "lz_compress";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint8_t> compressed(Lz_CompressBound(line.size()));
+
+        double ns = Measure([&]()
+        {
+            sink += Lz_Compress(line.data(), line.size(), compressed.data(), compressed.size());
+        }, options.mintimems);
+
+        Report(name, linesize, ns, linesize);
+    }
+
+    void BenchLzDecompress(const BenchOptions &options, int linesize)
+    {
+        const char *name = "lz_decompress";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<uint8_t> compressed(Lz_CompressBound(line.size()));
+        std::vector<uint8_t> decompressed(line.size());
+
+        std::size_t size = Lz_Compress(line.data(), line.size(), compressed.data(), compressed.size());
+
+        double ns = Measure([&]()
+        {
+            sink += Lz_Decompress(compressed.data(), size, decompressed.data(), decompressed.size()) ? 1 : 0;
+        }, options.mintimems);
+
+        Report(name, linesize, ns, linesize);
+    }
+
+    void BenchB64Encode(const BenchOptions &options, int linesize)
+    {
+        const char *name = "b64encode";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+        std::vector<char> encoded(B64Encode::EncodedSize(linesize) + 1);
+
+        double ns = Measure([&]()
+        {
+            sink += B64Encode::Encode(line.data(), line.size(), encoded.data(), encoded.size());
+        }, options.mintimems);
+
+        Report(name, linesize, ns, linesize);
+    }
+
+    void BenchCrc32(const BenchOptions &options, int linesize)
+    {
+        const char *name = "crc32";
+
+        if (false == Selected(options, name))
+        {
+            return;
+        }
+
+        auto line = MakeLine(linesize, sizeof(DATAHEADERV3), 0);
+
+        double ns = Measure([&]()
+        {
+            sink += Crc32_ComputeBuf(0, line.data(), line.size());
+        }, options.mintimems);
+
+        Report(name, linesize, ns, linesize);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (("--filter" == arg) && (i + 1 < argc))
+        {
+            options.filter = argv[++i];
+        }
+        else if (("--min-time" == arg) && (i + 1 < argc))
+        {
+            options.mintimems = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::printf("Usage: %s [--filter NAME] [--min-time MS]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("frame scanner: %s\n", FrameScan_KernelName());
+    std::printf("uncompand: %s\n", Uncompand_KernelName());
+    std::printf("tvg: %s\n", Tvg_KernelName());
+    std::printf("detector: %s\n", Detect_KernelName());
+    std::printf("persistence: %s\n", Persist_KernelName());
+    std::printf("change detection: %s\n", Change_KernelName());
+    std::printf("scan converter: %s\n", ScanConverter::KernelName());
+    std::printf("%-28s %8s %12s %10s\n", "benchmark", "bytes", "ns/line", "MB/s");
+
+    for (int linesize : LINE_SIZES)
+    {
+        BenchAssembly(options, "assemble_length", FrameParseMode::FPMode_Length, linesize);
+        BenchAssembly(options, "assemble_token", FrameParseMode::FPMode_Token, linesize);
+        BenchUncompand(options, linesize);
+        BenchTvg(options, linesize);
+        BenchDetect(options, "detect_first", DetectMode::DtMode_FirstReturn, linesize);
+        BenchDetect(options, "detect_peak", DetectMode::DtMode_Peak, linesize);
+        BenchChange(options, linesize);
+        BenchWriteLine(options, linesize);
+        BenchFillGap(options, linesize);
+        BenchStoreLine(options, "store_separate_step1", 1, false, linesize);
+        BenchStoreLine(options, "store_ingest_step1", 1, true, linesize);
+        BenchStoreLine(options, "store_separate_step4", 4, false, linesize);
+        BenchStoreLine(options, "store_ingest_step4", 4, true, linesize);
+        BenchStoreLine(options, "store_ingest_pyramid_max", 1, true, linesize, 3, DecimationMode::DMode_Max);
+        BenchStoreLine(options, "store_ingest_pyramid_peak", 1, true, linesize, 3, DecimationMode::DMode_Peak);
+        BenchStoreLine(options, "store_ingest_tvg", 1, true, linesize, 0, DecimationMode::DMode_Max, true);
+        BenchStoreLine(options, "store_ingest_persist_average", 1, true, linesize, 0, DecimationMode::DMode_Max, false,
+                       PersistenceMode::PMode_Average);
+        BenchStoreLine(options, "store_ingest_persist_maxhold", 1, true, linesize, 0, DecimationMode::DMode_Max, false,
+                       PersistenceMode::PMode_MaxHold);
+        BenchScanConvert(options, "scanconvert_nearest", false, linesize);
+        BenchScanConvert(options, "scanconvert_bilinear", true, linesize);
+        BenchScanConvertChanged(options, "scanconvert_changed_nearest", false, linesize);
+        BenchScanConvertChanged(options, "scanconvert_changed_bilinear", true, linesize);
+        BenchRecorder(options, "recorder_v1", sizeof(DATAHEADERV1), linesize);
+        BenchRecorder(options, "recorder_v2", sizeof(DATAHEADERV2), linesize);
+        BenchRecordingIndex(options, linesize);
+        BenchLzCompress(options, linesize);
+        BenchLzDecompress(options, linesize);
+        BenchB64Encode(options, linesize);
+        BenchCrc32(options, linesize);
+    }
+
+    std::remove(RECORDER_FILE);
+
+    return 0;
+}
@@ -12,6 +12,27 @@ public:
 
     const std::string &GetEncodedData() const;
 
+    /**
+     *   @brief Number of characters produced for datasize bytes, without the terminating NULL
+     */
+    static constexpr std::size_t EncodedSize(std::size_t datasize)
+    {
+        return (datasize + 2) / 3 * 4;
+    }
+
+    /**
+     *   @brief Encode into a caller buffer, no heap allocation
+     *   @param outsize - size of out, must be at least EncodedSize(datasize) + 1
+     *   @return number of characters written without the terminating NULL, 0 if out is too small
+     */
+    static std::size_t Encode(const void *data, std::size_t datasize, char *out, std::size_t outsize);
+
+    /**
+     *   @brief Decode into a caller buffer, characters outside the alphabet are skipped, decoding stops at '='
+     *   @return number of bytes written, bytes past outsize are dropped
+     */
+    static std::size_t Decode(const std::string &text, void *out, std::size_t outsize);
+
 private:
 
     std::string b64data;
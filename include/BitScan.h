@@ -0,0 +1,36 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ *   @brief Index of the lowest set bit, value must not be 0
+ */
+inline int BitScan_CountTrailingZeros(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+/**
+ *   @brief Index of the lowest set bit, value must not be 0
+ */
+inline int BitScan_CountTrailingZeros64(uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
@@ -0,0 +1,120 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockRecorder.h"
+
+/**
+ *  @class BlockReader
+ *  Random access to a block-compressed recording written by BlockRecorder.
+ *
+ *  The index is read from the end of the file. When the recording was not closed (no valid trailer),
+ *  the index is rebuilt by decoding the blocks up to the first damaged one.
+ *  Blocks are decoded in parallel, every worker reads the file through its own stream.
+ */
+class BlockReader final
+{
+public:
+
+    explicit BlockReader(const std::string &filename);
+    ~BlockReader();
+
+    BlockReader(const BlockReader &other) = delete;
+    BlockReader &operator=(const BlockReader &other) = delete;
+
+    /**
+     *   @return false - the file is not a block recording
+     */
+    bool IsOpen() const;
+
+    /**
+     *   @return false - the index was rebuilt from the blocks
+     */
+    bool IsIndexed() const;
+
+    std::size_t GetBlocksCount() const;
+    std::size_t GetLinesCount() const;
+    uint32_t GetTurnsCount() const;
+    uint64_t GetRawBytes() const;
+    uint64_t GetFileSize() const;
+
+    const BlockIndexEntry &GetBlock(std::size_t block) const;
+    const BlockLineEntry &GetLine(std::size_t line) const;
+
+    /**
+     *   @brief First line with the footer timestamp at or after timestamp
+     *
+     *   Timestamps start over when the 32-bit ms counter wraps or the sonar restarts, every run of growing
+     *   timestamps is searched on its own, see Recording_SeekTimestamp().
+     *
+     *   @return line index, -1 - no such line
+     */
+    int64_t FindTimestamp(uint32_t timestamp) const;
+
+    /**
+     *   @brief Line of the turn closest to angle
+     *   @param angle - header angle / 9, 0 ~ 3199
+     *   @return line index, -1 - the turn is not recorded
+     */
+    int64_t FindAngle(uint32_t turn, uint16_t angle) const;
+
+    /**
+     *   @brief Decode a block, CRCs are verified
+     *   @param data - DATAHEADER v3 lines of the block
+     *   @return false - the block is damaged or does not exist
+     */
+    bool ReadBlock(std::size_t block, std::vector<uint8_t> &data);
+
+    /**
+     *   @brief Decode blocks first ~ first + count - 1 in parallel
+     *   @param threads - decoding threads including the caller, 0 - one per CPU
+     *   @param callback - called with every decoded block, from several threads at once and in any order
+     *   @return number of blocks decoded, damaged blocks are not passed to the callback
+     */
+    std::size_t DecodeBlocks(std::size_t first, std::size_t count, int threads,
+                             const std::function<void(std::size_t, const uint8_t *, std::size_t)> &callback);
+
+    /**
+     *   @brief Copy lines first ~ first + count - 1 to dst, the blocks are decoded in parallel
+     *   @return bytes copied, the same bytes as the lines of a .bin recording; 0 - lines are damaged or
+     *           do not fit into size
+     */
+    std::size_t ReadLines(std::size_t first, std::size_t count, uint8_t *dst, std::size_t size, int threads);
+
+private:
+
+    bool ReadIndex();
+
+    /**
+     *   @brief Scan the blocks after the file header, the index of a recording that was not closed
+     */
+    void RebuildIndex();
+
+    /**
+     *   @brief Read and decode a block through stream
+     *   @param stored - scratch for the stored bytes
+     */
+    bool ReadBlock(std::ifstream &stream, uint64_t offset, BlockHeader &header, std::vector<uint8_t> &stored,
+                   std::vector<uint8_t> &data) const;
+
+    std::string filename;
+    std::ifstream file;
+    std::mutex filelock;                // Guards file for ReadBlock
+
+    uint64_t filesize;
+    bool opened;
+    bool indexed;
+
+    std::vector<BlockIndexEntry> blocks;
+    std::vector<BlockLineEntry> index;
+    std::vector<std::size_t> timestampruns; // First line of every run of growing timestamps
+    uint32_t turnscount;
+    uint64_t rawbytes;
+};
@@ -0,0 +1,191 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Recorder.h"
+#include "WriteBehind.h"
+
+/**
+ *  Block-compressed recording, .ssbr
+ *
+ *  BlockFileHeader
+ *  BlockHeader, stored block          - repeated, a block holds whole DATAHEADER v3 lines
+ *  BlockIndexEntry[blockscount]       - index, written when the recording is closed
+ *  BlockLineEntry[linescount]
+ *  BlockFileTrailer                   - last bytes of the file
+ *
+ *  A decompressed block is byte-identical to the same lines of a .bin recording.
+ *  All values are little-endian.
+ */
+constexpr uint32_t BLOCK_FILE_MAGIC = 0x52425353;     // "SSBR"
+constexpr uint32_t BLOCK_FILE_VERSION = 1;
+constexpr uint32_t BLOCK_MAGIC = 0x304B4C42;          // "BLK0"
+constexpr uint32_t BLOCK_INDEX_MAGIC = 0x49425353;    // "SSBI"
+
+constexpr uint32_t BLOCK_CODEC_STORED = 0;            // Not compressible, raw lines
+constexpr uint32_t BLOCK_CODEC_LZ = 1;                // Lz_Compress
+
+struct BlockFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockbytes;    // Lines are grouped until a block has this many bytes
+    uint32_t reserved;
+};
+
+struct BlockHeader
+{
+    uint32_t magic;
+    uint32_t codec;
+    uint32_t rawsize;       // Bytes of lines
+    uint32_t storedsize;    // Bytes following the header
+    uint32_t lines;
+    uint32_t rawcrc;        // Crc32 of the lines
+    uint32_t storedcrc;     // Crc32 of the stored bytes
+    uint32_t reserved;
+};
+
+struct BlockIndexEntry
+{
+    uint64_t offset;        // File offset of the BlockHeader
+    uint32_t firstline;     // Index of the first line of the block
+    uint32_t lines;
+};
+
+struct BlockLineEntry
+{
+    uint32_t timestamp;     // Footer timestamp, ms
+    uint32_t turn;          // Turn of the recording, from 0
+    uint32_t block;
+    uint32_t offset;        // Offset of the line in the decompressed block
+    uint32_t size;          // Bytes of the line with header and footer
+    uint16_t angle;         // Header angle / 9, 0 ~ 3199
+    uint16_t reserved;
+};
+
+struct BlockFileTrailer
+{
+    uint32_t magic;
+    uint32_t blockscount;
+    uint64_t linescount;
+    uint64_t indexoffset;   // File offset of the first BlockIndexEntry
+    uint32_t indexcrc;      // Crc32 of the block and line entries
+    uint32_t turnscount;
+};
+
+static_assert(16 == sizeof(BlockFileHeader), "BlockFileHeader layout");
+static_assert(32 == sizeof(BlockHeader), "BlockHeader layout");
+static_assert(16 == sizeof(BlockIndexEntry), "BlockIndexEntry layout");
+static_assert(24 == sizeof(BlockLineEntry), "BlockLineEntry layout");
+static_assert(32 == sizeof(BlockFileTrailer), "BlockFileTrailer layout");
+
+/**
+ *  @class BlockRecorder
+ *  Records lines into LZ-compressed blocks with per-block CRCs and an index by angle, timestamp and turn.
+ *
+ *  The processing thread only copies the converted line into the open block. Full blocks are compressed
+ *  and written by the recorder thread, so neither compression nor the file stalls acquisition.
+ *  Blocks come from a fixed pool: when the recorder thread falls behind by BLOCK_BUFFERS blocks,
+ *  lines are dropped and counted, or Write waits for a block under BPolicy_Wait. The recorder thread
+ *  passes the stored blocks to WriteBehind, which always waits for the disk. The index is written when
+ *  the recorder is destroyed; a recording without it is still readable by BlockReader, which rebuilds
+ *  the index from the blocks.
+ */
+class BlockRecorder final : public Recorder
+{
+public:
+    // A block is closed when the next line would make it larger
+    static constexpr std::size_t BLOCK_BYTES = 256U << 10;
+
+    // Blocks being filled, queued and compressed
+    static constexpr int BLOCK_BUFFERS = 8;
+
+    explicit BlockRecorder(std::unique_ptr<WriteBehind> Writer);
+
+    /**
+     *   @brief Write the open block, wait for the queued ones and write the index
+     */
+    ~BlockRecorder();
+
+    BlockRecorder(const BlockRecorder &other) = delete;
+    BlockRecorder &operator=(const BlockRecorder &other) = delete;
+
+    bool IsOpen() const override;
+
+    /**
+     *   @brief Processing thread: convert the line header to v3 and append the line to the open block
+     */
+    void Write(const uint8_t *line) override;
+
+    void SetBacklogPolicy(BacklogPolicy policy) override;
+
+    /**
+     *   @return queue statistics of the blocks, write statistics of the file
+     */
+    WriteBehindStats GetStats() const override;
+
+    uint64_t GetLinesCount() const;
+    uint64_t GetDroppedCount() const;
+    uint64_t GetBlocksCount() const;
+    uint64_t GetRawBytes() const;
+    uint64_t GetStoredBytes() const;
+
+private:
+
+    struct PendingBlock
+    {
+        std::vector<uint8_t> data;
+        std::vector<BlockLineEntry> lines;
+    };
+
+    /**
+     *   @brief Queue the open block to the recorder thread
+     */
+    void SubmitBlock();
+
+    void RecorderThread();
+
+    /**
+     *   @brief Recorder thread: compress and write the block, add it to the index
+     */
+    void WriteBlock(PendingBlock &block, std::vector<uint8_t> &stored);
+
+    void WriteIndex();
+
+    std::unique_ptr<WriteBehind> writer;
+
+    mutable std::mutex queuelock;                           // Guards queue, freeblocks and stopping
+    std::condition_variable queuecv;
+    std::condition_variable freecv;                         // Processing thread: a block is free
+    std::deque<std::unique_ptr<PendingBlock>> queue;
+    std::vector<std::unique_ptr<PendingBlock>> freeblocks;
+    bool stopping;
+    std::unique_ptr<std::thread> thread;
+
+    // Processing thread
+    std::unique_ptr<PendingBlock> current;
+    uint32_t turn;
+    int prevangle;
+
+    // Recorder thread
+    std::vector<BlockIndexEntry> blocks;
+    std::vector<BlockLineEntry> index;
+    uint64_t fileoffset;
+
+    std::atomic<BacklogPolicy> policy;
+    std::atomic<uint32_t> highwater;
+    std::atomic<uint64_t> linescount;
+    std::atomic<uint64_t> droppedcount;
+    std::atomic<uint64_t> blockscount;
+    std::atomic<uint64_t> rawbytes;
+    std::atomic<uint64_t> storedbytes;
+};
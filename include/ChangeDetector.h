@@ -0,0 +1,144 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "EventRing.h"
+#include "KernelInfo.h"
+
+struct ChangeSettings
+{
+    bool enabled;
+    uint16_t threshold;     // A sample is changed when it exceeds the background by more, 12-bit samples
+    float learning;         // Weight of the new line in the background, 0 ~ 1
+    float minlength;        // m, shorter segments are dropped
+    float mingap;           // m, segments closer are merged
+    float deadzone;         // m, samples closer are skipped
+    float soundspeed;       // m/s
+    float samplefrequency;  // Hz
+};
+
+/**
+ *  Range segment of a line where returns appeared over the background
+ */
+struct ChangeSegment
+{
+    uint32_t timestamp;     // Timestamp of the line, ms
+    uint16_t angle;         // Line of the full turn, 0 ~ 3199, 0.1125 deg
+    uint16_t peak;          // Largest increase over the background in the segment
+    float start;            // m
+    float end;              // m
+};
+
+struct ChangeKernels
+{
+    void (*mask)(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask);
+};
+
+/**
+ *   @brief Mark changed samples: bit i % 32 of mask[i / 32] is set when samples[i] - background[i] > threshold
+ *   @param mask - (count + 31) / 32 words, bits after count are cleared
+ */
+void Change_Mask(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask);
+
+/**
+ *   @brief Name of the kernel selected for this CPU: "avx2", "sse2", "neon" or "scalar"
+ */
+const char *Change_KernelName();
+
+/**
+ *   @brief Every change mask kernel, each must follow the definition of Change_Mask()
+ *   @note  Kernels take count >= 0
+ */
+template<>
+const std::vector<KernelInfo<ChangeKernels>> &Kernel_GetAll<ChangeKernels>();
+
+/**
+ *  @class ChangeDetector
+ *  Turn-to-turn change detection run by the processing thread on every stored line.
+ *
+ *  Every row of the image has a background, an exponential moving average of the row across turns.
+ *  A new line is compared with the background of its row before it is learned, runs of changed samples
+ *  are merged into range segments. The first line of a row only initialises its background.
+ *
+ *  Segments of a line are passed to the callback together and queued to a single-producer/single-consumer ring.
+ */
+class ChangeDetector final
+{
+public:
+    // Segments reported for one line, the rest of the line is ignored
+    static constexpr int MAX_LINE_SEGMENTS = 64;
+
+    explicit ChangeDetector(std::size_t slots);
+    ~ChangeDetector();
+
+    ChangeDetector(const ChangeDetector &other) = delete;
+    ChangeDetector &operator=(const ChangeDetector &other) = delete;
+
+    /**
+     *   @brief Background is discarded when the detection is enabled
+     */
+    void SetSettings(const ChangeSettings &settings);
+    ChangeSettings GetSettings() const;
+
+    /**
+     *   @brief Called by the processing thread with the segments of every line having any, nullptr - no callback
+     *   @note  Waits for a running callback to return
+     */
+    void SetCallback(std::function<void(const ChangeSegment *, std::size_t)> callback);
+
+    /**
+     *   @brief Processing thread: compare the samples of a line with the background of its row and learn them
+     *   @param row, rows - row of the image and rows per turn, a new number of rows discards the background
+     */
+    void ProcessLine(int row, int rows, uint16_t angle, uint32_t timestamp, const uint16_t *samples, int count);
+
+    /**
+     *   @brief Consumer: take up to count oldest segments
+     *   @return number of segments copied
+     */
+    std::size_t Read(ChangeSegment *dst, std::size_t count);
+
+    uint64_t GetLinesCount() const;
+    uint64_t GetSegmentsCount() const;
+    uint64_t GetOverflowCount() const;
+
+private:
+
+    /**
+     *   @brief Merge a run of changed samples into the current segment or start a new one
+     */
+    void AddRun(int start, int end);
+    void CloseSegment();
+
+    mutable std::mutex settingslock;    // Guards settings, callback and the background
+    ChangeSettings settings;
+    std::function<void(const ChangeSegment *, std::size_t)> callback;
+
+    std::vector<uint16_t> background;   // rows * rowsamples
+    std::vector<uint8_t> learned;       // Row has a background
+    int rowcount;
+    int rowsamples;
+
+    // Scratch of the line being processed
+    std::vector<uint32_t> mask;
+    std::vector<ChangeSegment> segments;
+    const uint16_t *linesamples;
+    const uint16_t *linebackground;
+    int segmentstart;                   // -1 - no open segment
+    int segmentend;
+    int minlength;                      // samples
+    int mingap;                         // samples
+    float metrespersample;
+    ChangeSegment linesegment;          // timestamp and angle of the line
+
+    EventRing<ChangeSegment> events;
+
+    std::atomic<uint64_t> linescount;
+    std::atomic<uint64_t> segmentscount;
+};
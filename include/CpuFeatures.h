@@ -0,0 +1,24 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPUFEATURES_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CPUFEATURES_NEON 1
+#endif
+
+#if defined(CPUFEATURES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPUFEATURES_TARGET(x) __attribute__((target(x)))
+#else
+#define CPUFEATURES_TARGET(x)
+#endif
+
+/**
+ *   @brief Runtime CPU feature checks used to select SIMD kernels.
+ *   @note  Results are detected once and cached. Always false on non-x86 targets.
+ */
+bool CpuFeatures_HasSSE2();
+bool CpuFeatures_HasSSSE3();
+bool CpuFeatures_HasAVX2();
@@ -0,0 +1,83 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "SonarStructures.h"
+
+/**
+ *  DState_Sync    - waiting for the autobaud symbol '@'
+ *  DState_Baud    - autobaud answered, waiting for the <baudrate> line
+ *  DState_Command - command mode, every command is answered
+ *  DState_Work    - streaming lines, START (keep-alive) and STOP are handled and not answered
+ */
+enum class DeviceState { DState_Sync, DState_Baud, DState_Command, DState_Work };
+
+/**
+ *  @class DeviceProtocol
+ *  MRS900 side of the command protocol, shared by the simulator and the test stand-ins.
+ *  Bytes from the host are passed to OnByte(), replies are sent through Send(); a derived class
+ *  answers the commands and streams lines while the state is DState_Work.
+ */
+class DeviceProtocol
+{
+public:
+
+    DeviceProtocol();
+    virtual ~DeviceProtocol();
+
+    DeviceProtocol(const DeviceProtocol &other) = delete;
+    DeviceProtocol &operator=(const DeviceProtocol &other) = delete;
+
+    /**
+     *   @brief Byte received from the host, the autobaud symbol restarts the session in any state
+     */
+    void OnByte(char ch);
+
+    DeviceState GetState() const;
+
+    uint64_t GetSyncsCount() const;
+    uint64_t GetCommandsCount() const;
+    uint64_t GetCrcErrorsCount() const;
+    uint64_t GetKeepAlivesCount() const;
+
+protected:
+
+    /**
+     *   @brief Leave DState_Work as the device does without keep-alive
+     */
+    void EnterCommandMode();
+
+    virtual void Send(const char *text) = 0;
+
+    /**
+     *   @brief Valid command in command mode, except START
+     *   @return reply, "#OK\n" by default
+     */
+    virtual const char *OnCommand(const DEVICECOMMAND &command);
+
+    virtual void OnSync();
+    virtual void OnBaudrate(const std::string &baudrate);
+    virtual void OnStart();
+    virtual void OnStop();
+    virtual void OnKeepAlive();
+    virtual void OnInvalidCommand();
+
+private:
+
+    /**
+     *   @brief Line received from the host without the terminating '\r'
+     */
+    void OnLine(const std::string &line);
+
+    void OnCommandLine(const std::string &text);
+
+    DeviceState state;
+    std::string inputline;
+
+    uint64_t syncs;
+    uint64_t commands;
+    uint64_t crcerrors;
+    uint64_t keepalives;
+};
@@ -0,0 +1,97 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/**
+ *  @class EventRing
+ *  Preallocated single-producer/single-consumer ring of small records, e.g. detections.
+ *  The processing thread pushes, the application reads. A push to a full ring fails and is counted
+ *  as an overflow, so the processing thread never blocks.
+ */
+template <typename T>
+class EventRing final
+{
+public:
+
+    explicit EventRing(std::size_t slots) :
+        slots(std::max<std::size_t>(1, slots)),
+        head(0),
+        tail(0),
+        overflowcount(0)
+    {
+        events = std::make_unique<T[]>(this->slots);
+    }
+
+    EventRing(const EventRing &other) = delete;
+    EventRing &operator=(const EventRing &other) = delete;
+
+    /**
+     *   @brief Producer: queue count records
+     *   @return number of records queued, the rest is counted as overflows
+     */
+    std::size_t Push(const T *src, std::size_t count)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        std::size_t t = tail.load(std::memory_order_acquire);
+        std::size_t queued = std::min(count, slots - (h - t));
+
+        for (std::size_t i = 0; i < queued; i++)
+        {
+            events[(h + i) % slots] = src[i];
+        }
+
+        head.store(h + queued, std::memory_order_release);
+
+        if (queued < count)
+        {
+            overflowcount.fetch_add(count - queued, std::memory_order_relaxed);
+        }
+
+        return queued;
+    }
+
+    /**
+     *   @brief Consumer: take up to count oldest records
+     *   @return number of records copied
+     */
+    std::size_t Read(T *dst, std::size_t count)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t h = head.load(std::memory_order_acquire);
+        std::size_t copied = std::min(count, h - t);
+
+        for (std::size_t i = 0; i < copied; i++)
+        {
+            dst[i] = events[(t + i) % slots];
+        }
+
+        tail.store(t + copied, std::memory_order_release);
+
+        return copied;
+    }
+
+    std::size_t GetCapacity() const
+    {
+        return slots;
+    }
+
+    uint64_t GetOverflowCount() const
+    {
+        return overflowcount;
+    }
+
+private:
+
+    std::unique_ptr<T[]> events;
+    std::size_t slots;
+
+    std::atomic<std::size_t> head;      // next slot to write, producer owned
+    std::atomic<std::size_t> tail;      // next slot to read, consumer owned
+
+    std::atomic<uint64_t> overflowcount;
+};
@@ -0,0 +1,86 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "Transport.h"
+
+/**
+ *  @class FileTransport
+ *  Replays lines recorded by ThreadSonarSerial, writes are discarded.
+ *  The transport is passive: no handshake, the reader goes straight to line assembly,
+ *  so recorded lines take the same path as live ones (SonarData, gap fill, callback).
+ *
+ *  Bytes are delivered line by line. With speed 0 lines are delivered as fast as they are
+ *  consumed; otherwise each line is released when its footer timestamp is due, scaled by speed
+ *  (1.0 - recorded rate, 2.0 - twice as fast).
+ */
+class FileTransport final : public Transport
+{
+public:
+
+    FileTransport(const std::string &filename, uint32_t baudrate, uint32_t timeoutms, double speed = 0.0);
+    ~FileTransport();
+
+    /**
+     *   @note Waits the read timeout at most: at the end of file or while the next line is not due yet
+     */
+    std::size_t Read(uint8_t *dst, std::size_t size) override;
+    std::size_t Write(const uint8_t *src, std::size_t size) override;
+    using Transport::Write;
+    std::size_t Available() override;
+    bool WaitReadable(int64_t timeoutms) override;
+    uint32_t GetBaudrate() const override;
+    bool IsPassive() const override;
+
+    /**
+     *   @brief Set replay speed, can be changed while replaying
+     *   @param speed - 0 as fast as possible, 1.0 recorded rate, N - N times faster
+     */
+    void SetSpeed(double speed);
+    double GetSpeed() const;
+
+    uint64_t GetFileSize() const;
+    uint64_t GetPosition() const;
+    uint64_t GetFramesCount() const;
+    bool IsFinished() const;
+
+private:
+
+    /**
+     *   @brief Find the end and release time of the line starting at position
+     *   @note  Bytes that are not a valid line are released one by one without pacing
+     */
+    void ParseFrame();
+
+    /**
+     *   @brief Make the next line available once it is due
+     *   @return false - the line is not due before deadline
+     */
+    bool NextFrame(std::chrono::steady_clock::time_point deadline);
+
+    std::ifstream file;
+
+    uint64_t filesize;
+    std::atomic<uint64_t> position;
+    uint64_t frameend;                 // bytes up to frameend are released
+
+    bool framepending;                 // ParseFrame is done for the line at position
+    uint64_t pendingend;
+    std::chrono::steady_clock::time_point pendingdue;
+
+    std::atomic<double> speed;
+    std::atomic<bool> rebase;          // speed changed, restart the replay clock
+    bool havetimestamp;
+    uint32_t prevtimestamp;
+    uint64_t streamtimeus;             // recorded time since clockbase
+    std::chrono::steady_clock::time_point clockbase;
+
+    std::atomic<uint64_t> framescount;
+
+    uint32_t baudrate;
+    uint32_t timeoutms;
+};
@@ -0,0 +1,71 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "SerialRxBuffer.h"
+
+enum class FrameParseMode { FPMode_Token, FPMode_Length };
+
+/**
+ *  @class FrameAssembler
+ *  Assembles DATA ... ENDx lines from the receive buffer.
+ *
+ *  FPMode_Token  - scans every received block for the ENDx token.
+ *  FPMode_Length - reads the DATAHEADER, checks dataoffset/samples and pulls the remaining
+ *                  payload in one bulk read; the footer magic is checked only at the expected
+ *                  offset. The token scan is used only to resync after a malformed frame.
+ */
+class FrameAssembler final
+{
+public:
+
+    FrameAssembler(SerialRxBuffer &RxBuffer, FrameParseMode mode = FrameParseMode::FPMode_Length);
+    ~FrameAssembler();
+
+    /**
+     *   @brief Receive one line
+     *   @param linebuf - destination buffer
+     *   @param maxbytes - destination buffer size, also the longest accepted line
+     *   @return 0 - line received, -1 - no line received (timeout or no DATA within maxbytes), -7 - wrong number of samples
+     */
+    int GetLine(uint8_t *linebuf, std::size_t maxbytes);
+
+    void SetParseMode(FrameParseMode mode);
+    FrameParseMode GetParseMode() const;
+
+    /**
+     *   @brief Number of malformed frames dropped by the length-driven parser
+     */
+    uint64_t GetResyncCount() const;
+
+    /**
+     *   @brief Bytes that could not be returned to the receive buffer for rescanning
+     *   @note  0 when the SerialRxBuffer reserve is at least the maxbytes passed to GetLine
+     */
+    uint64_t GetLostCount() const;
+
+private:
+
+    /**
+     *   @return 0 - "DATA" copied to linebuf, -4 - not found within maxbytes, -6 - timeout
+     */
+    int FindStart(uint8_t *linebuf, std::size_t maxbytes);
+    int GetLineByToken(uint8_t *linebuf, std::size_t maxbytes);
+    int GetLineByLength(uint8_t *linebuf, std::size_t maxbytes);
+
+    std::size_t ReadExact(uint8_t *dst, std::size_t size, int64_t timeoutms);
+
+    /**
+     *   @brief Return bytes after a DATA token to the receive buffer, they are parsed again
+     */
+    void Rescan(const uint8_t *src, std::size_t count);
+
+    SerialRxBuffer &rxbuffer;
+
+    std::atomic<FrameParseMode> parsemode;
+    std::atomic<uint64_t> resynccount;
+    std::atomic<uint64_t> lostcount;
+};
@@ -0,0 +1,54 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/**
+ *  @class FramePool
+ *  Fixed-capacity pool of aligned line buffers, allocated once at construction.
+ *  Buffers are checked out by the serial reader and returned once the callback
+ *  and the recorder are done with them, so acquisition does no heap allocation.
+ */
+class FramePool final
+{
+public:
+
+    FramePool(std::size_t buffers, std::size_t buffersize, std::size_t alignment = 64);
+    ~FramePool();
+
+    /**
+     *   @brief Check out a buffer
+     *   @return pointer to the buffer, nullptr if all buffers are in use
+     */
+    uint8_t *Acquire();
+
+    /**
+     *   @brief Return a buffer obtained by Acquire
+     */
+    void Release(uint8_t *buffer);
+
+    std::size_t GetBufferSize() const;
+    std::size_t GetCapacity() const;
+    std::size_t GetAvailable() const;
+
+    uint64_t GetCheckoutCount() const;
+    uint64_t GetExhaustedCount() const;
+
+private:
+
+    std::unique_ptr<uint8_t[]> storage;
+    std::unique_ptr<uint8_t *[]> freelist;
+
+    std::size_t capacity;
+    std::size_t buffersize;
+    std::size_t freecount;
+
+    mutable std::mutex poolmutex;
+
+    std::atomic<uint64_t> checkoutcount;
+    std::atomic<uint64_t> exhaustedcount;
+};
@@ -0,0 +1,66 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ *  @class FrameRing
+ *  Preallocated single-producer/single-consumer ring of line buffers.
+ *  The serial reader thread pushes lines checked out of the FramePool,
+ *  the processing thread pops them and returns them to the pool when done.
+ *  A push to a full ring fails and is counted as an overflow, so the reader never blocks.
+ *  The producer takes the wait mutex only when the consumer is waiting for data.
+ */
+class FrameRing final
+{
+public:
+
+    FrameRing(std::size_t slots);
+    ~FrameRing();
+
+    /**
+     *   @brief Producer: publish a line
+     *   @return true - line queued, false - ring is full, line is not queued
+     */
+    bool Push(uint8_t *frame);
+
+    /**
+     *   @brief Consumer: take the oldest line
+     *   @return pointer to the line, nullptr if ring is empty
+     */
+    uint8_t *Pop();
+
+    /**
+     *   @brief Consumer: wait until a line is available
+     *   @return true - line available, false - timeout
+     */
+    bool WaitForData(int64_t timeoutms);
+
+    std::size_t GetCapacity() const;
+    std::size_t GetOccupancy() const;
+    std::size_t GetHighWater() const;
+    uint64_t GetFramesCount() const;
+    uint64_t GetOverflowCount() const;
+
+private:
+
+    std::unique_ptr<uint8_t *[]> frames;
+
+    std::size_t slots;
+
+    std::atomic<std::size_t> head; // next slot to write, producer owned
+    std::atomic<std::size_t> tail; // next slot to read, consumer owned
+
+    std::atomic<std::size_t> highwater;
+    std::atomic<uint64_t> framescount;
+    std::atomic<uint64_t> overflowcount;
+
+    std::mutex waitmutex;
+    std::condition_variable waitcv;
+    std::atomic<bool> sleeping;     // Consumer is in WaitForData
+};
@@ -0,0 +1,63 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ *   Frame delimiters sent by the sonar: "DATA" starts a line, "END0"/"END1" terminates it.
+ *   Values can be OR-ed to search for several tokens at once.
+ */
+enum FRAME_TOKENS
+{
+    FRAME_TOKEN_NONE = 0,
+    FRAME_TOKEN_DATA = 1,
+    FRAME_TOKEN_END0 = 2,
+    FRAME_TOKEN_END1 = 4,
+    FRAME_TOKEN_END  = FRAME_TOKEN_END0 | FRAME_TOKEN_END1,
+    FRAME_TOKEN_ANY  = FRAME_TOKEN_DATA | FRAME_TOKEN_END
+};
+
+constexpr std::size_t FRAME_TOKEN_SIZE = 4;
+
+constexpr uint32_t FRAME_MAGIC_DATA = 0x41544144; // "DATA" as DATAHEADER.magic
+constexpr uint32_t FRAME_MAGIC_END0 = 0x30444E45; // "END0" as DATAFOOTER.magic
+constexpr uint32_t FRAME_MAGIC_END1 = 0x31444E45; // "END1" as DATAFOOTER.magic, keep-alive requested
+
+struct _frame_token_match
+{
+    std::size_t offset; // offset of the token first byte, equal to buffer length if not found
+    int token;          // FRAME_TOKEN_xxx found, FRAME_TOKEN_NONE if not found
+};
+
+typedef struct _frame_token_match   FRAMETOKENMATCH;
+
+struct _frame_bounds
+{
+    std::size_t begin;  // offset of "DATA"
+    std::size_t end;    // offset one past "END0"/"END1"
+    int endtoken;       // FRAME_TOKEN_END0 or FRAME_TOKEN_END1
+};
+
+typedef struct _frame_bounds   FRAMEBOUNDS;
+
+/**
+ *   @brief Find the first occurrence of any of the requested tokens
+ *   @param buf - bytes to search
+ *   @param len - number of bytes
+ *   @param tokenmask - FRAME_TOKEN_xxx values OR-ed together
+ *   @return match, token is FRAME_TOKEN_NONE if nothing found
+ */
+FRAMETOKENMATCH FrameScan_FindToken(const uint8_t *buf, std::size_t len, int tokenmask);
+
+/**
+ *   @brief Find the first complete DATA ... ENDx frame in a block
+ *   @note  A "DATA" found before the end token restarts the frame, same as the serial parser does
+ *   @return true - frame found and bounds are valid, false - no complete frame in the block
+ */
+bool FrameScan_FindFrame(const uint8_t *buf, std::size_t len, FRAMEBOUNDS *bounds);
+
+/**
+ *   @brief Name of the kernel selected at runtime ("avx2", "sse2" or "scalar")
+ */
+const char *FrameScan_KernelName();
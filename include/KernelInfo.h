@@ -0,0 +1,51 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <vector>
+
+/**
+ *  One SIMD kernel of a module, Functions is the table of its entry points, e.g. PersistKernels.
+ *  A module lists every kernel it was built with in its Kernel_GetAll(), the scalar one first and the preferred
+ *  one last. It dispatches to the last one this CPU can run, the kernel test checks all of them.
+ */
+template<typename Functions>
+struct KernelInfo
+{
+    Functions functions;
+    const char *name;           // "scalar", "sse2", "ssse3", "avx2" or "neon"
+    bool (*supported)();        // CPU check, nullptr - runs on every CPU the module was built for
+};
+
+/**
+ *   @brief Every kernel of the module, specialized by the module next to its kernels
+ */
+template<typename Functions>
+const std::vector<KernelInfo<Functions>> &Kernel_GetAll();
+
+/**
+ *   @brief Kernels of the module this CPU can run, the scalar one first
+ */
+template<typename Functions>
+std::vector<KernelInfo<Functions>> Kernel_GetSupported()
+{
+    std::vector<KernelInfo<Functions>> kernels;
+
+    for (const KernelInfo<Functions> &kernel : Kernel_GetAll<Functions>())
+    {
+        if ((nullptr == kernel.supported) || (false != kernel.supported()))
+        {
+            kernels.push_back(kernel);
+        }
+    }
+
+    return kernels;
+}
+
+/**
+ *   @brief Kernel the module dispatches to: the last one this CPU can run
+ */
+template<typename Functions>
+KernelInfo<Functions> Kernel_Select()
+{
+    return Kernel_GetSupported<Functions>().back();
+}
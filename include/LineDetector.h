@@ -0,0 +1,125 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "EventRing.h"
+#include "KernelInfo.h"
+
+/**
+ *  DtMode_Off         - detector is not run
+ *  DtMode_FirstReturn - first sample at or above the threshold, e.g. bottom or wall
+ *  DtMode_Peak        - largest sample if it reaches the threshold, the first one of equal samples
+ */
+enum class DetectMode { DtMode_Off, DtMode_FirstReturn, DtMode_Peak };
+
+struct DetectorSettings
+{
+    DetectMode mode;
+    float threshold;        // Fraction of the full scale 4095, 0 ~ 1
+    float deadzone;         // m, samples closer are skipped
+    float range;            // m, samples farther are skipped, 0 - whole line
+    float soundspeed;       // m/s
+    float samplefrequency;  // Hz
+};
+
+/**
+ *  Detection of one line, amplitude 0 - nothing detected
+ */
+struct Detection
+{
+    uint32_t timestamp;     // Timestamp of the line, ms
+    uint16_t angle;         // Line of the full turn, 0 ~ 3199, 0.1125 deg
+    uint16_t amplitude;     // Sample at the detection
+    float range;            // m
+};
+
+struct DetectKernels
+{
+    int (*firstabove)(const uint16_t *samples, int count, uint16_t threshold);
+    uint16_t (*maximum)(const uint16_t *samples, int count);
+};
+
+/**
+ *   @brief Index of the first sample at or above threshold
+ *   @return -1 - no sample reaches the threshold
+ */
+int Detect_FirstAbove(const uint16_t *samples, int count, uint16_t threshold);
+
+/**
+ *   @brief Index of the first largest sample
+ *   @return -1 - count is 0
+ */
+int Detect_Peak(const uint16_t *samples, int count);
+
+/**
+ *   @brief Name of the kernel selected for this CPU: "avx2", "sse2", "neon" or "scalar"
+ */
+const char *Detect_KernelName();
+
+/**
+ *   @brief Every detector kernel: firstabove follows Detect_FirstAbove(), maximum gives the largest sample, 0 for an empty line
+ *   @note  Kernels take count >= 0
+ */
+template<>
+const std::vector<KernelInfo<DetectKernels>> &Kernel_GetAll<DetectKernels>();
+
+/**
+ *  @class LineDetector
+ *  Detector run by the processing thread on every stored line.
+ *
+ *  Detections are passed to the callback and queued to a single-producer/single-consumer ring,
+ *  so a consumer needing detections only never copies samples. A detection queued to a full ring is
+ *  dropped and counted as an overflow.
+ */
+class LineDetector final
+{
+public:
+
+    explicit LineDetector(std::size_t slots);
+    ~LineDetector();
+
+    LineDetector(const LineDetector &other) = delete;
+    LineDetector &operator=(const LineDetector &other) = delete;
+
+    void SetSettings(const DetectorSettings &settings);
+    DetectorSettings GetSettings() const;
+
+    /**
+     *   @brief Called by the processing thread with every detection, nullptr - no callback
+     *   @note  Waits for a running callback to return
+     */
+    void SetCallback(std::function<void(const Detection &)> callback);
+
+    /**
+     *   @brief Processing thread: detect on the samples of a line
+     *   @param samples - uncompanded samples of the line, as stored in SonarData
+     */
+    void ProcessLine(uint16_t angle, uint32_t timestamp, const uint16_t *samples, int count);
+
+    /**
+     *   @brief Consumer: take up to count oldest detections
+     *   @return number of detections copied
+     */
+    std::size_t Read(Detection *dst, std::size_t count);
+
+    uint64_t GetLinesCount() const;
+    uint64_t GetDetectionsCount() const;
+    uint64_t GetOverflowCount() const;
+
+private:
+
+    mutable std::mutex settingslock;    // Guards settings and callback
+    DetectorSettings settings;
+    std::function<void(const Detection &)> callback;
+
+    EventRing<Detection> detections;
+
+    std::atomic<uint64_t> linescount;
+    std::atomic<uint64_t> detectionscount;
+};
@@ -0,0 +1,35 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "Recorder.h"
+#include "WriteBehind.h"
+
+/**
+ *  @class LineRecorder
+ *  Writes received lines to the recording file one after another, as DATAHEADER v3 lines.
+ *  The processing thread only copies the line into a WriteBehind buffer.
+ */
+class LineRecorder final : public Recorder
+{
+public:
+
+    LineRecorder(std::unique_ptr<WriteBehind> Writer);
+    ~LineRecorder();
+
+    bool IsOpen() const override;
+
+    /**
+     *   @brief Convert the line header to v3 and append the line
+     */
+    void Write(const uint8_t *line) override;
+
+    void SetBacklogPolicy(BacklogPolicy policy) override;
+    WriteBehindStats GetStats() const override;
+
+private:
+
+    std::unique_ptr<WriteBehind> writer;
+};
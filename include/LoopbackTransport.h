@@ -0,0 +1,48 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <condition_variable>
+
+#include "Transport.h"
+
+/**
+ *  @class LoopbackTransport
+ *  In-memory transport, used to run the protocol code without hardware.
+ *  A single instance reads back what was written to it; CreatePair returns two
+ *  connected ends, one for the library and one for a device stand-in.
+ */
+class LoopbackTransport final : public Transport
+{
+public:
+
+    LoopbackTransport(uint32_t baudrate, uint32_t timeoutms);
+    ~LoopbackTransport();
+
+    static std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>> CreatePair(uint32_t baudrate, uint32_t timeoutms);
+
+    std::size_t Read(uint8_t *dst, std::size_t size) override;
+    std::size_t Write(const uint8_t *src, std::size_t size) override;
+    using Transport::Write;
+    std::size_t Available() override;
+    bool WaitReadable(int64_t timeoutms) override;
+    uint32_t GetBaudrate() const override;
+
+private:
+
+    struct Channel
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<uint8_t> bytes;
+    };
+
+    std::shared_ptr<Channel> rxchannel;
+    std::shared_ptr<Channel> txchannel;
+
+    uint32_t baudrate;
+    uint32_t timeoutms;
+};
@@ -0,0 +1,32 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ *  Byte-oriented LZ77 block codec in the spirit of LZ4, used for recording blocks.
+ *
+ *  A block is a sequence of (token, literals, match) records. The token holds the literal count in the
+ *  high nibble and the match length - 4 in the low nibble, 15 is extended by bytes added until one is
+ *  below 255. A match is a 16-bit little-endian offset back into the output. The last record has
+ *  literals only and ends the block.
+ */
+
+/**
+ *   @brief Largest compressed size of size bytes
+ */
+std::size_t Lz_CompressBound(std::size_t size);
+
+/**
+ *   @brief Compress size bytes of src
+ *   @return compressed size, 0 - the result does not fit into capacity, e.g. data is not compressible
+ */
+std::size_t Lz_Compress(const uint8_t *src, std::size_t size, uint8_t *dst, std::size_t capacity);
+
+/**
+ *   @brief Decompress a block produced by Lz_Compress
+ *   @note  Never reads or writes out of the buffers, whatever the input is
+ *   @return false - the block is corrupted or does not decompress to exactly rawsize bytes
+ */
+bool Lz_Decompress(const uint8_t *src, std::size_t size, uint8_t *dst, std::size_t rawsize);
@@ -0,0 +1,57 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "KernelInfo.h"
+
+/**
+ *  Persistence of the polar image across turns
+ *  PMode_Off     - no persistence buffer
+ *  PMode_Average - exponential moving average of every cell, smooths speckle
+ *  PMode_MaxHold - largest sample of every cell, optionally decaying, keeps moving targets as trails
+ */
+enum class PersistenceMode { PMode_Off, PMode_Average, PMode_MaxHold };
+
+struct PersistenceSettings
+{
+    PersistenceMode mode;
+    float weight;           // PMode_Average: weight of the new line, 0 ~ 1, 1 - no averaging
+    uint16_t decay;         // PMode_MaxHold: subtracted from the held sample on every update, 0 - held until cleared
+};
+
+struct PersistKernels
+{
+    void (*average)(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight);
+    void (*maxhold)(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay);
+};
+
+/**
+ *   @brief Weight of PMode_Average in Q15, 1 ~ 32767
+ */
+int16_t Persist_Weight(float weight);
+
+/**
+ *   @brief Move the average towards the samples: state += round((sample - state) * weight / 32768)
+ *   @param weight - Q15, see Persist_Weight()
+ *   @note  Samples and state are 12-bit, the difference fits a signed 16-bit lane
+ */
+void Persist_Average(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight);
+
+/**
+ *   @brief Hold the largest sample: state = max(sample, state - decay), saturated at 0
+ */
+void Persist_MaxHold(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay);
+
+/**
+ *   @brief Name of the kernel selected for this CPU: "avx2", "sse2", "neon" or "scalar"
+ */
+const char *Persist_KernelName();
+
+/**
+ *   @brief Every persistence kernel, each must follow the formulas above
+ */
+template<>
+const std::vector<KernelInfo<PersistKernels>> &Kernel_GetAll<PersistKernels>();
@@ -0,0 +1,139 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SonarStructures.h"
+#include "WriteBehind.h"
+
+constexpr int RECORDING_TURN_LINES = 3200;            // Lines per turn, header angle / 9
+
+/**
+ *   @brief Turn of the next recorded line: a new turn starts when the angle steps by more than half a turn
+ *   @param previous - angle of the previous line, -1 - first line
+ */
+inline uint32_t Recording_NextTurn(uint32_t turn, int previous, int angle)
+{
+    int step = (previous < angle) ? angle - previous : previous - angle;
+
+    return ((previous >= 0) && (2 * step > RECORDING_TURN_LINES)) ? turn + 1 : turn;
+}
+
+/**
+ *   @brief First entry of every run of growing timestamps, a run starts where the timestamp goes back
+ *          (the 32-bit ms counter wrapped or the sonar restarted)
+ */
+template<typename Entry>
+std::vector<std::size_t> Recording_TimestampRuns(const std::vector<Entry> &entries)
+{
+    std::vector<std::size_t> runs;
+
+    for (std::size_t i = 0; i < entries.size(); i++)
+    {
+        if ((0 == i) || (entries[i].timestamp < entries[i - 1].timestamp))
+        {
+            runs.push_back(i);
+        }
+    }
+
+    return runs;
+}
+
+/**
+ *   @brief First entry with the timestamp at or after timestamp, each run of Recording_TimestampRuns() searched
+ *          on its own: the first run spanning timestamp gives the entry, when none does the first entry of the
+ *          run starting closest after it
+ *   @return entries.size() - no entry at or after timestamp
+ */
+template<typename Entry>
+std::size_t Recording_SeekTimestamp(const std::vector<Entry> &entries, const std::vector<std::size_t> &runs, uint32_t timestamp)
+{
+    std::size_t following = entries.size();
+
+    for (std::size_t run = 0; run < runs.size(); run++)
+    {
+        auto first = entries.begin() + runs[run];
+        auto last = (run + 1 < runs.size()) ? entries.begin() + runs[run + 1] : entries.end();
+
+        if (first->timestamp > timestamp)
+        {
+            // Starts after timestamp, kept when no run spans it
+            if ((entries.size() == following) || (first->timestamp < entries[following].timestamp))
+            {
+                following = runs[run];
+            }
+
+            continue;
+        }
+
+        if ((last - 1)->timestamp >= timestamp)
+        {
+            auto found = std::lower_bound(first, last, timestamp,
+                                          [](const Entry &entry, uint32_t value) { return entry.timestamp < value; });
+
+            return static_cast<std::size_t>(found - entries.begin());
+        }
+    }
+
+    return following;
+}
+
+/**
+ *  @class Recorder
+ *  Writes received lines to the recording file, called by the processing thread for every line.
+ *  Lines with DATAHEADER v1 and v2 are converted to v3, so a recording always has the same header layout.
+ *  The file is written by a background thread, the backlog policy decides what Write does when the disk
+ *  falls behind.
+ */
+class Recorder
+{
+public:
+
+    virtual ~Recorder()
+    {
+    }
+
+    virtual bool IsOpen() const = 0;
+
+    /**
+     *   @brief Convert the line header to v3 and append the line
+     */
+    virtual void Write(const uint8_t *line) = 0;
+
+    /**
+     *   @brief What Write does when the recording thread is behind, BPolicy_Drop by default
+     */
+    virtual void SetBacklogPolicy(BacklogPolicy policy) = 0;
+
+    /**
+     *   @return queue and write statistics, frames are lines
+     */
+    virtual WriteBehindStats GetStats() const = 0;
+
+    /**
+     *   @brief Create the recorder by the file extension
+     *
+     *   .ssbr            - BlockRecorder, compressed blocks with an index
+     *   any other name   - LineRecorder, lines as received
+     *
+     *   Both write the file through WriteBehind.
+     *
+     *   @return recorder, IsOpen is false when the file cannot be created, e.g. the name is empty
+     */
+    static std::unique_ptr<Recorder> Open(const std::string &filename);
+#if !defined (__linux__)
+    static std::unique_ptr<Recorder> Open(const std::wstring &filename);
+#endif
+
+protected:
+
+    /**
+     *   @brief Header of the line converted to v3, samples of the line follow the source header
+     */
+    static DATAHEADERV3 ConvertHeader(const uint8_t *line);
+};
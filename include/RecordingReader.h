@@ -0,0 +1,217 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "SonarStructures.h"
+
+/**
+ *  Line of a recording. Lines follow each other without padding, so the header and footer are not aligned
+ *  in the mapped file and are copied out; the samples point into the mapped file.
+ */
+struct RecordingLine
+{
+    DATAHEADERV3 header;
+    const uint8_t *samples;         // header.dataoffset bytes after the line start
+    std::size_t count;              // bytes of samples
+    DATAFOOTER footer;
+    uint64_t offset;                // File offset of the line
+    uint32_t turn;                  // Turn of the recording, from 0
+    uint16_t angle;                 // Header angle / 9, 0 ~ 3199
+};
+
+class RecordingReader;
+
+/**
+ *  @class RecordingIterator
+ *  Random access iterator over the lines of a RecordingReader, dereferences to a RecordingLine
+ */
+class RecordingIterator final
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef RecordingLine value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const RecordingLine *pointer;
+    typedef RecordingLine reference;
+
+    RecordingIterator(const RecordingReader *reader, std::size_t line) :
+        reader(reader),
+        line(line)
+    {
+    }
+
+    RecordingLine operator*() const;
+
+    /**
+     *   @brief Line number of the iterator in the recording
+     */
+    std::size_t GetIndex() const
+    {
+        return line;
+    }
+
+    RecordingIterator &operator++()
+    {
+        line++;
+        return *this;
+    }
+
+    RecordingIterator &operator--()
+    {
+        line--;
+        return *this;
+    }
+
+    RecordingIterator &operator+=(std::ptrdiff_t n)
+    {
+        line += n;
+        return *this;
+    }
+
+    RecordingIterator operator+(std::ptrdiff_t n) const
+    {
+        return RecordingIterator(reader, line + n);
+    }
+
+    std::ptrdiff_t operator-(const RecordingIterator &other) const
+    {
+        return static_cast<std::ptrdiff_t>(line) - static_cast<std::ptrdiff_t>(other.line);
+    }
+
+    bool operator==(const RecordingIterator &other) const
+    {
+        return line == other.line;
+    }
+
+    bool operator!=(const RecordingIterator &other) const
+    {
+        return line != other.line;
+    }
+
+    bool operator<(const RecordingIterator &other) const
+    {
+        return line < other.line;
+    }
+
+private:
+
+    const RecordingReader *reader;
+    std::size_t line;
+};
+
+/**
+ *  Lines first ~ last - 1 of a recording, e.g. the share of one worker
+ */
+struct RecordingRange
+{
+    RecordingIterator first;
+    RecordingIterator last;
+
+    RecordingIterator begin() const
+    {
+        return first;
+    }
+
+    RecordingIterator end() const
+    {
+        return last;
+    }
+};
+
+/**
+ *  @class RecordingReader
+ *  Read-only access to a .bin recording written by LineRecorder, without copying.
+ *
+ *  The file is memory-mapped and indexed once when opened: DATA tokens are found by the frame scanner
+ *  kernels and every candidate is accepted when its length lands on an END0/END1 footer, so samples
+ *  looking like tokens do not split lines. Bytes that are not a DATAHEADER v3 line are skipped.
+ *
+ *  Views returned by the iterators stay valid while the reader exists. The reader is not modified
+ *  after opening, so any number of threads can iterate it at once.
+ */
+class RecordingReader final
+{
+public:
+
+    explicit RecordingReader(const std::string &filename);
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader &other) = delete;
+    RecordingReader &operator=(const RecordingReader &other) = delete;
+
+    /**
+     *   @return false - the file cannot be opened or mapped
+     */
+    bool IsOpen() const;
+
+    std::size_t GetLinesCount() const;
+    uint32_t GetTurnsCount() const;
+    uint64_t GetFileSize() const;
+
+    /**
+     *   @brief Bytes that are not part of a line, e.g. a line cut by the end of the file
+     */
+    uint64_t GetSkippedBytes() const;
+
+    RecordingLine GetLine(std::size_t line) const;
+
+    RecordingIterator begin() const;
+    RecordingIterator end() const;
+
+    /**
+     *   @brief First line with the footer timestamp at or after timestamp
+     *
+     *   Timestamps are 32-bit ms and start over when the counter wraps or the sonar restarts, so the recording
+     *   is made of runs of growing timestamps, each searched on its own. The first run, in recording order,
+     *   spanning timestamp gives the line; when none does, the first line of the run starting closest after it.
+     *
+     *   @return end() - no line at or after timestamp
+     */
+    RecordingIterator SeekTimestamp(uint32_t timestamp) const;
+
+    /**
+     *   @brief First line of the turn
+     *   @return end() - the turn is not recorded
+     */
+    RecordingIterator SeekTurn(uint32_t turn) const;
+
+    /**
+     *   @brief Split the lines into up to parts ranges of about the same number of bytes
+     *   @param turns - true: ranges start at a turn, parts may be less than requested
+     */
+    std::vector<RecordingRange> Split(int parts, bool turns = false) const;
+
+private:
+
+    struct LineEntry
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t timestamp;
+        uint32_t turn;
+        uint16_t angle;
+    };
+
+    /**
+     *   @brief Find the lines of the mapped file
+     */
+    void BuildIndex();
+
+    const uint8_t *data;
+    uint64_t filesize;
+    uint64_t skippedbytes;
+    bool opened;
+
+#if defined( _WIN32 )
+    void *filehandle;
+    void *mappinghandle;
+#endif
+
+    std::vector<LineEntry> index;
+    std::vector<std::size_t> timestampruns; // First line of every run of growing timestamps
+};
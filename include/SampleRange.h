@@ -0,0 +1,13 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+/**
+ *   @brief Range covered by one sample of a line. Two-way travel: one sample is c / (2 * fs) of range
+ *   @param soundspeed - m/s
+ *   @param samplefrequency - Hz
+ *   @return m
+ */
+inline double SampleRange_MetresPerSample(float soundspeed, float samplefrequency)
+{
+    return soundspeed / (2.0 * samplefrequency);
+}
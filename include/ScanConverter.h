@@ -0,0 +1,132 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SonarData.h"
+
+/**
+ *  @class ScanConverter
+ *  Polar to Cartesian (PPI) conversion of SonarData.
+ *
+ *  The sonar is in the image center, line 0 points up and lines go clockwise,
+ *  range samples fit the radius of the largest circle in the image.
+ *  The pixel to (line, sample) table is precomputed for the image geometry and rebuilt when it changes.
+ *  Conversion is split into tiles of image rows run by a worker pool, AVX2 gathers are used when available.
+ *
+ *  ConvertChanged redraws only the pixels of the lines changed since the previous conversion,
+ *  the table keeps the pixels of every line for that.
+ */
+class ScanConverter final
+{
+public:
+
+    /**
+     *   @param width, height - output image size in pixels
+     *   @param range - samples from the center to the edge of the circle, 0 - whole line
+     *   @param linesperfullturn - lines of the image to convert, the table is rebuilt if SonarData has other
+     *   @param bilinear - interpolate between 2 lines and 2 samples, otherwise nearest sample
+     *   @param threads - conversion threads including the caller, 0 - one per CPU
+     */
+    ScanConverter(int width, int height, int range, int linesperfullturn, bool bilinear, int threads = 0);
+    ~ScanConverter();
+
+    ScanConverter(const ScanConverter &other) = delete;
+    ScanConverter &operator=(const ScanConverter &other) = delete;
+
+    /**
+     *   @brief Convert the whole image
+     *   @return output image, width * height samples, valid until the next conversion
+     */
+    const uint16_t *Convert(const SonarData &image);
+
+    /**
+     *   @brief Redraw the pixels of the lines changed since the previous conversion of the same image
+     *
+     *   Falls back to Convert for another SonarData object or geometry.
+     *
+     *   @param changed - number of the redrawn lines, optional
+     *   @return output image, width * height samples, valid until the next conversion
+     */
+    const uint16_t *ConvertChanged(const SonarData &image, int *changed = nullptr);
+
+    const uint16_t *GetImage() const;
+
+    int GetWidth() const;
+    int GetHeight() const;
+
+    /**
+     *   @brief Name of the conversion kernel selected for this CPU: "avx2" or "scalar"
+     */
+    static const char *KernelName();
+
+private:
+
+    /**
+     *   @brief Table of the pixels, pixels out of the circle point to the zero padding after the last row
+     */
+    void BuildTable(int samplesperline, int linesperfullturn);
+
+    /**
+     *   @brief Pixels of every line, a bilinear pixel belongs to both its lines
+     */
+    void BuildLineIndex();
+
+    /**
+     *   @brief Update rowbase from the line aliases of the image
+     */
+    void UpdateRowBase(const SonarData &sonardata);
+
+    /**
+     *   @brief Run job(first, last) on every tile of items, returns when all tiles are done
+     */
+    void RunTiles(std::size_t items, std::size_t tileitems, const std::function<void(std::size_t, std::size_t)> &job);
+
+    void WorkerThread();
+
+    int width;
+    int height;
+    int range;
+    int threadscount;
+    bool bilinear;
+
+    int tablesamples;   // Geometry the table is built for
+    int tablelines;
+
+    std::vector<uint16_t> image;
+
+    std::vector<uint16_t> pixelline;    // Line of the pixel, tablelines - zero pixel
+    std::vector<uint16_t> pixelline1;   // Next line for bilinear
+    std::vector<uint16_t> pixelsample;  // Sample of the pixel, the next sample is used by bilinear
+    std::vector<uint8_t> pixelwline;    // Weight of the next line, 1/256
+    std::vector<uint8_t> pixelwsample;  // Weight of the next sample, 1/256
+
+    std::vector<int32_t> rowbase;       // Offset of the row of every line, tablelines + 1 entries
+
+    std::vector<uint32_t> lineoffset;   // Pixels of line i are linepixels[lineoffset[i]..lineoffset[i + 1]]
+    std::vector<uint32_t> linepixels;
+
+    const SonarData *convertedimage;    // Image and epoch of the last conversion for ConvertChanged
+    uint64_t convertedepoch;
+    std::vector<int> changedlines;
+
+    std::vector<std::thread> workers;
+    std::mutex jobmutex;
+    std::condition_variable jobready;
+    std::condition_variable jobdone;
+    const std::function<void(std::size_t, std::size_t)> *job;
+    std::size_t jobitems;
+    std::size_t jobtileitems;
+    uint64_t jobgeneration;
+    int jobbusy;
+    bool stopping;
+    std::atomic<std::size_t> nexttile;
+};
@@ -11,7 +11,7 @@
 #include <regex>
 #include <map>
 
-#include "serial/serial.h"
+#include "Transport.h"
 #include "ScansonarCommands.h"
 #include "ThreadSonarSerial.h"
 
@@ -41,9 +41,9 @@ class Scansonar : public ISonar
     std::unique_ptr<ThreadSonarSerial>threadsonarserial_;
 
     /**
-    *   Serial port class used by echosounder
+    *   Transport used by echosounder: serial port, network or recording
     */
-    std::shared_ptr<serial::Serial>serial_port_;
+    std::shared_ptr<Transport>transport_;
 
     /**
     *   Data return by the unit after host issued command to it
@@ -111,8 +111,10 @@ public:
         Constructor
     */
     //Scansonar(std::shared_ptr<serial::Serial> SerialPort, std::map<int, ScansonarCommandList>& CommandList = ScansonarCommands);
-    Scansonar(std::shared_ptr<serial::Serial> SerialPort, std::wstring filename = L"", const std::function<void(char*, int)> cbfunc = [](char* line, int num){}, std::map<int, ScansonarCommandList>& CommandList = ScansonarCommands);
-    Scansonar(std::shared_ptr<serial::Serial> SerialPort, std::string filename = "", const std::function<void(char*, int)> cbfunc = [](char* line, int num){}, std::map<int, ScansonarCommandList>& CommandList = ScansonarCommands);
+#if !defined (__linux__)
+    Scansonar(std::shared_ptr<Transport> SonarTransport, std::wstring filename = L"", const std::function<void(char*, int)> cbfunc = [](char* line, int num){}, std::map<int, ScansonarCommandList>& CommandList = ScansonarCommands);
+#endif
+    Scansonar(std::shared_ptr<Transport> SonarTransport, std::string filename = "", const std::function<void(char*, int)> cbfunc = [](char* line, int num){}, std::map<int, ScansonarCommandList>& CommandList = ScansonarCommands);
 
     /**
     *   @brief Set default scanning sonar settings
@@ -131,17 +133,96 @@ public:
     const std::string& GetValue(ScansonarCommandIds command);
 
     /**
-    *   @brief Get serial port used for access to echosounder.
-    *   @return std::shared_ptr<serial::Serial> reference
+    *   @brief Get transport used for access to echosounder.
+    *   @return std::shared_ptr<Transport> reference
     */
-    std::shared_ptr<serial::Serial>& GetSerialPort();
+    std::shared_ptr<Transport>& GetTransport();
 
     /**
     *   @brief Get pointer to Raw Scanning Sonar data
-    *   @return pointer to data
+    *   @return pointer to data, freed when the image is replaced the second time, see GetSonarImageGeneration();
+    *           GetSonarImage() keeps the image for as long as it is held
     */
     uint16_t* GetRawSonarData() const;
 
+    /**
+    *   @brief Get ring of lines between the serial reader and the processing thread
+    *   @return FrameRing reference, used for occupancy and overflow statistics
+    */
+    const FrameRing &GetFrameRing() const;
+
+    /**
+    *   @brief Get polar image built from the received lines
+    *   @return SonarData sized by the samples and stepping mode settings, resolves lines skipped by stepping.
+    *           Replaced by a new image when SendSettings changes the geometry, a longer line is received or
+    *           the pyramid or persistence settings change. The returned reference keeps its image allocated.
+    */
+    std::shared_ptr<const SonarData> GetSonarImage() const;
+
+    /**
+    *   @brief Get number of SonarData reallocations, changes when pointers to the image must be obtained again
+    *   @note  Only the previous image is kept: raw pointers are freed when the generation advances twice
+    */
+    uint32_t GetSonarImageGeneration() const;
+
+    /**
+    *   @brief Keep 2x, 4x and 8x range-decimated levels of the polar image, updated while lines are stored
+    *   @param levels - 0 ~ SonarData::MAX_PYRAMID_LEVELS, 0 - no pyramid
+    *   @param mode - reduction of the samples of a level
+    */
+    void SetSonarPyramid(int levels, DecimationMode mode);
+
+    /**
+    *   @brief Keep the average or the maximum of every cell of the polar image across turns
+    *   @note  Updated with the rows received, read by SonarData::GetPersistenceLine() of GetSonarImage()
+    */
+    void SetSonarPersistence(const PersistenceSettings &settings);
+
+    /**
+    *   @brief Compensate spreading, absorption and the gain setting in the polar image
+    *   @note  The gain table follows sample frequency, sound speed, central frequency, gain and TVG time of SendSettings
+    */
+    void SetTvgCompensation(bool enabled, const TvgModel &model);
+
+    /**
+    *   @brief Detect the first return or the peak of every stored line
+    *   @note  Threshold (%), deadzone (mm), range (m) and sound speed are taken from SendSettings
+    *   @param callback - called by the processing thread with every detection, nullptr - ring only
+    */
+    void SetDetector(DetectMode mode, std::function<void(const Detection &)> callback);
+
+    /**
+    *   @brief Get detector of the processing thread
+    *   @return LineDetector reference, detections are read from its ring
+    */
+    LineDetector &GetDetector() const;
+
+    /**
+    *   @brief Compare every stored line with the background of its angle and report the range segments that changed
+    *   @note  Deadzone (mm) and sound speed are taken from SendSettings, the background is learned again when enabled
+    *   @param callback - called by the processing thread with the segments of a line, nullptr - ring only
+    */
+    void SetChangeDetection(const ChangeSettings &settings, std::function<void(const ChangeSegment *, std::size_t)> callback);
+
+    /**
+    *   @brief Get change detector of the processing thread
+    *   @return ChangeDetector reference, segments are read from its ring
+    */
+    ChangeDetector &GetChangeDetector() const;
+
+    /**
+    *   @brief Get pool of line buffers used by the acquisition threads
+    *   @return FramePool reference, used for allocation statistics
+    */
+    const FramePool &GetFramePool() const;
+
+    /**
+    *   @brief Get recorder of the recording file given to the constructor
+    *   @return Recorder reference, IsOpen is false when nothing is recorded. Sets the backlog policy,
+    *           used for queue and write statistics
+    */
+    Recorder &GetRecorder() const;
+
     virtual void GetSettings() override;
     virtual void SetSettings() override;
     virtual void Start() override;
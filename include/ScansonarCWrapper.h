@@ -46,8 +46,166 @@ typedef struct echosoundervalue_t EchosounderValue;
 typedef struct echosoundervalue_t *pEchosounderValue;
 typedef const struct echosoundervalue_t *pcEchosounderValue;
 
+struct scansonarringstats_t
+{
+    uint32_t capacity;      // number of line slots
+    uint32_t occupancy;     // lines waiting for processing
+    uint32_t highwater;     // maximum occupancy seen
+    uint64_t frames;        // lines passed to the processing thread
+    uint64_t overflows;     // lines dropped because the ring was full
+};
+
+typedef struct scansonarringstats_t ScansonarRingStats;
+typedef struct scansonarringstats_t *pScansonarRingStats;
+
+struct scansonarpoolstats_t
+{
+    uint32_t capacity;          // number of line buffers
+    uint32_t available;         // line buffers not checked out
+    uint64_t checkouts;         // line buffers checked out since open
+    uint64_t exhausted;         // lines dropped because no buffer was available
+};
+
+typedef struct scansonarpoolstats_t ScansonarPoolStats;
+typedef struct scansonarpoolstats_t *pScansonarPoolStats;
+
+struct scansonarrecorderstats_t
+{
+    uint32_t capacity;          // buffers between the processing thread and the disk
+    uint32_t queued;            // buffers waiting for the disk
+    uint32_t highwater;         // maximum of queued
+    uint32_t direct;            // 1 - the file bypasses the page cache (O_DIRECT)
+    uint64_t lines;             // lines recorded
+    uint64_t dropped;           // lines dropped because the disk fell behind
+    uint64_t bytes;             // bytes written to the file
+    uint64_t writes;            // write calls
+    uint64_t latencyus;         // total time spent in write calls, us
+    uint64_t maxlatencyus;      // longest write call, us
+    uint64_t errors;            // failed write calls
+};
+
+typedef struct scansonarrecorderstats_t ScansonarRecorderStats;
+typedef struct scansonarrecorderstats_t *pScansonarRecorderStats;
+
+struct scansonarreplaystats_t
+{
+    uint64_t filesize;          // recording size in bytes
+    uint64_t position;          // bytes delivered to the line parser
+    uint64_t frames;            // lines released
+    uint32_t finished;          // 1 - whole recording delivered
+};
+
+typedef struct scansonarreplaystats_t ScansonarReplayStats;
+typedef struct scansonarreplaystats_t *pScansonarReplayStats;
+
+struct scansonarrecordinginfo_t
+{
+    uint64_t lines;             // lines in the recording
+    uint32_t blocks;            // compressed blocks
+    uint32_t turns;             // a new turn starts when the angle steps by more than half a turn
+    uint64_t rawbytes;          // size of the lines as a .bin recording
+    uint64_t filesize;          // recording size in bytes
+    uint32_t indexed;           // 0 - the recording was not closed, the index is rebuilt from the blocks
+};
+
+typedef struct scansonarrecordinginfo_t ScansonarRecordingInfo;
+typedef struct scansonarrecordinginfo_t *pScansonarRecordingInfo;
+
+struct scansonargeometry_t
+{
+    uint32_t samplesperline;    // samples in every line of the image
+    uint32_t linesperfullturn;  // 3200 / stepping mode
+    uint32_t generation;        // incremented when the image is reallocated
+};
+
+typedef struct scansonargeometry_t ScansonarGeometry;
+typedef struct scansonargeometry_t *pScansonarGeometry;
+
+struct scansonarsnapshot_t
+{
+    uint64_t epoch;             // in: lines changed after this epoch are copied, 0 - all; out: epoch of the copy
+    uint32_t generation;        // in/out: image generation, all lines are copied when it changed
+    uint32_t lines;             // out: lines copied
+};
+
+typedef struct scansonarsnapshot_t ScansonarSnapshot;
+typedef struct scansonarsnapshot_t *pScansonarSnapshot;
+
+struct scansonardetection_t
+{
+    uint32_t timestamp;         // timestamp of the line, ms
+    uint16_t angle;             // line of the full turn, 0 ~ 3199, 0.1125 deg
+    uint16_t amplitude;         // sample at the detection, 0 - nothing detected
+    float range;                // m
+};
+
+typedef struct scansonardetection_t ScansonarDetection;
+typedef struct scansonardetection_t *pScansonarDetection;
+
+struct scansonardetectorstats_t
+{
+    uint64_t lines;             // lines the detector was run on
+    uint64_t detections;        // lines with a detection
+    uint64_t overflows;         // detections dropped because ScansonarReadDetections was not called
+};
+
+typedef struct scansonardetectorstats_t ScansonarDetectorStats;
+typedef struct scansonardetectorstats_t *pScansonarDetectorStats;
+
+struct scansonarchangesegment_t
+{
+    uint32_t timestamp;         // timestamp of the line, ms
+    uint16_t angle;             // line of the full turn, 0 ~ 3199, 0.1125 deg
+    uint16_t peak;              // largest increase over the background in the segment
+    float start;                // m
+    float end;                  // m
+};
+
+typedef struct scansonarchangesegment_t ScansonarChangeSegment;
+typedef struct scansonarchangesegment_t *pScansonarChangeSegment;
+
+struct scansonarchangestats_t
+{
+    uint64_t lines;             // lines compared or learned
+    uint64_t segments;          // changed segments found
+    uint64_t overflows;         // segments dropped because ScansonarReadChanges was not called
+};
+
+typedef struct scansonarchangestats_t ScansonarChangeStats;
+typedef struct scansonarchangestats_t *pScansonarChangeStats;
+
 typedef void *pSnrCtx;
 typedef void *hEchosounder; 
+typedef void *pScanConverter;
+typedef void *pScansonarImage;
+typedef void *pScansonarRecording;
+
+#define SCANCONVERTER_BILINEAR 0x01U // interpolate between 2 lines and 2 samples instead of the nearest sample
+
+#define SCANSONAR_DECIMATION_MAX  0U // largest sample of the block
+#define SCANSONAR_DECIMATION_MEAN 1U // rounded mean of the block
+#define SCANSONAR_DECIMATION_PEAK 2U // largest or smallest sample, whichever is farther from the mean
+
+#define SCANSONAR_PERSISTENCE_OFF     0U // no persistence buffer
+#define SCANSONAR_PERSISTENCE_AVERAGE 1U // exponential moving average of every cell across turns
+#define SCANSONAR_PERSISTENCE_MAXHOLD 2U // largest sample of every cell, optionally decaying
+
+#define SCANSONAR_TVG_20LOGR 0U // two-way spreading of volume backscatter
+#define SCANSONAR_TVG_30LOGR 1U // seabed imaging
+#define SCANSONAR_TVG_40LOGR 2U // two-way spreading of point targets
+
+#define SCANSONAR_ABSORPTION_NONE  0U // spreading only
+#define SCANSONAR_ABSORPTION_FIXED 1U // coefficient in dB/km
+#define SCANSONAR_ABSORPTION_THORP 2U // Thorp's sea water formula at IdCentralFrequency
+
+#define SCANSONAR_TVG_AFTER_SONAR_TVG 0x01U // keep the sonar TVG up to IdTVGTime (ms), compensate from there
+
+#define SCANSONAR_DETECT_OFF   0U // detector is not run
+#define SCANSONAR_DETECT_FIRST 1U // first sample at or above IdThreshold, e.g. bottom or wall
+#define SCANSONAR_DETECT_PEAK  2U // largest sample if it reaches IdThreshold
+
+#define SCANSONAR_RECORD_DROP 0U // lines are dropped while the disk is behind, acquisition never waits
+#define SCANSONAR_RECORD_WAIT 1U // processing waits for the disk, lines are dropped by the ring instead
 
 /**
  * @brief   Initiate connection to single frequency echosounder
@@ -66,6 +224,25 @@ DLL_EXPORT pSnrCtx ScansonarOpen(const char *portpath, uint32_t baudrate, const
 DLL_EXPORT pSnrCtx ScansonarOpen(const char* portpath, uint32_t baudrate, const wchar_t* filename, void(* const line_cb)(char*, int));
 #endif
 
+/**
+ * @brief   Initiate connection to the scanning sonar over any supported transport
+ *
+ * @note    file:// replays a recording made by this library, the sonar handshake is skipped.
+ *
+ * @param[in]  uri          tcp://host:port, udp://host:port, file://path, loop:// or serial port path
+ * @param[in]  baudrate     serial port baudrate; for tcp:// and udp:// the sonar baudrate behind the bridge
+ * @param[in]  filename     file to record lines to, may be empty
+ * @param[in]  line_cb      called for every received line, may be NULL
+ *
+ * @return                  Valid handle to futher using to manage the echosounder
+ * @return                  NULL in case of failure
+ */
+#if defined (__linux__)
+DLL_EXPORT pSnrCtx ScansonarOpenUri(const char *uri, uint32_t baudrate, const char *filename, void(*const line_cb)(char*, int));
+#else
+DLL_EXPORT pSnrCtx ScansonarOpenUri(const char* uri, uint32_t baudrate, const wchar_t* filename, void(* const line_cb)(char*, int));
+#endif
+
 /**
  * @brief   Finalize connection to the echosounder
  *
@@ -237,6 +414,10 @@ DLL_EXPORT bool ScansonarDetect(pSnrCtx snrctx);
  * @brief   Return pointer for RAW echosounder data buffer
  *
  * @note    Not affect anything
+ * @note    Rows of lines skipped by stepping are not filled, use ScansonarGetSonarLine or ScansonarCopySonarData
+ * @note    Buffer is sized by IdSamples and IdSteppingMode, see ScansonarGetGeometry.
+ *          Only the image replaced last is kept: the pointer is freed when the geometry generation is incremented
+ *          the second time after the call. Use ScansonarImageAcquire to keep the image while it is read.
  *
  * @param[in]  snrctx       Connection handle obtained by (Single|Dual)EchosounderOpen function.
  *
@@ -244,6 +425,527 @@ DLL_EXPORT bool ScansonarDetect(pSnrCtx snrctx);
  */
 DLL_EXPORT uint16_t* GetRawSonarData(pSnrCtx snrctx);
 
+/**
+ * @brief   Return samples of one line of the polar image
+ *
+ * @note    Lines skipped by stepping return the samples of the last received neighbour line
+ * @note    Freed as the buffer of GetRawSonarData, see ScansonarImageGetLine to keep it
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  line         Line index, 0 ~ lines per full turn - 1
+ *
+ * @return                  Pointer to samples per line values
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT const uint16_t* ScansonarGetSonarLine(pSnrCtx snrctx, int line);
+
+/**
+ * @brief   Copy the polar image with every line filled
+ *
+ * @note    Lines skipped by stepping are filled with the samples of the last received neighbour line
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] dst          Destination buffer
+ * @param[in]  count        Size of dst in samples, at least samples per line * lines per full turn
+ *
+ * @return                  0  - image is copied
+ * @return                  -1 - invalid arguments or dst is too small
+ */
+DLL_EXPORT int ScansonarCopySonarData(pSnrCtx snrctx, uint16_t *dst, size_t count);
+
+/**
+ * @brief   Get size of the polar image
+ *
+ * @note    The image is reallocated when ScansonarStart sends a new IdSamples or IdSteppingMode,
+ *          when a longer line is received, e.g. from a recording, and when the pyramid or the persistence
+ *          settings change. Pointers returned by GetRawSonarData, ScansonarGetSonarLine and
+ *          ScansonarGetPersistenceData must be obtained again when generation changes.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] geometry     Image size
+ *
+ * @return                  0  - geometry is valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarGetGeometry(pSnrCtx snrctx, pScansonarGeometry geometry);
+
+/**
+ * @brief   Copy the lines of the polar image changed since the previous snapshot
+ *
+ * @note    Acquisition is not blocked and untouched lines are not copied. Every copied line is consistent,
+ *          a line written meanwhile is copied again. Keep dst and pass the same snapshot structure
+ *          to the next call to update dst incrementally; start with a zeroed structure.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] dst          Destination buffer, line i at dst + i * samples per line
+ * @param[in]  count        Size of dst in samples, at least samples per line * lines per full turn
+ * @param[in,out] snapshot  Epoch and generation of dst
+ *
+ * @return                  0  - changed lines are copied
+ * @return                  -1 - invalid arguments or dst is too small for the current geometry
+ */
+DLL_EXPORT int ScansonarGetSnapshot(pSnrCtx snrctx, uint16_t *dst, size_t count, pScansonarSnapshot snapshot);
+
+/**
+ * @brief   Keep range-decimated levels of the polar image for zoomed-out views
+ *
+ * @note    Level n has the samples of every line decimated by 1 << n, levels are updated while lines are stored.
+ *          The image is copied with the new levels, geometry generation is incremented.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  levels       0 ~ 3, 0 - no levels, 3 - 2x, 4x and 8x
+ * @param[in]  mode         SCANSONAR_DECIMATION_MAX, SCANSONAR_DECIMATION_MEAN or SCANSONAR_DECIMATION_PEAK
+ *
+ * @return                  0  - levels are set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetPyramid(pSnrCtx snrctx, uint32_t levels, uint32_t mode);
+
+/**
+ * @brief   Copy one line of a range-decimated level
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  level        0 - full resolution, 1 ~ levels set by ScansonarSetPyramid
+ * @param[in]  line         Line index, 0 ~ lines per full turn - 1
+ * @param[out] dst          Destination buffer
+ * @param[in]  count        Size of dst in samples, at least ceil(samples per line / (1 << level))
+ *
+ * @return                  Number of samples copied
+ * @return                  -1 - invalid arguments, the level is not kept or dst is too small
+ */
+DLL_EXPORT int ScansonarGetPyramidLine(pSnrCtx snrctx, uint32_t level, int line, uint16_t *dst, size_t count);
+
+/**
+ * @brief   Keep the polar image averaged or max-held across turns in a buffer of its own
+ *
+ * @note    Every received line updates its cells: average += (sample - average) * weight, or
+ *          maximum = max(sample, maximum - decay). Lines not received are not touched.
+ *          The image is copied with the new persistence, geometry generation is incremented.
+ *          The persistence is kept when only weight or decay change.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  mode         SCANSONAR_PERSISTENCE_OFF, SCANSONAR_PERSISTENCE_AVERAGE or SCANSONAR_PERSISTENCE_MAXHOLD
+ * @param[in]  weight       SCANSONAR_PERSISTENCE_AVERAGE: weight of the new line, 0 ~ 1, e.g. 0.25 averages about 4 turns
+ * @param[in]  decay        SCANSONAR_PERSISTENCE_MAXHOLD: subtracted from the held sample every turn, 0 - held
+ *
+ * @return                  0  - persistence is set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetPersistence(pSnrCtx snrctx, uint32_t mode, float weight, uint32_t decay);
+
+/**
+ * @brief   Copy the persistence of one line
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  line         Line index, 0 ~ lines per full turn - 1
+ * @param[out] dst          Destination buffer
+ * @param[in]  count        Size of dst in samples, at least samples per line
+ *
+ * @return                  Number of samples copied
+ * @return                  -1 - invalid arguments, persistence is off or dst is too small
+ */
+DLL_EXPORT int ScansonarGetPersistenceLine(pSnrCtx snrctx, int line, uint16_t *dst, size_t count);
+
+/**
+ * @brief   Get the persistence buffer, laid out as GetRawSonarData
+ *
+ * @note    Read-only. Freed as the buffer of GetRawSonarData, see ScansonarImageGetPersistenceData to keep it.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ *
+ * @return                  Persistence rows
+ * @return                  NULL - invalid arguments or persistence is off
+ */
+DLL_EXPORT const uint16_t* ScansonarGetPersistenceData(pSnrCtx snrctx);
+
+/**
+ * @brief   Keep the current polar image for reading
+ *
+ * @note    The image stays allocated until ScansonarImageRelease, also after the sonar replaces it or the connection
+ *          is closed. Lines keep being stored into it until it is replaced, see the generation of ScansonarImageGetGeometry.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ *
+ * @return                  Image handle
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT pScansonarImage ScansonarImageAcquire(pSnrCtx snrctx);
+
+/**
+ * @brief   Release the image, pointers obtained from it must not be used any more
+ *
+ * @param[in]  image        Handle obtained by ScansonarImageAcquire function.
+ */
+DLL_EXPORT void ScansonarImageRelease(pScansonarImage image);
+
+/**
+ * @brief   Get size of the image and the generation it was acquired at
+ *
+ * @param[in]  image        Handle obtained by ScansonarImageAcquire function.
+ * @param[out] geometry     Image size
+ *
+ * @return                  0  - geometry is valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarImageGetGeometry(pScansonarImage image, pScansonarGeometry geometry);
+
+/**
+ * @brief   Row storage of the image, laid out as GetRawSonarData, valid until ScansonarImageRelease
+ *
+ * @param[in]  image        Handle obtained by ScansonarImageAcquire function.
+ *
+ * @return                  Rows of samples per line values
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT const uint16_t* ScansonarImageGetData(pScansonarImage image);
+
+/**
+ * @brief   Samples of one line of the image, as ScansonarGetSonarLine, valid until ScansonarImageRelease
+ *
+ * @param[in]  image        Handle obtained by ScansonarImageAcquire function.
+ * @param[in]  line         Line index, 0 ~ lines per full turn - 1
+ *
+ * @return                  Pointer to samples per line values
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT const uint16_t* ScansonarImageGetLine(pScansonarImage image, int line);
+
+/**
+ * @brief   Persistence rows of the image, as ScansonarGetPersistenceData, valid until ScansonarImageRelease
+ *
+ * @param[in]  image        Handle obtained by ScansonarImageAcquire function.
+ *
+ * @return                  Persistence rows
+ * @return                  NULL - invalid arguments or persistence is off
+ */
+DLL_EXPORT const uint16_t* ScansonarImageGetPersistenceData(pScansonarImage image);
+
+/**
+ * @brief   Compensate TVG and gain of the polar image on the host
+ *
+ * @note    Every range bin is multiplied by a fixed point gain: spreading and absorption from 1 m, less IdGain.
+ *          The gain table is rebuilt from IdSamplFreq, IdSound, IdCentralFrequency, IdGain and IdTVGTime by
+ *          ScansonarStart. Samples are saturated to 4095, the gain is limited to +42 dB.
+ *          The line callback and the recording are not affected.
+ *
+ * @param[in]  snrctx           Connection handle obtained by ScansonarOpen function.
+ * @param[in]  enable           0 - disabled, the image has the samples as received
+ * @param[in]  spreading        SCANSONAR_TVG_20LOGR, SCANSONAR_TVG_30LOGR or SCANSONAR_TVG_40LOGR
+ * @param[in]  absorption       SCANSONAR_ABSORPTION_NONE, SCANSONAR_ABSORPTION_FIXED or SCANSONAR_ABSORPTION_THORP
+ * @param[in]  absorptiondbkm   Absorption coefficient of SCANSONAR_ABSORPTION_FIXED, dB/km
+ * @param[in]  flags            SCANSONAR_TVG_AFTER_SONAR_TVG
+ *
+ * @return                  0  - compensation is set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetTvgCompensation(pSnrCtx snrctx, uint32_t enable, uint32_t spreading, uint32_t absorption,
+                                           float absorptiondbkm, uint32_t flags);
+
+/**
+ * @brief   Detect a target on every line stored in the polar image
+ *
+ * @note    Samples closer than IdDeadzone (mm) and farther than IdRange (m, whole line when not set) are skipped,
+ *          IdThreshold is a percentage of the full scale 4095. Range is converted with IdSound and IdSamplFreq.
+ *          The limits are applied by ScansonarStart. Detection runs on the TVG compensated samples when
+ *          ScansonarSetTvgCompensation is enabled.
+ *          Every line gives one detection, passed to detection_cb and queued for ScansonarReadDetections.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  mode         SCANSONAR_DETECT_OFF, SCANSONAR_DETECT_FIRST or SCANSONAR_DETECT_PEAK
+ * @param[in]  detection_cb Called by the processing thread with every detection, NULL - queue only
+ *
+ * @return                  0  - detector is set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetDetector(pSnrCtx snrctx, uint32_t mode, void(*const detection_cb)(const ScansonarDetection*));
+
+/**
+ * @brief   Take the oldest queued detections
+ *
+ * @note    The queue keeps SCANSONAR_DETECTION_SLOTS detections, newer ones are dropped while it is full.
+ *          Call from one thread only.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] dst          Destination buffer
+ * @param[in]  count        Size of dst in detections
+ *
+ * @return                  Number of detections copied
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarReadDetections(pSnrCtx snrctx, pScansonarDetection dst, size_t count);
+
+/**
+ * @brief   Get statistics of the detector
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] stats        Detector statistics
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarGetDetectorStats(pSnrCtx snrctx, pScansonarDetectorStats stats);
+
+/**
+ * @brief   Report returns appearing between turns
+ *
+ * @note    Every stored line is compared with the background of its angle, an average of the previous turns.
+ *          Runs of samples exceeding the background by more than threshold, beyond IdDeadzone, are merged into
+ *          range segments passed to change_cb and queued for ScansonarReadChanges. The first turn after
+ *          the detection is enabled only learns the background.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  enable       0 - disabled
+ * @param[in]  threshold    Increase of a sample over the background, 0 ~ 4095
+ * @param[in]  learning     Weight of a new line in the background, 0 ~ 1, e.g. 0.05 follows about 20 turns
+ * @param[in]  minlength    Shorter segments are dropped, m
+ * @param[in]  mingap       Segments closer are merged, m
+ * @param[in]  change_cb    Called by the processing thread with the segments of a line, NULL - queue only
+ *
+ * @return                  0  - change detection is set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetChangeDetection(pSnrCtx snrctx, uint32_t enable, uint32_t threshold, float learning,
+                                           float minlength, float mingap,
+                                           void(*const change_cb)(const ScansonarChangeSegment*, int));
+
+/**
+ * @brief   Take the oldest queued change segments
+ *
+ * @note    The queue keeps SCANSONAR_CHANGE_SLOTS segments, newer ones are dropped while it is full.
+ *          Call from one thread only.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] dst          Destination buffer
+ * @param[in]  count        Size of dst in segments
+ *
+ * @return                  Number of segments copied
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarReadChanges(pSnrCtx snrctx, pScansonarChangeSegment dst, size_t count);
+
+/**
+ * @brief   Get statistics of the change detection
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] stats        Change detection statistics
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarGetChangeStats(pSnrCtx snrctx, pScansonarChangeStats stats);
+
+/**
+ * @brief   Create polar to Cartesian (PPI) scan converter
+ *
+ * @note    The sonar is in the image center, line 0 points up and lines go clockwise.
+ *          The pixel lookup table is built at the first conversion and rebuilt when the geometry changes.
+ *
+ * @param[in]  width, height    Output image size in pixels
+ * @param[in]  range            Samples from the center to the edge of the circle, 0 - whole line
+ * @param[in]  linesperfullturn Lines of the polar image, see ScansonarGetGeometry
+ * @param[in]  flags            SCANCONVERTER_BILINEAR or 0
+ * @param[in]  threads          Conversion threads, 0 - one per CPU
+ *
+ * @return                  Converter handle
+ * @return                  NULL - converter is not created
+ */
+DLL_EXPORT pScanConverter ScansonarScanConverterCreate(uint32_t width, uint32_t height, uint32_t range, uint32_t linesperfullturn, uint32_t flags, uint32_t threads);
+
+/**
+ * @brief   Destroy scan converter, the image returned by ScansonarScanConvert is freed
+ *
+ * @param[in]  converter    Handle obtained by ScansonarScanConverterCreate function.
+ */
+DLL_EXPORT void ScansonarScanConverterDestroy(pScanConverter converter);
+
+/**
+ * @brief   Convert the polar image to Cartesian
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  converter    Handle obtained by ScansonarScanConverterCreate function.
+ *
+ * @return                  Image of width * height samples, row by row, owned by the converter and valid until
+ *                          the next conversion or ScansonarScanConverterDestroy
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT const uint16_t* ScansonarScanConvert(pSnrCtx snrctx, pScanConverter converter);
+
+/**
+ * @brief   Update the Cartesian image with the lines changed since the previous conversion
+ *
+ * @note    Only the pixels of the changed lines are redrawn, so the cost follows the ping rate rather than the
+ *          image size. The whole image is converted the first time and after the geometry of the sonar image changes.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  converter    Handle obtained by ScansonarScanConverterCreate function.
+ * @param[out] lines        Number of redrawn lines, can be NULL
+ *
+ * @return                  Image of width * height samples, the same buffer as ScansonarScanConvert returns
+ * @return                  NULL - invalid arguments
+ */
+DLL_EXPORT const uint16_t* ScansonarScanConvertChanged(pSnrCtx snrctx, pScanConverter converter, uint32_t *lines);
+
+/**
+ * @brief   Get statistics of the ring between the serial reader and the processing thread
+ *
+ * @note    Can be used to size SCANSONAR_RING_SLOTS: overflows grow when processing (callback, file) is too slow
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] stats        Ring statistics
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarGetRingStats(pSnrCtx snrctx, pScansonarRingStats stats);
+
+/**
+ * @brief   Get statistics of the line buffer pool
+ *
+ * @note    Lines are received into recycled buffers, the pool is allocated once when the handle is opened
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] stats        Pool statistics
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarGetPoolStats(pSnrCtx snrctx, pScansonarPoolStats stats);
+
+/**
+ * @brief   Set what the recorder does when the disk falls behind
+ *
+ * @note    The recording file is written by a thread of its own from a pool of large buffers,
+ *          the policy applies when every buffer is waiting for the disk.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[in]  policy       SCANSONAR_RECORD_DROP (default) or SCANSONAR_RECORD_WAIT
+ *
+ * @return                  0  - policy is set
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarSetRecorderPolicy(pSnrCtx snrctx, uint32_t policy);
+
+/**
+ * @brief   Get queue and write statistics of the recording file
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpen function.
+ * @param[out] stats        Recorder statistics
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments or nothing is recorded
+ */
+DLL_EXPORT int ScansonarGetRecorderStats(pSnrCtx snrctx, pScansonarRecorderStats stats);
+
+/**
+ * @brief   Set replay speed of a recording opened by ScansonarOpenUri("file://...")
+ *
+ * @note    Lines are paced by the footer timestamps. While replaying no line is dropped:
+ *          the reader waits for the processing thread when the ring is full.
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpenUri function.
+ * @param[in]  speed        0 - as fast as possible, 1.0 - recorded rate, N - N times faster
+ *
+ * @return                  0  - speed is set
+ * @return                  -1 - invalid arguments or the handle is not a replay
+ */
+DLL_EXPORT int ScansonarSetReplaySpeed(pSnrCtx snrctx, double speed);
+
+/**
+ * @brief   Get progress of a recording opened by ScansonarOpenUri("file://...")
+ *
+ * @param[in]  snrctx       Connection handle obtained by ScansonarOpenUri function.
+ * @param[out] stats        Replay progress
+ *
+ * @return                  0  - stats are valid
+ * @return                  -1 - invalid arguments or the handle is not a replay
+ */
+DLL_EXPORT int ScansonarGetReplayStats(pSnrCtx snrctx, pScansonarReplayStats stats);
+
+/**
+ * @brief   Open a block-compressed recording for random access
+ *
+ * @note    The recording is written when the filename passed to ScansonarOpen ends with .ssbr:
+ *          lines are grouped into LZ-compressed blocks with CRCs, compressed by a thread of their own.
+ *          A recording that was not closed is opened up to the first damaged block.
+ *
+ * @param[in]  filename     .ssbr recording
+ *
+ * @return                  Recording handle
+ * @return                  NULL - the file is not a block-compressed recording
+ */
+DLL_EXPORT pScansonarRecording ScansonarRecordingOpen(const char *filename);
+
+/**
+ * @brief   Close the recording
+ *
+ * @param[in]  recording    Handle obtained by ScansonarRecordingOpen function.
+ */
+DLL_EXPORT void ScansonarRecordingClose(pScansonarRecording recording);
+
+/**
+ * @param[in]  recording    Handle obtained by ScansonarRecordingOpen function.
+ * @param[out] info         Size of the recording
+ *
+ * @return                  0  - info is valid
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarRecordingGetInfo(pScansonarRecording recording, pScansonarRecordingInfo info);
+
+/**
+ * @brief   Find the first line with the footer timestamp at or after timestamp
+ *
+ * @param[in]  recording    Handle obtained by ScansonarRecordingOpen function.
+ * @param[in]  timestamp    Footer timestamp, ms
+ *
+ * @return                  Line number
+ * @return                  -1 - invalid arguments or no such line
+ */
+DLL_EXPORT int64_t ScansonarRecordingFindTimestamp(pScansonarRecording recording, uint32_t timestamp);
+
+/**
+ * @brief   Find the line of a turn closest to angle
+ *
+ * @param[in]  recording    Handle obtained by ScansonarRecordingOpen function.
+ * @param[in]  turn         Turn of the recording, from 0
+ * @param[in]  angle        Header angle / 9, 0 ~ 3199
+ *
+ * @return                  Line number
+ * @return                  -1 - invalid arguments or the turn is not recorded
+ */
+DLL_EXPORT int64_t ScansonarRecordingFindAngle(pScansonarRecording recording, uint32_t turn, uint32_t angle);
+
+/**
+ * @brief   Copy lines of the recording, the blocks holding them are decoded in parallel
+ *
+ * @note    Lines are copied as DATAHEADER v3 lines, the same bytes as a .bin recording of them.
+ *
+ * @param[in]  recording    Handle obtained by ScansonarRecordingOpen function.
+ * @param[in]  first        First line
+ * @param[in]  count        Number of lines, lines after the end of the recording are not copied
+ * @param[out] dst          Buffer for the lines
+ * @param[in]  size         Size of dst in bytes
+ * @param[in]  threads      Decoding threads, 0 - one per CPU
+ *
+ * @return                  Bytes copied
+ * @return                  -1 - invalid arguments, dst is too small or a block is damaged
+ */
+DLL_EXPORT int64_t ScansonarRecordingReadLines(pScansonarRecording recording, uint64_t first, uint32_t count, uint8_t *dst, size_t size, uint32_t threads);
+
+/**
+ * @brief   Convert 8-bit companded samples to 12-bit amplitudes
+ *
+ * @note    Same conversion as used for the RAW data buffer, can be applied to the line passed to the callback.
+ *          Uses the fastest SIMD kernel supported by the CPU.
+ *
+ * @param[in]  src          Companded samples, e.g. callback data starting at the header dataoffset
+ * @param[out] dst          Amplitudes, count values are written
+ * @param[in]  count        Number of samples
+ *
+ * @return                  0  - samples are converted
+ * @return                  -1 - invalid arguments
+ */
+DLL_EXPORT int ScansonarUncompand(const uint8_t *src, uint16_t *dst, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,80 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <chrono>
+
+#include "Transport.h"
+
+/**
+ *  @class SerialRxBuffer
+ *  Receive buffer between the transport and the MRS900 protocol parser.
+ *  Bytes are pulled from the transport in chunks of whatever the driver has queued,
+ *  the parser consumes them from memory. Unconsumed bytes are kept between calls.
+ *  Fill leaves reserve bytes of the buffer free, so PutBack of up to reserve bytes always succeeds.
+ */
+class SerialRxBuffer final
+{
+public:
+
+    /**
+     *   @param reserve - longest PutBack that must not fail, up to capacity / 2
+     */
+    SerialRxBuffer(std::shared_ptr<Transport> SonarTransport, std::size_t capacity = 65536, std::size_t reserve = 0);
+    ~SerialRxBuffer();
+
+    /**
+     *   @brief Pull all bytes queued by the driver into the buffer
+     *   @note  Blocks up to the port read timeout when nothing is queued
+     *   @return number of bytes added to the buffer
+     */
+    std::size_t Fill();
+
+    /**
+     *   @brief Wait for new bytes up to the deadline and pull them into the buffer
+     *   @note  The wait is driven by transport readiness, so data is handled as soon as it arrives
+     *   @return number of bytes added, 0 - deadline expired or the buffer is full, see IsFull()
+     */
+    std::size_t FillUntil(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     *   @brief No room left but the reserve, Fill adds nothing until bytes are consumed
+     */
+    bool IsFull() const;
+
+    /**
+     *   @brief Copy bytes to the caller, reading the port as needed
+     *   @return number of bytes copied, less than size in case of timeout
+     */
+    std::size_t Read(uint8_t *dst, std::size_t size);
+
+    /**
+     *   @brief Buffered bytes not consumed yet
+     */
+    const uint8_t *Data() const;
+    std::size_t Size() const;
+
+    void Consume(std::size_t count);
+    void Clear();
+
+    /**
+     *   @brief Return bytes to the front of the buffer, used by the parser to rescan them
+     *   @return false - not enough room in the buffer, count is larger than the reserve
+     */
+    bool PutBack(const uint8_t *src, std::size_t count);
+
+private:
+
+    void Compact();
+
+    std::shared_ptr<Transport> transport;
+
+    std::unique_ptr<uint8_t[]> buffer;
+
+    std::size_t capacity;
+    std::size_t reserve;
+    std::size_t head;
+    std::size_t tail;
+};
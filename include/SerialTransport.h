@@ -0,0 +1,40 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "Transport.h"
+#include "serial/serial.h"
+
+/**
+ *  @class SerialTransport
+ *  Serial port backend, wraps serial::Serial
+ */
+class SerialTransport final : public Transport
+{
+public:
+
+    SerialTransport(const std::string &portpath, uint32_t baudrate, uint32_t timeoutms);
+    SerialTransport(std::shared_ptr<serial::Serial> SerialPort);
+    ~SerialTransport();
+
+    std::size_t Read(uint8_t *dst, std::size_t size) override;
+    std::size_t Write(const uint8_t *src, std::size_t size) override;
+    using Transport::Write;
+    std::size_t Available() override;
+
+    /**
+     *   @note Waits timeoutms at most, the port read timeout used by Read is restored after the wait.
+     *         On Windows readiness is left to Read
+     */
+    bool WaitReadable(int64_t timeoutms) override;
+    void Flush() override;
+    uint32_t GetBaudrate() const override;
+
+    std::shared_ptr<serial::Serial> &GetSerialPort();
+
+private:
+
+    std::shared_ptr<serial::Serial> serialport;
+};
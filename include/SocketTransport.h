@@ -0,0 +1,85 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "Transport.h"
+
+/**
+ *  @class SocketTransport
+ *  Common part of the network backends: readiness, timeouts and socket lifetime
+ */
+class SocketTransport : public Transport
+{
+public:
+
+    ~SocketTransport();
+
+    std::size_t Write(const uint8_t *src, std::size_t size) override;
+    using Transport::Write;
+    std::size_t Available() override;
+    bool WaitReadable(int64_t timeoutms) override;
+    intptr_t GetReadyFd() const override;
+    uint32_t GetBaudrate() const override;
+
+protected:
+
+    SocketTransport(uint32_t baudrate, uint32_t timeoutms);
+
+    /**
+     *   @brief Create socket of given type and connect it to host:port
+     *   @param bindlocal - bind the local address to the same port before connect (UDP)
+     */
+    void Connect(const std::string &host, const std::string &port, int socktype, bool bindlocal);
+
+    /**
+     *   @brief Single recv() of at most size bytes, waiting up to timeoutms
+     *   @return number of bytes received, 0 - timeout, empty datagram or TCP connection closed (peerclosed is set)
+     */
+    std::size_t ReceiveSome(uint8_t *dst, std::size_t size, int64_t timeoutms);
+
+    void Close();
+
+    intptr_t sockfd;
+    bool stream;        // SOCK_STREAM, a 0-byte receive is the peer closing
+    bool peerclosed;
+    uint32_t baudrate;
+    uint32_t timeoutms;
+};
+
+/**
+ *  @class TcpTransport
+ *  TCP client, for sonars behind a serial-to-Ethernet bridge in TCP server mode
+ */
+class TcpTransport final : public SocketTransport
+{
+public:
+
+    TcpTransport(const std::string &host, const std::string &port, uint32_t baudrate, uint32_t timeoutms);
+
+    std::size_t Read(uint8_t *dst, std::size_t size) override;
+};
+
+/**
+ *  @class UdpTransport
+ *  UDP peer, for bridges in UDP mode. The bridge is expected to send to the same port it listens on.
+ *  Datagrams are staged so a short Read does not truncate them.
+ */
+class UdpTransport final : public SocketTransport
+{
+public:
+
+    UdpTransport(const std::string &host, const std::string &port, uint32_t baudrate, uint32_t timeoutms);
+
+    std::size_t Read(uint8_t *dst, std::size_t size) override;
+    std::size_t Available() override;
+    bool WaitReadable(int64_t timeoutms) override;
+
+private:
+
+    std::unique_ptr<uint8_t[]> datagram;
+
+    std::size_t datagramhead;
+    std::size_t datagramtail;
+};
@@ -2,26 +2,239 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
 #include <iterator>
 #include <memory>
+#include <vector>
 
+#include "Persistence.h"
+
+/**
+ *  Reduction of the samples of a range-decimated pyramid level
+ *  DMode_Max  - largest sample, keeps small targets
+ *  DMode_Mean - rounded mean, keeps the speckle level
+ *  DMode_Peak - the largest or the smallest sample, whichever is farther from the mean, keeps echoes and shadows
+ */
+enum class DecimationMode { DMode_Max, DMode_Mean, DMode_Peak };
+
+/**
+ *  @class SonarData
+ *  Polar image, one row per line of the turn.
+ *
+ *  Written by the processing thread only. Readers copy rows without blocking it:
+ *  every row has a sequence counter (seqlock, odd while the row is written) and every change
+ *  of a line, its row samples or its alias, is stamped with the image epoch.
+ *
+ *  Optionally keeps a pyramid of 2x, 4x and 8x range-decimated rows, updated while the line is stored.
+ *  Level rows follow the rows: the same aliases, seqlocks and epochs.
+ *
+ *  Optionally keeps a persistence row per row, the average or the maximum of the row across turns.
+ *  It is updated only when the row is written and follows the rows the same way as the levels.
+ */
 class SonarData final
 {
+public:
+    static constexpr int MAX_PYRAMID_LEVELS = 3;
+
+private:
     std::unique_ptr<uint16_t[]> sonardata;
+    std::unique_ptr<uint16_t[]> leveldata[MAX_PYRAMID_LEVELS]; // Rows of the level decimated by 2 << level
+    std::unique_ptr<uint16_t[]> persistdata;            // Persistence rows, nullptr - PMode_Off
+    std::unique_ptr<int[]> persistextent;               // Samples from the persistence row beginning that may be non-zero
+    std::unique_ptr<int[]> rowextent;                   // Samples from the row beginning that may be non-zero
+    std::unique_ptr<std::atomic<int>[]> rowmap;         // Row holding the samples of each line, skipped lines alias the last received row
+    std::unique_ptr<std::atomic<uint32_t>[]> rowseq;    // Seqlock of each row
+    std::unique_ptr<std::atomic<uint64_t>[]> rowepoch;  // Epoch of the last write to each row
+    std::unique_ptr<std::atomic<uint64_t>[]> lineepoch; // Epoch of the last alias change of each line
+    std::atomic<uint64_t> epoch;                        // Incremented on every stored line, lines up to it are complete
 
     int samplesperline;
     int linesperfullturn;
+    int pyramidlevels;
+    DecimationMode decimation;
+    int levelsamples[MAX_PYRAMID_LEVELS];
+    PersistenceSettings persistence;
+    int16_t persistweight;                              // Q15 weight of PMode_Average
+
+    void BeginRowWrite(int row);
+    void EndRowWrite(int row, uint64_t writeepoch);
+
+    /**
+     *   @brief Update the pyramid levels of a row from its samples first up to last
+     *   @note  Whole blocks of the largest decimation are reduced, samples after last must be final or updated later
+     */
+    void DecimateRow(int row, int first, int last);
+
+    /**
+     *   @brief Update the persistence row from the row samples first up to last
+     */
+    void PersistRow(int row, int first, int last);
+
+    /**
+     *   @brief Copy the row of a line from data, retried until it is not torn by a concurrent write
+     */
+    void ReadRow(const uint16_t *data, int rowsamples, int line, uint16_t *dst) const;
 
 public:
-    SonarData(int samplesperline = 20400, int linesperfullturn = 3200);
+    // Zero samples after the last row: vector gathers read 32 bits at any sample, the scan converter maps empty pixels here
+    static constexpr int PADDING_SAMPLES = 16;
+
+    /**
+     *   @param pyramidlevels - range-decimated levels kept besides the rows, 0 ~ MAX_PYRAMID_LEVELS
+     *   @param persistence - persistence kept besides the rows
+     */
+    SonarData(int samplesperline = 20400, int linesperfullturn = 3200,
+              int pyramidlevels = 0, DecimationMode decimation = DecimationMode::DMode_Max,
+              const PersistenceSettings &persistence = { PersistenceMode::PMode_Off, 1.0F, 0 });
+
+    /**
+     *   @brief Copy of source with another line length, samples beyond the shorter length are cleared
+     */
+    SonarData(const SonarData &source, int samplesperline);
+
+    /**
+     *   @brief Copy of source with another line length, pyramid and persistence, the levels are built from the copied rows
+     *   @note  Persistence of source is copied when source keeps one, otherwise it starts from the copied rows
+     */
+    SonarData(const SonarData &source, int samplesperline, int pyramidlevels, DecimationMode decimation,
+              const PersistenceSettings &persistence);
     ~SonarData();
 
+    /**
+     *   @brief Sample of a line, the line alias is resolved
+     */
     uint16_t *GetSample(int line, int position) const;
 
+    /**
+     *   @brief Samples of a line, GetSamplesPerLine() values
+     *   @note  Lines skipped by stepping point to the row of the received line
+     */
+    const uint16_t *GetLine(int line) const;
+
+    /**
+     *   @brief Row of GetRawSonarData() holding the samples of a line
+     */
+    int GetLineRow(int line) const;
+
+    /**
+     *   @brief Copy all lines with the aliases resolved, every line is copied consistently
+     *   @param dst - GetSamplesPerLine() * GetLinesPerFullTurn() values
+     */
+    void MaterializeDense(uint16_t *dst) const;
+
+    /**
+     *   @brief Copy one line, retried until it is not torn by a concurrent write
+     *   @param dst - GetSamplesPerLine() values
+     */
+    void ReadLine(int line, uint16_t *dst) const;
+
+    /**
+     *   @brief Epoch of the last stored line
+     */
+    uint64_t GetEpoch() const;
+
+    /**
+     *   @brief Epoch of the last change of a line: its row was written or it was pointed to another row
+     */
+    uint64_t GetLineEpoch(int line) const;
+
+    /**
+     *   @brief Lines changed after sinceepoch, including lines skipped by stepping that alias a written row
+     *   @param lines - changed lines in increasing order
+     *   @return epoch to pass next time, changes up to it are all listed
+     */
+    uint64_t GetChangedLines(uint64_t sinceepoch, std::vector<int> &lines) const;
+
+    /**
+     *   @brief Copy lines changed after sinceepoch, line i to dst + i * GetSamplesPerLine()
+     *
+     *   Untouched lines are not copied and acquisition is not blocked. Every copied line is consistent.
+     *   Changes up to the returned epoch are all included, lines stored while copying may already be newer.
+     *
+     *   @param sinceepoch - epoch returned by the previous snapshot, 0 - all lines
+     *   @param lines - number of lines copied, may be nullptr
+     *   @return epoch to pass to the next snapshot
+     */
+    uint64_t Snapshot(uint16_t *dst, uint64_t sinceepoch, int *lines) const;
+
     int GetSamplesPerLine() const;
     int GetLinesPerFullTurn() const;
 
+    int GetPyramidLevels() const;
+    DecimationMode GetDecimation() const;
+
+    /**
+     *   @brief Samples per line of a level, level 0 - full resolution rows, level n - decimated by 1 << n
+     *   @return 0 - the level is not kept
+     */
+    int GetLevelSamplesPerLine(int level) const;
+
+    /**
+     *   @brief Samples of a line at a level, GetLevelSamplesPerLine(level) values, the line alias is resolved
+     */
+    const uint16_t *GetLevelLine(int level, int line) const;
+
+    /**
+     *   @brief Copy one line of a level, retried until it is not torn by a concurrent write
+     *   @param dst - GetLevelSamplesPerLine(level) values
+     */
+    void ReadLevelLine(int level, int line, uint16_t *dst) const;
+
+    /**
+     *   @brief Row storage of a level, rows of lines skipped by stepping are not filled
+     */
+    const uint16_t *GetLevelData(int level) const;
+
+    PersistenceSettings GetPersistence() const;
+
+    /**
+     *   @brief Persistence samples of a line, GetSamplesPerLine() values, the line alias is resolved
+     *   @return nullptr - PMode_Off
+     */
+    const uint16_t *GetPersistenceLine(int line) const;
+
+    /**
+     *   @brief Copy the persistence of one line, retried until it is not torn by a concurrent write
+     *   @param dst - GetSamplesPerLine() values
+     */
+    void ReadPersistenceLine(int line, uint16_t *dst) const;
+
+    /**
+     *   @brief Persistence row storage laid out as GetRawSonarData(), nullptr - PMode_Off
+     *   @note  Read-only, written by the processing thread with the rows
+     */
+    const uint16_t *GetPersistenceData() const;
+
+    /**
+     *   @brief Clear the rows, the levels and the persistence
+     */
     void CleanSonarData();
 
+    /**
+     *   @brief Store received line: the row is cleared and the companded samples are uncompanded to its beginning
+     */
+    void WriteLine(int line, const uint8_t *samples, int count);
+
+    /**
+     *   @brief Fill rows skipped between two received lines with a copy of row srcline
+     *   @note  Rows from prevline up to currline are filled, currline excluded, in either direction
+     */
+    void FillGap(int prevline, int currline, int srcline);
+
+    /**
+     *   @brief Store received line and point the skipped lines to it
+     *
+     *   The samples are uncompanded straight into the row, only the part written by an earlier longer line is cleared.
+     *   Skipped lines are not copied: they alias the row, showing its latest samples, until a line is received for them.
+     *
+     *   @param gapfrom, gapto - lines from gapfrom up to gapto, gapto excluded, in either direction; equal for no gap
+     *   @param gain - Q8.8 TVG gain of every sample applied after uncompanding, see Tvg_Apply; nullptr - none
+     */
+    void IngestLine(int line, const uint8_t *samples, int count, int gapfrom, int gapto, const uint16_t *gain = nullptr);
+
+    /**
+     *   @brief Row storage, rows of lines skipped by stepping are not filled, see GetLine() and MaterializeDense()
+     *   @note  Rows are followed by PADDING_SAMPLES zeros
+     */
     uint16_t *GetRawSonarData() const;
 };
@@ -115,6 +115,8 @@ struct deviceCommand
 typedef struct deviceCommand   DEVICECOMMAND;
 typedef struct deviceCommand *PDEVICECOMMAND;
 
+constexpr int32_t DEVICECOMMAND_MAGIC = 1145982275;   // DEVICECOMMAND.magic, "CMND"
+
 struct _dataheader_v1
 {
     uint32_t magic;
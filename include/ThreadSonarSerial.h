@@ -8,10 +8,35 @@
 #include <memory>
 #include <chrono>
 #include <functional>
+#include <mutex>
 
-#include "serial/serial.h"
+#include "Transport.h"
+#include "SerialRxBuffer.h"
+#include "FrameAssembler.h"
+#include "FrameRing.h"
+#include "FramePool.h"
 #include "SonarData.h"
+#include "Recorder.h"
 #include "SonarStructures.h"
+#include "Tvg.h"
+#include "LineDetector.h"
+#include "ChangeDetector.h"
+
+#if !defined(SCANSONAR_RING_SLOTS)
+#define SCANSONAR_RING_SLOTS 64U // Lines buffered between the serial reader and the processing thread
+#endif
+
+#if !defined(SCANSONAR_DETECTION_SLOTS)
+#define SCANSONAR_DETECTION_SLOTS 4096U // Detections buffered for ScansonarReadDetections, more than a turn
+#endif
+
+#if !defined(SCANSONAR_CHANGE_SLOTS)
+#define SCANSONAR_CHANGE_SLOTS 4096U // Change segments buffered for ScansonarReadChanges
+#endif
+
+#define SCANSONAR_MAX_LINE_SIZE 20400U   // Largest line received from the sonar, bytes
+#define SCANSONAR_RX_BUFFER_SIZE 65536U  // Receive buffer, keeps SCANSONAR_MAX_LINE_SIZE free for rescanning
+#define SCANSONAR_FULL_TURN_LINES 3200   // Lines per turn at stepping mode 1, header angle / 9
 
 enum class ThreadSSState { TSSState_Init, TSSState_Connecting, TSSState_Connected,
                            TSSState_Working, TSSState_SetSettings, TSSState_Disconnected
@@ -23,14 +48,69 @@ public:
 
     ThreadSonarSerial(ThreadSonarSerial &other) = delete;
 
-    ThreadSonarSerial(std::shared_ptr<serial::Serial> SerialPort, std::wstring filename = L"", std::function<void(char*, int)> cbfunc = [](char* line, int num) {});
-    ThreadSonarSerial(std::shared_ptr<serial::Serial> SerialPort, std::string filename = "", std::function<void(char*, int)> cbfunc = [](char* line, int num) {});
+    ThreadSonarSerial(std::shared_ptr<Transport> SonarTransport, std::wstring filename = L"", std::function<void(char*, int)> cbfunc = [](char* line, int num) {});
+    ThreadSonarSerial(std::shared_ptr<Transport> SonarTransport, std::string filename = "", std::function<void(char*, int)> cbfunc = [](char* line, int num) {});
 
     ~ThreadSonarSerial();
 
     ThreadSSState GetThreadState() const;
 
     uint16_t* GetSonarData() const;
+    std::shared_ptr<const SonarData> GetSonarImage() const;
+    uint32_t GetSonarImageGeneration() const;
+
+    /**
+     *   @brief Keep range-decimated levels in SonarData, the image is copied with the new pyramid
+     */
+    void SetSonarPyramid(int levels, DecimationMode mode);
+
+    /**
+     *   @brief Keep persistence of the polar image, the image is copied with the new persistence
+     */
+    void SetSonarPersistence(const PersistenceSettings &settings);
+
+    /**
+     *   @brief Compensate TVG and gain of the stored lines, the table is rebuilt on every settings change
+     *   @note  Applied to SonarData only, the line callback and the recording get the samples as received
+     */
+    void SetTvgCompensation(bool enabled, const TvgModel &model);
+
+    /**
+     *   @brief Sound speed of the TVG table, m/s, used from the next SetSonarParams
+     */
+    void SetSoundSpeed(float soundspeed);
+
+    /**
+     *   @brief Run the detector on every stored line, DtMode_Off stops it
+     *   @param callback - called by the processing thread with every detection, nullptr - ring only
+     */
+    void SetDetector(DetectMode mode, std::function<void(const Detection &)> callback);
+
+    /**
+     *   @brief Detector limits, used from the next SetSonarParams
+     *   @param threshold - fraction of the full scale
+     *   @param deadzone - m
+     *   @param range - m, 0 - whole line
+     */
+    void SetDetectorLimits(float threshold, float deadzone, float range);
+
+    LineDetector &GetDetector() const;
+
+    /**
+     *   @brief Run turn-to-turn change detection on every stored line, the background is learned again when enabled
+     *   @param settings - deadzone, sound speed and sample frequency are taken from the sonar settings
+     *   @param callback - called by the processing thread with the segments of a line, nullptr - ring only
+     */
+    void SetChangeDetection(const ChangeSettings &settings, std::function<void(const ChangeSegment *, std::size_t)> callback);
+
+    ChangeDetector &GetChangeDetector() const;
+
+    void SetFrameParseMode(FrameParseMode mode);
+    uint64_t GetFrameResyncCount() const;
+
+    const FrameRing &GetFrameRing() const;
+    const FramePool &GetFramePool() const;
+    Recorder &GetRecorder() const;
 
     void SetSonarParams();
     void SetSonarParams(const PDATAGCOMMONSONARPARAM pdcsp, const PDATAGSCANSONARPARAM pdssp);
@@ -38,24 +118,31 @@ public:
     ThreadSSState ThreadInit();
     ThreadSSState ThreadWorking();
 
+    void ProcessLine(uint8_t *linebuffer);
+
     ThreadSSState ThreadConnecting();
 
     ThreadSSState ThreadConnected();
     ThreadSSState ThreadSetSettings();
 
-    std::shared_ptr<serial::Serial> serialport;
+    std::shared_ptr<Transport> serialport;
     std::atomic<ThreadSSState> state;
 
     std::atomic<bool> threadkilled;
-    std::unique_ptr<std::thread> thread;
+    std::unique_ptr<std::thread> thread;        // Serial reader: protocol and line assembly
+    std::unique_ptr<std::thread> processthread; // Drains framering: decoding, storage and callback
+
+    std::unique_ptr<FrameRing> framering;
+    std::unique_ptr<FramePool> framepool;
 
     void KillThread() 
     { 
         threadkilled = true; 
         thread->join(); 
+        processthread->join();
     }
 
-    std::unique_ptr<std::ofstream> outputfile;
+    std::unique_ptr<Recorder> recorder;
     std::chrono::steady_clock::time_point keep_alive_counter;
 
     std::function<void(char*, int)> cb_dataready; // Call on data arrived / for preprocess
@@ -75,6 +162,16 @@ private:
     int MRS900_Reset();
     int MRS900_GetEndOrCmnd();
 
+    /**
+     *   @brief Wait until one of the tokens is received
+     *   @param tokens - tokens to wait for
+     *   @param timeoutms - overall deadline in milliseconds
+     *   @param onconsume - called with every received byte consumed while waiting (including the token)
+     *   @return index of the token received, -2 - timeout occured
+     */
+    int MRS900_WaitTokens(std::initializer_list<const char *> tokens, int64_t timeoutms,
+                          const std::function<void(const uint8_t *, std::size_t)> &onconsume = nullptr);
+
     int MRS900_Command2Work();
     int MRS900_Work2Command();
 
@@ -86,10 +183,51 @@ private:
     int MRS900_GetLine(uint8_t *linebuf);
     int MRS900_SendCommand(int command, void *param) const;
 
-    std::unique_ptr<SonarData> sonarData;
+    /**
+     *   @brief Replace SonarData when the geometry changes
+     *   @note  The image is kept when only the line length changes, a new number of lines starts an empty image
+     *   @note  The previous image is kept until the next change so pointers obtained just before stay valid
+     */
+    void ResizeSonarData(int samplesperline, int linesperfullturn);
+    void ReplaceSonarData(std::shared_ptr<SonarData> image); // sonardatalock is held
+
+    /**
+     *   @brief Build the TVG table from the current settings, the table is built without the lock
+     *   @note  The table is dropped when a newer build started or TVG was disabled meanwhile, see tvggeneration
+     */
+    void UpdateTvgTable();
+
+    /**
+     *   @brief Pass the limits, sound speed and sample frequency to the detector and the change detector
+     */
+    void UpdateDetectorSettings();
+
+    std::shared_ptr<SonarData> sonarData;
+    std::shared_ptr<SonarData> retiredData;   // Previous image, keeps raw pointers valid for one more replacement
+    mutable std::mutex sonardatalock;          // Guards sonarData and prev_angle against ResizeSonarData
+    std::atomic<uint32_t> sonardatageneration; // Incremented on every reallocation
+    int pyramidlevels;                         // Pyramid of every new image, guarded by sonardatalock
+    DecimationMode decimation;
+    PersistenceSettings persistence;           // Persistence of every new image, guarded by sonardatalock
+    bool tvgenabled;                           // TVG compensation, guarded by sonardatalock
+    TvgModel tvgmodel;
+    float soundspeed;
+    uint32_t tvggeneration;                    // Incremented when the TVG inputs change and on every build, guarded by sonardatalock
+    std::shared_ptr<const std::vector<uint16_t>> tvgtable; // Q8.8 gain of every sample, nullptr - disabled
+    DetectorSettings detectorsettings;         // Guarded by sonardatalock, the detector has its own copy
+    std::unique_ptr<LineDetector> detector;
+    ChangeSettings changesettings;             // Guarded by sonardatalock, the change detector has its own copy
+    std::unique_ptr<ChangeDetector> changedetector;
+    std::unique_ptr<SerialRxBuffer> rxbuffer;
+    std::unique_ptr<FrameAssembler> frameassembler;
 
     std::atomic<bool> params_updated;
 
     std::atomic<DATAGCOMMONSONARPARAM> dcsp;
     std::atomic<DATAGSCANSONARPARAM> dssp;
+
+    uint8_t *readerbuffer;                    // Pooled buffer owned by the serial reader
+    std::unique_ptr<uint8_t[]> scratchbuffer; // Receives lines while the pool is exhausted
+
+    int prev_angle; // Owned by the processing thread, in rows of sonarData
 };
@@ -0,0 +1,107 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+/**
+ *  @class TransportException
+ *  Thrown by transports when the link is lost or cannot be opened
+ */
+class TransportException : public std::runtime_error
+{
+public:
+
+    explicit TransportException(const std::string &what) :
+        std::runtime_error(what)
+    {
+    }
+};
+
+/**
+ *  @class Transport
+ *  Byte stream between the host and the sonar.
+ *
+ *  Read blocks until size bytes are received or the read timeout expires,
+ *  the same way serial::Serial does, so the protocol code is backend independent.
+ */
+class Transport
+{
+public:
+
+    virtual ~Transport()
+    {
+    }
+
+    /**
+     *   @brief Read up to size bytes
+     *   @return number of bytes read, less than size in case of timeout
+     */
+    virtual std::size_t Read(uint8_t *dst, std::size_t size) = 0;
+
+    /**
+     *   @brief Write size bytes
+     *   @return number of bytes written
+     */
+    virtual std::size_t Write(const uint8_t *src, std::size_t size) = 0;
+
+    std::size_t Write(const std::string &data)
+    {
+        return Write(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+    }
+
+    /**
+     *   @brief Number of bytes that can be read without blocking
+     */
+    virtual std::size_t Available() = 0;
+
+    /**
+     *   @brief Wait until bytes are available
+     *   @param timeoutms - longest wait, a backend may return earlier
+     *   @return true - bytes available or readiness is not known (Read waits itself), false - timeout
+     */
+    virtual bool WaitReadable(int64_t timeoutms) = 0;
+
+    virtual void Flush()
+    {
+    }
+
+    /**
+     *   @brief Descriptor to use in select()/poll() by the application, -1 if there is none
+     */
+    virtual intptr_t GetReadyFd() const
+    {
+        return -1;
+    }
+
+    /**
+     *   @brief Line rate of the sonar, used for autobaud and ping interval calculation
+     */
+    virtual uint32_t GetBaudrate() const = 0;
+
+    /**
+     *   @brief Passive transports only deliver recorded lines, the sonar handshake is skipped
+     */
+    virtual bool IsPassive() const
+    {
+        return false;
+    }
+
+    /**
+     *   @brief Open transport by URI
+     *
+     *   tcp://host:port  - TCP client, e.g. serial-to-Ethernet bridge
+     *   udp://host:port  - UDP, the same local port is bound to receive
+     *   file://path      - recorded lines, passive; file://path?speed=N sets the replay speed
+     *   loop://          - loopback, written bytes are read back
+     *   serial://path or path without scheme - serial port
+     *
+     *   @param baudrate - serial port baudrate; for network transports the line rate of the sonar behind the bridge
+     *   @param timeoutms - read timeout
+     *   @return transport, throws TransportException on failure
+     */
+    static std::shared_ptr<Transport> Open(const std::string &uri, uint32_t baudrate, uint32_t timeoutms);
+};
@@ -0,0 +1,79 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "KernelInfo.h"
+
+/**
+ *  Two-way spreading loss compensated by the host TVG
+ *  TSpreading_20LogR - volume backscatter, cylindrical spreading
+ *  TSpreading_30LogR - seabed imaging, between the two
+ *  TSpreading_40LogR - point targets, spherical spreading
+ */
+enum class TvgSpreading { TSpreading_20LogR, TSpreading_30LogR, TSpreading_40LogR };
+
+/**
+ *  Absorption compensated by the host TVG
+ *  TAbsorption_None  - spreading only
+ *  TAbsorption_Fixed - coefficient given in TvgModel
+ *  TAbsorption_Thorp - Thorp's sea water formula at the central frequency of the sonar
+ */
+enum class TvgAbsorption { TAbsorption_None, TAbsorption_Fixed, TAbsorption_Thorp };
+
+struct TvgModel
+{
+    TvgSpreading spreading;
+    TvgAbsorption absorption;
+    float absorptiondbkm;   // TAbsorption_Fixed, dB/km
+    bool aftersonartvg;     // The sonar TVG is kept up to tvg_time and the curve continues from there, otherwise from 1 m
+};
+
+/**
+ *  Sonar settings the gain table depends on
+ */
+struct TvgSonarSettings
+{
+    float samplefrequency;  // Hz
+    float soundspeed;       // m/s
+    float centralfrequency; // Hz, 0 - unknown, Thorp absorption is not applied
+    float gain;             // dB, gain of the sonar, removed by the table
+    float tvgtime;          // ms, end of the sonar TVG
+};
+
+// Gain of one range bin, Q8.8: 256 is 0 dB, the largest is 0x7FFF (+42 dB)
+constexpr uint16_t TVG_GAIN_ONE = 256;
+constexpr uint16_t TVG_GAIN_MAX = 0x7FFF;
+
+// Compensated samples are saturated to the 12-bit range of the uncompanded samples
+constexpr uint16_t TVG_SAMPLE_MAX = 4095;
+
+struct TvgKernels
+{
+    void (*apply)(uint16_t *samples, const uint16_t *gain, std::size_t count);
+};
+
+/**
+ *   @brief Gain of every range bin: spreading and absorption from the reference range, less the sonar gain
+ *   @param samples - range bins in the table
+ */
+std::vector<uint16_t> Tvg_BuildTable(const TvgModel &model, const TvgSonarSettings &settings, int samples);
+
+/**
+ *   @brief Multiply samples by the gain table in place, rounded and saturated to TVG_SAMPLE_MAX
+ *   @param gain - Q8.8 gain of every sample
+ */
+void Tvg_Apply(uint16_t *samples, const uint16_t *gain, std::size_t count);
+
+/**
+ *   @brief Name of the kernel selected for this CPU: "avx2", "sse2", "neon" or "scalar"
+ */
+const char *Tvg_KernelName();
+
+/**
+ *   @brief Every TVG kernel, each must match the scalar one bit for bit for gains up to TVG_GAIN_MAX
+ */
+template<>
+const std::vector<KernelInfo<TvgKernels>> &Kernel_GetAll<TvgKernels>();
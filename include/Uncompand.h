@@ -0,0 +1,36 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "KernelInfo.h"
+
+struct UncompandKernels
+{
+    void (*line)(const uint8_t *src, uint16_t *dst, std::size_t count);
+};
+
+/**
+ *   @brief Convert 8-bit companded samples received from the sonar to 12-bit amplitude
+ *   @param src - companded samples
+ *   @param dst - amplitudes, count values are written
+ */
+void Uncompand_Line(const uint8_t *src, uint16_t *dst, std::size_t count);
+
+/**
+ *   @brief Name of the kernel selected for this CPU: "avx2", "ssse3", "neon" or "scalar"
+ */
+const char *Uncompand_KernelName();
+
+/**
+ *   @brief Amplitude of one companded sample, the reference every kernel must match
+ */
+uint16_t Uncompand_Sample(uint8_t sample);
+
+/**
+ *   @brief Every uncompand kernel, each must match Uncompand_Sample()
+ */
+template<>
+const std::vector<KernelInfo<UncompandKernels>> &Kernel_GetAll<UncompandKernels>();
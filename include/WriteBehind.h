@@ -0,0 +1,158 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ *  What the producer does when every buffer is waiting for the disk
+ *
+ *  BPolicy_Drop - the frame is dropped and counted, the producer never waits for the file
+ *  BPolicy_Wait - the producer waits for a buffer, nothing is lost but the caller stalls with the disk
+ */
+enum class BacklogPolicy { BPolicy_Drop, BPolicy_Wait };
+
+struct WriteBehindStats
+{
+    uint32_t capacity;      // buffers between the producer and the disk
+    uint32_t queued;        // full buffers waiting for the disk
+    uint32_t highwater;     // maximum of queued
+    uint64_t frames;        // frames accepted
+    uint64_t dropped;       // frames dropped by BPolicy_Drop
+    uint64_t bytes;         // bytes written to the file
+    uint64_t writes;        // write calls, one per buffer
+    uint64_t latencyus;     // total time spent in write calls, us
+    uint64_t maxlatencyus;  // longest write call, us
+    uint64_t errors;        // failed write calls, the data of the buffer is lost
+    bool direct;            // written with O_DIRECT, bypassing the page cache
+};
+
+/**
+ *  @class WriteBehind
+ *  Sequential file written by a background thread from a fixed pool of large aligned buffers.
+ *
+ *  The producer only copies frames into the open buffer. Full buffers are written by the writer thread
+ *  with one pwrite each; on Linux the file is opened with O_DIRECT when the file system supports it,
+ *  so buffers are written at aligned offsets and do not fill the page cache. Elsewhere buffers are
+ *  written through a stream. A slow or stalled disk (SD card, network share) only fills the pool,
+ *  then the backlog policy applies to whole frames.
+ *
+ *  One producer thread; policy and statistics can be used from any thread.
+ */
+class WriteBehind final
+{
+public:
+    // O_DIRECT alignment of buffer addresses, sizes and file offsets
+    static constexpr std::size_t BUFFER_ALIGNMENT = 4096;
+
+    static constexpr std::size_t DEFAULT_BUFFER_BYTES = 1U << 20;
+    static constexpr int DEFAULT_BUFFERS = 8;
+
+    /**
+     *   @param bufferbytes - rounded up to BUFFER_ALIGNMENT
+     *   @param direct - false: never bypass the page cache
+     */
+    explicit WriteBehind(const std::string &filename, std::size_t bufferbytes = DEFAULT_BUFFER_BYTES,
+                         int buffers = DEFAULT_BUFFERS, bool direct = true);
+#if !defined (__linux__)
+    explicit WriteBehind(const std::wstring &filename, std::size_t bufferbytes = DEFAULT_BUFFER_BYTES,
+                         int buffers = DEFAULT_BUFFERS, bool direct = true);
+#endif
+
+    /**
+     *   @brief Write the open buffer and wait for the queued ones
+     */
+    ~WriteBehind();
+
+    WriteBehind(const WriteBehind &other) = delete;
+    WriteBehind &operator=(const WriteBehind &other) = delete;
+
+    bool IsOpen() const;
+
+    void SetPolicy(BacklogPolicy policy);
+    BacklogPolicy GetPolicy() const;
+
+    /**
+     *   @brief Producer: append a frame made of header and data, a frame is written whole or not at all
+     *   @return false - the frame was dropped, the file is not open or BPolicy_Drop found no room
+     */
+    bool WriteFrame(const void *header, std::size_t headersize, const void *data, std::size_t datasize);
+
+    WriteBehindStats GetStats() const;
+
+private:
+
+    struct Buffer
+    {
+        std::unique_ptr<uint8_t[]> storage;
+        uint8_t *data;                      // storage aligned to BUFFER_ALIGNMENT
+        std::size_t used;
+    };
+
+    WriteBehind(std::size_t bufferbytes, int buffers);
+
+    /**
+     *   @brief Allocate the buffers and start the writer thread once the file is open
+     */
+    void Start();
+
+    /**
+     *   @brief Copy bytes into the open buffer, full buffers are queued to the writer thread
+     *   @param lock - held on queuelock, released while copying
+     */
+    void Append(const uint8_t *src, std::size_t size, std::unique_lock<std::mutex> &lock);
+
+    void WriterThread();
+
+    /**
+     *   @brief Writer thread: write the buffer at fileoffset
+     *   @return false - the write failed
+     */
+    bool WriteBuffer(const Buffer &buffer);
+
+    std::size_t bufferbytes;
+    int bufferscount;
+
+#if defined( _WIN32 )
+    std::unique_ptr<std::ofstream> stream;
+#else
+    int fd;
+#endif
+
+    std::vector<Buffer> buffers;
+
+    std::mutex queuelock;                   // Guards queue, freebuffers and stopping
+    std::condition_variable queuecv;        // Writer thread: a buffer is queued
+    std::condition_variable freecv;         // Producer: a buffer is free
+    std::deque<Buffer *> queue;
+    std::vector<Buffer *> freebuffers;
+    bool stopping;
+    std::unique_ptr<std::thread> thread;
+
+    // Producer
+    Buffer *current;
+
+    // Writer thread
+    uint64_t fileoffset;
+
+    std::atomic<BacklogPolicy> policy;
+    std::atomic<bool> direct;
+    std::atomic<uint32_t> queued;
+    std::atomic<uint32_t> highwater;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> latencyus;
+    std::atomic<uint64_t> maxlatencyus;
+    std::atomic<uint64_t> errors;
+};
@@ -48,6 +48,17 @@ namespace
             outbuf[i * 4] = 0; // Make sure out string is NULL-terminated
         }
     }
+
+    int decodechar(char ch)
+    {
+        if ((ch >= 'A') && (ch <= 'Z')) return ch - 'A';
+        if ((ch >= 'a') && (ch <= 'z')) return ch - 'a' + 26;
+        if ((ch >= '0') && (ch <= '9')) return ch - '0' + 52;
+        if ('+' == ch) return 62;
+        if ('/' == ch) return 63;
+
+        return -1;
+    }
 }
 
 B64Encode::B64Encode(const void *data, std::size_t datasize, const std::string &extra)
@@ -58,6 +69,56 @@ B64Encode::B64Encode(const void *data, std::size_t datasize, const std::string &
     b64data = b64data + extra;
 }
 
+std::size_t B64Encode::Encode(const void *data, std::size_t datasize, char *out, std::size_t outsize)
+{
+    if (outsize < EncodedSize(datasize) + 1)
+    {
+        return 0;
+    }
+
+    b64encode(reinterpret_cast<const uint8_t *>(data), static_cast<uint16_t>(datasize), reinterpret_cast<uint8_t *>(out));
+
+    return EncodedSize(datasize);
+}
+
+std::size_t B64Encode::Decode(const std::string &text, void *out, std::size_t outsize)
+{
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(out);
+    uint32_t accumulator = 0;
+    int bits = 0;
+    std::size_t count = 0;
+
+    for (char ch : text)
+    {
+        if ('=' == ch)
+        {
+            break;
+        }
+
+        int value = decodechar(ch);
+
+        if (value < 0)
+        {
+            continue;
+        }
+
+        accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+
+        if (bits >= 8)
+        {
+            bits -= 8;
+
+            if (count < outsize)
+            {
+                bytes[count++] = static_cast<uint8_t>(accumulator >> bits);
+            }
+        }
+    }
+
+    return count;
+}
+
 B64Encode::~B64Encode()
 {
 }
@@ -0,0 +1,441 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "BlockReader.h"
+#include "Crc32.h"
+#include "FrameScanner.h"
+#include "LzCodec.h"
+
+namespace
+{
+    // Larger blocks are taken as damaged headers, BlockRecorder writes BLOCK_BYTES plus a line at most
+    constexpr uint32_t MAX_BLOCK_RAW_SIZE = 64U << 20;
+}
+
+BlockReader::BlockReader(const std::string &filename) :
+    filename(filename),
+    file(filename, std::ifstream::binary | std::ifstream::ate),
+    filesize(0),
+    opened(false),
+    indexed(false),
+    turnscount(0),
+    rawbytes(0)
+{
+    if (false == file.is_open())
+    {
+        return;
+    }
+
+    filesize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    BlockFileHeader header;
+
+    if ((filesize < sizeof(header)) || (false == file.read(reinterpret_cast<char *>(&header), sizeof(header)).good()))
+    {
+        return;
+    }
+
+    if ((BLOCK_FILE_MAGIC != header.magic) || (BLOCK_FILE_VERSION != header.version))
+    {
+        return;
+    }
+
+    opened = true;
+    indexed = ReadIndex();
+
+    if (false == indexed)
+    {
+        RebuildIndex();
+    }
+
+    timestampruns = Recording_TimestampRuns(index);
+
+    for (const BlockLineEntry &entry : index)
+    {
+        rawbytes += entry.size;
+    }
+}
+
+BlockReader::~BlockReader()
+{
+}
+
+bool BlockReader::IsOpen() const
+{
+    return opened;
+}
+
+bool BlockReader::IsIndexed() const
+{
+    return indexed;
+}
+
+std::size_t BlockReader::GetBlocksCount() const
+{
+    return blocks.size();
+}
+
+std::size_t BlockReader::GetLinesCount() const
+{
+    return index.size();
+}
+
+uint32_t BlockReader::GetTurnsCount() const
+{
+    return turnscount;
+}
+
+uint64_t BlockReader::GetRawBytes() const
+{
+    return rawbytes;
+}
+
+uint64_t BlockReader::GetFileSize() const
+{
+    return filesize;
+}
+
+const BlockIndexEntry &BlockReader::GetBlock(std::size_t block) const
+{
+    return blocks.at(block);
+}
+
+const BlockLineEntry &BlockReader::GetLine(std::size_t line) const
+{
+    return index.at(line);
+}
+
+bool BlockReader::ReadIndex()
+{
+    BlockFileTrailer trailer;
+
+    if (filesize < sizeof(BlockFileHeader) + sizeof(trailer))
+    {
+        return false;
+    }
+
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(filesize - sizeof(trailer)));
+
+    if ((false == file.read(reinterpret_cast<char *>(&trailer), sizeof(trailer)).good()) || (BLOCK_INDEX_MAGIC != trailer.magic))
+    {
+        return false;
+    }
+
+    uint64_t indexend = filesize - sizeof(trailer);
+
+    if ((trailer.indexoffset < sizeof(BlockFileHeader)) || (trailer.indexoffset > indexend) ||
+        (trailer.linescount > indexend / sizeof(BlockLineEntry)) ||
+        (trailer.blockscount * sizeof(BlockIndexEntry) + trailer.linescount * sizeof(BlockLineEntry) != indexend - trailer.indexoffset))
+    {
+        return false;
+    }
+
+    std::vector<BlockIndexEntry> readblocks(trailer.blockscount);
+    std::vector<BlockLineEntry> readindex(static_cast<std::size_t>(trailer.linescount));
+
+    file.seekg(static_cast<std::streamoff>(trailer.indexoffset));
+    file.read(reinterpret_cast<char *>(readblocks.data()), readblocks.size() * sizeof(BlockIndexEntry));
+    file.read(reinterpret_cast<char *>(readindex.data()), readindex.size() * sizeof(BlockLineEntry));
+
+    if (false == file.good())
+    {
+        return false;
+    }
+
+    uint32_t crc = Crc32_ComputeBuf(0, readblocks.data(), readblocks.size() * sizeof(BlockIndexEntry));
+    crc = Crc32_ComputeBuf(crc, readindex.data(), readindex.size() * sizeof(BlockLineEntry));
+
+    if (crc != trailer.indexcrc)
+    {
+        return false;
+    }
+
+    for (const BlockIndexEntry &entry : readblocks)
+    {
+        if ((entry.offset >= trailer.indexoffset) || (static_cast<uint64_t>(entry.firstline) + entry.lines > readindex.size()))
+        {
+            return false;
+        }
+    }
+
+    for (const BlockLineEntry &entry : readindex)
+    {
+        if (entry.block >= readblocks.size())
+        {
+            return false;
+        }
+    }
+
+    blocks = std::move(readblocks);
+    index = std::move(readindex);
+    turnscount = trailer.turnscount;
+
+    return true;
+}
+
+void BlockReader::RebuildIndex()
+{
+    blocks.clear();
+    index.clear();
+
+    uint64_t offset = sizeof(BlockFileHeader);
+    uint32_t turn = 0;
+    int prevangle = -1;
+
+    BlockHeader header;
+    std::vector<uint8_t> stored;
+    std::vector<uint8_t> data;
+    std::vector<BlockLineEntry> lines;
+
+    while ((offset + sizeof(BlockHeader) <= filesize) && (false != ReadBlock(file, offset, header, stored, data)))
+    {
+        lines.clear();
+
+        std::size_t position = 0;
+
+        while (data.size() - position >= sizeof(DATAHEADERV3) + sizeof(DATAFOOTER))
+        {
+            DATAHEADERV3 dh;
+            DATAFOOTER df;
+
+            std::memcpy(&dh, &data[position], sizeof(dh));
+
+            if ((FRAME_MAGIC_DATA != dh.magic) || (dh.samples < sizeof(DATAHEADERV3) + sizeof(DATAFOOTER)) ||
+                (dh.samples > data.size() - position))
+            {
+                break;
+            }
+
+            std::memcpy(&df, &data[position + dh.samples - sizeof(DATAFOOTER)], sizeof(df));
+
+            int angle = static_cast<int>((dh.angle / 9) % RECORDING_TURN_LINES);
+
+            turn = Recording_NextTurn(turn, prevangle, angle);
+            prevangle = angle;
+
+            lines.push_back({ df.timestamp, turn, static_cast<uint32_t>(blocks.size()), static_cast<uint32_t>(position), dh.samples,
+                              static_cast<uint16_t>(angle), 0 });
+
+            position += dh.samples;
+        }
+
+        if ((position != data.size()) || (lines.size() != header.lines))
+        {
+            break;
+        }
+
+        blocks.push_back({ offset, static_cast<uint32_t>(index.size()), header.lines });
+        index.insert(index.end(), lines.begin(), lines.end());
+
+        offset += sizeof(BlockHeader) + header.storedsize;
+    }
+
+    turnscount = (false == index.empty()) ? index.back().turn + 1 : 0;
+}
+
+bool BlockReader::ReadBlock(std::ifstream &stream, uint64_t offset, BlockHeader &header, std::vector<uint8_t> &stored,
+                            std::vector<uint8_t> &data) const
+{
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(offset));
+
+    if ((offset + sizeof(header) > filesize) || (false == stream.read(reinterpret_cast<char *>(&header), sizeof(header)).good()))
+    {
+        return false;
+    }
+
+    if ((BLOCK_MAGIC != header.magic) || (header.storedsize > filesize - offset - sizeof(header)) ||
+        (header.rawsize > MAX_BLOCK_RAW_SIZE))
+    {
+        return false;
+    }
+
+    data.resize(header.rawsize);
+
+    if (BLOCK_CODEC_STORED == header.codec)
+    {
+        if ((header.storedsize != header.rawsize) ||
+            (false == stream.read(reinterpret_cast<char *>(data.data()), header.rawsize).good()) ||
+            (Crc32_ComputeBuf(0, data.data(), data.size()) != header.storedcrc))
+        {
+            return false;
+        }
+    }
+    else if (BLOCK_CODEC_LZ == header.codec)
+    {
+        stored.resize(header.storedsize);
+
+        if ((false == stream.read(reinterpret_cast<char *>(stored.data()), header.storedsize).good()) ||
+            (Crc32_ComputeBuf(0, stored.data(), stored.size()) != header.storedcrc) ||
+            (false == Lz_Decompress(stored.data(), stored.size(), data.data(), data.size())))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return Crc32_ComputeBuf(0, data.data(), data.size()) == header.rawcrc;
+}
+
+bool BlockReader::ReadBlock(std::size_t block, std::vector<uint8_t> &data)
+{
+    if (block >= blocks.size())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(filelock);
+
+    BlockHeader header;
+    std::vector<uint8_t> stored;
+
+    return (false != ReadBlock(file, blocks[block].offset, header, stored, data)) && (header.lines == blocks[block].lines);
+}
+
+int64_t BlockReader::FindTimestamp(uint32_t timestamp) const
+{
+    std::size_t found = Recording_SeekTimestamp(index, timestampruns, timestamp);
+
+    return (index.size() == found) ? -1 : static_cast<int64_t>(found);
+}
+
+int64_t BlockReader::FindAngle(uint32_t turn, uint16_t angle) const
+{
+    auto first = std::lower_bound(index.begin(), index.end(), turn,
+                                  [](const BlockLineEntry &entry, uint32_t value) { return entry.turn < value; });
+    auto last = std::upper_bound(first, index.end(), turn,
+                                 [](uint32_t value, const BlockLineEntry &entry) { return value < entry.turn; });
+
+    int64_t found = -1;
+    int best = RECORDING_TURN_LINES;
+
+    for (auto it = first; it != last; ++it)
+    {
+        int distance = std::abs(static_cast<int>(it->angle) - static_cast<int>(angle % RECORDING_TURN_LINES));
+        distance = std::min(distance, RECORDING_TURN_LINES - distance);
+
+        if (distance < best)
+        {
+            best = distance;
+            found = static_cast<int64_t>(it - index.begin());
+        }
+    }
+
+    return found;
+}
+
+std::size_t BlockReader::DecodeBlocks(std::size_t first, std::size_t count, int threads,
+                                      const std::function<void(std::size_t, const uint8_t *, std::size_t)> &callback)
+{
+    if (first >= blocks.size())
+    {
+        return 0;
+    }
+
+    std::size_t end = first + std::min(count, blocks.size() - first);
+
+    if (threads <= 0)
+    {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    threads = static_cast<int>(std::min(static_cast<std::size_t>(threads), end - first));
+
+    std::atomic<std::size_t> next(first);
+    std::atomic<std::size_t> decoded(0);
+
+    auto worker = [&]()
+    {
+        std::ifstream stream(filename, std::ifstream::binary);
+
+        BlockHeader header;
+        std::vector<uint8_t> stored;
+        std::vector<uint8_t> data;
+
+        for (std::size_t block = next++; block < end; block = next++)
+        {
+            if ((false != ReadBlock(stream, blocks[block].offset, header, stored, data)) && (header.lines == blocks[block].lines))
+            {
+                callback(block, data.data(), data.size());
+                decoded++;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+    {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+
+    return decoded;
+}
+
+std::size_t BlockReader::ReadLines(std::size_t first, std::size_t count, uint8_t *dst, std::size_t size, int threads)
+{
+    if ((first >= index.size()) || (0 == count) || (nullptr == dst))
+    {
+        return 0;
+    }
+
+    std::size_t end = first + std::min(count, index.size() - first);
+    std::size_t firstblock = index[first].block;
+    std::size_t lastblock = index[end - 1].block;
+
+    // Lines of a block are contiguous in the block and in dst: one copy a block
+    std::vector<std::size_t> dstoffset(lastblock - firstblock + 1, 0);
+    std::size_t total = 0;
+
+    for (std::size_t line = first; line < end; line++)
+    {
+        if ((line == first) || (index[line].block != index[line - 1].block))
+        {
+            dstoffset[index[line].block - firstblock] = total;
+        }
+
+        total += index[line].size;
+    }
+
+    if (total > size)
+    {
+        return 0;
+    }
+
+    std::atomic<bool> damaged(false);
+
+    std::size_t decoded = DecodeBlocks(firstblock, lastblock - firstblock + 1, threads,
+                                       [&](std::size_t block, const uint8_t *data, std::size_t datasize)
+    {
+        std::size_t lo = std::max<std::size_t>(first, blocks[block].firstline);
+        std::size_t hi = std::min<std::size_t>(end, blocks[block].firstline + blocks[block].lines) - 1;
+        std::size_t start = index[lo].offset;
+        std::size_t stop = static_cast<std::size_t>(index[hi].offset) + index[hi].size;
+
+        if ((stop > datasize) || (start > stop) || (dstoffset[block - firstblock] + stop - start > total))
+        {
+            damaged = true;
+            return;
+        }
+
+        std::memcpy(&dst[dstoffset[block - firstblock]], &data[start], stop - start);
+    });
+
+    return ((decoded == lastblock - firstblock + 1) && (false == damaged)) ? total : 0;
+}
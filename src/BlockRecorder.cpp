@@ -0,0 +1,306 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <cstring>
+
+#include "BlockRecorder.h"
+#include "Crc32.h"
+#include "LzCodec.h"
+
+BlockRecorder::BlockRecorder(std::unique_ptr<WriteBehind> Writer) :
+    writer(std::move(Writer)),
+    stopping(false),
+    turn(0),
+    prevangle(-1),
+    fileoffset(0),
+    policy(BacklogPolicy::BPolicy_Drop),
+    highwater(0),
+    linescount(0),
+    droppedcount(0),
+    blockscount(0),
+    rawbytes(0),
+    storedbytes(0)
+{
+    if (false == IsOpen())
+    {
+        return;
+    }
+
+    // Blocks are allocated once, Write does not allocate
+    for (int i = 0; i < BLOCK_BUFFERS; i++)
+    {
+        auto block = std::make_unique<PendingBlock>();
+
+        block->data.reserve(BLOCK_BYTES);
+        block->lines.reserve(BLOCK_BYTES / (sizeof(DATAHEADERV3) + sizeof(DATAFOOTER)));
+
+        freeblocks.push_back(std::move(block));
+    }
+
+    // The recorder thread is the only producer of the writer, it may wait for the disk
+    writer->SetPolicy(BacklogPolicy::BPolicy_Wait);
+
+    BlockFileHeader header = { BLOCK_FILE_MAGIC, BLOCK_FILE_VERSION, static_cast<uint32_t>(BLOCK_BYTES), 0 };
+
+    writer->WriteFrame(&header, sizeof(header), nullptr, 0);
+    fileoffset = sizeof(header);
+
+    thread = std::make_unique<std::thread>(&BlockRecorder::RecorderThread, this);
+}
+
+BlockRecorder::~BlockRecorder()
+{
+    if (nullptr == thread)
+    {
+        return;
+    }
+
+    if ((nullptr != current) && (false == current->lines.empty()))
+    {
+        SubmitBlock();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queuelock);
+        stopping = true;
+    }
+
+    queuecv.notify_all();
+    thread->join();
+
+    WriteIndex();
+
+    // Waits for the file
+    writer.reset();
+}
+
+bool BlockRecorder::IsOpen() const
+{
+    return (nullptr != writer) && (false != writer->IsOpen());
+}
+
+void BlockRecorder::Write(const uint8_t *line)
+{
+    if (false == IsOpen())
+    {
+        return;
+    }
+
+    const DATAHEADER *pdh = reinterpret_cast<const DATAHEADER *>(line);
+
+    DATAHEADERV3 dhv3 = ConvertHeader(line);
+
+    DATAFOOTER footer;
+    std::memcpy(&footer, &line[pdh->samples - sizeof(DATAFOOTER)], sizeof(DATAFOOTER));
+
+    // Dropped lines still count for the turn
+    int angle = static_cast<int>((dhv3.angle / 9) % RECORDING_TURN_LINES);
+
+    turn = Recording_NextTurn(turn, prevangle, angle);
+    prevangle = angle;
+
+    if ((nullptr != current) && (false == current->lines.empty()) && (current->data.size() + dhv3.samples > BLOCK_BYTES))
+    {
+        SubmitBlock();
+    }
+
+    if (nullptr == current)
+    {
+        std::unique_lock<std::mutex> lock(queuelock);
+
+        if (BacklogPolicy::BPolicy_Wait == policy)
+        {
+            freecv.wait(lock, [this]() { return (false == freeblocks.empty()) || (BacklogPolicy::BPolicy_Wait != policy); });
+        }
+
+        if (false == freeblocks.empty())
+        {
+            current = std::move(freeblocks.back());
+            freeblocks.pop_back();
+        }
+    }
+
+    if (nullptr == current)
+    {
+        // Recorder thread is BLOCK_BUFFERS blocks behind
+        droppedcount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    BlockLineEntry entry = { footer.timestamp, turn, 0, static_cast<uint32_t>(current->data.size()), dhv3.samples,
+                             static_cast<uint16_t>(angle), 0 };
+
+    const uint8_t *header = reinterpret_cast<const uint8_t *>(&dhv3);
+
+    current->data.insert(current->data.end(), header, header + sizeof(DATAHEADERV3));
+    current->data.insert(current->data.end(), &line[pdh->dataoffset], &line[pdh->samples]);
+    current->lines.push_back(entry);
+
+    linescount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BlockRecorder::SubmitBlock()
+{
+    {
+        std::lock_guard<std::mutex> lock(queuelock);
+        queue.push_back(std::move(current));
+
+        if (queue.size() > highwater)
+        {
+            highwater = static_cast<uint32_t>(queue.size());
+        }
+    }
+
+    queuecv.notify_one();
+}
+
+void BlockRecorder::RecorderThread()
+{
+    std::vector<uint8_t> stored(Lz_CompressBound(BLOCK_BYTES));
+
+    for (;;)
+    {
+        std::unique_ptr<PendingBlock> block;
+
+        {
+            std::unique_lock<std::mutex> lock(queuelock);
+            queuecv.wait(lock, [this]() { return (false == queue.empty()) || (false != stopping); });
+
+            // Queued blocks are written before stopping
+            if (false != queue.empty())
+            {
+                break;
+            }
+
+            block = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        WriteBlock(*block, stored);
+
+        block->data.clear();
+        block->lines.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(queuelock);
+            freeblocks.push_back(std::move(block));
+        }
+
+        freecv.notify_one();
+    }
+}
+
+void BlockRecorder::WriteBlock(PendingBlock &block, std::vector<uint8_t> &stored)
+{
+    std::size_t rawsize = block.data.size();
+
+    if (stored.size() < rawsize)
+    {
+        stored.resize(Lz_CompressBound(rawsize));
+    }
+
+    // Compressed data larger than the lines is not kept
+    std::size_t storedsize = Lz_Compress(block.data.data(), rawsize, stored.data(), rawsize);
+    const uint8_t *payload = stored.data();
+    uint32_t codec = BLOCK_CODEC_LZ;
+
+    if (0 == storedsize)
+    {
+        payload = block.data.data();
+        storedsize = rawsize;
+        codec = BLOCK_CODEC_STORED;
+    }
+
+    BlockHeader header = { BLOCK_MAGIC, codec, static_cast<uint32_t>(rawsize), static_cast<uint32_t>(storedsize),
+                           static_cast<uint32_t>(block.lines.size()), Crc32_ComputeBuf(0, block.data.data(), rawsize),
+                           Crc32_ComputeBuf(0, payload, storedsize), 0 };
+
+    writer->WriteFrame(&header, sizeof(header), payload, storedsize);
+
+    uint32_t number = static_cast<uint32_t>(blocks.size());
+
+    blocks.push_back({ fileoffset, static_cast<uint32_t>(index.size()), header.lines });
+
+    for (BlockLineEntry entry : block.lines)
+    {
+        entry.block = number;
+        index.push_back(entry);
+    }
+
+    fileoffset += sizeof(header) + storedsize;
+
+    blockscount.fetch_add(1, std::memory_order_relaxed);
+    rawbytes.fetch_add(rawsize, std::memory_order_relaxed);
+    storedbytes.fetch_add(sizeof(header) + storedsize, std::memory_order_relaxed);
+}
+
+void BlockRecorder::WriteIndex()
+{
+    std::size_t blocksize = blocks.size() * sizeof(BlockIndexEntry);
+    std::size_t indexsize = index.size() * sizeof(BlockLineEntry);
+
+    BlockFileTrailer trailer = { BLOCK_INDEX_MAGIC, static_cast<uint32_t>(blocks.size()), index.size(), fileoffset, 0,
+                                 (false == index.empty()) ? index.back().turn + 1 : 0 };
+
+    trailer.indexcrc = Crc32_ComputeBuf(0, blocks.data(), blocksize);
+    trailer.indexcrc = Crc32_ComputeBuf(trailer.indexcrc, index.data(), indexsize);
+
+    writer->WriteFrame(blocks.data(), blocksize, index.data(), indexsize);
+    writer->WriteFrame(&trailer, sizeof(trailer), nullptr, 0);
+}
+
+void BlockRecorder::SetBacklogPolicy(BacklogPolicy policy)
+{
+    {
+        std::lock_guard<std::mutex> lock(queuelock);
+        this->policy = policy;
+    }
+
+    // Releases Write waiting for a block
+    freecv.notify_all();
+}
+
+WriteBehindStats BlockRecorder::GetStats() const
+{
+    if (nullptr == writer)
+    {
+        return WriteBehindStats();
+    }
+
+    WriteBehindStats stats = writer->GetStats();
+
+    {
+        std::lock_guard<std::mutex> lock(queuelock);
+        stats.queued = static_cast<uint32_t>(queue.size());
+    }
+
+    stats.capacity = BLOCK_BUFFERS;
+    stats.highwater = highwater;
+    stats.frames = linescount;
+    stats.dropped = droppedcount;
+
+    return stats;
+}
+
+uint64_t BlockRecorder::GetLinesCount() const
+{
+    return linescount;
+}
+
+uint64_t BlockRecorder::GetDroppedCount() const
+{
+    return droppedcount;
+}
+
+uint64_t BlockRecorder::GetBlocksCount() const
+{
+    return blockscount;
+}
+
+uint64_t BlockRecorder::GetRawBytes() const
+{
+    return rawbytes;
+}
+
+uint64_t BlockRecorder::GetStoredBytes() const
+{
+    return storedbytes;
+}
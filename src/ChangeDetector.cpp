@@ -0,0 +1,358 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cmath>
+
+#include "BitScan.h"
+#include "CpuFeatures.h"
+#include "SampleRange.h"
+#include "Persistence.h"
+#include "ChangeDetector.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(CPUFEATURES_NEON)
+#include <arm_neon.h>
+#endif
+
+constexpr int ChangeDetector::MAX_LINE_SEGMENTS;
+
+namespace
+{
+    void MaskScalar(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask)
+    {
+        for (int i = 0; i < count; i += 32)
+        {
+            uint32_t bits = 0;
+            int last = std::min(32, count - i);
+
+            for (int j = 0; j < last; j++)
+            {
+                bits |= (samples[i + j] > background[i + j] + threshold) ? (1U << j) : 0U;
+            }
+
+            mask[i / 32] = bits;
+        }
+    }
+
+#if defined(CPUFEATURES_X86)
+    // (x - background) - threshold saturates to 0 for unchanged samples, the compare with 0 marks them
+    CPUFEATURES_TARGET("sse2")
+    uint32_t UnchangedSSE2(const uint16_t *samples, const uint16_t *background, __m128i threshold)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[0]));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[8]));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&background[0]));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&background[8]));
+
+        __m128i u0 = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_subs_epu16(x0, b0), threshold), zero);
+        __m128i u1 = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_subs_epu16(x1, b1), threshold), zero);
+
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(u0, u1)));
+    }
+
+    CPUFEATURES_TARGET("sse2")
+    void MaskSSE2(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask)
+    {
+        const __m128i t = _mm_set1_epi16(static_cast<short>(threshold));
+
+        int i = 0;
+
+        for (; i + 32 <= count; i += 32)
+        {
+            uint32_t unchanged = UnchangedSSE2(&samples[i], &background[i], t) |
+                                 (UnchangedSSE2(&samples[i + 16], &background[i + 16], t) << 16);
+
+            mask[i / 32] = ~unchanged;
+        }
+
+        MaskScalar(&samples[i], &background[i], count - i, threshold, &mask[i / 32]);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void MaskAVX2(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask)
+    {
+        const __m256i t = _mm256_set1_epi16(static_cast<short>(threshold));
+        const __m256i zero = _mm256_setzero_si256();
+
+        int i = 0;
+
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i]));
+            __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i + 16]));
+            __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&background[i]));
+            __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&background[i + 16]));
+
+            __m256i u0 = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_subs_epu16(x0, b0), t), zero);
+            __m256i u1 = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_subs_epu16(x1, b1), t), zero);
+
+            // Pack works inside 128-bit lanes, the permute puts the samples back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(u0, u1), 0xD8);
+
+            mask[i / 32] = ~static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+        }
+
+        MaskScalar(&samples[i], &background[i], count - i, threshold, &mask[i / 32]);
+    }
+#endif
+
+#if defined(CPUFEATURES_NEON)
+    void MaskNEON(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask)
+    {
+        static const uint8_t weights[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+
+        const uint16x8_t t = vdupq_n_u16(threshold);
+        const uint8x8_t w = vld1_u8(weights);
+
+        int i = 0;
+
+        for (; i + 32 <= count; i += 32)
+        {
+            uint32_t bits = 0;
+
+            for (int j = 0; j < 32; j += 8)
+            {
+                uint16x8_t d = vqsubq_u16(vqsubq_u16(vld1q_u16(&samples[i + j]), vld1q_u16(&background[i + j])), t);
+                uint8x8_t changed = vand_u8(vmovn_u16(vcgtq_u16(d, vdupq_n_u16(0))), w);
+
+                bits |= static_cast<uint32_t>(vaddv_u8(changed)) << j;
+            }
+
+            mask[i / 32] = bits;
+        }
+
+        MaskScalar(&samples[i], &background[i], count - i, threshold, &mask[i / 32]);
+    }
+#endif
+
+    const KernelInfo<ChangeKernels> &GetDispatch()
+    {
+        static const KernelInfo<ChangeKernels> dispatch = Kernel_Select<ChangeKernels>();
+        return dispatch;
+    }
+}
+
+void Change_Mask(const uint16_t *samples, const uint16_t *background, int count, uint16_t threshold, uint32_t *mask)
+{
+    GetDispatch().functions.mask(samples, background, std::max(0, count), threshold, mask);
+}
+
+const char *Change_KernelName()
+{
+    return GetDispatch().name;
+}
+
+template<>
+const std::vector<KernelInfo<ChangeKernels>> &Kernel_GetAll<ChangeKernels>()
+{
+    static const std::vector<KernelInfo<ChangeKernels>> kernels =
+    {
+        { { MaskScalar }, "scalar", nullptr },
+#if defined(CPUFEATURES_X86)
+        { { MaskSSE2 }, "sse2", CpuFeatures_HasSSE2 },
+        { { MaskAVX2 }, "avx2", CpuFeatures_HasAVX2 },
+#endif
+#if defined(CPUFEATURES_NEON)
+        { { MaskNEON }, "neon", nullptr },
+#endif
+    };
+
+    return kernels;
+}
+
+ChangeDetector::ChangeDetector(std::size_t slots) :
+    settings({ false, 400, 0.05F, 0.0F, 0.0F, 0.0F, 1500.0F, 100000.0F }),
+    rowcount(0),
+    rowsamples(0),
+    linesamples(nullptr),
+    linebackground(nullptr),
+    segmentstart(-1),
+    segmentend(-1),
+    minlength(0),
+    mingap(0),
+    metrespersample(0.0F),
+    linesegment({ 0, 0, 0, 0.0F, 0.0F }),
+    events(slots),
+    linescount(0),
+    segmentscount(0)
+{
+    segments.reserve(MAX_LINE_SEGMENTS);
+}
+
+ChangeDetector::~ChangeDetector()
+{
+}
+
+void ChangeDetector::SetSettings(const ChangeSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+
+    if ((false != settings.enabled) && (false == this->settings.enabled))
+    {
+        std::fill(learned.begin(), learned.end(), 0);
+    }
+
+    this->settings = settings;
+}
+
+ChangeSettings ChangeDetector::GetSettings() const
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+    return settings;
+}
+
+void ChangeDetector::SetCallback(std::function<void(const ChangeSegment *, std::size_t)> callback)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+    this->callback = std::move(callback);
+}
+
+void ChangeDetector::ProcessLine(int row, int rows, uint16_t angle, uint32_t timestamp, const uint16_t *samples, int count)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+
+    if ((false == settings.enabled) || (settings.soundspeed <= 0.0F) || (settings.samplefrequency <= 0.0F) ||
+        (row < 0) || (row >= rows) || (count <= 0))
+    {
+        return;
+    }
+
+    if ((rows != rowcount) || (count > rowsamples))
+    {
+        // New geometry, allocated once: every row learns its background again
+        rowcount = rows;
+        rowsamples = std::max(count, rowsamples);
+        background.assign(static_cast<std::size_t>(rowcount) * rowsamples, 0);
+        learned.assign(rowcount, 0);
+        mask.resize((rowsamples + 31) / 32);
+    }
+
+    uint16_t *rowbackground = &background[static_cast<std::size_t>(row) * rowsamples];
+
+    linescount.fetch_add(1, std::memory_order_relaxed);
+
+    if (0 == learned[row])
+    {
+        std::copy(samples, samples + count, rowbackground);
+        learned[row] = 1;
+        return;
+    }
+
+    metrespersample = static_cast<float>(SampleRange_MetresPerSample(settings.soundspeed, settings.samplefrequency));
+    minlength = static_cast<int>(std::ceil(settings.minlength / metrespersample));
+    mingap = static_cast<int>(settings.mingap / metrespersample);
+
+    int first = std::min(count, static_cast<int>(std::ceil(settings.deadzone / metrespersample)));
+
+    Change_Mask(&samples[first], &rowbackground[first], count - first, settings.threshold, mask.data());
+
+    linesamples = &samples[first];
+    linebackground = &rowbackground[first];
+    linesegment = { timestamp, angle, 0, 0.0F, 0.0F };
+    segmentstart = -1;
+    segments.clear();
+
+    int words = (count - first + 31) / 32;
+
+    for (int w = 0; (w < words) && (static_cast<int>(segments.size()) < MAX_LINE_SEGMENTS); w++)
+    {
+        uint32_t bits = mask[w];
+
+        // Runs of set bits, a run reaching the end of the word is merged with the one starting the next word
+        while (0 != bits)
+        {
+            int start = BitScan_CountTrailingZeros(bits);
+            uint32_t rest = ~bits & (~0U << start);
+            int end = (0 == rest) ? 32 : BitScan_CountTrailingZeros(rest);
+
+            AddRun(w * 32 + start, w * 32 + end);
+
+            bits = (32 == end) ? 0 : bits & (~0U << end);
+        }
+    }
+
+    CloseSegment();
+
+    for (auto &segment : segments)
+    {
+        segment.start += first * metrespersample;
+        segment.end += first * metrespersample;
+    }
+
+    // Changed samples are learned as well, slowly with a small weight
+    Persist_Average(rowbackground, samples, static_cast<std::size_t>(count), Persist_Weight(settings.learning));
+
+    if (false == segments.empty())
+    {
+        segmentscount.fetch_add(segments.size(), std::memory_order_relaxed);
+        events.Push(segments.data(), segments.size());
+
+        if (nullptr != callback)
+        {
+            callback(segments.data(), segments.size());
+        }
+    }
+}
+
+void ChangeDetector::AddRun(int start, int end)
+{
+    if ((segmentstart >= 0) && (start - segmentend <= mingap))
+    {
+        segmentend = end;
+        return;
+    }
+
+    CloseSegment();
+
+    segmentstart = start;
+    segmentend = end;
+}
+
+void ChangeDetector::CloseSegment()
+{
+    if ((segmentstart < 0) || (segmentend - segmentstart < minlength) || (static_cast<int>(segments.size()) >= MAX_LINE_SEGMENTS))
+    {
+        segmentstart = -1;
+        return;
+    }
+
+    int peak = 0;
+
+    for (int i = segmentstart; i < segmentend; i++)
+    {
+        peak = std::max(peak, linesamples[i] - linebackground[i]);
+    }
+
+    ChangeSegment segment = linesegment;
+
+    segment.peak = static_cast<uint16_t>(peak);
+    segment.start = segmentstart * metrespersample;
+    segment.end = segmentend * metrespersample;
+
+    segments.push_back(segment);
+    segmentstart = -1;
+}
+
+std::size_t ChangeDetector::Read(ChangeSegment *dst, std::size_t count)
+{
+    return events.Read(dst, count);
+}
+
+uint64_t ChangeDetector::GetLinesCount() const
+{
+    return linescount;
+}
+
+uint64_t ChangeDetector::GetSegmentsCount() const
+{
+    return segmentscount;
+}
+
+uint64_t ChangeDetector::GetOverflowCount() const
+{
+    return events.GetOverflowCount();
+}
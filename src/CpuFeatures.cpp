@@ -0,0 +1,75 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include "CpuFeatures.h"
+
+#if defined(CPUFEATURES_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct CpuFeatureFlags
+    {
+        bool sse2;
+        bool ssse3;
+        bool avx2;
+    };
+
+    CpuFeatureFlags DetectCpuFeatures()
+    {
+        CpuFeatureFlags flags = { false, false, false };
+
+#if defined(CPUFEATURES_X86) && defined(_MSC_VER)
+        int regs[4] = { 0, };
+
+        __cpuid(regs, 0);
+        int maxleaf = regs[0];
+
+        __cpuid(regs, 1);
+        flags.sse2  = (0 != (regs[3] & (1 << 26)));
+        flags.ssse3 = (0 != (regs[2] & (1 << 9)));
+
+        bool osxsave = (0 != (regs[2] & (1 << 27)));
+        bool avx = (0 != (regs[2] & (1 << 28)));
+
+        if ((maxleaf >= 7) && (false != osxsave) && (false != avx))
+        {
+            // OS must save YMM state
+            if (6 == (_xgetbv(0) & 6))
+            {
+                __cpuidex(regs, 7, 0);
+                flags.avx2 = (0 != (regs[1] & (1 << 5)));
+            }
+        }
+#elif defined(CPUFEATURES_X86)
+        __builtin_cpu_init();
+
+        flags.sse2  = (0 != __builtin_cpu_supports("sse2"));
+        flags.ssse3 = (0 != __builtin_cpu_supports("ssse3"));
+        flags.avx2  = (0 != __builtin_cpu_supports("avx2"));
+#endif
+
+        return flags;
+    }
+
+    const CpuFeatureFlags &GetCpuFeatures()
+    {
+        static const CpuFeatureFlags flags = DetectCpuFeatures();
+        return flags;
+    }
+}
+
+bool CpuFeatures_HasSSE2()
+{
+    return GetCpuFeatures().sse2;
+}
+
+bool CpuFeatures_HasSSSE3()
+{
+    return GetCpuFeatures().ssse3;
+}
+
+bool CpuFeatures_HasAVX2()
+{
+    return GetCpuFeatures().avx2;
+}
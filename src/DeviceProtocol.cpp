@@ -0,0 +1,219 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include "DeviceProtocol.h"
+#include "B64Encode.h"
+#include "Crc32.h"
+
+namespace
+{
+    constexpr std::size_t MAX_LINE_LENGTH = 1024;
+    constexpr std::size_t COMMAND_HEADER_SIZE = 4 * sizeof(int32_t);    // magic, command, checksum, size
+}
+
+DeviceProtocol::DeviceProtocol() :
+    state(DeviceState::DState_Sync),
+    syncs(0),
+    commands(0),
+    crcerrors(0),
+    keepalives(0)
+{
+}
+
+DeviceProtocol::~DeviceProtocol()
+{
+}
+
+void DeviceProtocol::OnByte(char ch)
+{
+    if ('@' == ch)
+    {
+        syncs++;
+        state = DeviceState::DState_Baud;
+        inputline.clear();
+        Send("#SYNC\n");
+        OnSync();
+        return;
+    }
+
+    if ('\r' != ch)
+    {
+        if (inputline.size() < MAX_LINE_LENGTH)
+        {
+            inputline.push_back(ch);
+        }
+
+        return;
+    }
+
+    std::string line;
+    line.swap(inputline);
+
+    OnLine(line);
+}
+
+DeviceState DeviceProtocol::GetState() const
+{
+    return state;
+}
+
+uint64_t DeviceProtocol::GetSyncsCount() const
+{
+    return syncs;
+}
+
+uint64_t DeviceProtocol::GetCommandsCount() const
+{
+    return commands;
+}
+
+uint64_t DeviceProtocol::GetCrcErrorsCount() const
+{
+    return crcerrors;
+}
+
+uint64_t DeviceProtocol::GetKeepAlivesCount() const
+{
+    return keepalives;
+}
+
+void DeviceProtocol::EnterCommandMode()
+{
+    state = DeviceState::DState_Command;
+    Send("CMND\r\n");
+}
+
+const char *DeviceProtocol::OnCommand(const DEVICECOMMAND &command)
+{
+    (void)command;
+    return "#OK\n";
+}
+
+void DeviceProtocol::OnSync()
+{
+}
+
+void DeviceProtocol::OnBaudrate(const std::string &baudrate)
+{
+    (void)baudrate;
+}
+
+void DeviceProtocol::OnStart()
+{
+}
+
+void DeviceProtocol::OnStop()
+{
+}
+
+void DeviceProtocol::OnKeepAlive()
+{
+}
+
+void DeviceProtocol::OnInvalidCommand()
+{
+}
+
+void DeviceProtocol::OnLine(const std::string &line)
+{
+    std::size_t first = line.find_first_not_of(" \t\n");
+
+    switch (state)
+    {
+        case DeviceState::DState_Baud:
+        {
+            std::size_t open = line.find('<');
+            std::size_t close = line.find('>');
+
+            if ((std::string::npos != open) && (std::string::npos != close) && (open < close))
+            {
+                Send("#OK\n");
+                EnterCommandMode();
+                OnBaudrate(line.substr(open + 1, close - open - 1));
+            }
+            else
+            {
+                Send("#ER\n");
+            }
+
+            break;
+        }
+
+        case DeviceState::DState_Command:
+        case DeviceState::DState_Work:
+        {
+            if (std::string::npos == first)
+            {
+                // Empty line is used by the host as a command mode probe
+                if (DeviceState::DState_Command == state)
+                {
+                    Send("#OK\n");
+                }
+
+                break;
+            }
+
+            OnCommandLine(line.substr(first));
+            break;
+        }
+
+        case DeviceState::DState_Sync:
+        default:
+            break;
+    }
+}
+
+void DeviceProtocol::OnCommandLine(const std::string &text)
+{
+    DEVICECOMMAND command{};
+
+    std::size_t size = B64Encode::Decode(text, &command, sizeof(command));
+
+    bool isvalid = (size >= COMMAND_HEADER_SIZE) &&
+                   (DEVICECOMMAND_MAGIC == command.magic) &&
+                   (command.size >= 0) &&
+                   (static_cast<std::size_t>(command.size) <= sizeof(command.data)) &&
+                   (size >= COMMAND_HEADER_SIZE + static_cast<std::size_t>(command.size));
+
+    if ((false != isvalid) &&
+        (static_cast<uint32_t>(command.checksum) != Crc32_ComputeBuf(0, command.data, static_cast<std::size_t>(command.size))))
+    {
+        crcerrors++;
+        isvalid = false;
+    }
+
+    commands++;
+
+    if (DeviceState::DState_Work == state)
+    {
+        // Streaming: only START (keep-alive) and STOP are handled, nothing is answered
+        if ((false != isvalid) && (BIN_COMMAND_START == command.command))
+        {
+            keepalives++;
+            OnKeepAlive();
+        }
+        else if ((false != isvalid) && (BIN_COMMAND_STOP == command.command))
+        {
+            EnterCommandMode();
+            OnStop();
+        }
+
+        return;
+    }
+
+    if (false == isvalid)
+    {
+        Send("#ER\n");
+        OnInvalidCommand();
+        return;
+    }
+
+    if (BIN_COMMAND_START == command.command)
+    {
+        Send("#OK\n");
+        Send("WORK\r\n");
+        state = DeviceState::DState_Work;
+        OnStart();
+        return;
+    }
+
+    Send(OnCommand(command));
+}
@@ -0,0 +1,246 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <thread>
+
+#include "FileTransport.h"
+#include "FrameScanner.h"
+#include "SonarStructures.h"
+
+namespace
+{
+    // Footer timestamp is in milliseconds
+    constexpr uint64_t TIMESTAMP_TICK_US = 1000;
+
+    // Pauses in the recording (sonar stopped, settings changed) are shortened to this
+    constexpr uint32_t MAX_FRAME_GAP_TICKS = 1000;
+}
+
+FileTransport::FileTransport(const std::string &filename, uint32_t baudrate, uint32_t timeoutms, double speed) :
+    file(filename, std::ifstream::binary | std::ifstream::ate),
+    filesize(0),
+    position(0),
+    frameend(0),
+    framepending(false),
+    pendingend(0),
+    speed(speed),
+    rebase(true),
+    havetimestamp(false),
+    prevtimestamp(0),
+    streamtimeus(0),
+    framescount(0),
+    baudrate(baudrate),
+    timeoutms(timeoutms)
+{
+    if (false == file.is_open())
+    {
+        throw TransportException("Cannot open " + filename);
+    }
+
+    filesize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+}
+
+FileTransport::~FileTransport()
+{
+}
+
+void FileTransport::ParseFrame()
+{
+    uint64_t start = position;
+    auto now = std::chrono::steady_clock::now();
+
+    framepending = true;
+    pendingend = start + 1;
+    pendingdue = now;
+
+    DATAHEADERV1 dh;
+    DATAFOOTER df;
+
+    if (filesize - start < sizeof(DATAHEADERV1) + sizeof(DATAFOOTER))
+    {
+        pendingend = filesize;
+        return;
+    }
+
+    file.read(reinterpret_cast<char *>(&dh), sizeof(DATAHEADERV1));
+
+    bool isframe = (FRAME_MAGIC_DATA == dh.magic) &&
+                   (dh.samples >= dh.dataoffset + sizeof(DATAFOOTER)) &&
+                   (dh.samples <= filesize - start);
+
+    if (false != isframe)
+    {
+        file.seekg(static_cast<std::streamoff>(start + dh.samples - sizeof(DATAFOOTER)));
+        file.read(reinterpret_cast<char *>(&df), sizeof(DATAFOOTER));
+
+        isframe = (FRAME_MAGIC_END0 == df.magic) || (FRAME_MAGIC_END1 == df.magic);
+    }
+
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(start));
+
+    if (false == isframe)
+    {
+        return;
+    }
+
+    pendingend = start + dh.samples;
+    framescount++;
+
+    double replayspeed = speed;
+
+    if (replayspeed <= 0.0)
+    {
+        return;
+    }
+
+    if ((true == rebase.exchange(false)) || (false == havetimestamp))
+    {
+        havetimestamp = true;
+        prevtimestamp = df.timestamp;
+        streamtimeus = 0;
+        clockbase = now;
+    }
+    else
+    {
+        // Unsigned difference handles the timestamp wrap
+        uint32_t delta = std::min(df.timestamp - prevtimestamp, MAX_FRAME_GAP_TICKS);
+
+        prevtimestamp = df.timestamp;
+        streamtimeus += delta * TIMESTAMP_TICK_US;
+    }
+
+    pendingdue = clockbase + std::chrono::microseconds(static_cast<int64_t>(streamtimeus / replayspeed));
+}
+
+bool FileTransport::NextFrame(std::chrono::steady_clock::time_point deadline)
+{
+    if (false == framepending)
+    {
+        ParseFrame();
+    }
+
+    if (pendingdue > deadline)
+    {
+        std::this_thread::sleep_until(deadline);
+        return false;
+    }
+
+    std::this_thread::sleep_until(pendingdue);
+
+    framepending = false;
+    frameend = pendingend;
+
+    return true;
+}
+
+std::size_t FileTransport::Read(uint8_t *dst, std::size_t size)
+{
+    std::size_t copied = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    while ((copied < size) && (position < filesize))
+    {
+        if ((position == frameend) && (false == NextFrame(deadline)))
+        {
+            return copied;
+        }
+
+        std::size_t chunk = static_cast<std::size_t>(std::min<uint64_t>(size - copied, frameend - position));
+
+        file.read(reinterpret_cast<char *>(&dst[copied]), static_cast<std::streamsize>(chunk));
+
+        std::size_t br = static_cast<std::size_t>(file.gcount());
+        position += br;
+        copied += br;
+
+        if (br < chunk)
+        {
+            file.clear();
+            break;
+        }
+    }
+
+    if (copied < size)
+    {
+        std::this_thread::sleep_until(deadline);
+    }
+
+    return copied;
+}
+
+std::size_t FileTransport::Write(const uint8_t *src, std::size_t size)
+{
+    (void)src;
+    return size;
+}
+
+std::size_t FileTransport::Available()
+{
+    if (position < frameend)
+    {
+        return static_cast<std::size_t>(frameend - position);
+    }
+
+    // Next line is released by Read once it is due
+    return 0;
+}
+
+bool FileTransport::WaitReadable(int64_t timeoutms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    if (position < frameend)
+    {
+        return true;
+    }
+
+    if (position == filesize)
+    {
+        std::this_thread::sleep_until(deadline);
+        return false;
+    }
+
+    return NextFrame(deadline);
+}
+
+uint32_t FileTransport::GetBaudrate() const
+{
+    return baudrate;
+}
+
+bool FileTransport::IsPassive() const
+{
+    return true;
+}
+
+void FileTransport::SetSpeed(double speed)
+{
+    this->speed = std::max(speed, 0.0);
+    rebase = true;
+}
+
+double FileTransport::GetSpeed() const
+{
+    return speed;
+}
+
+uint64_t FileTransport::GetFileSize() const
+{
+    return filesize;
+}
+
+uint64_t FileTransport::GetPosition() const
+{
+    return position;
+}
+
+uint64_t FileTransport::GetFramesCount() const
+{
+    return framescount;
+}
+
+bool FileTransport::IsFinished() const
+{
+    return position == filesize;
+}
@@ -0,0 +1,248 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <iostream>
+
+#include "FrameAssembler.h"
+#include "FrameScanner.h"
+#include "SonarStructures.h"
+
+FrameAssembler::FrameAssembler(SerialRxBuffer &RxBuffer, FrameParseMode mode) :
+    rxbuffer(RxBuffer),
+    parsemode(mode),
+    resynccount(0),
+    lostcount(0)
+{
+}
+
+FrameAssembler::~FrameAssembler()
+{
+}
+
+void FrameAssembler::SetParseMode(FrameParseMode mode)
+{
+    parsemode = mode;
+}
+
+FrameParseMode FrameAssembler::GetParseMode() const
+{
+    return parsemode;
+}
+
+uint64_t FrameAssembler::GetResyncCount() const
+{
+    return resynccount;
+}
+
+uint64_t FrameAssembler::GetLostCount() const
+{
+    return lostcount;
+}
+
+void FrameAssembler::Rescan(const uint8_t *src, std::size_t count)
+{
+    // Does not fail when the buffer reserve covers maxbytes
+    if (false == rxbuffer.PutBack(src, count))
+    {
+        lostcount += count;
+    }
+}
+
+int FrameAssembler::GetLine(uint8_t *linebuf, std::size_t maxbytes)
+{
+    if (FrameParseMode::FPMode_Length == parsemode)
+    {
+        return GetLineByLength(linebuf, maxbytes);
+    }
+
+    return GetLineByToken(linebuf, maxbytes);
+}
+
+std::size_t FrameAssembler::ReadExact(uint8_t *dst, std::size_t size, int64_t timeoutms)
+{
+    std::size_t bytesread = 0;
+
+    auto time_begin = std::chrono::steady_clock::now();
+
+    while (bytesread < size)
+    {
+        bytesread += rxbuffer.Read(&dst[bytesread], size - bytesread);
+
+        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+
+        if (period.count() > timeoutms)
+        {
+            break;
+        }
+    }
+
+    return bytesread;
+}
+
+int FrameAssembler::FindStart(uint8_t *linebuf, std::size_t maxbytes)
+{
+    std::size_t bytesskipped = 0;
+
+    auto time_begin = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        FRAMETOKENMATCH match = FrameScan_FindToken(rxbuffer.Data(), rxbuffer.Size(), FRAME_TOKEN_DATA);
+
+        if (FRAME_TOKEN_DATA == match.token)
+        {
+            rxbuffer.Consume(match.offset);
+            rxbuffer.Read(linebuf, FRAME_TOKEN_SIZE);
+
+            return 0;
+        }
+
+        // Drop scanned bytes, keep a possibly incomplete token at the end
+        std::size_t skip = (rxbuffer.Size() >= FRAME_TOKEN_SIZE) ? rxbuffer.Size() - (FRAME_TOKEN_SIZE - 1) : 0;
+        rxbuffer.Consume(skip);
+        bytesskipped += skip;
+
+        if (bytesskipped >= maxbytes)
+        {
+            return -4;
+        }
+
+        rxbuffer.Fill();
+
+        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+
+        if (period.count() > 1000LL)
+        {
+            return -6;
+        }
+    }
+}
+
+int FrameAssembler::GetLineByToken(uint8_t *linebuf, std::size_t maxbytes)
+{
+    int retvalue = FindStart(linebuf, maxbytes);
+
+    if (0 != retvalue)
+    {
+        return -1;
+    }
+
+    std::size_t bytesread = FRAME_TOKEN_SIZE;
+
+    auto time_begin = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        const uint8_t *data = rxbuffer.Data();
+        std::size_t size = rxbuffer.Size();
+
+        FRAMETOKENMATCH match = FrameScan_FindToken(data, size, FRAME_TOKEN_ANY);
+
+        // Copy up to the end of the token found, or all but a possibly incomplete token
+        std::size_t chunk = (FRAME_TOKEN_NONE != match.token) ? match.offset + FRAME_TOKEN_SIZE :
+                            (size >= FRAME_TOKEN_SIZE) ? size - (FRAME_TOKEN_SIZE - 1) : 0;
+
+        if (bytesread + chunk > maxbytes)
+        {
+            return -1;
+        }
+
+        std::memcpy(&linebuf[bytesread], data, chunk);
+        rxbuffer.Consume(chunk);
+        bytesread += chunk;
+
+        if (0 != (match.token & FRAME_TOKEN_END))
+        {
+            break;
+        }
+        else if (FRAME_TOKEN_DATA == match.token)
+        {
+            //std::cout << "FrameAssembler::GetLineByToken Error: DATA detected when ENDx expected" << "\n";
+
+            std::memmove(linebuf, &linebuf[bytesread - FRAME_TOKEN_SIZE], FRAME_TOKEN_SIZE);
+            bytesread = FRAME_TOKEN_SIZE;
+            continue;
+        }
+
+        rxbuffer.Fill();
+
+        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+
+        if (period.count() > 1000LL)
+        {
+            std::string tracebuf = "period.count() > 1000LL bytesread = " + std::to_string(bytesread);
+            std::cout << tracebuf << "\n";
+            return -1;
+        }
+    }
+
+    // At this point we assume that DATA and ENDx received correctly
+    // Check only number of samples is equal bytesread
+
+    PDATAHEADER pdh = reinterpret_cast<PDATAHEADER>(&linebuf[0]);
+
+    if (pdh->samples > static_cast<uint32_t>(bytesread))
+    {
+        // Wrong number of samples
+        retvalue = -7;
+    }
+
+    return retvalue;
+}
+
+int FrameAssembler::GetLineByLength(uint8_t *linebuf, std::size_t maxbytes)
+{
+    // dataoffset and samples are both within the shortest header
+    constexpr std::size_t headersize = sizeof(DATAHEADERV1);
+
+    for (;;)
+    {
+        int retvalue = FindStart(linebuf, maxbytes);
+
+        if (0 != retvalue)
+        {
+            return -1;
+        }
+
+        std::size_t bytesread = FRAME_TOKEN_SIZE;
+        bytesread += ReadExact(&linebuf[bytesread], headersize - bytesread, 1000LL);
+
+        if (bytesread < headersize)
+        {
+            Rescan(&linebuf[FRAME_TOKEN_SIZE], bytesread - FRAME_TOKEN_SIZE);
+            return -1;
+        }
+
+        PDATAHEADERV1 pdh = reinterpret_cast<PDATAHEADERV1>(&linebuf[0]);
+
+        bool isvalidheader = ((sizeof(DATAHEADERV1) == pdh->dataoffset) ||
+                              (sizeof(DATAHEADERV2) == pdh->dataoffset) ||
+                              (sizeof(DATAHEADERV3) == pdh->dataoffset)) &&
+                             (pdh->samples >= pdh->dataoffset + sizeof(DATAFOOTER)) &&
+                             (pdh->samples <= maxbytes);
+
+        if (false != isvalidheader)
+        {
+            std::size_t framesize = pdh->samples;
+            bytesread += ReadExact(&linebuf[bytesread], framesize - bytesread, 1000LL);
+
+            if (bytesread < framesize)
+            {
+                Rescan(&linebuf[FRAME_TOKEN_SIZE], bytesread - FRAME_TOKEN_SIZE);
+                return -1;
+            }
+
+            PDATAFOOTER pdf = reinterpret_cast<PDATAFOOTER>(&linebuf[framesize - sizeof(DATAFOOTER)]);
+
+            if ((FRAME_MAGIC_END0 == pdf->magic) || (FRAME_MAGIC_END1 == pdf->magic))
+            {
+                return 0;
+            }
+        }
+
+        // Malformed frame: rescan everything after this DATA token
+        resynccount++;
+        Rescan(&linebuf[FRAME_TOKEN_SIZE], bytesread - FRAME_TOKEN_SIZE);
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include "FramePool.h"
+
+FramePool::FramePool(std::size_t buffers, std::size_t buffersize, std::size_t alignment) :
+    capacity(buffers),
+    buffersize(buffersize),
+    freecount(0),
+    checkoutcount(0),
+    exhaustedcount(0)
+{
+    // Buffer stride is rounded up so every buffer starts aligned
+    std::size_t stride = (buffersize + alignment - 1) / alignment * alignment;
+
+    storage = std::make_unique<uint8_t[]>(buffers * stride + alignment);
+    freelist = std::make_unique<uint8_t *[]>(buffers);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(storage.get());
+    base = (base + alignment - 1) / alignment * alignment;
+
+    for (std::size_t i = 0; i < buffers; i++)
+    {
+        freelist[freecount++] = reinterpret_cast<uint8_t *>(base + i * stride);
+    }
+}
+
+FramePool::~FramePool()
+{
+}
+
+uint8_t *FramePool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(poolmutex);
+
+    if (0 == freecount)
+    {
+        exhaustedcount++;
+        return nullptr;
+    }
+
+    checkoutcount++;
+
+    return freelist[--freecount];
+}
+
+void FramePool::Release(uint8_t *buffer)
+{
+    if (nullptr == buffer)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(poolmutex);
+
+    if (freecount < capacity)
+    {
+        freelist[freecount++] = buffer;
+    }
+}
+
+std::size_t FramePool::GetBufferSize() const
+{
+    return buffersize;
+}
+
+std::size_t FramePool::GetCapacity() const
+{
+    return capacity;
+}
+
+std::size_t FramePool::GetAvailable() const
+{
+    std::lock_guard<std::mutex> lock(poolmutex);
+    return freecount;
+}
+
+uint64_t FramePool::GetCheckoutCount() const
+{
+    return checkoutcount;
+}
+
+uint64_t FramePool::GetExhaustedCount() const
+{
+    return exhaustedcount;
+}
@@ -0,0 +1,121 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <chrono>
+
+#include "FrameRing.h"
+
+FrameRing::FrameRing(std::size_t slots) :
+    slots(slots),
+    head(0),
+    tail(0),
+    highwater(0),
+    framescount(0),
+    overflowcount(0),
+    sleeping(false)
+{
+    frames = std::make_unique<uint8_t *[]>(slots);
+}
+
+FrameRing::~FrameRing()
+{
+}
+
+bool FrameRing::Push(uint8_t *frame)
+{
+    std::size_t h = head.load(std::memory_order_relaxed);
+    std::size_t t = tail.load(std::memory_order_acquire);
+
+    if (h - t >= slots)
+    {
+        overflowcount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    frames[h % slots] = frame;
+    head.store(h + 1, std::memory_order_release);
+
+    framescount.fetch_add(1, std::memory_order_relaxed);
+
+    std::size_t occupancy = h + 1 - t;
+
+    if (occupancy > highwater.load(std::memory_order_relaxed))
+    {
+        highwater.store(occupancy, std::memory_order_relaxed);
+    }
+
+    // Pairs with the fence in WaitForData: either the consumer sees the new head or this sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (false != sleeping.load(std::memory_order_relaxed))
+    {
+        {
+            // Taking the lock orders this notify against a consumer about to wait
+            std::lock_guard<std::mutex> lock(waitmutex);
+        }
+
+        waitcv.notify_one();
+    }
+
+    return true;
+}
+
+uint8_t *FrameRing::Pop()
+{
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t h = head.load(std::memory_order_acquire);
+
+    if (h == t)
+    {
+        return nullptr;
+    }
+
+    uint8_t *frame = frames[t % slots];
+    tail.store(t + 1, std::memory_order_release);
+
+    return frame;
+}
+
+bool FrameRing::WaitForData(int64_t timeoutms)
+{
+    std::unique_lock<std::mutex> lock(waitmutex);
+
+    // Announced before head is checked, the producer only locks and notifies while it is set
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool ready = waitcv.wait_for(lock, std::chrono::milliseconds(timeoutms), [this]()
+    {
+        return head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed);
+    });
+
+    sleeping.store(false, std::memory_order_relaxed);
+
+    return ready;
+}
+
+std::size_t FrameRing::GetCapacity() const
+{
+    return slots;
+}
+
+std::size_t FrameRing::GetOccupancy() const
+{
+    std::size_t t = tail.load(std::memory_order_acquire);
+    std::size_t h = head.load(std::memory_order_acquire);
+
+    return h - t;
+}
+
+std::size_t FrameRing::GetHighWater() const
+{
+    return highwater;
+}
+
+uint64_t FrameRing::GetFramesCount() const
+{
+    return framescount;
+}
+
+uint64_t FrameRing::GetOverflowCount() const
+{
+    return overflowcount;
+}
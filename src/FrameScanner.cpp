@@ -0,0 +1,281 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <cstring>
+
+#include "BitScan.h"
+#include "CpuFeatures.h"
+#include "FrameScanner.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    typedef FRAMETOKENMATCH (*FrameScanKernel)(const uint8_t *buf, std::size_t len, int tokenmask);
+
+    inline int TokenAt(const uint8_t *p)
+    {
+        uint32_t word;
+        std::memcpy(&word, p, sizeof(word));
+
+        switch (word)
+        {
+            case FRAME_MAGIC_DATA: return FRAME_TOKEN_DATA;
+            case FRAME_MAGIC_END0: return FRAME_TOKEN_END0;
+            case FRAME_MAGIC_END1: return FRAME_TOKEN_END1;
+            default:               return FRAME_TOKEN_NONE;
+        }
+    }
+
+    FRAMETOKENMATCH ScanScalarFrom(const uint8_t *buf, std::size_t from, std::size_t len, int tokenmask)
+    {
+        if (len >= FRAME_TOKEN_SIZE)
+        {
+            const std::size_t last = len - FRAME_TOKEN_SIZE;
+
+            // Single leading character: let memchr skip the payload
+            int leadchar = (FRAME_TOKEN_DATA == tokenmask) ? 'D' : (0 == (tokenmask & FRAME_TOKEN_DATA)) ? 'E' : 0;
+
+            std::size_t i = from;
+
+            while (i <= last)
+            {
+                if (0 != leadchar)
+                {
+                    const void *found = std::memchr(&buf[i], leadchar, last - i + 1);
+
+                    if (nullptr == found)
+                    {
+                        break;
+                    }
+
+                    i = static_cast<std::size_t>(static_cast<const uint8_t *>(found) - buf);
+                }
+                else if (('D' != buf[i]) && ('E' != buf[i]))
+                {
+                    i++;
+                    continue;
+                }
+
+                int token = TokenAt(&buf[i]);
+
+                if (0 != (token & tokenmask))
+                {
+                    return { i, token };
+                }
+
+                i++;
+            }
+        }
+
+        return { len, FRAME_TOKEN_NONE };
+    }
+
+    FRAMETOKENMATCH ScanScalar(const uint8_t *buf, std::size_t len, int tokenmask)
+    {
+        return ScanScalarFrom(buf, 0, len, tokenmask);
+    }
+
+#if defined(CPUFEATURES_X86)
+    CPUFEATURES_TARGET("sse2")
+    FRAMETOKENMATCH ScanSSE2(const uint8_t *buf, std::size_t len, int tokenmask)
+    {
+        constexpr std::size_t step = 16;
+
+        const __m128i chD = _mm_set1_epi8('D');
+        const __m128i chA = _mm_set1_epi8('A');
+        const __m128i chT = _mm_set1_epi8('T');
+        const __m128i chE = _mm_set1_epi8('E');
+        const __m128i chN = _mm_set1_epi8('N');
+        const __m128i ch0 = _mm_set1_epi8('0');
+        const __m128i ch1 = _mm_set1_epi8('1');
+
+        std::size_t i = 0;
+
+        for (; i + step + FRAME_TOKEN_SIZE - 1 <= len; i += step)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&buf[i]));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&buf[i + 1]));
+            __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&buf[i + 2]));
+            __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&buf[i + 3]));
+
+            __m128i hit = _mm_setzero_si128();
+
+            if (0 != (tokenmask & FRAME_TOKEN_DATA))
+            {
+                __m128i da = _mm_and_si128(_mm_cmpeq_epi8(v0, chD), _mm_cmpeq_epi8(v1, chA));
+                __m128i ta = _mm_and_si128(_mm_cmpeq_epi8(v2, chT), _mm_cmpeq_epi8(v3, chA));
+                hit = _mm_and_si128(da, ta);
+            }
+
+            if (0 != (tokenmask & FRAME_TOKEN_END))
+            {
+                __m128i en = _mm_and_si128(_mm_cmpeq_epi8(v0, chE), _mm_cmpeq_epi8(v1, chN));
+                __m128i end = _mm_and_si128(en, _mm_cmpeq_epi8(v2, chD));
+                __m128i digit = _mm_setzero_si128();
+
+                if (0 != (tokenmask & FRAME_TOKEN_END0))
+                {
+                    digit = _mm_cmpeq_epi8(v3, ch0);
+                }
+
+                if (0 != (tokenmask & FRAME_TOKEN_END1))
+                {
+                    digit = _mm_or_si128(digit, _mm_cmpeq_epi8(v3, ch1));
+                }
+
+                hit = _mm_or_si128(hit, _mm_and_si128(end, digit));
+            }
+
+            uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+
+            if (0 != bits)
+            {
+                std::size_t offset = i + BitScan_CountTrailingZeros(bits);
+                return { offset, TokenAt(&buf[offset]) };
+            }
+        }
+
+        return ScanScalarFrom(buf, i, len, tokenmask);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    FRAMETOKENMATCH ScanAVX2(const uint8_t *buf, std::size_t len, int tokenmask)
+    {
+        constexpr std::size_t step = 32;
+
+        const __m256i chD = _mm256_set1_epi8('D');
+        const __m256i chA = _mm256_set1_epi8('A');
+        const __m256i chT = _mm256_set1_epi8('T');
+        const __m256i chE = _mm256_set1_epi8('E');
+        const __m256i chN = _mm256_set1_epi8('N');
+        const __m256i ch0 = _mm256_set1_epi8('0');
+        const __m256i ch1 = _mm256_set1_epi8('1');
+
+        std::size_t i = 0;
+
+        for (; i + step + FRAME_TOKEN_SIZE - 1 <= len; i += step)
+        {
+            __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&buf[i]));
+            __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&buf[i + 1]));
+            __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&buf[i + 2]));
+            __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&buf[i + 3]));
+
+            __m256i hit = _mm256_setzero_si256();
+
+            if (0 != (tokenmask & FRAME_TOKEN_DATA))
+            {
+                __m256i da = _mm256_and_si256(_mm256_cmpeq_epi8(v0, chD), _mm256_cmpeq_epi8(v1, chA));
+                __m256i ta = _mm256_and_si256(_mm256_cmpeq_epi8(v2, chT), _mm256_cmpeq_epi8(v3, chA));
+                hit = _mm256_and_si256(da, ta);
+            }
+
+            if (0 != (tokenmask & FRAME_TOKEN_END))
+            {
+                __m256i en = _mm256_and_si256(_mm256_cmpeq_epi8(v0, chE), _mm256_cmpeq_epi8(v1, chN));
+                __m256i end = _mm256_and_si256(en, _mm256_cmpeq_epi8(v2, chD));
+                __m256i digit = _mm256_setzero_si256();
+
+                if (0 != (tokenmask & FRAME_TOKEN_END0))
+                {
+                    digit = _mm256_cmpeq_epi8(v3, ch0);
+                }
+
+                if (0 != (tokenmask & FRAME_TOKEN_END1))
+                {
+                    digit = _mm256_or_si256(digit, _mm256_cmpeq_epi8(v3, ch1));
+                }
+
+                hit = _mm256_or_si256(hit, _mm256_and_si256(end, digit));
+            }
+
+            uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+
+            if (0 != bits)
+            {
+                std::size_t offset = i + BitScan_CountTrailingZeros(bits);
+                return { offset, TokenAt(&buf[offset]) };
+            }
+        }
+
+        return ScanScalarFrom(buf, i, len, tokenmask);
+    }
+#endif
+
+    struct FrameScanDispatch
+    {
+        FrameScanKernel kernel;
+        const char *name;
+    };
+
+    FrameScanDispatch SelectKernel()
+    {
+#if defined(CPUFEATURES_X86)
+        if (false != CpuFeatures_HasAVX2())
+        {
+            return { ScanAVX2, "avx2" };
+        }
+
+        if (false != CpuFeatures_HasSSE2())
+        {
+            return { ScanSSE2, "sse2" };
+        }
+#endif
+        return { ScanScalar, "scalar" };
+    }
+
+    const FrameScanDispatch &GetDispatch()
+    {
+        static const FrameScanDispatch dispatch = SelectKernel();
+        return dispatch;
+    }
+}
+
+FRAMETOKENMATCH FrameScan_FindToken(const uint8_t *buf, std::size_t len, int tokenmask)
+{
+    if ((nullptr == buf) || (0 == (tokenmask & FRAME_TOKEN_ANY)))
+    {
+        return { len, FRAME_TOKEN_NONE };
+    }
+
+    return GetDispatch().kernel(buf, len, tokenmask & FRAME_TOKEN_ANY);
+}
+
+bool FrameScan_FindFrame(const uint8_t *buf, std::size_t len, FRAMEBOUNDS *bounds)
+{
+    FRAMETOKENMATCH start = FrameScan_FindToken(buf, len, FRAME_TOKEN_DATA);
+
+    while (FRAME_TOKEN_DATA == start.token)
+    {
+        std::size_t payload = start.offset + FRAME_TOKEN_SIZE;
+        FRAMETOKENMATCH next = FrameScan_FindToken(&buf[payload], len - payload, FRAME_TOKEN_ANY);
+
+        if (FRAME_TOKEN_NONE == next.token)
+        {
+            break;
+        }
+
+        if (FRAME_TOKEN_DATA == next.token)
+        {
+            // Frame restarted before its end token
+            start.offset = payload + next.offset;
+            continue;
+        }
+
+        if (nullptr != bounds)
+        {
+            bounds->begin = start.offset;
+            bounds->end = payload + next.offset + FRAME_TOKEN_SIZE;
+            bounds->endtoken = next.token;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+const char *FrameScan_KernelName()
+{
+    return GetDispatch().name;
+}
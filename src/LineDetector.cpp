@@ -0,0 +1,333 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cmath>
+
+#include "BitScan.h"
+#include "CpuFeatures.h"
+#include "SampleRange.h"
+#include "LineDetector.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(CPUFEATURES_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    constexpr float FULL_SCALE = 4095.0F;
+
+    int FirstAboveScalar(const uint16_t *samples, int count, uint16_t threshold)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (samples[i] >= threshold)
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    uint16_t MaximumScalar(const uint16_t *samples, int count)
+    {
+        uint16_t maximum = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            maximum = std::max(maximum, samples[i]);
+        }
+
+        return maximum;
+    }
+
+#if defined(CPUFEATURES_X86)
+    // SSE2 has signed 16-bit compare and max only, flipping the sign bit keeps the unsigned order
+    CPUFEATURES_TARGET("sse2")
+    int FirstAboveSSE2(const uint16_t *samples, int count, uint16_t threshold)
+    {
+        if (0 == threshold)
+        {
+            return (count > 0) ? 0 : -1;
+        }
+
+        const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+        const __m128i limit = _mm_set1_epi16(static_cast<short>((threshold - 1) ^ 0x8000));
+
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i])), sign);
+            uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi16(x, limit)));
+
+            if (0 != bits)
+            {
+                return i + BitScan_CountTrailingZeros(bits) / 2;
+            }
+        }
+
+        int tail = FirstAboveScalar(&samples[i], count - i, threshold);
+
+        return (tail < 0) ? -1 : i + tail;
+    }
+
+    CPUFEATURES_TARGET("sse2")
+    uint16_t MaximumSSE2(const uint16_t *samples, int count)
+    {
+        const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+
+        __m128i maximum = sign;
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            maximum = _mm_max_epi16(maximum, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i])), sign));
+        }
+
+        maximum = _mm_max_epi16(maximum, _mm_shuffle_epi32(maximum, 0x4E));
+        maximum = _mm_max_epi16(maximum, _mm_shuffle_epi32(maximum, 0xB1));
+        maximum = _mm_max_epi16(maximum, _mm_shufflelo_epi16(maximum, 0xB1));
+
+        uint16_t value = static_cast<uint16_t>(_mm_cvtsi128_si32(maximum) ^ 0x8000);
+
+        return std::max(value, MaximumScalar(&samples[i], count - i));
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    int FirstAboveAVX2(const uint16_t *samples, int count, uint16_t threshold)
+    {
+        const __m256i limit = _mm256_set1_epi16(static_cast<short>(threshold));
+
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i]));
+
+            // x >= threshold where max(x, threshold) == x
+            uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_max_epu16(x, limit), x)));
+
+            if (0 != bits)
+            {
+                return i + BitScan_CountTrailingZeros(bits) / 2;
+            }
+        }
+
+        int tail = FirstAboveScalar(&samples[i], count - i, threshold);
+
+        return (tail < 0) ? -1 : i + tail;
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    uint16_t MaximumAVX2(const uint16_t *samples, int count)
+    {
+        __m256i maximum = _mm256_setzero_si256();
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            maximum = _mm256_max_epu16(maximum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i])));
+        }
+
+        __m128i folded = _mm_max_epu16(_mm256_castsi256_si128(maximum), _mm256_extracti128_si256(maximum, 1));
+
+        // minpos of the inverted samples finds the largest one
+        folded = _mm_minpos_epu16(_mm_xor_si128(folded, _mm_set1_epi16(-1)));
+
+        uint16_t value = static_cast<uint16_t>(~_mm_cvtsi128_si32(folded));
+
+        return std::max(value, MaximumScalar(&samples[i], count - i));
+    }
+#endif
+
+#if defined(CPUFEATURES_NEON)
+    int FirstAboveNEON(const uint16_t *samples, int count, uint16_t threshold)
+    {
+        const uint16x8_t limit = vdupq_n_u16(threshold);
+
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            // Narrowing shift packs the 16-bit compare to 4 bits a sample
+            uint16x8_t above = vcgeq_u16(vld1q_u16(&samples[i]), limit);
+            uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(above, 4)), 0);
+
+            if (0 != bits)
+            {
+                return i + BitScan_CountTrailingZeros64(bits) / 4;
+            }
+        }
+
+        int tail = FirstAboveScalar(&samples[i], count - i, threshold);
+
+        return (tail < 0) ? -1 : i + tail;
+    }
+
+    uint16_t MaximumNEON(const uint16_t *samples, int count)
+    {
+        uint16x8_t maximum = vdupq_n_u16(0);
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            maximum = vmaxq_u16(maximum, vld1q_u16(&samples[i]));
+        }
+
+        return std::max(vmaxvq_u16(maximum), MaximumScalar(&samples[i], count - i));
+    }
+#endif
+
+    const KernelInfo<DetectKernels> &GetDispatch()
+    {
+        static const KernelInfo<DetectKernels> dispatch = Kernel_Select<DetectKernels>();
+        return dispatch;
+    }
+}
+
+int Detect_FirstAbove(const uint16_t *samples, int count, uint16_t threshold)
+{
+    return GetDispatch().functions.firstabove(samples, std::max(0, count), threshold);
+}
+
+int Detect_Peak(const uint16_t *samples, int count)
+{
+    if (count <= 0)
+    {
+        return -1;
+    }
+
+    // The line is in L1 after the maximum, the second pass finds where it is
+    return GetDispatch().functions.firstabove(samples, count, GetDispatch().functions.maximum(samples, count));
+}
+
+const char *Detect_KernelName()
+{
+    return GetDispatch().name;
+}
+
+template<>
+const std::vector<KernelInfo<DetectKernels>> &Kernel_GetAll<DetectKernels>()
+{
+    static const std::vector<KernelInfo<DetectKernels>> kernels =
+    {
+        { { FirstAboveScalar, MaximumScalar }, "scalar", nullptr },
+#if defined(CPUFEATURES_X86)
+        { { FirstAboveSSE2, MaximumSSE2 }, "sse2", CpuFeatures_HasSSE2 },
+        { { FirstAboveAVX2, MaximumAVX2 }, "avx2", CpuFeatures_HasAVX2 },
+#endif
+#if defined(CPUFEATURES_NEON)
+        { { FirstAboveNEON, MaximumNEON }, "neon", nullptr },
+#endif
+    };
+
+    return kernels;
+}
+
+LineDetector::LineDetector(std::size_t slots) :
+    settings({ DetectMode::DtMode_Off, 0.1F, 0.0F, 0.0F, 1500.0F, 100000.0F }),
+    detections(slots),
+    linescount(0),
+    detectionscount(0)
+{
+}
+
+LineDetector::~LineDetector()
+{
+}
+
+void LineDetector::SetSettings(const DetectorSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+    this->settings = settings;
+}
+
+DetectorSettings LineDetector::GetSettings() const
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+    return settings;
+}
+
+void LineDetector::SetCallback(std::function<void(const Detection &)> callback)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+    this->callback = std::move(callback);
+}
+
+void LineDetector::ProcessLine(uint16_t angle, uint32_t timestamp, const uint16_t *samples, int count)
+{
+    std::lock_guard<std::mutex> lock(settingslock);
+
+    if ((DetectMode::DtMode_Off == settings.mode) || (settings.soundspeed <= 0.0F) || (settings.samplefrequency <= 0.0F))
+    {
+        return;
+    }
+
+    float metrespersample = static_cast<float>(SampleRange_MetresPerSample(settings.soundspeed, settings.samplefrequency));
+
+    int first = std::min(count, static_cast<int>(std::ceil(settings.deadzone / metrespersample)));
+    int last = (settings.range > 0.0F) ? std::min(count, static_cast<int>(settings.range / metrespersample)) : count;
+
+    Detection detection = { timestamp, angle, 0, 0.0F };
+
+    if (first < last)
+    {
+        int index = -1;
+
+        if (DetectMode::DtMode_Peak == settings.mode)
+        {
+            index = Detect_Peak(&samples[first], last - first);
+
+            if ((index >= 0) && (samples[first + index] < settings.threshold * FULL_SCALE))
+            {
+                index = -1;
+            }
+        }
+        else
+        {
+            uint16_t threshold = static_cast<uint16_t>(std::ceil(std::max(0.0F, std::min(settings.threshold, 1.0F)) * FULL_SCALE));
+            index = Detect_FirstAbove(&samples[first], last - first, threshold);
+        }
+
+        if (index >= 0)
+        {
+            detection.amplitude = samples[first + index];
+            detection.range = (first + index + 0.5F) * metrespersample;
+
+            detectionscount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    linescount.fetch_add(1, std::memory_order_relaxed);
+
+    detections.Push(&detection, 1);
+
+    if (nullptr != callback)
+    {
+        callback(detection);
+    }
+}
+
+std::size_t LineDetector::Read(Detection *dst, std::size_t count)
+{
+    return detections.Read(dst, count);
+}
+
+uint64_t LineDetector::GetLinesCount() const
+{
+    return linescount;
+}
+
+uint64_t LineDetector::GetDetectionsCount() const
+{
+    return detectionscount;
+}
+
+uint64_t LineDetector::GetOverflowCount() const
+{
+    return detections.GetOverflowCount();
+}
@@ -0,0 +1,50 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include "LineRecorder.h"
+#include "SonarStructures.h"
+
+LineRecorder::LineRecorder(std::unique_ptr<WriteBehind> Writer) :
+    writer(std::move(Writer))
+{
+}
+
+LineRecorder::~LineRecorder()
+{
+}
+
+bool LineRecorder::IsOpen() const
+{
+    return (nullptr != writer) && (false != writer->IsOpen());
+}
+
+void LineRecorder::Write(const uint8_t *line)
+{
+    if (false == IsOpen())
+    {
+        return;
+    }
+
+    const DATAHEADER *pdh = reinterpret_cast<const DATAHEADER *>(line);
+
+    DATAHEADERV3 dhv3 = ConvertHeader(line);
+
+    // Dropped lines are counted by the writer
+    writer->WriteFrame(&dhv3, sizeof(DATAHEADERV3), &line[pdh->dataoffset], pdh->samples - pdh->dataoffset);
+}
+
+void LineRecorder::SetBacklogPolicy(BacklogPolicy policy)
+{
+    if (nullptr != writer)
+    {
+        writer->SetPolicy(policy);
+    }
+}
+
+WriteBehindStats LineRecorder::GetStats() const
+{
+    if (nullptr == writer)
+    {
+        return WriteBehindStats();
+    }
+
+    return writer->GetStats();
+}
@@ -0,0 +1,99 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <chrono>
+#include <algorithm>
+
+#include "LoopbackTransport.h"
+
+LoopbackTransport::LoopbackTransport(uint32_t baudrate, uint32_t timeoutms) :
+    baudrate(baudrate),
+    timeoutms(timeoutms)
+{
+    rxchannel = std::make_shared<Channel>();
+    txchannel = rxchannel;
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+}
+
+std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>> LoopbackTransport::CreatePair(uint32_t baudrate, uint32_t timeoutms)
+{
+    auto first = std::make_shared<LoopbackTransport>(baudrate, timeoutms);
+    auto second = std::make_shared<LoopbackTransport>(baudrate, timeoutms);
+
+    // Cross the channels: what one end writes the other end reads
+    auto forward = std::make_shared<Channel>();
+    auto backward = std::make_shared<Channel>();
+
+    first->txchannel = forward;
+    first->rxchannel = backward;
+    second->txchannel = backward;
+    second->rxchannel = forward;
+
+    return std::make_pair(first, second);
+}
+
+std::size_t LoopbackTransport::Read(uint8_t *dst, std::size_t size)
+{
+    std::size_t copied = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    std::unique_lock<std::mutex> lock(rxchannel->mutex);
+
+    while (copied < size)
+    {
+        if (true == rxchannel->bytes.empty())
+        {
+            if (std::cv_status::timeout == rxchannel->cv.wait_until(lock, deadline))
+            {
+                if (true == rxchannel->bytes.empty())
+                {
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        std::size_t chunk = std::min(size - copied, rxchannel->bytes.size());
+        std::copy_n(rxchannel->bytes.begin(), chunk, &dst[copied]);
+        rxchannel->bytes.erase(rxchannel->bytes.begin(), rxchannel->bytes.begin() + chunk);
+
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+std::size_t LoopbackTransport::Write(const uint8_t *src, std::size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(txchannel->mutex);
+        txchannel->bytes.insert(txchannel->bytes.end(), src, src + size);
+    }
+
+    txchannel->cv.notify_all();
+
+    return size;
+}
+
+std::size_t LoopbackTransport::Available()
+{
+    std::lock_guard<std::mutex> lock(rxchannel->mutex);
+    return rxchannel->bytes.size();
+}
+
+bool LoopbackTransport::WaitReadable(int64_t timeoutms)
+{
+    std::unique_lock<std::mutex> lock(rxchannel->mutex);
+
+    return rxchannel->cv.wait_for(lock, std::chrono::milliseconds(timeoutms), [this]()
+    {
+        return false == rxchannel->bytes.empty();
+    });
+}
+
+uint32_t LoopbackTransport::GetBaudrate() const
+{
+    return baudrate;
+}
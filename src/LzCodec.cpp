@@ -0,0 +1,327 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <cstring>
+#include <vector>
+
+#include "BitScan.h"
+#include "LzCodec.h"
+
+namespace
+{
+    constexpr std::size_t MIN_MATCH = 4;
+    constexpr std::size_t MAX_OFFSET = 65535;
+    constexpr std::size_t END_LITERALS = 5;     // Last bytes of a block are always literals
+    constexpr std::size_t MATCH_LIMIT = 12;     // No match starts in the last bytes of a block
+    constexpr int HASH_BITS = 14;
+    constexpr int MIN_HASH_BITS = 8;            // Small inputs use a smaller table, it is cleared for every block
+    constexpr int SKIP_SHIFT = 6;               // Search step grows by one every 64 bytes without a match
+
+    constexpr uint32_t RUN_MASK = 15;
+
+    inline uint32_t Read32(const uint8_t *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t Read64(const uint8_t *p)
+    {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t Hash(uint32_t sequence, int hashbits)
+    {
+        return (sequence * 2654435761U) >> (32 - hashbits);
+    }
+
+    /**
+     *   @brief Number of equal bytes of p and q, p is not read at or after pend
+     */
+    std::size_t MatchLength(const uint8_t *p, const uint8_t *q, const uint8_t *pend)
+    {
+        const uint8_t *start = p;
+
+        while (p + sizeof(uint64_t) <= pend)
+        {
+            uint64_t diff = Read64(p) ^ Read64(q);
+
+            if (0 != diff)
+            {
+                // Little-endian: the lowest differing bit is in the first differing byte
+                return static_cast<std::size_t>(p - start) + BitScan_CountTrailingZeros64(diff) / 8;
+            }
+
+            p += sizeof(uint64_t);
+            q += sizeof(uint64_t);
+        }
+
+        while ((p < pend) && (*p == *q))
+        {
+            p++;
+            q++;
+        }
+
+        return static_cast<std::size_t>(p - start);
+    }
+
+    inline uint8_t *WriteLength(uint8_t *op, std::size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *op++ = 255;
+        }
+
+        *op++ = static_cast<uint8_t>(length);
+
+        return op;
+    }
+
+    /**
+     *   @brief Append a record, matchlength 0 - the last record of the block, literals only
+     *   @return end of the record, nullptr - the record does not fit
+     */
+    uint8_t *WriteSequence(uint8_t *op, const uint8_t *oend, const uint8_t *literals, std::size_t literalscount,
+                           std::size_t offset, std::size_t matchlength)
+    {
+        std::size_t need = 1 + literalscount + literalscount / 255 + 1;
+
+        if (0 != matchlength)
+        {
+            need += 2 + (matchlength - MIN_MATCH) / 255 + 1;
+        }
+
+        if (static_cast<std::size_t>(oend - op) < need)
+        {
+            return nullptr;
+        }
+
+        uint8_t *token = op++;
+
+        if (literalscount >= RUN_MASK)
+        {
+            *token = static_cast<uint8_t>(RUN_MASK << 4);
+            op = WriteLength(op, literalscount - RUN_MASK);
+        }
+        else
+        {
+            *token = static_cast<uint8_t>(literalscount << 4);
+        }
+
+        std::memcpy(op, literals, literalscount);
+        op += literalscount;
+
+        if (0 == matchlength)
+        {
+            return op;
+        }
+
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+
+        std::size_t length = matchlength - MIN_MATCH;
+
+        if (length >= RUN_MASK)
+        {
+            *token |= RUN_MASK;
+            op = WriteLength(op, length - RUN_MASK);
+        }
+        else
+        {
+            *token |= static_cast<uint8_t>(length);
+        }
+
+        return op;
+    }
+
+    /**
+     *   @brief Read the extension bytes of a 15 nibble
+     *   @return false - the input ends
+     */
+    inline bool ReadLength(const uint8_t *&ip, const uint8_t *iend, std::size_t &length)
+    {
+        uint8_t value;
+
+        do
+        {
+            if (ip >= iend)
+            {
+                return false;
+            }
+
+            value = *ip++;
+            length += value;
+        } while (255 == value);
+
+        return true;
+    }
+}
+
+std::size_t Lz_CompressBound(std::size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+std::size_t Lz_Compress(const uint8_t *src, std::size_t size, uint8_t *dst, std::size_t capacity)
+{
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + capacity;
+
+    std::size_t anchor = 0;
+
+    if (size > MATCH_LIMIT)
+    {
+        int hashbits = HASH_BITS;
+
+        while ((hashbits > MIN_HASH_BITS) && ((std::size_t(1) << hashbits) > size))
+        {
+            hashbits--;
+        }
+
+        std::vector<uint32_t> table(std::size_t(1) << hashbits, 0);
+
+        const std::size_t limit = size - MATCH_LIMIT;
+        const uint8_t *matchend = src + size - END_LITERALS;
+
+        std::size_t ip = 1;
+
+        while (ip <= limit)
+        {
+            uint32_t sequence = Read32(&src[ip]);
+            uint32_t &slot = table[Hash(sequence, hashbits)];
+            std::size_t ref = slot;
+
+            slot = static_cast<uint32_t>(ip);
+
+            if ((ref >= ip) || (ip - ref > MAX_OFFSET) || (Read32(&src[ref]) != sequence))
+            {
+                ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+
+            while ((ip > anchor) && (ref > 0) && (src[ip - 1] == src[ref - 1]))
+            {
+                ip--;
+                ref--;
+            }
+
+            std::size_t length = MIN_MATCH + MatchLength(&src[ip + MIN_MATCH], &src[ref + MIN_MATCH], matchend);
+
+            op = WriteSequence(op, oend, &src[anchor], ip - anchor, ip - ref, length);
+
+            if (nullptr == op)
+            {
+                return 0;
+            }
+
+            ip += length;
+            anchor = ip;
+
+            // Position inside the match keeps runs of repeated records found
+            if (ip <= limit)
+            {
+                table[Hash(Read32(&src[ip - 2]), hashbits)] = static_cast<uint32_t>(ip - 2);
+            }
+        }
+    }
+
+    op = WriteSequence(op, oend, &src[anchor], size - anchor, 0, 0);
+
+    if (nullptr == op)
+    {
+        return 0;
+    }
+
+    return static_cast<std::size_t>(op - dst);
+}
+
+bool Lz_Decompress(const uint8_t *src, std::size_t size, uint8_t *dst, std::size_t rawsize)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + size;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + rawsize;
+
+    for (;;)
+    {
+        if (ip >= iend)
+        {
+            return false;
+        }
+
+        uint8_t token = *ip++;
+        std::size_t literalscount = token >> 4;
+
+        if ((RUN_MASK == literalscount) && (false == ReadLength(ip, iend, literalscount)))
+        {
+            return false;
+        }
+
+        if ((literalscount > static_cast<std::size_t>(iend - ip)) || (literalscount > static_cast<std::size_t>(oend - op)))
+        {
+            return false;
+        }
+
+        std::memcpy(op, ip, literalscount);
+        op += literalscount;
+        ip += literalscount;
+
+        if (ip == iend)
+        {
+            return op == oend;
+        }
+
+        if (iend - ip < 2)
+        {
+            return false;
+        }
+
+        std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+        ip += 2;
+
+        if ((0 == offset) || (offset > static_cast<std::size_t>(op - dst)))
+        {
+            return false;
+        }
+
+        std::size_t length = token & RUN_MASK;
+
+        if ((RUN_MASK == length) && (false == ReadLength(ip, iend, length)))
+        {
+            return false;
+        }
+
+        length += MIN_MATCH;
+
+        if (length > static_cast<std::size_t>(oend - op))
+        {
+            return false;
+        }
+
+        const uint8_t *match = op - offset;
+
+        if ((offset >= sizeof(uint64_t)) && (length + sizeof(uint64_t) <= static_cast<std::size_t>(oend - op)))
+        {
+            // Chunks never overlap the bytes being written, the last one may write past the match
+            uint8_t *end = op + length;
+
+            for (; op < end; op += sizeof(uint64_t), match += sizeof(uint64_t))
+            {
+                std::memcpy(op, match, sizeof(uint64_t));
+            }
+
+            op = end;
+        }
+        else
+        {
+            // Overlapping match repeats the last offset bytes
+            for (std::size_t i = 0; i < length; i++)
+            {
+                op[i] = match[i];
+            }
+
+            op += length;
+        }
+    }
+}
@@ -0,0 +1,199 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cmath>
+
+#include "CpuFeatures.h"
+#include "Persistence.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(CPUFEATURES_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    void AverageScalar(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            int32_t difference = static_cast<int16_t>(samples[i] - state[i]);
+            state[i] = static_cast<uint16_t>(state[i] + ((difference * weight + 0x4000) >> 15));
+        }
+    }
+
+    void MaxHoldScalar(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            uint16_t held = (state[i] > decay) ? static_cast<uint16_t>(state[i] - decay) : 0;
+            state[i] = std::max(samples[i], held);
+        }
+    }
+
+#if defined(CPUFEATURES_X86)
+    /*
+     *  SSE2 has no rounding multiply: difference and weight pairs (d, 1) and (w, 0x4000) make madd return
+     *  d * w + 0x4000, shifted and packed back it is the result of mulhrs.
+     */
+    CPUFEATURES_TARGET("sse2")
+    void AverageSSE2(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i factor = _mm_unpacklo_epi16(_mm_set1_epi16(weight), _mm_set1_epi16(0x4000));
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[i]));
+            __m128i d = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i])), s);
+
+            __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(d, one), factor), 15);
+            __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(d, one), factor), 15);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[i]), _mm_add_epi16(s, _mm_packs_epi32(lo, hi)));
+        }
+
+        AverageScalar(&state[i], &samples[i], count - i, weight);
+    }
+
+    // Samples are 12-bit, the signed max orders them as unsigned
+    CPUFEATURES_TARGET("sse2")
+    void MaxHoldSSE2(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay)
+    {
+        const __m128i d = _mm_set1_epi16(static_cast<short>(decay));
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i held = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[i])), d);
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i]));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[i]), _mm_max_epi16(x, held));
+        }
+
+        MaxHoldScalar(&state[i], &samples[i], count - i, decay);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void AverageAVX2(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight)
+    {
+        const __m256i w = _mm256_set1_epi16(weight);
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&state[i]));
+            __m256i d = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i])), s);
+
+            // (d * w + 0x4000) >> 15
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&state[i]), _mm256_add_epi16(s, _mm256_mulhrs_epi16(d, w)));
+        }
+
+        AverageScalar(&state[i], &samples[i], count - i, weight);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void MaxHoldAVX2(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay)
+    {
+        const __m256i d = _mm256_set1_epi16(static_cast<short>(decay));
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i held = _mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(&state[i])), d);
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i]));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&state[i]), _mm256_max_epu16(x, held));
+        }
+
+        MaxHoldScalar(&state[i], &samples[i], count - i, decay);
+    }
+#endif
+
+#if defined(CPUFEATURES_NEON)
+    void AverageNEON(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight)
+    {
+        const int16x8_t w = vdupq_n_s16(weight);
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            int16x8_t s = vreinterpretq_s16_u16(vld1q_u16(&state[i]));
+            int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vld1q_u16(&samples[i])), s);
+
+            // Rounding doubling multiply high is (d * w + 0x4000) >> 15
+            vst1q_u16(&state[i], vreinterpretq_u16_s16(vaddq_s16(s, vqrdmulhq_s16(d, w))));
+        }
+
+        AverageScalar(&state[i], &samples[i], count - i, weight);
+    }
+
+    void MaxHoldNEON(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay)
+    {
+        const uint16x8_t d = vdupq_n_u16(decay);
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            vst1q_u16(&state[i], vmaxq_u16(vld1q_u16(&samples[i]), vqsubq_u16(vld1q_u16(&state[i]), d)));
+        }
+
+        MaxHoldScalar(&state[i], &samples[i], count - i, decay);
+    }
+#endif
+
+    const KernelInfo<PersistKernels> &GetDispatch()
+    {
+        static const KernelInfo<PersistKernels> dispatch = Kernel_Select<PersistKernels>();
+        return dispatch;
+    }
+}
+
+int16_t Persist_Weight(float weight)
+{
+    float q15 = std::round(std::max(0.0F, std::min(weight, 1.0F)) * 32768.0F);
+
+    return static_cast<int16_t>(std::max(1.0F, std::min(q15, 32767.0F)));
+}
+
+void Persist_Average(uint16_t *state, const uint16_t *samples, std::size_t count, int16_t weight)
+{
+    GetDispatch().functions.average(state, samples, count, weight);
+}
+
+void Persist_MaxHold(uint16_t *state, const uint16_t *samples, std::size_t count, uint16_t decay)
+{
+    GetDispatch().functions.maxhold(state, samples, count, decay);
+}
+
+const char *Persist_KernelName()
+{
+    return GetDispatch().name;
+}
+
+template<>
+const std::vector<KernelInfo<PersistKernels>> &Kernel_GetAll<PersistKernels>()
+{
+    static const std::vector<KernelInfo<PersistKernels>> kernels =
+    {
+        { { AverageScalar, MaxHoldScalar }, "scalar", nullptr },
+#if defined(CPUFEATURES_X86)
+        { { AverageSSE2, MaxHoldSSE2 }, "sse2", CpuFeatures_HasSSE2 },
+        { { AverageAVX2, MaxHoldAVX2 }, "avx2", CpuFeatures_HasAVX2 },
+#endif
+#if defined(CPUFEATURES_NEON)
+        { { AverageNEON, MaxHoldNEON }, "neon", nullptr },
+#endif
+    };
+
+    return kernels;
+}
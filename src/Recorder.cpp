@@ -0,0 +1,93 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <cctype>
+#include <cstring>
+
+#include "Recorder.h"
+#include "LineRecorder.h"
+#include "BlockRecorder.h"
+
+namespace
+{
+    const char BLOCK_RECORDING_EXTENSION[] = ".ssbr";
+
+    template <typename String>
+    bool IsBlockRecording(const String &filename)
+    {
+        std::size_t length = sizeof(BLOCK_RECORDING_EXTENSION) - 1;
+
+        if (filename.length() < length)
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < length; i++)
+        {
+            auto c = filename[filename.length() - length + i];
+
+            if ((static_cast<uint32_t>(c) > 127) || (std::tolower(static_cast<int>(c)) != BLOCK_RECORDING_EXTENSION[i]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename String>
+    std::unique_ptr<Recorder> OpenRecorder(const String &filename)
+    {
+        auto writer = std::make_unique<WriteBehind>(filename);
+
+        if (false != IsBlockRecording(filename))
+        {
+            return std::make_unique<BlockRecorder>(std::move(writer));
+        }
+
+        return std::make_unique<LineRecorder>(std::move(writer));
+    }
+}
+
+std::unique_ptr<Recorder> Recorder::Open(const std::string &filename)
+{
+    return OpenRecorder(filename);
+}
+
+#if !defined (__linux__)
+std::unique_ptr<Recorder> Recorder::Open(const std::wstring &filename)
+{
+    return OpenRecorder(filename);
+}
+#endif
+
+DATAHEADERV3 Recorder::ConvertHeader(const uint8_t *line)
+{
+    const DATAHEADER *pdh = reinterpret_cast<const DATAHEADER *>(line);
+
+    DATAHEADERV3 dhv3;
+    std::memcpy(&dhv3, pdh, sizeof(DATAHEADERV3));
+
+    dhv3.dataoffset = sizeof(DATAHEADERV3);
+    dhv3.latitude = 0;
+    dhv3.longitude = 0;
+
+    if (sizeof(DATAHEADERV1) == pdh->dataoffset)
+    {
+        // v1 DATAHEADER
+        dhv3.gyro = 0;
+        dhv3.compass = 0;
+        dhv3.samples += 16;
+    }
+    else if (sizeof(DATAHEADERV2) == pdh->dataoffset)
+    {
+        // v2 DATAHEADER
+        dhv3.samples += 8;
+    }
+    else
+    {
+        // v3 DATAHEADER
+        dhv3.gyro = 0;
+        dhv3.compass = 0;
+    }
+
+    return dhv3;
+}
@@ -0,0 +1,307 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cstring>
+
+#if defined( _WIN32 )
+#if !defined( NOMINMAX )
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "RecordingReader.h"
+#include "Recorder.h"
+#include "FrameScanner.h"
+
+RecordingLine RecordingIterator::operator*() const
+{
+    return reader->GetLine(line);
+}
+
+RecordingReader::RecordingReader(const std::string &filename) :
+    data(nullptr),
+    filesize(0),
+    skippedbytes(0),
+    opened(false)
+#if defined( _WIN32 )
+    ,
+    filehandle(INVALID_HANDLE_VALUE),
+    mappinghandle(nullptr)
+#endif
+{
+#if defined( _WIN32 )
+    filehandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    LARGE_INTEGER size;
+
+    if ((INVALID_HANDLE_VALUE == filehandle) || (0 == GetFileSizeEx(filehandle, &size)))
+    {
+        return;
+    }
+
+    filesize = static_cast<uint64_t>(size.QuadPart);
+
+    // An empty file cannot be mapped
+    if (0 != filesize)
+    {
+        mappinghandle = CreateFileMappingA(filehandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (nullptr == mappinghandle)
+        {
+            return;
+        }
+
+        data = static_cast<const uint8_t *>(MapViewOfFile(mappinghandle, FILE_MAP_READ, 0, 0, 0));
+
+        if (nullptr == data)
+        {
+            return;
+        }
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+
+    if (0 != fstat(fd, &st))
+    {
+        close(fd);
+        return;
+    }
+
+    filesize = static_cast<uint64_t>(st.st_size);
+
+    // An empty file cannot be mapped
+    if (0 != filesize)
+    {
+        void *mapping = mmap(nullptr, static_cast<std::size_t>(filesize), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED == mapping)
+        {
+            close(fd);
+            return;
+        }
+
+        data = static_cast<const uint8_t *>(mapping);
+    }
+
+    // The mapping keeps the file
+    close(fd);
+#endif
+
+    opened = true;
+
+    BuildIndex();
+}
+
+RecordingReader::~RecordingReader()
+{
+#if defined( _WIN32 )
+    if (nullptr != data)
+    {
+        UnmapViewOfFile(data);
+    }
+
+    if (nullptr != mappinghandle)
+    {
+        CloseHandle(mappinghandle);
+    }
+
+    if (INVALID_HANDLE_VALUE != filehandle)
+    {
+        CloseHandle(filehandle);
+    }
+#else
+    if (nullptr != data)
+    {
+        munmap(const_cast<uint8_t *>(data), static_cast<std::size_t>(filesize));
+    }
+#endif
+}
+
+void RecordingReader::BuildIndex()
+{
+    constexpr uint64_t MIN_LINE_SIZE = sizeof(DATAHEADERV3) + sizeof(DATAFOOTER);
+
+    uint64_t position = 0;
+    uint64_t linebytes = 0;
+    uint32_t turn = 0;
+    int prevangle = -1;
+
+    while (filesize - position >= MIN_LINE_SIZE)
+    {
+        // Lines follow each other in a recording, the kernel returns at once; garbage is skipped at SIMD speed
+        FRAMETOKENMATCH match = FrameScan_FindToken(&data[position], static_cast<std::size_t>(filesize - position), FRAME_TOKEN_DATA);
+
+        if (FRAME_TOKEN_NONE == match.token)
+        {
+            break;
+        }
+
+        position += match.offset;
+
+        if (filesize - position < MIN_LINE_SIZE)
+        {
+            break;
+        }
+
+        // Lines are not aligned in the file
+        DATAHEADERV3 dh;
+        DATAFOOTER df = { 0, 0 };
+
+        std::memcpy(&dh, &data[position], sizeof(dh));
+
+        bool isline = (sizeof(DATAHEADERV3) == dh.dataoffset) && (dh.samples >= MIN_LINE_SIZE) &&
+                      (dh.samples <= filesize - position);
+
+        if (false != isline)
+        {
+            std::memcpy(&df, &data[position + dh.samples - sizeof(DATAFOOTER)], sizeof(df));
+            isline = (FRAME_MAGIC_END0 == df.magic) || (FRAME_MAGIC_END1 == df.magic);
+        }
+
+        if (false == isline)
+        {
+            // "DATA" inside other bytes
+            position++;
+            continue;
+        }
+
+        int angle = static_cast<int>((dh.angle / 9) % RECORDING_TURN_LINES);
+
+        turn = Recording_NextTurn(turn, prevangle, angle);
+        prevangle = angle;
+
+        index.push_back({ position, dh.samples, df.timestamp, turn, static_cast<uint16_t>(angle) });
+
+        position += dh.samples;
+        linebytes += dh.samples;
+    }
+
+    timestampruns = Recording_TimestampRuns(index);
+    skippedbytes = filesize - linebytes;
+}
+
+bool RecordingReader::IsOpen() const
+{
+    return opened;
+}
+
+std::size_t RecordingReader::GetLinesCount() const
+{
+    return index.size();
+}
+
+uint32_t RecordingReader::GetTurnsCount() const
+{
+    return (false == index.empty()) ? index.back().turn + 1 : 0;
+}
+
+uint64_t RecordingReader::GetFileSize() const
+{
+    return filesize;
+}
+
+uint64_t RecordingReader::GetSkippedBytes() const
+{
+    return skippedbytes;
+}
+
+RecordingLine RecordingReader::GetLine(std::size_t line) const
+{
+    const LineEntry &entry = index.at(line);
+    const uint8_t *start = &data[entry.offset];
+
+    RecordingLine result;
+
+    std::memcpy(&result.header, start, sizeof(DATAHEADERV3));
+    result.samples = start + sizeof(DATAHEADERV3);
+    result.count = entry.size - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+    std::memcpy(&result.footer, start + entry.size - sizeof(DATAFOOTER), sizeof(DATAFOOTER));
+    result.offset = entry.offset;
+    result.turn = entry.turn;
+    result.angle = entry.angle;
+
+    return result;
+}
+
+RecordingIterator RecordingReader::begin() const
+{
+    return RecordingIterator(this, 0);
+}
+
+RecordingIterator RecordingReader::end() const
+{
+    return RecordingIterator(this, index.size());
+}
+
+RecordingIterator RecordingReader::SeekTimestamp(uint32_t timestamp) const
+{
+    return RecordingIterator(this, Recording_SeekTimestamp(index, timestampruns, timestamp));
+}
+
+RecordingIterator RecordingReader::SeekTurn(uint32_t turn) const
+{
+    auto found = std::lower_bound(index.begin(), index.end(), turn,
+                                  [](const LineEntry &entry, uint32_t value) { return entry.turn < value; });
+
+    if ((index.end() != found) && (turn != found->turn))
+    {
+        return end();
+    }
+
+    return RecordingIterator(this, static_cast<std::size_t>(found - index.begin()));
+}
+
+std::vector<RecordingRange> RecordingReader::Split(int parts, bool turns) const
+{
+    std::vector<RecordingRange> ranges;
+
+    if (false != index.empty())
+    {
+        return ranges;
+    }
+
+    parts = static_cast<int>(std::min<std::size_t>(std::max(1, parts), index.size()));
+
+    uint64_t first = index.front().offset;
+    uint64_t total = index.back().offset + index.back().size - first;
+    std::size_t start = 0;
+
+    for (int i = 1; i < parts; i++)
+    {
+        uint64_t target = first + total * i / parts;
+
+        auto cut = std::lower_bound(index.begin(), index.end(), target,
+                                    [](const LineEntry &entry, uint64_t value) { return entry.offset < value; });
+
+        if ((false != turns) && (index.end() != cut))
+        {
+            cut = SeekTurn(cut->turn).GetIndex() + index.begin();
+        }
+
+        std::size_t line = static_cast<std::size_t>(cut - index.begin());
+
+        if ((line > start) && (line < index.size()))
+        {
+            ranges.push_back({ RecordingIterator(this, start), RecordingIterator(this, line) });
+            start = line;
+        }
+    }
+
+    ranges.push_back({ RecordingIterator(this, start), end() });
+
+    return ranges;
+}
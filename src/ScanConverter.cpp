@@ -0,0 +1,522 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cmath>
+
+#include "CpuFeatures.h"
+#include "ScanConverter.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr int TILE_ROWS = 16;
+
+    // Changed lines redrawn by one thread; a ping changes fewer, so ConvertChanged does not wake the pool
+    constexpr std::size_t TILE_LINES = 32;
+    constexpr double TWO_PI = 6.283185307179586;
+
+    struct ConvertArgs
+    {
+        const uint16_t *data;
+        const int32_t *rowbase;
+        const uint16_t *line;
+        const uint16_t *line1;
+        const uint16_t *sample;
+        const uint8_t *wline;
+        const uint8_t *wsample;
+        uint16_t *dst;
+    };
+
+    typedef void (*ConvertKernel)(const ConvertArgs &args, std::size_t first, std::size_t last);
+
+    void NearestScalar(const ConvertArgs &args, std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; i++)
+        {
+            args.dst[i] = args.data[args.rowbase[args.line[i]] + args.sample[i]];
+        }
+    }
+
+    inline uint16_t BilinearPixel(const ConvertArgs &args, std::size_t i)
+    {
+        const uint16_t *p0 = &args.data[args.rowbase[args.line[i]] + args.sample[i]];
+        const uint16_t *p1 = &args.data[args.rowbase[args.line1[i]] + args.sample[i]];
+
+        uint32_t ws = args.wsample[i];
+        uint32_t wl = args.wline[i];
+
+        uint32_t v0 = p0[0] * (256 - ws) + p0[1] * ws;
+        uint32_t v1 = p1[0] * (256 - ws) + p1[1] * ws;
+
+        return static_cast<uint16_t>((v0 * (256 - wl) + v1 * wl + 32768) >> 16);
+    }
+
+    void BilinearScalar(const ConvertArgs &args, std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; i++)
+        {
+            args.dst[i] = BilinearPixel(args, i);
+        }
+    }
+
+    // Pixels of a line are scattered over the image, the gather does not pay off without a scatter
+    void NearestList(const ConvertArgs &args, const uint32_t *pixels, std::size_t count)
+    {
+        for (std::size_t k = 0; k < count; k++)
+        {
+            uint32_t i = pixels[k];
+            args.dst[i] = args.data[args.rowbase[args.line[i]] + args.sample[i]];
+        }
+    }
+
+    void BilinearList(const ConvertArgs &args, const uint32_t *pixels, std::size_t count)
+    {
+        for (std::size_t k = 0; k < count; k++)
+        {
+            args.dst[pixels[k]] = BilinearPixel(args, pixels[k]);
+        }
+    }
+
+#if defined(CPUFEATURES_X86)
+    CPUFEATURES_TARGET("avx2")
+    inline __m256i GatherSamples(const ConvertArgs &args, const uint16_t *line, std::size_t i)
+    {
+        // 32 bits at the sample: the sample in the low half, the next one in the high half
+        __m256i lines = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&line[i])));
+        __m256i samples = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&args.sample[i])));
+        __m256i index = _mm256_add_epi32(_mm256_i32gather_epi32(args.rowbase, lines, 4), samples);
+
+        return _mm256_i32gather_epi32(reinterpret_cast<const int *>(args.data), index, 2);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void NearestAVX2(const ConvertArgs &args, std::size_t first, std::size_t last)
+    {
+        const __m256i lowmask = _mm256_set1_epi32(0xFFFF);
+
+        std::size_t i = first;
+
+        for (; i + 16 <= last; i += 16)
+        {
+            __m256i v0 = _mm256_and_si256(GatherSamples(args, args.line, i), lowmask);
+            __m256i v1 = _mm256_and_si256(GatherSamples(args, args.line, i + 8), lowmask);
+
+            // Pack works inside 128-bit lanes, quadwords 0,2,1,3 restore the order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&args.dst[i]), packed);
+        }
+
+        NearestScalar(args, i, last);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void BilinearAVX2(const ConvertArgs &args, std::size_t first, std::size_t last)
+    {
+        const __m256i one = _mm256_set1_epi32(256);
+        const __m256i rounding = _mm256_set1_epi32(32768);
+
+        std::size_t i = first;
+
+        for (; i + 8 <= last; i += 8)
+        {
+            __m256i ws = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&args.wsample[i])));
+            __m256i wl = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&args.wline[i])));
+
+            // 16-bit weight pairs (256 - ws, ws) match the sample pairs of the gather
+            __m256i wpair = _mm256_or_si256(_mm256_sub_epi32(one, ws), _mm256_slli_epi32(ws, 16));
+
+            __m256i v0 = _mm256_madd_epi16(GatherSamples(args, args.line, i), wpair);
+            __m256i v1 = _mm256_madd_epi16(GatherSamples(args, args.line1, i), wpair);
+
+            __m256i v = _mm256_add_epi32(_mm256_mullo_epi32(v0, _mm256_sub_epi32(one, wl)), _mm256_mullo_epi32(v1, wl));
+            v = _mm256_srli_epi32(_mm256_add_epi32(v, rounding), 16);
+
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&args.dst[i]), _mm256_castsi256_si128(packed));
+        }
+
+        BilinearScalar(args, i, last);
+    }
+#endif
+
+    struct ConvertDispatch
+    {
+        ConvertKernel nearest;
+        ConvertKernel bilinear;
+        const char *name;
+    };
+
+    ConvertDispatch SelectKernel()
+    {
+#if defined(CPUFEATURES_X86)
+        if (false != CpuFeatures_HasAVX2())
+        {
+            return { NearestAVX2, BilinearAVX2, "avx2" };
+        }
+#endif
+        return { NearestScalar, BilinearScalar, "scalar" };
+    }
+
+    const ConvertDispatch &GetDispatch()
+    {
+        static const ConvertDispatch dispatch = SelectKernel();
+        return dispatch;
+    }
+}
+
+ScanConverter::ScanConverter(int width, int height, int range, int linesperfullturn, bool bilinear, int threads) :
+    width(std::max(1, width)),
+    height(std::max(1, height)),
+    range(std::max(0, range)),
+    threadscount(threads),
+    bilinear(bilinear),
+    tablesamples(-1),
+    tablelines(std::max(1, linesperfullturn)),
+    image(static_cast<std::size_t>(this->width) * this->height, 0),
+    convertedimage(nullptr),
+    convertedepoch(0),
+    job(nullptr),
+    jobitems(0),
+    jobtileitems(1),
+    jobgeneration(0),
+    jobbusy(0),
+    stopping(false),
+    nexttile(0)
+{
+    if (threadscount <= 0)
+    {
+        threadscount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    // The caller converts tiles too
+    for (int i = 1; i < threadscount; i++)
+    {
+        workers.emplace_back(&ScanConverter::WorkerThread, this);
+    }
+}
+
+ScanConverter::~ScanConverter()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobmutex);
+        stopping = true;
+    }
+
+    jobready.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+const uint16_t *ScanConverter::GetImage() const
+{
+    return image.data();
+}
+
+int ScanConverter::GetWidth() const
+{
+    return width;
+}
+
+int ScanConverter::GetHeight() const
+{
+    return height;
+}
+
+const char *ScanConverter::KernelName()
+{
+    return GetDispatch().name;
+}
+
+void ScanConverter::WorkerThread()
+{
+    uint64_t done = 0;
+
+    for (;;)
+    {
+        const std::function<void(std::size_t, std::size_t)> *current;
+        std::size_t items;
+        std::size_t tileitems;
+
+        {
+            std::unique_lock<std::mutex> lock(jobmutex);
+            jobready.wait(lock, [&]() { return (false != stopping) || (done != jobgeneration); });
+
+            if (false != stopping)
+            {
+                return;
+            }
+
+            done = jobgeneration;
+            current = job;
+            items = jobitems;
+            tileitems = jobtileitems;
+        }
+
+        std::size_t first;
+
+        while ((first = nexttile.fetch_add(tileitems)) < items)
+        {
+            (*current)(first, std::min(first + tileitems, items));
+        }
+
+        std::lock_guard<std::mutex> lock(jobmutex);
+
+        if (0 == --jobbusy)
+        {
+            jobdone.notify_one();
+        }
+    }
+}
+
+void ScanConverter::RunTiles(std::size_t items, std::size_t tileitems, const std::function<void(std::size_t, std::size_t)> &tilejob)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobmutex);
+
+        job = &tilejob;
+        jobitems = items;
+        jobtileitems = tileitems;
+        nexttile = 0;
+        jobbusy = static_cast<int>(workers.size());
+        jobgeneration++;
+    }
+
+    jobready.notify_all();
+
+    std::size_t first;
+
+    while ((first = nexttile.fetch_add(tileitems)) < items)
+    {
+        tilejob(first, std::min(first + tileitems, items));
+    }
+
+    std::unique_lock<std::mutex> lock(jobmutex);
+    jobdone.wait(lock, [&]() { return 0 == jobbusy; });
+}
+
+void ScanConverter::BuildTable(int samplesperline, int linesperfullturn)
+{
+    std::size_t pixels = image.size();
+
+    tablesamples = samplesperline;
+    tablelines = linesperfullturn;
+
+    pixelline.assign(pixels, 0);
+    pixelsample.assign(pixels, 0);
+    pixelline1.assign((false != bilinear) ? pixels : 0, 0);
+    pixelwline.assign((false != bilinear) ? pixels : 0, 0);
+    pixelwsample.assign((false != bilinear) ? pixels : 0, 0);
+    rowbase.assign(linesperfullturn + 1, 0);
+
+    double radius = std::min(width, height) / 2.0;
+    double samplesperpixel = ((0 != range) ? range : samplesperline) / radius;
+
+    // Bilinear reads the next sample as well
+    int lastsample = (false != bilinear) ? samplesperline - 1 : samplesperline;
+
+    RunTiles(pixels, static_cast<std::size_t>(TILE_ROWS) * width, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; i++)
+        {
+            double dx = static_cast<double>(i % width) + 0.5 - width / 2.0;
+            double dy = static_cast<double>(i / width) + 0.5 - height / 2.0;
+            double distance = std::sqrt(dx * dx + dy * dy);
+            double sample = distance * samplesperpixel;
+
+            if ((distance >= radius) || (sample >= lastsample))
+            {
+                // Zero padding after the last row
+                pixelline[i] = static_cast<uint16_t>(linesperfullturn);
+
+                if (false != bilinear)
+                {
+                    pixelline1[i] = static_cast<uint16_t>(linesperfullturn);
+                }
+
+                continue;
+            }
+
+            // Clockwise from up
+            double angle = std::atan2(dx, -dy);
+            double line = ((angle < 0.0) ? angle + TWO_PI : angle) / TWO_PI * linesperfullturn;
+
+            if (false != bilinear)
+            {
+                int line0 = static_cast<int>(line);
+
+                pixelline[i] = static_cast<uint16_t>(line0 % linesperfullturn);
+                pixelline1[i] = static_cast<uint16_t>((line0 + 1) % linesperfullturn);
+                pixelsample[i] = static_cast<uint16_t>(sample);
+                pixelwline[i] = static_cast<uint8_t>((line - line0) * 256.0);
+                pixelwsample[i] = static_cast<uint8_t>((sample - static_cast<int>(sample)) * 256.0);
+            }
+            else
+            {
+                pixelline[i] = static_cast<uint16_t>(static_cast<int>(line + 0.5) % linesperfullturn);
+                pixelsample[i] = static_cast<uint16_t>(sample);
+            }
+        }
+    });
+
+    BuildLineIndex();
+}
+
+void ScanConverter::BuildLineIndex()
+{
+    std::size_t pixels = image.size();
+
+    lineoffset.assign(tablelines + 1, 0);
+
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+        if (pixelline[i] < tablelines)
+        {
+            lineoffset[pixelline[i] + 1]++;
+
+            if ((false != bilinear) && (pixelline1[i] != pixelline[i]))
+            {
+                lineoffset[pixelline1[i] + 1]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < tablelines; i++)
+    {
+        lineoffset[i + 1] += lineoffset[i];
+    }
+
+    std::vector<uint32_t> position(lineoffset.begin(), lineoffset.end() - 1);
+
+    linepixels.resize(lineoffset[tablelines]);
+
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+        if (pixelline[i] < tablelines)
+        {
+            linepixels[position[pixelline[i]]++] = static_cast<uint32_t>(i);
+
+            if ((false != bilinear) && (pixelline1[i] != pixelline[i]))
+            {
+                linepixels[position[pixelline1[i]]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+}
+
+void ScanConverter::UpdateRowBase(const SonarData &sonardata)
+{
+    int samplesperline = sonardata.GetSamplesPerLine();
+
+    // Aliases of the lines skipped by stepping are resolved once per conversion
+    for (int i = 0; i < tablelines; i++)
+    {
+        rowbase[i] = sonardata.GetLineRow(i) * samplesperline;
+    }
+
+    rowbase[tablelines] = tablelines * samplesperline;
+}
+
+const uint16_t *ScanConverter::Convert(const SonarData &sonardata)
+{
+    int samplesperline = sonardata.GetSamplesPerLine();
+    int linesperfullturn = sonardata.GetLinesPerFullTurn();
+
+    if ((samplesperline != tablesamples) || (linesperfullturn != tablelines))
+    {
+        BuildTable(samplesperline, linesperfullturn);
+    }
+
+    // Lines stored during the conversion are redrawn by the next ConvertChanged
+    convertedimage = &sonardata;
+    convertedepoch = sonardata.GetEpoch();
+
+    UpdateRowBase(sonardata);
+
+    ConvertArgs args =
+    {
+        sonardata.GetRawSonarData(), rowbase.data(),
+        pixelline.data(), pixelline1.data(), pixelsample.data(), pixelwline.data(), pixelwsample.data(),
+        image.data()
+    };
+
+    ConvertKernel kernel = (false != bilinear) ? GetDispatch().bilinear : GetDispatch().nearest;
+
+    RunTiles(image.size(), static_cast<std::size_t>(TILE_ROWS) * width, [&](std::size_t first, std::size_t last)
+    {
+        kernel(args, first, last);
+    });
+
+    return image.data();
+}
+
+const uint16_t *ScanConverter::ConvertChanged(const SonarData &sonardata, int *changed)
+{
+    bool samegeometry = (sonardata.GetSamplesPerLine() == tablesamples) && (sonardata.GetLinesPerFullTurn() == tablelines);
+
+    if ((&sonardata != convertedimage) || (false == samegeometry) || (sonardata.GetEpoch() < convertedepoch))
+    {
+        if (nullptr != changed)
+        {
+            *changed = sonardata.GetLinesPerFullTurn();
+        }
+
+        return Convert(sonardata);
+    }
+
+    convertedepoch = sonardata.GetChangedLines(convertedepoch, changedlines);
+
+    if (nullptr != changed)
+    {
+        *changed = static_cast<int>(changedlines.size());
+    }
+
+    if (true == changedlines.empty())
+    {
+        return image.data();
+    }
+
+    UpdateRowBase(sonardata);
+
+    ConvertArgs args =
+    {
+        sonardata.GetRawSonarData(), rowbase.data(),
+        pixelline.data(), pixelline1.data(), pixelsample.data(), pixelwline.data(), pixelwsample.data(),
+        image.data()
+    };
+
+    auto redraw = [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; i++)
+        {
+            int line = changedlines[i];
+            const uint32_t *pixels = &linepixels[lineoffset[line]];
+            std::size_t count = lineoffset[line + 1] - lineoffset[line];
+
+            if (false != bilinear)
+            {
+                BilinearList(args, pixels, count);
+            }
+            else
+            {
+                NearestList(args, pixels, count);
+            }
+        }
+    };
+
+    if (changedlines.size() <= TILE_LINES)
+    {
+        redraw(0, changedlines.size());
+    }
+    else
+    {
+        // A bilinear pixel of 2 changed lines is drawn by both, with the same value
+        RunTiles(changedlines.size(), TILE_LINES, redraw);
+    }
+
+    return image.data();
+}
@@ -2,7 +2,6 @@
 #include "Scansonar.h"
 #include "SonarStructures.h"
 
-#include "serial/serial.h"
 
 #include <iostream>
 
@@ -25,9 +24,12 @@ void Scansonar::SetDefaultSettings()
     scansonar_settings_[IdTxLength]         = "20";
     scansonar_settings_[IdSamplFreq]        = "100000";
     scansonar_settings_[IdSamples]          = "1376";   // 10meters
-    scansonar_settings_[IdInterval]         = std::to_string(GetPingInterval(1376, 1, GetSerialPort()->getBaudrate()));
+    scansonar_settings_[IdInterval]         = std::to_string(GetPingInterval(1376, 1, GetTransport()->GetBaudrate()));
     scansonar_settings_[IdGain]             = "0.0";
     scansonar_settings_[IdTVGTime]          = "80";
+    scansonar_settings_[IdSound]            = "1500";
+    scansonar_settings_[IdThreshold]        = "10";
+    scansonar_settings_[IdDeadzone]         = "300";
     scansonar_settings_[IdCommandID]        = "538444416";
 
     scansonar_settings_[IdSectorHeading]    = "0";
@@ -185,7 +187,7 @@ int Scansonar::SendSettings()
         return -1;
     }
 
-    const auto& interval = std::to_string(GetPingInterval(dcsp.samples, dssp.stepping_mode, GetSerialPort()->getBaudrate()));
+    const auto& interval = std::to_string(GetPingInterval(dcsp.samples, dssp.stepping_mode, GetTransport()->GetBaudrate()));
     scansonar_settings_[IdInterval] = interval; // Update interval value internally
 
     if (false == interval.empty())
@@ -197,26 +199,45 @@ int Scansonar::SendSettings()
         return -1;
     }
 
+    const auto& sound = scansonar_settings_[IdSound];
+
+    if (false == sound.empty())
+    {
+        // Not sent to the sonar, the host TVG needs it
+        threadsonarserial_->SetSoundSpeed(std::stof(sound));
+    }
+
+    // Detector limits are not sent to the sonar either, IdRange is not set by default and detects the whole line
+    const auto& threshold = scansonar_settings_[IdThreshold];
+    const auto& deadzone = scansonar_settings_[IdDeadzone];
+    const auto& range = scansonar_settings_[IdRange];
+
+    threadsonarserial_->SetDetectorLimits((false == threshold.empty()) ? std::stof(threshold) / 100.0F : 0.0F,
+                                          (false == deadzone.empty()) ? std::stof(deadzone) / 1000.0F : 0.0F,
+                                          (false == range.empty()) ? std::stof(range) : 0.0F);
+
     threadsonarserial_->SetSonarParams(&dcsp, &dssp);
 
     return 0;
 }
 
-Scansonar::Scansonar(std::shared_ptr<serial::Serial> SerialPort, std::wstring filename, std::function<void(char*, int)> cbfunc, std::map<int, ScansonarCommandList>& CommandList) :
-    serial_port_(SerialPort),
+#if !defined (__linux__)
+Scansonar::Scansonar(std::shared_ptr<Transport> SonarTransport, std::wstring filename, std::function<void(char*, int)> cbfunc, std::map<int, ScansonarCommandList>& CommandList) :
+    transport_(SonarTransport),
     is_detected_(false)
 {
-    threadsonarserial_ = std::make_unique<ThreadSonarSerial>(SerialPort, filename, cbfunc);
+    threadsonarserial_ = std::make_unique<ThreadSonarSerial>(SonarTransport, filename, cbfunc);
 
     SetDefaultSettings();
     SendSettings();
 }
+#endif
 
-Scansonar::Scansonar(std::shared_ptr<serial::Serial> SerialPort, std::string filename, std::function<void(char*, int)> cbfunc, std::map<int, ScansonarCommandList>& CommandList) :
-    serial_port_(SerialPort),
+Scansonar::Scansonar(std::shared_ptr<Transport> SonarTransport, std::string filename, std::function<void(char*, int)> cbfunc, std::map<int, ScansonarCommandList>& CommandList) :
+    transport_(SonarTransport),
     is_detected_(false)
 {
-    threadsonarserial_ = std::make_unique<ThreadSonarSerial>(SerialPort, filename, cbfunc);
+    threadsonarserial_ = std::make_unique<ThreadSonarSerial>(SonarTransport, filename, cbfunc);
 
     SetDefaultSettings();
     SendSettings();
@@ -368,6 +389,20 @@ bool Scansonar::SetValue(ScansonarCommandIds Command, const std::string& SonarVa
 
             break;
         }
+        case IdDeadzone:
+        {
+            int minvalue = 0;
+            int maxvalue = 100000;
+
+            retvalue = (ivalue < minvalue) ? false : (ivalue > maxvalue) ? false : true;
+
+            if (true == retvalue)
+            {
+                scansonar_settings_[IdDeadzone] = SonarValue;
+            }
+
+            break;
+        }
         case IdThreshold:
         {
             int minvalue = 5;
@@ -484,9 +519,9 @@ bool Scansonar::IsDetected()
 
 }
 
-std::shared_ptr<serial::Serial>& Scansonar::GetSerialPort()
+std::shared_ptr<Transport>& Scansonar::GetTransport()
 {
-    return serial_port_;
+    return transport_;
 }
 
 void Scansonar::GetSettings()
@@ -510,4 +545,64 @@ void Scansonar::Stop()
 uint16_t* Scansonar::GetRawSonarData() const
 {
     return threadsonarserial_->GetSonarData();
+}
+
+const FrameRing &Scansonar::GetFrameRing() const
+{
+    return threadsonarserial_->GetFrameRing();
+}
+
+std::shared_ptr<const SonarData> Scansonar::GetSonarImage() const
+{
+    return threadsonarserial_->GetSonarImage();
+}
+
+uint32_t Scansonar::GetSonarImageGeneration() const
+{
+    return threadsonarserial_->GetSonarImageGeneration();
+}
+
+void Scansonar::SetSonarPyramid(int levels, DecimationMode mode)
+{
+    threadsonarserial_->SetSonarPyramid(levels, mode);
+}
+
+void Scansonar::SetSonarPersistence(const PersistenceSettings &settings)
+{
+    threadsonarserial_->SetSonarPersistence(settings);
+}
+
+void Scansonar::SetTvgCompensation(bool enabled, const TvgModel &model)
+{
+    threadsonarserial_->SetTvgCompensation(enabled, model);
+}
+
+void Scansonar::SetDetector(DetectMode mode, std::function<void(const Detection &)> callback)
+{
+    threadsonarserial_->SetDetector(mode, std::move(callback));
+}
+
+LineDetector &Scansonar::GetDetector() const
+{
+    return threadsonarserial_->GetDetector();
+}
+
+void Scansonar::SetChangeDetection(const ChangeSettings &settings, std::function<void(const ChangeSegment *, std::size_t)> callback)
+{
+    threadsonarserial_->SetChangeDetection(settings, std::move(callback));
+}
+
+ChangeDetector &Scansonar::GetChangeDetector() const
+{
+    return threadsonarserial_->GetChangeDetector();
+}
+
+const FramePool &Scansonar::GetFramePool() const
+{
+    return threadsonarserial_->GetFramePool();
+}
+
+Recorder &Scansonar::GetRecorder() const
+{
+    return threadsonarserial_->GetRecorder();
 }
\ No newline at end of file
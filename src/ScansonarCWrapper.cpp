@@ -1,11 +1,17 @@
 // Copyright (c) EofE Ultrasonics Co., Ltd., 2024
 #include <cstdio>
 #include <cstdarg>
+#include <algorithm>
+#include <memory>
 #include <string>
 
 #include "Scansonar.h"
 #include "ScansonarCWrapper.h"
-#include "serial/serial.h"
+#include "SerialTransport.h"
+#include "FileTransport.h"
+#include "BlockReader.h"
+#include "Uncompand.h"
+#include "ScanConverter.h"
 
 #if defined(_MSC_VER) && _MSC_VER < 1900
 
@@ -48,14 +54,42 @@ pSnrCtx ScansonarOpen(const char* portpath, uint32_t baudrate, const wchar_t* fi
 
     try
     {
-        std::shared_ptr<serial::Serial> serialPort(new serial::Serial(portpath, baudrate, serial::Timeout::simpleTimeout(SERIALPORT_TIMEOUT_MS)));
+        std::shared_ptr<Transport> transport = std::make_shared<SerialTransport>(portpath, baudrate, SERIALPORT_TIMEOUT_MS);
         if (nullptr == line_cb)
         {
-            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(serialPort, filename));
+            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(transport, filename));
         }
         else
         {
-            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(serialPort, filename, line_cb));
+            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(transport, filename, line_cb));
+        }
+    }
+    catch(...)
+    {
+        // In case of any exception this function returns nullptr
+    }
+
+    return ctx;
+}
+
+#if defined (__linux__)
+pSnrCtx ScansonarOpenUri(const char* uri, uint32_t baudrate, const char* filename, void(* const line_cb)(char*, int))
+#else
+pSnrCtx ScansonarOpenUri(const char* uri, uint32_t baudrate, const wchar_t* filename, void(*const line_cb)(char*, int))
+#endif
+{
+    pSnrCtx ctx = nullptr;
+
+    try
+    {
+        std::shared_ptr<Transport> transport = Transport::Open(uri, baudrate, SERIALPORT_TIMEOUT_MS);
+        if (nullptr == line_cb)
+        {
+            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(transport, filename));
+        }
+        else
+        {
+            ctx = reinterpret_cast<pSnrCtx>(new Scansonar(transport, filename, line_cb));
         }
     }
     catch(...)
@@ -76,7 +110,7 @@ void ScansonarClose(pSnrCtx snrctx)
 size_t ScansonarReadData(pSnrCtx snrctx, uint8_t *buffer, size_t size)
 {
     auto ss = reinterpret_cast<Scansonar*>(snrctx);
-    return ss->GetSerialPort()->read(buffer, size);
+    return ss->GetTransport()->Read(buffer, size);
 }
 
 long ScansonarValueToLong(pcEchosounderValue value)
@@ -165,3 +199,762 @@ uint16_t* GetRawSonarData(pSnrCtx snrctx)
     auto ss = reinterpret_cast<Scansonar*>(snrctx);
     return ss->GetRawSonarData();
 }
+
+const uint16_t* ScansonarGetSonarLine(pSnrCtx snrctx, int line)
+{
+    if (nullptr == snrctx)
+    {
+        return nullptr;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto image = ss->GetSonarImage();
+
+    if ((line < 0) || (line >= image->GetLinesPerFullTurn()))
+    {
+        return nullptr;
+    }
+
+    return image->GetLine(line);
+}
+
+int ScansonarCopySonarData(pSnrCtx snrctx, uint16_t *dst, size_t count)
+{
+    if ((nullptr == snrctx) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto image = ss->GetSonarImage();
+
+    if (count < static_cast<size_t>(image->GetSamplesPerLine()) * image->GetLinesPerFullTurn())
+    {
+        return -1;
+    }
+
+    image->MaterializeDense(dst);
+
+    return 0;
+}
+
+int ScansonarGetGeometry(pSnrCtx snrctx, pScansonarGeometry geometry)
+{
+    if ((nullptr == snrctx) || (nullptr == geometry))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto image = ss->GetSonarImage();
+
+    geometry->samplesperline = static_cast<uint32_t>(image->GetSamplesPerLine());
+    geometry->linesperfullturn = static_cast<uint32_t>(image->GetLinesPerFullTurn());
+    geometry->generation = ss->GetSonarImageGeneration();
+
+    return 0;
+}
+
+int ScansonarGetSnapshot(pSnrCtx snrctx, uint16_t *dst, size_t count, pScansonarSnapshot snapshot)
+{
+    if ((nullptr == snrctx) || (nullptr == dst) || (nullptr == snapshot))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    uint32_t generation = ss->GetSonarImageGeneration();
+    auto image = ss->GetSonarImage();
+
+    if (count < static_cast<size_t>(image->GetSamplesPerLine()) * image->GetLinesPerFullTurn())
+    {
+        return -1;
+    }
+
+    // dst of another image is refreshed whole
+    uint64_t since = (generation == snapshot->generation) ? snapshot->epoch : 0;
+    int lines = 0;
+
+    snapshot->epoch = image->Snapshot(dst, since, &lines);
+    snapshot->generation = generation;
+    snapshot->lines = static_cast<uint32_t>(lines);
+
+    return 0;
+}
+
+int ScansonarSetPyramid(pSnrCtx snrctx, uint32_t levels, uint32_t mode)
+{
+    if ((nullptr == snrctx) || (levels > static_cast<uint32_t>(SonarData::MAX_PYRAMID_LEVELS)) || (mode > SCANSONAR_DECIMATION_PEAK))
+    {
+        return -1;
+    }
+
+    static const DecimationMode modes[] = { DecimationMode::DMode_Max, DecimationMode::DMode_Mean, DecimationMode::DMode_Peak };
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->SetSonarPyramid(static_cast<int>(levels), modes[mode]);
+
+    return 0;
+}
+
+int ScansonarGetPyramidLine(pSnrCtx snrctx, uint32_t level, int line, uint16_t *dst, size_t count)
+{
+    if ((nullptr == snrctx) || (nullptr == dst) || (level > static_cast<uint32_t>(SonarData::MAX_PYRAMID_LEVELS)))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto image = ss->GetSonarImage();
+
+    int samples = image->GetLevelSamplesPerLine(static_cast<int>(level));
+
+    if ((0 == samples) || (line < 0) || (line >= image->GetLinesPerFullTurn()) || (count < static_cast<size_t>(samples)))
+    {
+        return -1;
+    }
+
+    image->ReadLevelLine(static_cast<int>(level), line, dst);
+
+    return samples;
+}
+
+int ScansonarSetPersistence(pSnrCtx snrctx, uint32_t mode, float weight, uint32_t decay)
+{
+    if ((nullptr == snrctx) || (mode > SCANSONAR_PERSISTENCE_MAXHOLD) || (weight < 0.0F) || (weight > 1.0F) || (decay > 0xFFFFU))
+    {
+        return -1;
+    }
+
+    static const PersistenceMode modes[] =
+    {
+        PersistenceMode::PMode_Off, PersistenceMode::PMode_Average, PersistenceMode::PMode_MaxHold
+    };
+
+    PersistenceSettings settings = { modes[mode], weight, static_cast<uint16_t>(decay) };
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->SetSonarPersistence(settings);
+
+    return 0;
+}
+
+int ScansonarGetPersistenceLine(pSnrCtx snrctx, int line, uint16_t *dst, size_t count)
+{
+    if ((nullptr == snrctx) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto image = ss->GetSonarImage();
+
+    int samples = image->GetSamplesPerLine();
+
+    if ((nullptr == image->GetPersistenceData()) || (line < 0) || (line >= image->GetLinesPerFullTurn()) ||
+        (count < static_cast<size_t>(samples)))
+    {
+        return -1;
+    }
+
+    image->ReadPersistenceLine(line, dst);
+
+    return samples;
+}
+
+const uint16_t* ScansonarGetPersistenceData(pSnrCtx snrctx)
+{
+    if (nullptr == snrctx)
+    {
+        return nullptr;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+
+    return ss->GetSonarImage()->GetPersistenceData();
+}
+
+namespace
+{
+    /**
+     *  Image kept by ScansonarImageAcquire, the reference keeps it allocated after it is replaced
+     */
+    struct AcquiredImage
+    {
+        std::shared_ptr<const SonarData> image;
+        uint32_t generation;
+    };
+}
+
+pScansonarImage ScansonarImageAcquire(pSnrCtx snrctx)
+{
+    if (nullptr == snrctx)
+    {
+        return nullptr;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    pScansonarImage image = nullptr;
+
+    try
+    {
+        // Generation first: a replacement in between makes it older, never newer than the image
+        uint32_t generation = ss->GetSonarImageGeneration();
+
+        image = reinterpret_cast<pScansonarImage>(new AcquiredImage{ ss->GetSonarImage(), generation });
+    }
+    catch(...)
+    {
+        // In case of any exception this function returns nullptr
+    }
+
+    return image;
+}
+
+void ScansonarImageRelease(pScansonarImage image)
+{
+    auto acquired = reinterpret_cast<AcquiredImage*>(image);
+    delete acquired;
+}
+
+int ScansonarImageGetGeometry(pScansonarImage image, pScansonarGeometry geometry)
+{
+    if ((nullptr == image) || (nullptr == geometry))
+    {
+        return -1;
+    }
+
+    auto acquired = reinterpret_cast<AcquiredImage*>(image);
+
+    geometry->samplesperline = static_cast<uint32_t>(acquired->image->GetSamplesPerLine());
+    geometry->linesperfullturn = static_cast<uint32_t>(acquired->image->GetLinesPerFullTurn());
+    geometry->generation = acquired->generation;
+
+    return 0;
+}
+
+const uint16_t* ScansonarImageGetData(pScansonarImage image)
+{
+    if (nullptr == image)
+    {
+        return nullptr;
+    }
+
+    return reinterpret_cast<AcquiredImage*>(image)->image->GetRawSonarData();
+}
+
+const uint16_t* ScansonarImageGetLine(pScansonarImage image, int line)
+{
+    if (nullptr == image)
+    {
+        return nullptr;
+    }
+
+    auto acquired = reinterpret_cast<AcquiredImage*>(image);
+
+    if ((line < 0) || (line >= acquired->image->GetLinesPerFullTurn()))
+    {
+        return nullptr;
+    }
+
+    return acquired->image->GetLine(line);
+}
+
+const uint16_t* ScansonarImageGetPersistenceData(pScansonarImage image)
+{
+    if (nullptr == image)
+    {
+        return nullptr;
+    }
+
+    return reinterpret_cast<AcquiredImage*>(image)->image->GetPersistenceData();
+}
+
+int ScansonarSetTvgCompensation(pSnrCtx snrctx, uint32_t enable, uint32_t spreading, uint32_t absorption,
+                                float absorptiondbkm, uint32_t flags)
+{
+    if ((nullptr == snrctx) || (spreading > SCANSONAR_TVG_40LOGR) || (absorption > SCANSONAR_ABSORPTION_THORP) ||
+        (absorptiondbkm < 0.0F))
+    {
+        return -1;
+    }
+
+    static const TvgSpreading spreadings[] =
+    {
+        TvgSpreading::TSpreading_20LogR, TvgSpreading::TSpreading_30LogR, TvgSpreading::TSpreading_40LogR
+    };
+
+    static const TvgAbsorption absorptions[] =
+    {
+        TvgAbsorption::TAbsorption_None, TvgAbsorption::TAbsorption_Fixed, TvgAbsorption::TAbsorption_Thorp
+    };
+
+    TvgModel model = { spreadings[spreading], absorptions[absorption], absorptiondbkm, 0 != (flags & SCANSONAR_TVG_AFTER_SONAR_TVG) };
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->SetTvgCompensation(0 != enable, model);
+
+    return 0;
+}
+
+int ScansonarSetDetector(pSnrCtx snrctx, uint32_t mode, void(*const detection_cb)(const ScansonarDetection*))
+{
+    if ((nullptr == snrctx) || (mode > SCANSONAR_DETECT_PEAK))
+    {
+        return -1;
+    }
+
+    static const DetectMode modes[] = { DetectMode::DtMode_Off, DetectMode::DtMode_FirstReturn, DetectMode::DtMode_Peak };
+
+    std::function<void(const Detection &)> callback;
+
+    if (nullptr != detection_cb)
+    {
+        callback = [detection_cb](const Detection &detection)
+        {
+            ScansonarDetection cdetection = { detection.timestamp, detection.angle, detection.amplitude, detection.range };
+            detection_cb(&cdetection);
+        };
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->SetDetector(modes[mode], std::move(callback));
+
+    return 0;
+}
+
+int ScansonarReadDetections(pSnrCtx snrctx, pScansonarDetection dst, size_t count)
+{
+    if ((nullptr == snrctx) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    LineDetector &detector = ss->GetDetector();
+
+    Detection detections[64];
+    size_t copied = 0;
+
+    while (copied < count)
+    {
+        size_t read = detector.Read(detections, std::min(count - copied, sizeof(detections) / sizeof(detections[0])));
+
+        for (size_t i = 0; i < read; i++)
+        {
+            dst[copied + i] = { detections[i].timestamp, detections[i].angle, detections[i].amplitude, detections[i].range };
+        }
+
+        copied += read;
+
+        if (0 == read)
+        {
+            break;
+        }
+    }
+
+    return static_cast<int>(copied);
+}
+
+int ScansonarGetDetectorStats(pSnrCtx snrctx, pScansonarDetectorStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    const LineDetector &detector = ss->GetDetector();
+
+    stats->lines = detector.GetLinesCount();
+    stats->detections = detector.GetDetectionsCount();
+    stats->overflows = detector.GetOverflowCount();
+
+    return 0;
+}
+
+int ScansonarSetChangeDetection(pSnrCtx snrctx, uint32_t enable, uint32_t threshold, float learning,
+                                float minlength, float mingap,
+                                void(*const change_cb)(const ScansonarChangeSegment*, int))
+{
+    if ((nullptr == snrctx) || (threshold > 4095U) || (learning < 0.0F) || (learning > 1.0F) ||
+        (minlength < 0.0F) || (mingap < 0.0F))
+    {
+        return -1;
+    }
+
+    std::function<void(const ChangeSegment *, std::size_t)> callback;
+
+    if (nullptr != change_cb)
+    {
+        callback = [change_cb](const ChangeSegment *segments, std::size_t count)
+        {
+            ScansonarChangeSegment csegments[ChangeDetector::MAX_LINE_SEGMENTS];
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                csegments[i] = { segments[i].timestamp, segments[i].angle, segments[i].peak, segments[i].start, segments[i].end };
+            }
+
+            change_cb(csegments, static_cast<int>(count));
+        };
+    }
+
+    ChangeSettings settings = { 0 != enable, static_cast<uint16_t>(threshold), learning, minlength, mingap, 0.0F, 0.0F, 0.0F };
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->SetChangeDetection(settings, std::move(callback));
+
+    return 0;
+}
+
+int ScansonarReadChanges(pSnrCtx snrctx, pScansonarChangeSegment dst, size_t count)
+{
+    if ((nullptr == snrctx) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ChangeDetector &detector = ss->GetChangeDetector();
+
+    ChangeSegment segments[64];
+    size_t copied = 0;
+
+    while (copied < count)
+    {
+        size_t read = detector.Read(segments, std::min(count - copied, sizeof(segments) / sizeof(segments[0])));
+
+        for (size_t i = 0; i < read; i++)
+        {
+            dst[copied + i] = { segments[i].timestamp, segments[i].angle, segments[i].peak, segments[i].start, segments[i].end };
+        }
+
+        copied += read;
+
+        if (0 == read)
+        {
+            break;
+        }
+    }
+
+    return static_cast<int>(copied);
+}
+
+int ScansonarGetChangeStats(pSnrCtx snrctx, pScansonarChangeStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    const ChangeDetector &detector = ss->GetChangeDetector();
+
+    stats->lines = detector.GetLinesCount();
+    stats->segments = detector.GetSegmentsCount();
+    stats->overflows = detector.GetOverflowCount();
+
+    return 0;
+}
+
+pScanConverter ScansonarScanConverterCreate(uint32_t width, uint32_t height, uint32_t range, uint32_t linesperfullturn, uint32_t flags, uint32_t threads)
+{
+    if ((0 == width) || (0 == height))
+    {
+        return nullptr;
+    }
+
+    pScanConverter converter = nullptr;
+
+    try
+    {
+        converter = reinterpret_cast<pScanConverter>(new ScanConverter(static_cast<int>(width), static_cast<int>(height), static_cast<int>(range),
+                                                                       static_cast<int>(linesperfullturn), 0 != (flags & SCANCONVERTER_BILINEAR),
+                                                                       static_cast<int>(threads)));
+    }
+    catch(...)
+    {
+        // In case of any exception this function returns nullptr
+    }
+
+    return converter;
+}
+
+void ScansonarScanConverterDestroy(pScanConverter converter)
+{
+    auto sc = reinterpret_cast<ScanConverter*>(converter);
+    delete sc;
+}
+
+const uint16_t* ScansonarScanConvert(pSnrCtx snrctx, pScanConverter converter)
+{
+    if ((nullptr == snrctx) || (nullptr == converter))
+    {
+        return nullptr;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto sc = reinterpret_cast<ScanConverter*>(converter);
+
+    return sc->Convert(*ss->GetSonarImage());
+}
+
+const uint16_t* ScansonarScanConvertChanged(pSnrCtx snrctx, pScanConverter converter, uint32_t *lines)
+{
+    if ((nullptr == snrctx) || (nullptr == converter))
+    {
+        return nullptr;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto sc = reinterpret_cast<ScanConverter*>(converter);
+
+    int changed = 0;
+    const uint16_t *image = sc->ConvertChanged(*ss->GetSonarImage(), &changed);
+
+    if (nullptr != lines)
+    {
+        *lines = static_cast<uint32_t>(changed);
+    }
+
+    return image;
+}
+
+int ScansonarGetRingStats(pSnrCtx snrctx, pScansonarRingStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    const FrameRing &ring = ss->GetFrameRing();
+
+    stats->capacity = static_cast<uint32_t>(ring.GetCapacity());
+    stats->occupancy = static_cast<uint32_t>(ring.GetOccupancy());
+    stats->highwater = static_cast<uint32_t>(ring.GetHighWater());
+    stats->frames = ring.GetFramesCount();
+    stats->overflows = ring.GetOverflowCount();
+
+    return 0;
+}
+
+int ScansonarGetPoolStats(pSnrCtx snrctx, pScansonarPoolStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    const FramePool &pool = ss->GetFramePool();
+
+    stats->capacity = static_cast<uint32_t>(pool.GetCapacity());
+    stats->available = static_cast<uint32_t>(pool.GetAvailable());
+    stats->checkouts = pool.GetCheckoutCount();
+    stats->exhausted = pool.GetExhaustedCount();
+
+    return 0;
+}
+
+int ScansonarSetRecorderPolicy(pSnrCtx snrctx, uint32_t policy)
+{
+    if ((nullptr == snrctx) || (policy > SCANSONAR_RECORD_WAIT))
+    {
+        return -1;
+    }
+
+    static const BacklogPolicy policies[] = { BacklogPolicy::BPolicy_Drop, BacklogPolicy::BPolicy_Wait };
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    ss->GetRecorder().SetBacklogPolicy(policies[policy]);
+
+    return 0;
+}
+
+int ScansonarGetRecorderStats(pSnrCtx snrctx, pScansonarRecorderStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    Recorder &recorder = ss->GetRecorder();
+
+    if (false == recorder.IsOpen())
+    {
+        return -1;
+    }
+
+    WriteBehindStats recorderstats = recorder.GetStats();
+
+    stats->capacity = recorderstats.capacity;
+    stats->queued = recorderstats.queued;
+    stats->highwater = recorderstats.highwater;
+    stats->direct = (false != recorderstats.direct) ? 1U : 0U;
+    stats->lines = recorderstats.frames;
+    stats->dropped = recorderstats.dropped;
+    stats->bytes = recorderstats.bytes;
+    stats->writes = recorderstats.writes;
+    stats->latencyus = recorderstats.latencyus;
+    stats->maxlatencyus = recorderstats.maxlatencyus;
+    stats->errors = recorderstats.errors;
+
+    return 0;
+}
+
+int ScansonarSetReplaySpeed(pSnrCtx snrctx, double speed)
+{
+    if (nullptr == snrctx)
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto replay = dynamic_cast<FileTransport*>(ss->GetTransport().get());
+
+    if (nullptr == replay)
+    {
+        return -1;
+    }
+
+    replay->SetSpeed(speed);
+
+    return 0;
+}
+
+int ScansonarGetReplayStats(pSnrCtx snrctx, pScansonarReplayStats stats)
+{
+    if ((nullptr == snrctx) || (nullptr == stats))
+    {
+        return -1;
+    }
+
+    auto ss = reinterpret_cast<Scansonar*>(snrctx);
+    auto replay = dynamic_cast<FileTransport*>(ss->GetTransport().get());
+
+    if (nullptr == replay)
+    {
+        return -1;
+    }
+
+    stats->filesize = replay->GetFileSize();
+    stats->position = replay->GetPosition();
+    stats->frames = replay->GetFramesCount();
+    stats->finished = (false != replay->IsFinished()) ? 1 : 0;
+
+    return 0;
+}
+
+pScansonarRecording ScansonarRecordingOpen(const char *filename)
+{
+    if (nullptr == filename)
+    {
+        return nullptr;
+    }
+
+    pScansonarRecording recording = nullptr;
+
+    try
+    {
+        auto reader = std::make_unique<BlockReader>(filename);
+
+        if (false != reader->IsOpen())
+        {
+            recording = reinterpret_cast<pScansonarRecording>(reader.release());
+        }
+    }
+    catch(...)
+    {
+        // In case of any exception this function returns nullptr
+    }
+
+    return recording;
+}
+
+void ScansonarRecordingClose(pScansonarRecording recording)
+{
+    auto reader = reinterpret_cast<BlockReader*>(recording);
+    delete reader;
+}
+
+int ScansonarRecordingGetInfo(pScansonarRecording recording, pScansonarRecordingInfo info)
+{
+    if ((nullptr == recording) || (nullptr == info))
+    {
+        return -1;
+    }
+
+    auto reader = reinterpret_cast<BlockReader*>(recording);
+
+    info->lines = reader->GetLinesCount();
+    info->blocks = static_cast<uint32_t>(reader->GetBlocksCount());
+    info->turns = reader->GetTurnsCount();
+    info->rawbytes = reader->GetRawBytes();
+    info->filesize = reader->GetFileSize();
+    info->indexed = (false != reader->IsIndexed()) ? 1 : 0;
+
+    return 0;
+}
+
+int64_t ScansonarRecordingFindTimestamp(pScansonarRecording recording, uint32_t timestamp)
+{
+    if (nullptr == recording)
+    {
+        return -1;
+    }
+
+    return reinterpret_cast<BlockReader*>(recording)->FindTimestamp(timestamp);
+}
+
+int64_t ScansonarRecordingFindAngle(pScansonarRecording recording, uint32_t turn, uint32_t angle)
+{
+    if ((nullptr == recording) || (angle >= RECORDING_TURN_LINES))
+    {
+        return -1;
+    }
+
+    return reinterpret_cast<BlockReader*>(recording)->FindAngle(turn, static_cast<uint16_t>(angle));
+}
+
+int64_t ScansonarRecordingReadLines(pScansonarRecording recording, uint64_t first, uint32_t count, uint8_t *dst, size_t size, uint32_t threads)
+{
+    if ((nullptr == recording) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    auto reader = reinterpret_cast<BlockReader*>(recording);
+
+    if (first >= reader->GetLinesCount())
+    {
+        return -1;
+    }
+
+    std::size_t copied = 0;
+
+    try
+    {
+        copied = reader->ReadLines(static_cast<std::size_t>(first), count, dst, size, static_cast<int>(threads));
+    }
+    catch(...)
+    {
+        // Worker threads cannot be started
+    }
+
+    return (0 == copied) ? -1 : static_cast<int64_t>(copied);
+}
+
+int ScansonarUncompand(const uint8_t *src, uint16_t *dst, size_t count)
+{
+    if ((nullptr == src) || (nullptr == dst))
+    {
+        return -1;
+    }
+
+    Uncompand_Line(src, dst, count);
+
+    return 0;
+}
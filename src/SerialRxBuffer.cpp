@@ -0,0 +1,190 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cstring>
+
+#include "SerialRxBuffer.h"
+
+SerialRxBuffer::SerialRxBuffer(std::shared_ptr<Transport> SonarTransport, std::size_t capacity, std::size_t reserve) :
+    transport(SonarTransport),
+    capacity(capacity),
+    reserve(std::min(reserve, capacity / 2)),
+    head(0),
+    tail(0)
+{
+    buffer = std::make_unique<uint8_t[]>(capacity);
+}
+
+SerialRxBuffer::~SerialRxBuffer()
+{
+}
+
+void SerialRxBuffer::Compact()
+{
+    if (head == tail)
+    {
+        head = 0;
+        tail = 0;
+    }
+    else if (head > 0)
+    {
+        std::memmove(&buffer[0], &buffer[head], tail - head);
+        tail -= head;
+        head = 0;
+    }
+}
+
+std::size_t SerialRxBuffer::Fill()
+{
+    // The reserve is kept for PutBack
+    if (false != IsFull())
+    {
+        return 0;
+    }
+
+    if (tail == capacity)
+    {
+        Compact();
+    }
+
+    std::size_t bytesread = 0;
+    std::size_t available = transport->Available();
+
+    if (0 == available)
+    {
+        // Nothing queued: wait for the first byte up to the port read timeout
+        bytesread = transport->Read(&buffer[tail], 1);
+        tail += bytesread;
+
+        if (0 == bytesread)
+        {
+            return 0;
+        }
+
+        available = transport->Available();
+    }
+
+    std::size_t toread = std::min(std::min(available, capacity - tail), capacity - reserve - (tail - head));
+
+    if (toread > 0)
+    {
+        std::size_t br = transport->Read(&buffer[tail], toread);
+        tail += br;
+        bytesread += br;
+    }
+
+    return bytesread;
+}
+
+bool SerialRxBuffer::IsFull() const
+{
+    return (tail - head) + reserve >= capacity;
+}
+
+std::size_t SerialRxBuffer::FillUntil(std::chrono::steady_clock::time_point deadline)
+{
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        // Waiting cannot help, readiness would be reported until the deadline
+        if (false != IsFull())
+        {
+            return 0;
+        }
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+        // Sleep on transport readiness until bytes arrive or the deadline expires
+        if ((0 == transport->Available()) && (false == transport->WaitReadable(std::max<int64_t>(left, 1))))
+        {
+            continue;
+        }
+        std::size_t bytesread = Fill();
+
+        if (bytesread > 0)
+        {
+            return bytesread;
+        }
+    }
+
+    return 0;
+}
+
+std::size_t SerialRxBuffer::Read(uint8_t *dst, std::size_t size)
+{
+    std::size_t copied = 0;
+
+    while (copied < size)
+    {
+        if (head == tail)
+        {
+            Compact();
+
+            // Large request: read the remainder directly into the caller buffer
+            if ((size - copied) >= capacity / 2)
+            {
+                std::size_t br = transport->Read(&dst[copied], size - copied);
+                copied += br;
+
+                if (0 == br)
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            if (0 == Fill())
+            {
+                break;
+            }
+        }
+
+        std::size_t chunk = std::min(size - copied, tail - head);
+        std::memcpy(&dst[copied], &buffer[head], chunk);
+
+        head += chunk;
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+const uint8_t *SerialRxBuffer::Data() const
+{
+    return &buffer[head];
+}
+
+std::size_t SerialRxBuffer::Size() const
+{
+    return tail - head;
+}
+
+void SerialRxBuffer::Consume(std::size_t count)
+{
+    head += std::min(count, tail - head);
+}
+
+void SerialRxBuffer::Clear()
+{
+    head = 0;
+    tail = 0;
+}
+
+bool SerialRxBuffer::PutBack(const uint8_t *src, std::size_t count)
+{
+    if (head < count)
+    {
+        if ((tail - head) + count > capacity)
+        {
+            return false;
+        }
+
+        std::memmove(&buffer[count], &buffer[head], tail - head);
+        tail = count + (tail - head);
+        head = count;
+    }
+
+    head -= count;
+    std::memcpy(&buffer[head], src, count);
+
+    return true;
+}
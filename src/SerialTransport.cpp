@@ -0,0 +1,124 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <limits>
+
+#include "SerialTransport.h"
+
+SerialTransport::SerialTransport(const std::string &portpath, uint32_t baudrate, uint32_t timeoutms)
+{
+    try
+    {
+        serialport = std::make_shared<serial::Serial>(portpath, baudrate, serial::Timeout::simpleTimeout(timeoutms));
+    }
+    catch (std::exception &ex)
+    {
+        throw TransportException(std::string("Serial port ") + portpath + ": " + ex.what());
+    }
+}
+
+SerialTransport::SerialTransport(std::shared_ptr<serial::Serial> SerialPort) :
+    serialport(SerialPort)
+{
+}
+
+SerialTransport::~SerialTransport()
+{
+}
+
+std::size_t SerialTransport::Read(uint8_t *dst, std::size_t size)
+{
+    try
+    {
+        return serialport->read(dst, size);
+    }
+    catch (serial::IOException &ex)
+    {
+        throw TransportException(ex.what());
+    }
+}
+
+std::size_t SerialTransport::Write(const uint8_t *src, std::size_t size)
+{
+    try
+    {
+        return serialport->write(src, size);
+    }
+    catch (serial::IOException &ex)
+    {
+        throw TransportException(ex.what());
+    }
+}
+
+std::size_t SerialTransport::Available()
+{
+    try
+    {
+        return serialport->available();
+    }
+    catch (serial::IOException &ex)
+    {
+        throw TransportException(ex.what());
+    }
+}
+
+bool SerialTransport::WaitReadable(int64_t timeoutms)
+{
+#if !defined( _WIN32 )
+    try
+    {
+        if (0 != serialport->available())
+        {
+            return true;
+        }
+
+        // serial::Serial::waitReadable waits the read timeout, it is set to the caller deadline for the wait
+        serial::Timeout timeout = serialport->getTimeout();
+        uint32_t readtimeout = timeout.read_timeout_constant;
+
+        timeout.read_timeout_constant = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(timeoutms, 1),
+                                                                                std::numeric_limits<uint32_t>::max()));
+        serialport->setTimeout(timeout);
+
+        bool readable = false;
+
+        try
+        {
+            readable = serialport->waitReadable();
+        }
+        catch (serial::IOException &)
+        {
+            timeout.read_timeout_constant = readtimeout;
+            serialport->setTimeout(timeout);
+            throw;
+        }
+
+        timeout.read_timeout_constant = readtimeout;
+        serialport->setTimeout(timeout);
+
+        return readable;
+    }
+    catch (serial::IOException &ex)
+    {
+        throw TransportException(ex.what());
+    }
+#else
+    (void)timeoutms;
+
+    return true;
+#endif
+}
+
+void SerialTransport::Flush()
+{
+    serialport->flush();
+}
+
+uint32_t SerialTransport::GetBaudrate() const
+{
+    return serialport->getBaudrate();
+}
+
+std::shared_ptr<serial::Serial> &SerialTransport::GetSerialPort()
+{
+    return serialport;
+}
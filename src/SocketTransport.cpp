@@ -0,0 +1,329 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#if defined( _WIN32 )
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined( _MSC_VER )
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+typedef int socklen_t;
+#define CLOSESOCKET closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define CLOSESOCKET close
+#endif
+
+#include "SocketTransport.h"
+
+namespace
+{
+    constexpr std::size_t UDP_DATAGRAM_SIZE = 65536;
+
+#if defined( _WIN32 )
+    void SocketStartup()
+    {
+        static const bool started = []()
+        {
+            WSADATA wsadata;
+            return 0 == WSAStartup(MAKEWORD(2, 2), &wsadata);
+        }();
+
+        if (false == started)
+        {
+            throw TransportException("WSAStartup failed");
+        }
+    }
+#endif
+
+#if defined( __linux__ )
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+}
+
+SocketTransport::SocketTransport(uint32_t baudrate, uint32_t timeoutms) :
+    sockfd(INVALID_SOCKET),
+    stream(false),
+    peerclosed(false),
+    baudrate(baudrate),
+    timeoutms(timeoutms)
+{
+#if defined( _WIN32 )
+    SocketStartup();
+#endif
+}
+
+SocketTransport::~SocketTransport()
+{
+    Close();
+}
+
+void SocketTransport::Connect(const std::string &host, const std::string &port, int socktype, bool bindlocal)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = nullptr;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+
+    if (0 != getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses))
+    {
+        throw TransportException("Cannot resolve " + host + ":" + port);
+    }
+
+    for (struct addrinfo *ai = addresses; nullptr != ai; ai = ai->ai_next)
+    {
+        auto fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+        if (INVALID_SOCKET == fd)
+        {
+            continue;
+        }
+
+        if (false != bindlocal)
+        {
+            struct sockaddr_storage local;
+            std::memcpy(&local, ai->ai_addr, ai->ai_addrlen);
+
+            // Any local address, the port is the same as the remote one
+            if (AF_INET == ai->ai_family)
+            {
+                reinterpret_cast<struct sockaddr_in *>(&local)->sin_addr.s_addr = htonl(INADDR_ANY);
+            }
+            else
+            {
+                reinterpret_cast<struct sockaddr_in6 *>(&local)->sin6_addr = in6addr_any;
+            }
+
+            if (0 != bind(fd, reinterpret_cast<struct sockaddr *>(&local), static_cast<socklen_t>(ai->ai_addrlen)))
+            {
+                CLOSESOCKET(fd);
+                continue;
+            }
+        }
+
+        if (0 != connect(fd, ai->ai_addr, static_cast<socklen_t>(ai->ai_addrlen)))
+        {
+            CLOSESOCKET(fd);
+            continue;
+        }
+
+        sockfd = static_cast<intptr_t>(fd);
+        break;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (INVALID_SOCKET == sockfd)
+    {
+        throw TransportException("Cannot connect to " + host + ":" + port);
+    }
+
+    stream = (SOCK_STREAM == socktype);
+
+    if (SOCK_STREAM == socktype)
+    {
+        // Commands and keep-alives are a few bytes long, do not let Nagle delay them
+        int nodelay = 1;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&nodelay), sizeof(nodelay));
+    }
+}
+
+void SocketTransport::Close()
+{
+    if (INVALID_SOCKET != sockfd)
+    {
+        CLOSESOCKET(sockfd);
+        sockfd = INVALID_SOCKET;
+    }
+}
+
+std::size_t SocketTransport::ReceiveSome(uint8_t *dst, std::size_t size, int64_t timeoutms)
+{
+    if (false == SocketTransport::WaitReadable(timeoutms))
+    {
+        return 0;
+    }
+
+    auto br = recv(sockfd, reinterpret_cast<char *>(dst), static_cast<int>(size), 0);
+
+    if (0 == br)
+    {
+        // A UDP datagram may be empty, only a stream reports the close this way
+        peerclosed = stream;
+        return 0;
+    }
+
+    if (br < 0)
+    {
+        throw TransportException("Socket receive failed");
+    }
+
+    return static_cast<std::size_t>(br);
+}
+
+std::size_t SocketTransport::Write(const uint8_t *src, std::size_t size)
+{
+    std::size_t written = 0;
+
+    while (written < size)
+    {
+        auto bw = send(sockfd, reinterpret_cast<const char *>(&src[written]), static_cast<int>(size - written), SEND_FLAGS);
+
+        if (bw <= 0)
+        {
+            throw TransportException("Socket send failed");
+        }
+
+        written += static_cast<std::size_t>(bw);
+    }
+
+    return written;
+}
+
+std::size_t SocketTransport::Available()
+{
+#if defined( _WIN32 )
+    u_long count = 0;
+
+    if (0 != ioctlsocket(sockfd, FIONREAD, &count))
+#else
+    int count = 0;
+
+    if (0 != ioctl(sockfd, FIONREAD, &count))
+#endif
+    {
+        throw TransportException("Socket state query failed");
+    }
+
+    return static_cast<std::size_t>(count);
+}
+
+bool SocketTransport::WaitReadable(int64_t timeoutms)
+{
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(sockfd, &readfds);
+
+    timeoutms = std::max<int64_t>(timeoutms, 0);
+
+    struct timeval tv;
+    tv.tv_sec = static_cast<long>(timeoutms / 1000);
+    tv.tv_usec = static_cast<long>((timeoutms % 1000) * 1000);
+
+    int result = select(static_cast<int>(sockfd + 1), &readfds, nullptr, nullptr, &tv);
+
+    return result > 0;
+}
+
+intptr_t SocketTransport::GetReadyFd() const
+{
+    return sockfd;
+}
+
+uint32_t SocketTransport::GetBaudrate() const
+{
+    return baudrate;
+}
+
+TcpTransport::TcpTransport(const std::string &host, const std::string &port, uint32_t baudrate, uint32_t timeoutms) :
+    SocketTransport(baudrate, timeoutms)
+{
+    Connect(host, port, SOCK_STREAM, false);
+}
+
+std::size_t TcpTransport::Read(uint8_t *dst, std::size_t size)
+{
+    std::size_t copied = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    while (copied < size)
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+        if (left < 0)
+        {
+            break;
+        }
+
+        copied += ReceiveSome(&dst[copied], size - copied, left);
+
+        if (false != peerclosed)
+        {
+            // Bytes received before the close are returned, the next Read reports it
+            if (0 == copied)
+            {
+                throw TransportException("Connection closed by peer");
+            }
+
+            break;
+        }
+    }
+
+    return copied;
+}
+
+UdpTransport::UdpTransport(const std::string &host, const std::string &port, uint32_t baudrate, uint32_t timeoutms) :
+    SocketTransport(baudrate, timeoutms),
+    datagramhead(0),
+    datagramtail(0)
+{
+    datagram = std::make_unique<uint8_t[]>(UDP_DATAGRAM_SIZE);
+
+    Connect(host, port, SOCK_DGRAM, true);
+}
+
+std::size_t UdpTransport::Read(uint8_t *dst, std::size_t size)
+{
+    std::size_t copied = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    while (copied < size)
+    {
+        if (datagramhead == datagramtail)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+            if (left < 0)
+            {
+                break;
+            }
+
+            datagramhead = 0;
+            datagramtail = ReceiveSome(&datagram[0], UDP_DATAGRAM_SIZE, left);
+
+            continue;
+        }
+
+        std::size_t chunk = std::min(size - copied, datagramtail - datagramhead);
+        std::memcpy(&dst[copied], &datagram[datagramhead], chunk);
+
+        datagramhead += chunk;
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+std::size_t UdpTransport::Available()
+{
+    return (datagramtail - datagramhead) + SocketTransport::Available();
+}
+
+bool UdpTransport::WaitReadable(int64_t timeoutms)
+{
+    return (datagramhead != datagramtail) || (false != SocketTransport::WaitReadable(timeoutms));
+}
@@ -1,22 +1,158 @@
 // Copyright (c) EofE Ultrasonics Co., Ltd., 2024
 #include "SonarData.h"
+#include "Uncompand.h"
+#include "Tvg.h"
 #include <cstring>
+#include <algorithm>
 
-SonarData::SonarData(int samplesperline, int linesperfullturn) :
+constexpr int SonarData::PADDING_SAMPLES;
+constexpr int SonarData::MAX_PYRAMID_LEVELS;
+
+namespace
+{
+    // Samples decimated at once, the partial sums of a chunk stay in L1
+    constexpr int DECIMATE_CHUNK = 512;
+
+    // Smallest, largest and sum of the samples of every block of a chunk
+    struct BlockStats
+    {
+        uint16_t minimum[DECIMATE_CHUNK / 2];
+        uint16_t maximum[DECIMATE_CHUNK / 2];
+        uint32_t sum[DECIMATE_CHUNK / 2];
+    };
+
+    inline uint16_t Reduce(DecimationMode mode, uint16_t minimum, uint16_t maximum, uint32_t sum, int count)
+    {
+        uint32_t mean = (sum + (count >> 1)) / count;
+
+        switch (mode)
+        {
+        case DecimationMode::DMode_Mean:
+            return static_cast<uint16_t>(mean);
+
+        case DecimationMode::DMode_Peak:
+            return (maximum - mean >= mean - minimum) ? maximum : minimum;
+
+        default:
+            return maximum;
+        }
+    }
+
+    /**
+     *   @brief Reduce blocks of 1 << shift samples, the mode is resolved once so the loops vectorize
+     */
+    void ReduceBlocks(DecimationMode mode, const BlockStats &stats, int count, int shift, uint16_t *dst)
+    {
+        uint32_t rounding = (1U << shift) >> 1;
+
+        switch (mode)
+        {
+        case DecimationMode::DMode_Mean:
+            for (int i = 0; i < count; i++)
+            {
+                dst[i] = static_cast<uint16_t>((stats.sum[i] + rounding) >> shift);
+            }
+            break;
+
+        case DecimationMode::DMode_Peak:
+            for (int i = 0; i < count; i++)
+            {
+                uint32_t mean = (stats.sum[i] + rounding) >> shift;
+                dst[i] = (stats.maximum[i] - mean >= mean - stats.minimum[i]) ? stats.maximum[i] : stats.minimum[i];
+            }
+            break;
+
+        default:
+            std::copy(stats.maximum, stats.maximum + count, dst);
+            break;
+        }
+    }
+}
+
+SonarData::SonarData(int samplesperline, int linesperfullturn, int pyramidlevels, DecimationMode decimation,
+                     const PersistenceSettings &persistence) :
+    epoch(0),
     samplesperline(samplesperline),
-    linesperfullturn(linesperfullturn)
+    linesperfullturn(linesperfullturn),
+    pyramidlevels(std::max(0, std::min(pyramidlevels, MAX_PYRAMID_LEVELS))),
+    decimation(decimation),
+    persistence(persistence),
+    persistweight(Persist_Weight(persistence.weight))
 {
-    sonardata = std::make_unique<uint16_t[]>(samplesperline * linesperfullturn);
+    sonardata = std::make_unique<uint16_t[]>(samplesperline * linesperfullturn + PADDING_SAMPLES);
+
+    for (int level = 0; level < MAX_PYRAMID_LEVELS; level++)
+    {
+        int factor = 2 << level;
+
+        levelsamples[level] = (level < this->pyramidlevels) ? (samplesperline + factor - 1) / factor : 0;
+
+        if (0 != levelsamples[level])
+        {
+            leveldata[level] = std::make_unique<uint16_t[]>(levelsamples[level] * linesperfullturn + PADDING_SAMPLES);
+        }
+    }
+
+    if (PersistenceMode::PMode_Off != persistence.mode)
+    {
+        persistdata = std::make_unique<uint16_t[]>(samplesperline * linesperfullturn + PADDING_SAMPLES);
+        persistextent = std::make_unique<int[]>(linesperfullturn);
+    }
+
+    rowextent = std::make_unique<int[]>(linesperfullturn);
+    rowmap = std::make_unique<std::atomic<int>[]>(linesperfullturn);
+    rowseq = std::make_unique<std::atomic<uint32_t>[]>(linesperfullturn);
+    rowepoch = std::make_unique<std::atomic<uint64_t>[]>(linesperfullturn);
+    lineepoch = std::make_unique<std::atomic<uint64_t>[]>(linesperfullturn);
     CleanSonarData();
 }
 
+SonarData::SonarData(const SonarData &source, int samplesperline) :
+    SonarData(source, samplesperline, source.pyramidlevels, source.decimation, source.persistence)
+{
+}
+
+SonarData::SonarData(const SonarData &source, int samplesperline, int pyramidlevels, DecimationMode decimation,
+                     const PersistenceSettings &persistence) :
+    SonarData(samplesperline, source.linesperfullturn, pyramidlevels, decimation, persistence)
+{
+    int copied = std::min(samplesperline, source.samplesperline);
+
+    // Accumulated persistence survives a change of the weight or the decay, a new mode starts from the rows
+    bool keeppersistence = (nullptr != source.persistdata) && (persistence.mode == source.persistence.mode);
+
+    for (int i = 0; i < linesperfullturn; i++)
+    {
+        // Source is not written meanwhile, it belongs to the thread making the copy
+        std::memcpy(&sonardata[i * samplesperline], &source.sonardata[i * source.samplesperline], copied * sizeof(uint16_t));
+
+        rowextent[i] = std::min(source.rowextent[i], copied);
+        rowmap[i].store(source.rowmap[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        rowepoch[i].store(source.rowepoch[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        lineepoch[i].store(source.lineepoch[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        DecimateRow(i, 0, rowextent[i]);
+
+        if (nullptr != persistdata)
+        {
+            const uint16_t *persistsrc = (false != keeppersistence) ? &source.persistdata[i * source.samplesperline] :
+                                                                      &sonardata[i * samplesperline];
+
+            std::memcpy(&persistdata[i * samplesperline], persistsrc, copied * sizeof(uint16_t));
+            persistextent[i] = (false != keeppersistence) ? std::min(source.persistextent[i], copied) : rowextent[i];
+        }
+    }
+
+    epoch.store(source.epoch.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
 SonarData::~SonarData()
 {
 }
 
 uint16_t *SonarData::GetSample(int line, int position) const
 {
-    return &sonardata[line * samplesperline + position];
+    return &sonardata[GetLineRow(line) * samplesperline + position];
     //return std::next(sonardata, line * samplesperline + position);
 }
 
@@ -30,12 +166,437 @@ int SonarData::GetLinesPerFullTurn() const
     return linesperfullturn;
 }
 
+int SonarData::GetPyramidLevels() const
+{
+    return pyramidlevels;
+}
+
+DecimationMode SonarData::GetDecimation() const
+{
+    return decimation;
+}
+
+int SonarData::GetLevelSamplesPerLine(int level) const
+{
+    if (0 == level)
+    {
+        return samplesperline;
+    }
+
+    return ((level > 0) && (level <= pyramidlevels)) ? levelsamples[level - 1] : 0;
+}
+
+PersistenceSettings SonarData::GetPersistence() const
+{
+    return persistence;
+}
+
+const uint16_t *SonarData::GetPersistenceData() const
+{
+    return persistdata.get();
+}
+
+const uint16_t *SonarData::GetPersistenceLine(int line) const
+{
+    return (nullptr != persistdata) ? &persistdata[GetLineRow(line) * samplesperline] : nullptr;
+}
+
+void SonarData::ReadPersistenceLine(int line, uint16_t *dst) const
+{
+    if (nullptr == persistdata)
+    {
+        std::fill(dst, dst + samplesperline, 0);
+        return;
+    }
+
+    ReadRow(persistdata.get(), samplesperline, line, dst);
+}
+
+void SonarData::PersistRow(int row, int first, int last)
+{
+    if ((nullptr == persistdata) || (first >= last))
+    {
+        return;
+    }
+
+    const uint16_t *src = &sonardata[row * samplesperline + first];
+    uint16_t *state = &persistdata[row * samplesperline + first];
+    std::size_t count = static_cast<std::size_t>(last - first);
+
+    if (PersistenceMode::PMode_MaxHold == persistence.mode)
+    {
+        Persist_MaxHold(state, src, count, persistence.decay);
+    }
+    else
+    {
+        Persist_Average(state, src, count, persistweight);
+    }
+}
+
+const uint16_t *SonarData::GetLevelData(int level) const
+{
+    return (0 == level) ? sonardata.get() : leveldata[level - 1].get();
+}
+
+const uint16_t *SonarData::GetLevelLine(int level, int line) const
+{
+    return &GetLevelData(level)[GetLineRow(line) * GetLevelSamplesPerLine(level)];
+}
+
+void SonarData::DecimateRow(int row, int first, int last)
+{
+    if (0 == pyramidlevels)
+    {
+        return;
+    }
+
+    const uint16_t *src = &sonardata[row * samplesperline];
+    int block = 1 << pyramidlevels;
+
+    // Level n is reduced from level n - 1, the two alternate so the loops do not alias
+    BlockStats stats[2];
+
+    last = std::min(last, samplesperline);
+
+    for (int start = first / block * block; start < last; start += DECIMATE_CHUNK)
+    {
+        // Chunk of whole blocks, only the block at the end of the row may be partial
+        int count = std::min(std::min(DECIMATE_CHUNK, (last - start + block - 1) / block * block), samplesperline - start);
+        int pairs = count / 2;
+        BlockStats *current = &stats[0];
+
+        for (int i = 0; i < pairs; i++)
+        {
+            uint16_t a = src[start + 2 * i];
+            uint16_t b = src[start + 2 * i + 1];
+
+            current->minimum[i] = std::min(a, b);
+            current->maximum[i] = std::max(a, b);
+            current->sum[i] = a + b;
+        }
+
+        if (0 != (count & 1))
+        {
+            current->minimum[pairs] = current->maximum[pairs] = src[start + count - 1];
+            current->sum[pairs] = src[start + count - 1];
+            pairs++;
+        }
+
+        for (int level = 0; level < pyramidlevels; level++)
+        {
+            if (0 != level)
+            {
+                const BlockStats *previous = current;
+                int half = pairs / 2;
+
+                current = &stats[level & 1];
+
+                for (int i = 0; i < half; i++)
+                {
+                    current->minimum[i] = std::min(previous->minimum[2 * i], previous->minimum[2 * i + 1]);
+                    current->maximum[i] = std::max(previous->maximum[2 * i], previous->maximum[2 * i + 1]);
+                    current->sum[i] = previous->sum[2 * i] + previous->sum[2 * i + 1];
+                }
+
+                if (0 != (pairs & 1))
+                {
+                    current->minimum[half] = previous->minimum[pairs - 1];
+                    current->maximum[half] = previous->maximum[pairs - 1];
+                    current->sum[half] = previous->sum[pairs - 1];
+                    half++;
+                }
+
+                pairs = half;
+            }
+
+            int shift = level + 1;
+            int firstsample = start >> shift;
+            uint16_t *dst = &leveldata[level][row * levelsamples[level] + firstsample];
+
+            // Block at the end of the row may have fewer samples
+            int whole = std::min(pairs, (samplesperline >> shift) - firstsample);
+
+            ReduceBlocks(decimation, *current, whole, shift, dst);
+
+            for (int i = whole; i < pairs; i++)
+            {
+                int blocksamples = samplesperline - ((firstsample + i) << shift);
+                dst[i] = Reduce(decimation, current->minimum[i], current->maximum[i], current->sum[i], blocksamples);
+            }
+        }
+    }
+}
+
 void SonarData::CleanSonarData()
 {
-    std::fill(sonardata.get(), sonardata.get() + linesperfullturn * samplesperline, 0);
+    uint64_t cleanepoch = epoch.load(std::memory_order_relaxed) + 1;
+
+    for (int i = 0; i < linesperfullturn; i++)
+    {
+        BeginRowWrite(i);
+        std::fill(&sonardata[i * samplesperline], &sonardata[(i + 1) * samplesperline], 0);
+
+        for (int level = 0; level < pyramidlevels; level++)
+        {
+            std::fill(&leveldata[level][i * levelsamples[level]], &leveldata[level][(i + 1) * levelsamples[level]], 0);
+        }
+
+        if (nullptr != persistdata)
+        {
+            std::fill(&persistdata[i * samplesperline], &persistdata[(i + 1) * samplesperline], 0);
+            persistextent[i] = 0;
+        }
+
+        rowextent[i] = 0;
+        rowmap[i].store(i, std::memory_order_release);
+        lineepoch[i].store(cleanepoch, std::memory_order_relaxed);
+        EndRowWrite(i, cleanepoch);
+    }
+
+    epoch.store(cleanepoch, std::memory_order_release);
 }
 
 uint16_t *SonarData::GetRawSonarData() const
 {
     return sonardata.get();
 }
+
+const uint16_t *SonarData::GetLine(int line) const
+{
+    return &sonardata[GetLineRow(line) * samplesperline];
+}
+
+int SonarData::GetLineRow(int line) const
+{
+    return rowmap[line].load(std::memory_order_acquire);
+}
+
+void SonarData::BeginRowWrite(int row)
+{
+    rowseq[row].store(rowseq[row].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SonarData::EndRowWrite(int row, uint64_t writeepoch)
+{
+    rowepoch[row].store(writeepoch, std::memory_order_relaxed);
+    rowseq[row].store(rowseq[row].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint64_t SonarData::GetLineEpoch(int line) const
+{
+    return std::max(lineepoch[line].load(std::memory_order_acquire), rowepoch[GetLineRow(line)].load(std::memory_order_acquire));
+}
+
+void SonarData::ReadLine(int line, uint16_t *dst) const
+{
+    ReadLevelLine(0, line, dst);
+}
+
+void SonarData::ReadLevelLine(int level, int line, uint16_t *dst) const
+{
+    ReadRow(GetLevelData(level), GetLevelSamplesPerLine(level), line, dst);
+}
+
+void SonarData::ReadRow(const uint16_t *data, int rowsamples, int line, uint16_t *dst) const
+{
+    for (;;)
+    {
+        int row = GetLineRow(line);
+        uint32_t before = rowseq[row].load(std::memory_order_acquire);
+
+        if (0 != (before & 1))
+        {
+            continue;
+        }
+
+        std::memcpy(dst, &data[row * rowsamples], rowsamples * sizeof(uint16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if ((before == rowseq[row].load(std::memory_order_relaxed)) && (row == GetLineRow(line)))
+        {
+            return;
+        }
+    }
+}
+
+void SonarData::MaterializeDense(uint16_t *dst) const
+{
+    for (int i = 0; i < linesperfullturn; i++)
+    {
+        ReadLine(i, &dst[i * samplesperline]);
+    }
+}
+
+uint64_t SonarData::GetEpoch() const
+{
+    return epoch.load(std::memory_order_acquire);
+}
+
+uint64_t SonarData::GetChangedLines(uint64_t sinceepoch, std::vector<int> &lines) const
+{
+    uint64_t changedepoch = GetEpoch();
+
+    lines.clear();
+
+    for (int i = 0; i < linesperfullturn; i++)
+    {
+        if (GetLineEpoch(i) > sinceepoch)
+        {
+            lines.push_back(i);
+        }
+    }
+
+    return changedepoch;
+}
+
+uint64_t SonarData::Snapshot(uint16_t *dst, uint64_t sinceepoch, int *lines) const
+{
+    uint64_t snapshotepoch = GetEpoch();
+    int copied = 0;
+
+    for (int i = 0; i < linesperfullturn; i++)
+    {
+        if ((0 == sinceepoch) || (GetLineEpoch(i) > sinceepoch))
+        {
+            ReadLine(i, &dst[i * samplesperline]);
+            copied++;
+        }
+    }
+
+    if (nullptr != lines)
+    {
+        *lines = copied;
+    }
+
+    return snapshotepoch;
+}
+
+void SonarData::WriteLine(int line, const uint8_t *samples, int count)
+{
+    uint16_t *row = &sonardata[line * samplesperline];
+    uint64_t writeepoch = epoch.load(std::memory_order_relaxed) + 1;
+
+    count = std::max(0, std::min(count, samplesperline));
+
+    BeginRowWrite(line);
+    std::memset(row, 0, samplesperline * sizeof(uint16_t));
+    Uncompand_Line(samples, row, static_cast<std::size_t>(count));
+    DecimateRow(line, 0, std::max(count, rowextent[line]));
+
+    if (nullptr != persistdata)
+    {
+        PersistRow(line, 0, std::max(count, persistextent[line]));
+        persistextent[line] = std::max(count, persistextent[line]);
+    }
+
+    EndRowWrite(line, writeepoch);
+
+    rowextent[line] = count;
+    rowmap[line].store(line, std::memory_order_release);
+    lineepoch[line].store(writeepoch, std::memory_order_release);
+
+    epoch.store(writeepoch, std::memory_order_release);
+}
+
+void SonarData::FillGap(int prevline, int currline, int srcline)
+{
+    const uint16_t *src = &sonardata[srcline * samplesperline];
+    int direction = (prevline < currline) ? 1 : -1;
+    uint64_t writeepoch = epoch.load(std::memory_order_relaxed) + 1;
+
+    for (int i = prevline; i != currline; i += direction)
+    {
+        if (i != srcline)
+        {
+            BeginRowWrite(i);
+            std::copy(src, src + samplesperline, &sonardata[i * samplesperline]);
+
+            for (int level = 0; level < pyramidlevels; level++)
+            {
+                const uint16_t *levelsrc = &leveldata[level][srcline * levelsamples[level]];
+                std::copy(levelsrc, levelsrc + levelsamples[level], &leveldata[level][i * levelsamples[level]]);
+            }
+
+            if (nullptr != persistdata)
+            {
+                const uint16_t *persistsrc = &persistdata[srcline * samplesperline];
+                std::copy(persistsrc, persistsrc + samplesperline, &persistdata[i * samplesperline]);
+                persistextent[i] = persistextent[srcline];
+            }
+
+            EndRowWrite(i, writeepoch);
+
+            rowextent[i] = rowextent[srcline];
+            rowmap[i].store(i, std::memory_order_release);
+            lineepoch[i].store(writeepoch, std::memory_order_release);
+        }
+    }
+
+    epoch.store(writeepoch, std::memory_order_release);
+}
+
+void SonarData::IngestLine(int line, const uint8_t *samples, int count, int gapfrom, int gapto, const uint16_t *gain)
+{
+    uint16_t *row = &sonardata[line * samplesperline];
+    int direction = (gapfrom < gapto) ? 1 : -1;
+    uint64_t writeepoch = epoch.load(std::memory_order_relaxed) + 1;
+
+    count = std::max(0, std::min(count, samplesperline));
+
+    BeginRowWrite(line);
+
+    if ((0 == pyramidlevels) && (nullptr == gain) && (nullptr == persistdata))
+    {
+        Uncompand_Line(samples, row, static_cast<std::size_t>(count));
+    }
+    else
+    {
+        // Gain is applied, the levels are reduced and the persistence is updated from every chunk while it is still in L1
+        for (int start = 0; start < count; start += DECIMATE_CHUNK)
+        {
+            int chunk = std::min(DECIMATE_CHUNK, count - start);
+
+            Uncompand_Line(&samples[start], &row[start], static_cast<std::size_t>(chunk));
+
+            if (nullptr != gain)
+            {
+                Tvg_Apply(&row[start], &gain[start], static_cast<std::size_t>(chunk));
+            }
+
+            DecimateRow(line, start, start + chunk);
+            PersistRow(line, start, start + chunk);
+        }
+    }
+
+    // Only what is left of a longer line is cleared
+    if (rowextent[line] > count)
+    {
+        std::memset(&row[count], 0, (rowextent[line] - count) * sizeof(uint16_t));
+        DecimateRow(line, count, rowextent[line]);
+    }
+
+    if (nullptr != persistdata)
+    {
+        // Persistence of a longer line decays with the zeros beyond this one
+        PersistRow(line, count, persistextent[line]);
+        persistextent[line] = std::max(count, persistextent[line]);
+    }
+
+    EndRowWrite(line, writeepoch);
+
+    rowextent[line] = count;
+    rowmap[line].store(line, std::memory_order_release);
+    lineepoch[line].store(writeepoch, std::memory_order_release);
+
+    for (int i = gapfrom; i != gapto; i += direction)
+    {
+        if (i != line)
+        {
+            rowmap[i].store(line, std::memory_order_release);
+            lineepoch[i].store(writeepoch, std::memory_order_release);
+        }
+    }
+
+    epoch.store(writeepoch, std::memory_order_release);
+}
@@ -1,5 +1,6 @@
 // Copyright (c) EofE Ultrasonics Co., Ltd., 2024
 #include <chrono>
+#include <cstring>
 #include <algorithm>
 #include <memory>
 #include <string>
@@ -7,36 +8,11 @@
 #include <iostream>
 
 #include "ThreadSonarSerial.h"
+#include "FrameScanner.h"
 #include "SonarStructures.h"
 #include "Crc32.h"
 #include "B64Encode.h"
-
-namespace
-{
-    // *INDENT-OFF*
-
-    const uint16_t uncompand8to12b[256] =
-    {
-           0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,   15, //   0 ~ 15
-          16,   17,   18,   19,   20,   21,   22,   23,   24,   25,   26,   27,   28,   29,   30,   31, //  16 ~ 31
-          32,   33,   34,   35,   36,   37,   38,   39,   40,   41,   42,   43,   44,   45,   46,   47, //  32 ~ 47
-          48,   49,   50,   51,   52,   53,   54,   55,   56,   57,   58,   59,   60,   61,   62,   63, //  48 ~ 63
-          65,   67,   69,   71,   73,   75,   77,   79,   81,   83,   85,   87,   89,   91,   93,   95, //  64 ~ 79
-          97,   99,  101,  103,  105,  107,  109,  111,  113,  115,  117,  119,  121,  123,  125,  127, //  80 ~ 95
-         131,  135,  139,  143,  147,  151,  155,  159,  163,  167,  171,  175,  179,  183,  187,  191, //  96 ~ 111
-         195,  199,  203,  207,  211,  215,  219,  223,  227,  231,  235,  239,  243,  247,  251,  255, // 112 ~ 127
-         263,  271,  279,  287,  295,  303,  311,  319,  327,  335,  343,  351,  359,  367,  375,  383, // 128 ~ 143
-         391,  399,  407,  415,  423,  431,  439,  447,  455,  463,  471,  479,  487,  495,  503,  511, // 144 ~ 159
-         527,  543,  559,  575,  591,  607,  623,  639,  655,  671,  687,  703,  719,  735,  751,  767, // 160 ~ 175
-         783,  799,  815,  831,  847,  863,  879,  895,  911,  927,  943,  959,  975,  991, 1007, 1023, // 176 ~ 191
-        1055, 1087, 1119, 1151, 1183, 1215, 1247, 1279, 1311, 1343, 1375, 1407, 1439, 1471, 1503, 1535, // 192 ~ 207
-        1567, 1599, 1631, 1663, 1695, 1727, 1759, 1791, 1823, 1855, 1887, 1919, 1951, 1983, 2015, 2047, // 208 ~ 223
-        2111, 2175, 2239, 2303, 2367, 2431, 2495, 2559, 2623, 2687, 2751, 2815, 2879, 2943, 3007, 3071, // 224 ~ 239
-        3135, 3199, 3263, 3327, 3391, 3455, 3519, 3583, 3647, 3711, 3775, 3839, 3903, 3967, 4031, 4095  // 240 ~ 255
-    };
-
-    // *INDENT-ON*
-}
+#include "Tvg.h"
 
 static void SonarSerialThreadFunc(void* arg)
 {
@@ -85,14 +61,14 @@ static void SonarSerialThreadFunc(void* arg)
                 }
                 }
             }
-            catch (serial::IOException& exstr)
+            catch (TransportException& exstr)
             {
                 tss->sonarfailed_ = true;
                 tss->state = ThreadSSState::TSSState_Disconnected;
                 tss->serialport.reset();
                 isfailed = true;
                 std::string exeptiontxt = std::string(exstr.what());
-                std::cout << "ThreadSonarSerial::Entry : IOException" << "\n";
+                std::cout << "ThreadSonarSerial::Entry : TransportException" << "\n";
                 std::cout << exstr.what() << "\n";
             }
         }
@@ -103,44 +79,105 @@ static void SonarSerialThreadFunc(void* arg)
     }
 }
 
+static void SonarProcessThreadFunc(void* arg)
+{
+    ThreadSonarSerial* tss = reinterpret_cast<ThreadSonarSerial*>(arg);
+
+    while (false == tss->threadkilled)
+    {
+        uint8_t *linebuffer = tss->framering->Pop();
+
+        if (nullptr == linebuffer)
+        {
+            tss->framering->WaitForData(20);
+            continue;
+        }
+
+        tss->ProcessLine(linebuffer);
+        tss->framepool->Release(linebuffer);
+    }
+}
+
 #if !defined (__linux__)
-ThreadSonarSerial::ThreadSonarSerial(std::shared_ptr<serial::Serial> SerialPort, std::wstring filename, std::function<void(char*, int)> cbfunc) :
-    cb_dataready(cbfunc),
-    serialport(SerialPort),
+ThreadSonarSerial::ThreadSonarSerial(std::shared_ptr<Transport> SonarTransport, std::wstring filename, std::function<void(char*, int)> cbfunc) :
+    serialport(SonarTransport),
     threadkilled(false),
+    cb_dataready(cbfunc),
+    sonarfailed_(false),
+    sonardatageneration(0),
+    pyramidlevels(0),
+    decimation(DecimationMode::DMode_Max),
+    persistence({ PersistenceMode::PMode_Off, 1.0F, 0 }),
+    tvgenabled(false),
+    tvgmodel({ TvgSpreading::TSpreading_20LogR, TvgAbsorption::TAbsorption_None, 0.0F, false }),
+    soundspeed(1500.0F),
+    tvggeneration(0),
+    detectorsettings({ DetectMode::DtMode_Off, 0.1F, 0.0F, 0.0F, 1500.0F, 0.0F }),
+    changesettings({ false, 400, 0.05F, 0.0F, 0.0F, 0.0F, 1500.0F, 0.0F }),
     params_updated(true),
-    sonarfailed_(false)
+    readerbuffer(nullptr),
+    prev_angle(-1)
 {
     dcsp = { 0, };
     dssp = { 0, };
 
     keep_alive_counter = std::chrono::steady_clock::now();
 
-    sonarData = std::make_unique<SonarData>();
-    outputfile = std::make_unique<std::ofstream>(filename, std::ofstream::binary);
+    // Sized by SetSonarParams
+    sonarData = std::make_shared<SonarData>(0, SCANSONAR_FULL_TURN_LINES);
+    rxbuffer = std::make_unique<SerialRxBuffer>(SonarTransport, SCANSONAR_RX_BUFFER_SIZE, SCANSONAR_MAX_LINE_SIZE);
+    frameassembler = std::make_unique<FrameAssembler>(*rxbuffer);
+    framering = std::make_unique<FrameRing>(SCANSONAR_RING_SLOTS);
+    framepool = std::make_unique<FramePool>(SCANSONAR_RING_SLOTS + 2, SCANSONAR_MAX_LINE_SIZE);
+    scratchbuffer = std::make_unique<uint8_t[]>(SCANSONAR_MAX_LINE_SIZE);
+    recorder = Recorder::Open(filename);
+    detector = std::make_unique<LineDetector>(SCANSONAR_DETECTION_SLOTS);
+    changedetector = std::make_unique<ChangeDetector>(SCANSONAR_CHANGE_SLOTS);
 
     state = ThreadSSState::TSSState_Init;
     thread = std::make_unique<std::thread>(SonarSerialThreadFunc, this);
+    processthread = std::make_unique<std::thread>(SonarProcessThreadFunc, this);
 }
 #endif
 
-ThreadSonarSerial::ThreadSonarSerial(std::shared_ptr<serial::Serial> SerialPort, std::string filename, std::function<void(char*, int)> cbfunc) :
-    cb_dataready(cbfunc),
-    serialport(SerialPort),
+ThreadSonarSerial::ThreadSonarSerial(std::shared_ptr<Transport> SonarTransport, std::string filename, std::function<void(char*, int)> cbfunc) :
+    serialport(SonarTransport),
     threadkilled(false),
+    cb_dataready(cbfunc),
+    sonarfailed_(false),
+    sonardatageneration(0),
+    pyramidlevels(0),
+    decimation(DecimationMode::DMode_Max),
+    persistence({ PersistenceMode::PMode_Off, 1.0F, 0 }),
+    tvgenabled(false),
+    tvgmodel({ TvgSpreading::TSpreading_20LogR, TvgAbsorption::TAbsorption_None, 0.0F, false }),
+    soundspeed(1500.0F),
+    tvggeneration(0),
+    detectorsettings({ DetectMode::DtMode_Off, 0.1F, 0.0F, 0.0F, 1500.0F, 0.0F }),
+    changesettings({ false, 400, 0.05F, 0.0F, 0.0F, 0.0F, 1500.0F, 0.0F }),
     params_updated(true),
-    sonarfailed_(false)
+    readerbuffer(nullptr),
+    prev_angle(-1)
 {
     dcsp = { 0, };
     dssp = { 0, };
 
     keep_alive_counter = std::chrono::steady_clock::now();
 
-    sonarData = std::make_unique<SonarData>();
-    outputfile = std::make_unique<std::ofstream>(filename, std::ofstream::binary);
+    // Sized by SetSonarParams
+    sonarData = std::make_shared<SonarData>(0, SCANSONAR_FULL_TURN_LINES);
+    rxbuffer = std::make_unique<SerialRxBuffer>(SonarTransport, SCANSONAR_RX_BUFFER_SIZE, SCANSONAR_MAX_LINE_SIZE);
+    frameassembler = std::make_unique<FrameAssembler>(*rxbuffer);
+    framering = std::make_unique<FrameRing>(SCANSONAR_RING_SLOTS);
+    framepool = std::make_unique<FramePool>(SCANSONAR_RING_SLOTS + 2, SCANSONAR_MAX_LINE_SIZE);
+    scratchbuffer = std::make_unique<uint8_t[]>(SCANSONAR_MAX_LINE_SIZE);
+    recorder = Recorder::Open(filename);
+    detector = std::make_unique<LineDetector>(SCANSONAR_DETECTION_SLOTS);
+    changedetector = std::make_unique<ChangeDetector>(SCANSONAR_CHANGE_SLOTS);
 
     state = ThreadSSState::TSSState_Init;
     thread = std::make_unique<std::thread>(SonarSerialThreadFunc, this);
+    processthread = std::make_unique<std::thread>(SonarProcessThreadFunc, this);
 }
 
 ThreadSonarSerial::~ThreadSonarSerial()
@@ -155,7 +192,12 @@ ThreadSSState ThreadSonarSerial::GetThreadState() const
 
 ThreadSSState ThreadSonarSerial::ThreadInit()
 {
-    // DO some preinit
+    // Recorded data: there is no sonar to talk to, assemble lines only
+    if (false != serialport->IsPassive())
+    {
+        return ThreadSSState::TSSState_Working;
+    }
+
     return ThreadSSState::TSSState_Connecting;
 }
 
@@ -216,21 +258,19 @@ ThreadSSState ThreadSonarSerial::ThreadConnected()
 //////////////////////////////////////////////
 ThreadSSState ThreadSonarSerial::ThreadWorking()
 {
-    ThreadSSState retvalue = ThreadSSState::TSSState_Disconnected;
     int result = 0;
 
-    auto linebuffer = std::make_unique<uint8_t[]>(sonarData->GetSamplesPerLine());
-
-    int gAngle = 0;
-
-    static int prev_angle = -1;
-    static int curr_angle = -1;
+    // Line is assembled in a pooled buffer, processing is done by SonarProcessThreadFunc
+    if (nullptr == readerbuffer)
+    {
+        readerbuffer = framepool->Acquire();
+    }
 
-    int in_angle = 0;
-    bool bResult = true;
+    // Pool exhausted: receive into the scratch buffer to stay in sync, the line is dropped
+    uint8_t *linebuffer = (nullptr != readerbuffer) ? readerbuffer : scratchbuffer.get();
 
     {
-        if ((result = MRS900_GetLine(&linebuffer[0])) < 0)        
+        if ((result = MRS900_GetLine(linebuffer)) < 0)        
         {
             if (-5 == result)
             {
@@ -243,14 +283,13 @@ ThreadSSState ThreadSonarSerial::ThreadWorking()
 
         PDATAHEADER pdh = reinterpret_cast<PDATAHEADER>(&linebuffer[0]);
         PDATAFOOTER pdf = reinterpret_cast<PDATAFOOTER>(&linebuffer[pdh->samples - sizeof(DATAFOOTER)]);
-        PCOMMANDID  recvid = reinterpret_cast<PCOMMANDID>(&pdh->commandid);
 
         if (0xFFFFFFFF == pdh->angle)
         {
             return ThreadSSState::TSSState_Working;
         }
 
-        if (pdf->magic == 826560069) // END1 case
+        if (pdf->magic == FRAME_MAGIC_END1) // END1 case
         {
             auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - keep_alive_counter);
 
@@ -263,155 +302,120 @@ ThreadSSState ThreadSonarSerial::ThreadWorking()
             }
         }
 
-        COMMANDID cid = *recvid;
-
-        in_angle = pdh->angle / 9;
-        in_angle = (0 == in_angle) ? 0 : (1 == cid.headup) ? sonarData->GetLinesPerFullTurn() - in_angle : in_angle;
-        in_angle = std::abs(in_angle);
-        in_angle %= sonarData->GetLinesPerFullTurn();
+        // Replay has no real-time deadline: wait for the processing thread instead of dropping lines
+        while ((false != serialport->IsPassive()) && (framering->GetOccupancy() >= framering->GetCapacity()) && (false == threadkilled))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-        // Conver Dataheader to v3
+        if ((nullptr != readerbuffer) && (false != framering->Push(readerbuffer)))
         {
-            bResult = true;
+            // Processing thread returns the buffer to the pool
+            readerbuffer = nullptr;
+        }
+    }
 
-            cb_dataready(reinterpret_cast<char*>(linebuffer.get()), static_cast<int>(pdh->samples));
+    if ((true == params_updated) && (false == serialport->IsPassive()))
+    {
+        for (int i = 0; i < 40; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-            if (sizeof(DATAHEADERV1) == pdh->dataoffset)
+            if (0 == MRS900_Work2Command())
             {
-                // v1 DATAHEADER
-                DATAHEADERV3 dhv3;
-                memcpy(&dhv3, pdh, sizeof(DATAHEADERV3));
-
-                dhv3.dataoffset = sizeof(DATAHEADERV3);
-                dhv3.gyro = 0;
-                dhv3.compass = 0;
-                dhv3.latitude = 0;
-                dhv3.longitude = 0;
-                dhv3.samples += 16;
-
-                if(false != outputfile->is_open())
-                {
-                    outputfile->write(reinterpret_cast<char *>(&dhv3), sizeof(DATAHEADERV3));
-                    outputfile->write(reinterpret_cast<char *>(&linebuffer[sizeof(DATAHEADERV1)]), pdh->samples - sizeof(DATAHEADERV1));
-                }
+                break;
             }
-            else if (sizeof(DATAHEADERV2) == pdh->dataoffset)
-            {
-                // v2 DATAHEADER
-                DATAHEADERV3 dhv3;
-                memcpy(&dhv3, pdh, sizeof(DATAHEADERV3));
+        }
 
-                dhv3.dataoffset = sizeof(DATAHEADERV3);
-                dhv3.latitude = 0;
-                dhv3.longitude = 0;
-                dhv3.samples += 8;
+        return ThreadSSState::TSSState_Connected;
+    }
 
-                if (false != outputfile->is_open())
-                {
-                    outputfile->write(reinterpret_cast<char *>(&dhv3), sizeof(DATAHEADERV3));
-                    outputfile->write(reinterpret_cast<char *>(&linebuffer[sizeof(DATAHEADERV2)]), pdh->samples - sizeof(DATAHEADERV2));
-                }
-            }
-            else
-            {
-                // v3 DATAHEADER
-                DATAHEADERV3 dhv3;
-                memcpy(&dhv3, pdh, sizeof(DATAHEADERV3));
+    return ThreadSSState::TSSState_Working;
+}
 
-                dhv3.dataoffset = sizeof(DATAHEADERV3);
-                dhv3.gyro = 0;
-                dhv3.compass = 0;
-                dhv3.latitude = 0;
-                dhv3.longitude = 0;
+void ThreadSonarSerial::ProcessLine(uint8_t *linebuffer)
+{
+    int curr_angle = -1;
 
-                if (false != outputfile->is_open())
-                {
-                    outputfile->write(reinterpret_cast<char *>(&dhv3), sizeof(DATAHEADERV3));
-                    outputfile->write(reinterpret_cast<char *>(&linebuffer[sizeof(DATAHEADERV3)]), pdh->samples - sizeof(DATAHEADERV3));
-                }
-            }
-        }
+    int in_angle = 0;
 
-        // TODO: Exception should be managed
-        if (false == bResult)
-        {
-            ThreadSSState::TSSState_Disconnected;
-        }
+    {
+        PDATAHEADER pdh = reinterpret_cast<PDATAHEADER>(&linebuffer[0]);
+        PCOMMANDID  recvid = reinterpret_cast<PCOMMANDID>(&pdh->commandid);
 
-        uint16_t *sonardata = sonarData->GetRawSonarData();
+        COMMANDID cid = *recvid;
 
-        std::memset(&sonardata[sonarData->GetSamplesPerLine() * in_angle], 0, sonarData->GetSamplesPerLine() * sizeof(uint16_t));
+        in_angle = pdh->angle / 9;
+        in_angle = (0 == in_angle) ? 0 : (1 == cid.headup) ? SCANSONAR_FULL_TURN_LINES - in_angle : in_angle;
+        in_angle = std::abs(in_angle);
+        in_angle %= SCANSONAR_FULL_TURN_LINES;
 
-        for (int i = 0; i < pdh->samples - pdh->dataoffset - sizeof(DATAFOOTER); i++)
-        {
-            uint8_t sample8 = linebuffer[i + pdh->dataoffset];
-            uint16_t sample = uncompand8to12b[sample8];
+        cb_dataready(reinterpret_cast<char*>(linebuffer), static_cast<int>(pdh->samples));
 
-            sonardata[(sonarData->GetSamplesPerLine() * in_angle) + i] = sample;
-        }
+        // Recording is always DATAHEADER v3
+        recorder->Write(linebuffer);
 
-        /// Fill memory between 2 consecutive received data lines
+        int count = static_cast<int>(pdh->samples - pdh->dataoffset - sizeof(DATAFOOTER));
 
-        curr_angle = (in_angle == 0 && prev_angle > 1599) ? 3199 : in_angle;
-        prev_angle = (in_angle > 1599 && prev_angle == 0) ? 3199 : prev_angle;
+        std::unique_lock<std::mutex> lock(sonardatalock);
 
-        if ((prev_angle != -1) && (std::abs(prev_angle - curr_angle) < 20))
+        if (count > sonarData->GetSamplesPerLine())
         {
-            int sign = ((prev_angle - curr_angle) > 0) ? 1 : -1;
+            // Line is longer than configured, e.g. replay of a recording made with other settings.
+            // This thread is the only writer, the image is copied without the lock.
+            int maxcount = static_cast<int>(SCANSONAR_MAX_LINE_SIZE - sizeof(DATAHEADERV1) - sizeof(DATAFOOTER));
+            auto current = sonarData;
 
-            if (sign == -1)
+            lock.unlock();
+            auto grown = std::make_shared<SonarData>(*current, std::min(count, maxcount));
+            lock.lock();
+
+            if (current == sonarData)
             {
-                for (int i = prev_angle; i < curr_angle; i++)
-                {
-                    int begin = sonarData->GetSamplesPerLine() * i;
-                    int end = sonarData->GetSamplesPerLine() * i + sonarData->GetSamplesPerLine();
+                ReplaceSonarData(std::move(grown));
+            }
+        }
 
-                    int begin_inangle = sonarData->GetSamplesPerLine() * in_angle;
-                    int end_inangle = sonarData->GetSamplesPerLine() * in_angle + sonarData->GetSamplesPerLine();
+        // Angle to row of the image, the image has one row per stepping
+        uint16_t turnangle = static_cast<uint16_t>(in_angle);
+        int lines = sonarData->GetLinesPerFullTurn();
+        in_angle = in_angle * lines / SCANSONAR_FULL_TURN_LINES;
 
-                    std::fill(sonardata + begin, sonardata + end, 0);
-                    std::copy(sonardata + begin_inangle, sonardata + end_inangle, sonardata + begin);
-                }
-            }
-            else
-            {
-                for (int i = prev_angle; i > curr_angle; i--)
-                {
-                    int begin = sonarData->GetSamplesPerLine() * i;
-                    int end = sonarData->GetSamplesPerLine() * i + sonarData->GetSamplesPerLine();
+        /// Fill memory between 2 consecutive received data lines
 
-                    int begin_inangle = sonarData->GetSamplesPerLine() * in_angle;
-                    int end_inangle = sonarData->GetSamplesPerLine() * in_angle + sonarData->GetSamplesPerLine();
+        curr_angle = (in_angle == 0 && prev_angle > lines / 2 - 1) ? lines - 1 : in_angle;
+        prev_angle = (in_angle > lines / 2 - 1 && prev_angle == 0) ? lines - 1 : prev_angle;
 
-                    std::fill(sonardata + begin, sonardata + end, 0);
-                    std::copy(sonardata + begin_inangle, sonardata + end_inangle, sonardata + begin);
-                }
-            }
+        int gapfrom = in_angle;
+        int gapto = in_angle;
+
+        if ((prev_angle != -1) && (std::abs(prev_angle - curr_angle) * SCANSONAR_FULL_TURN_LINES < 20 * lines))
+        {
+            gapfrom = prev_angle;
+            gapto = curr_angle;
         }
 
+        const uint16_t *gain = (nullptr != tvgtable) ? tvgtable->data() : nullptr;
+
+        sonarData->IngestLine(in_angle, &linebuffer[pdh->dataoffset], count, gapfrom, gapto, gain);
+
         prev_angle = in_angle;
-        gAngle = in_angle;
-    }
 
-    if (true == params_updated)
-    {
-        for (int i = 0; i < 40; i++)
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // Detected on the stored samples, TVG compensated when enabled. This thread is the only writer,
+        // the row is read without the lock so the detection callback cannot block ResizeSonarData.
+        auto image = sonarData;
+        lock.unlock();
 
-            if (0 == MRS900_Work2Command())
-            {
-                break;
-            }
-        }
+        PDATAFOOTER pdf = reinterpret_cast<PDATAFOOTER>(&linebuffer[pdh->samples - sizeof(DATAFOOTER)]);
 
-        return ThreadSSState::TSSState_Connected;
+        int stored = std::min(count, image->GetSamplesPerLine());
+
+        detector->ProcessLine(turnangle, pdf->timestamp, image->GetLine(in_angle), stored);
+        changedetector->ProcessLine(in_angle, lines, turnangle, pdf->timestamp, image->GetLine(in_angle), stored);
     }
 
     //pappdata->pointerPosition = in_angle; // Current angle
     //pappdata->newsonardata = true;
-
-    return ThreadSSState::TSSState_Working;
 }
 
 ThreadSSState ThreadSonarSerial::ThreadSetSettings()
@@ -447,121 +451,116 @@ ThreadSSState ThreadSonarSerial::ThreadSetSettings()
 
 int ThreadSonarSerial::MRS900_Responsecheck()
 {
-    int result = 0;
+    int result = MRS900_WaitTokens({ "#OK\n", "#ER\n" }, 2000LL);
 
-    uint8_t magicidbuffer[4] = { '0', '0', '0', '0' };
+    return result;
+}
 
-    const uint8_t oktoken[4] = { '#', 'O', 'K', '\n' };
-    const uint8_t ertoken[4] = { '#', 'E', 'R', '\n' };
+int ThreadSonarSerial::MRS900_Responsecheck(char *responsedata)
+{
+    int result = 0;
 
-    auto time_begin = std::chrono::steady_clock::now();
+    bool responsefind = true;
+    int responsecnt = 0;
 
-    for (;;)
+    // Text between '<' and '>' is the response
+    auto responseparser = [&](const uint8_t *data, std::size_t size)
     {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
-
-        if (br > 0)
+        for (std::size_t i = 0; i < size; i++)
         {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
+            uint8_t ch = data[i];
 
-            if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), oktoken))
+            if (ch == '<')
             {
-                result = 0;
-                break;
+                responsefind = true;
+                responsecnt = 0;
             }
-            else if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), ertoken))
+            else if (ch == '>')
             {
-                result = 1;
-                break;
+                if (nullptr != responsedata)
+                {
+                    responsedata[responsecnt] = 0;
+                    responsefind = false;
+                }
+            }
+            else if ((false != responsefind) && (responsecnt < 63) && (nullptr != responsedata))
+            {
+                responsedata[responsecnt++] = ch;
             }
         }
+    };
 
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+    result = MRS900_WaitTokens({ "#OK\n", "#ER\n" }, 2000LL, responseparser);
 
-        if (period.count() > 2000LL)
-        {
-            result = -2;
-            break;
-        }
+    if ((false != responsefind) && (responsecnt < 63) && (nullptr != responsedata))
+    {
+        responsedata[responsecnt] = 0;
     }
 
     return result;
 }
 
-int ThreadSonarSerial::MRS900_Responsecheck(char *responsedata)
+int ThreadSonarSerial::MRS900_WaitTokens(std::initializer_list<const char *> tokens, int64_t timeoutms, const std::function<void(const uint8_t *, std::size_t)> &onconsume)
 {
-    int result = 0;
-
-    uint8_t magicidbuffer[4] = { '0', '0', '0', '0' };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
 
-    const uint8_t oktoken[4] = { '#', 'O', 'K', '\n' };
-    const uint8_t ertoken[4] = { '#', 'E', 'R', '\n' };
-
-    auto time_begin = std::chrono::steady_clock::now();
+    std::size_t maxtokenlen = 0;
 
-    bool responsefind = true;
-    int responsecnt = 0;
+    for (auto token : tokens)
+    {
+        maxtokenlen = std::max(maxtokenlen, std::strlen(token));
+    }
 
     for (;;)
     {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
+        const uint8_t *data = rxbuffer->Data();
+        std::size_t size = rxbuffer->Size();
+
+        // The token completed first wins, same as a byte-by-byte check would do
+        std::size_t foundend = size + 1;
+        int foundindex = -1;
+        int index = 0;
 
-        if (br > 0)
+        for (auto token : tokens)
         {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
+            std::size_t len = std::strlen(token);
+            const uint8_t *pos = std::search(data, data + size, token, token + len);
 
-            if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), oktoken))
-            {
-                result = 0;
-                break;
-            }
-            else if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), ertoken))
+            if ((pos != data + size) && (static_cast<std::size_t>(pos - data) + len < foundend))
             {
-                result = 1;
-                break;
+                foundend = static_cast<std::size_t>(pos - data) + len;
+                foundindex = index;
             }
 
-            if (ch == '<')
-            {
-                responsefind = true;
-                responsecnt = 0;
-            }
-            else if (ch == '>')
-            {
-                if (nullptr != responsedata)
-                {
-                    responsedata[responsecnt] = 0;
-                    responsefind = false;
-                }
-            }
-            else if ((false != responsefind) && (responsecnt < 63) && (nullptr != responsedata))
+            index++;
+        }
+
+        if (foundindex >= 0)
+        {
+            if (onconsume)
             {
-                if (nullptr != responsedata)
-                {
-                    responsedata[responsecnt++] = ch;
-                }
+                onconsume(data, foundend);
             }
+
+            rxbuffer->Consume(foundend);
+            return foundindex;
         }
 
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+        // Keep a possibly incomplete token at the end
+        std::size_t keep = std::min(size, maxtokenlen - 1);
 
-        if (period.count() > 2000LL)
+        if (onconsume)
         {
-            result = -2;
-            break;
+            onconsume(data, size - keep);
         }
-    }
 
-    if ((false != responsefind) && (responsecnt < 63) && (nullptr != responsedata))
-    {
-        responsedata[responsecnt] = 0;
-    }
+        rxbuffer->Consume(size - keep);
 
-    return result;
+        if (0 == rxbuffer->FillUntil(deadline))
+        {
+            return -2;
+        }
+    }
 }
 
 void ThreadSonarSerial::SetSonarParams(const PDATAGCOMMONSONARPARAM pdcsp, const PDATAGSCANSONARPARAM pdssp)
@@ -569,6 +568,16 @@ void ThreadSonarSerial::SetSonarParams(const PDATAGCOMMONSONARPARAM pdcsp, const
     dcsp = *pdcsp;
     dssp = *pdssp;
 
+    // samples is the line size; stepping mode N sends every Nth line, 0 is continuous as 1
+    int linesize = static_cast<int>(std::min(pdcsp->samples, SCANSONAR_MAX_LINE_SIZE));
+    int steps = std::max(1, static_cast<int>(pdssp->stepping_mode));
+
+    ResizeSonarData(std::max(0, linesize - static_cast<int>(sizeof(DATAHEADERV1) + sizeof(DATAFOOTER))),
+                    std::max(1, SCANSONAR_FULL_TURN_LINES / steps));
+
+    UpdateTvgTable();
+    UpdateDetectorSettings();
+
     params_updated = true;
 }
 
@@ -587,76 +596,14 @@ bool ThreadSonarSerial::GetSonarParams()
 
 int ThreadSonarSerial::MRS900_Synccheck()
 {
-    int result = 0;
-
-    uint8_t magicidbuffer[6] = { '0', '0', '0', '0', '0', '0' };
-    const uint8_t synctoken[6] = { '#', 'S', 'Y', 'N', 'C', '\n'};
-
-    auto time_begin = std::chrono::steady_clock::now();
-
-    for (;;)
-    {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
-
-        if (br > 0)
-        {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-            if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), synctoken))
-            {
-                result = 0;
-                break;
-            }
-        }
-
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
-
-        if (period.count() > 2000LL)
-        {
-            result = -2;
-            break;
-        }
-    }
+    int result = MRS900_WaitTokens({ "#SYNC\n" }, 2000LL);
 
     return result;
 }
 
 int ThreadSonarSerial::MRS900_Workmodecheck()
 {
-    int result = 0;
-
-    uint8_t magicidbuffer[6] = { '0', '0', '0', '0', '0', '0' };
-    const uint8_t worktoken[6] = { 'W', 'O', 'R', 'K', '\r', '\n' };
-
-    auto time_begin = std::chrono::steady_clock::now();
-
-    for (;;)
-    {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
-
-        if (br > 0)
-        {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-            if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), worktoken))
-            {
-                result = 0;
-                break;
-            }
-        }
-
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
-
-        if (period.count() > 5000LL)
-        {
-            result = -2;
-            break;
-        }
-    }
+    int result = MRS900_WaitTokens({ "WORK\r\n" }, 5000LL);
 
     return result;
 }
@@ -716,38 +663,7 @@ int ThreadSonarSerial::MRS900_Work2Command()
 
 int ThreadSonarSerial::MRS900_Commandmodecheck(int timeout)
 {
-    int result = 0;
-
-    uint8_t magicidbuffer[6] = { '0', '0', '0', '0', '0', '0' };
-    const uint8_t cmndtoken[6] = { 'C', 'M', 'N', 'D', '\r', '\n' };
-
-    auto time_begin = std::chrono::steady_clock::now();
-
-    for (;;)
-    {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
-
-        if (br > 0)
-        {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-            if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), cmndtoken))
-            {
-                result = 0;
-                break;
-            }
-        }
-
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
-
-        if (period.count() > timeout)
-        {
-            result = -2;
-            break;
-        }
-    }
+    int result = MRS900_WaitTokens({ "CMND\r\n" }, timeout);
 
     return result;
 }
@@ -760,7 +676,7 @@ int ThreadSonarSerial::MRS900_IsCommandMode()
     {
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
-        std::size_t bw = serialport->write(reinterpret_cast <const uint8_t *>("\r"), 1);
+        std::size_t bw = serialport->Write(reinterpret_cast <const uint8_t *>("\r"), 1);
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
         if (0 == result)
@@ -780,56 +696,23 @@ int ThreadSonarSerial::MRS900_IsCommandMode()
 
 int ThreadSonarSerial::MRS900_GetEndOrCmnd()
 {
-    int result = 0;
-
-    uint8_t magicidbuffer[6] = { '0', '0', '0', '0', '0', '0' };
-    const uint8_t cmndtoken[6] = { 'C', 'M', 'N', 'D', '\r', '\n' };
-    const uint8_t end1token[4] = { 'E', 'N', 'D', '1' };
-
-    auto time_begin = std::chrono::steady_clock::now();
-
-    for (;;)
-    {
-        uint8_t ch;
-        std::size_t br = serialport->read(&ch, 1);
-
-        if (br > 0)
-        {
-            std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-            magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-            if (std::equal(magicidbuffer + 2, magicidbuffer + sizeof(magicidbuffer), end1token))
-            {
-                result = 1;
-                break;
-            }
-            else if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), cmndtoken))
-            {
-                result = 2;
-                break;
-            }
-        }
-
-        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
+    int result = MRS900_WaitTokens({ "END1", "CMND\r\n" }, 4000LL);
 
-        if (period.count() > 4000LL)
-        {
-            result = -2;
-            break;
-        }
-    }
-
-    return result;
+    // 1 - END1 received, 2 - CMND received, -2 - timeout
+    return (result < 0) ? result : result + 1;
 }
 
 int ThreadSonarSerial::MRS900_Autobaud()
 {
     int result = -1;
-    std::size_t byteswritten;
 
     constexpr uint8_t autobaud_symbol = '@';
 
-    byteswritten = serialport->write(&autobaud_symbol, 1);
+    // Nothing written, e.g. the port is gone: the caller retries
+    if (0 == serialport->Write(&autobaud_symbol, 1))
+    {
+        return -1;
+    }
 
     result = MRS900_Synccheck();
 
@@ -840,10 +723,13 @@ int ThreadSonarSerial::MRS900_Autobaud()
 
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-    uint32_t baudrate = serialport->getBaudrate();
+    uint32_t baudrate = serialport->GetBaudrate();
 
     std::string autobaudstr = std::string("    <") + std::to_string(baudrate) + std::string(">\r");
-    byteswritten = serialport->write(autobaudstr);
+    if (0 == serialport->Write(autobaudstr))
+    {
+        return -1;
+    }
 
     result = MRS900_Responsecheck();
 
@@ -864,139 +750,7 @@ int ThreadSonarSerial::MRS900_Autobaud()
 
 int ThreadSonarSerial::MRS900_GetLine(uint8_t *linebuf)
 {
-    int retvalue = 0;
-
-    uint8_t magicidbuffer[4] = { '0', '0', '0', '0' };
-    const uint8_t datatoken[4] = { 'D', 'A', 'T', 'A' };
-    const uint8_t end0token[4] = { 'E', 'N', 'D', '0' };
-    const uint8_t end1token[4] = { 'E', 'N', 'D', '1' };
-
-    enum _states { STATE_GETHEADER, STATE_GETFOOTER, STATE_PROCESSDATA } state;
-
-    int bytesread = 0;
-
-    state = STATE_GETHEADER;
-
-    auto time_begin = std::chrono::steady_clock::now();
-
-    if (STATE_GETHEADER == state)
-    {
-        for (;;)
-        {
-            uint8_t ch;
-
-            std::size_t br = serialport->read(&ch, 1);
-
-            if (br > 0)
-            {
-                bytesread++;
-
-                std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-                magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-                if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), datatoken))
-                {
-                    std::copy(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), linebuf);
-                    bytesread = sizeof(magicidbuffer);
-
-                    state = STATE_GETFOOTER;
-                    break;
-                }
-                else if (bytesread == sonarData->GetSamplesPerLine())
-                {
-                    retvalue = -4;
-                    break;
-                }
-                else
-                {
-                    //
-                }
-            }
-
-            auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
-
-            if (period.count() > 1000LL)
-            {
-                retvalue = -6;
-                break;
-            }
-        }
-    }
-
-    time_begin = std::chrono::steady_clock::now();
-
-    if ((STATE_GETFOOTER == state) && (0 == retvalue))
-    {
-        for (;;)
-        {
-            uint8_t ch;
-            std::size_t br = serialport->read(&ch, 1);
-
-            if (br > 0)
-            {
-                linebuf[bytesread++] = ch;
-
-                std::rotate(magicidbuffer, magicidbuffer + 1, magicidbuffer + sizeof(magicidbuffer));
-                magicidbuffer[sizeof(magicidbuffer) - 1] = ch;
-
-                if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), end0token) || 
-                    std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), end1token))
-                {
-                    state = STATE_PROCESSDATA;
-                    break;
-                }
-                else if (std::equal(magicidbuffer, magicidbuffer + sizeof(magicidbuffer), datatoken))
-                {
-                    //std::cout << "ThreadSonarSerial::MRS900_GetLine Error: DATA detected when ENDx expected" << "\n";
-
-                    bytesread = 4;
-                    continue;
-                }
-                else if (bytesread == sonarData->GetSamplesPerLine())
-                {
-                    retvalue = -4;
-                    break;
-                }
-                else
-                {
-                    //
-                }
-            }
-
-            auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin);
-
-            if (period.count() > 1000LL)
-            {
-                std::string tracebuf = "period.count() > 1000LL bytesread = " + std::to_string(bytesread);
-                std::cout << tracebuf << "\n";
-                retvalue = -6;
-                break;
-            }
-        }
-    }
-
-    if ((STATE_PROCESSDATA == state) && (0 == retvalue))
-    {
-        //wxLogDebug(wxT("ThreadSonarSerial::MRS900_GetLine: STATE_PROCESSDATA"));
-        // At this point we assume that DATA and ENDx received correctly
-        // Check only number of samples is equal bytesread
-
-        PDATAHEADER pdh = reinterpret_cast<PDATAHEADER>(&linebuf[0]);
-
-        if (pdh->samples > static_cast<uint32_t>(bytesread))
-        {
-            //std::string tracebuf = "pdh->samples > bytesread: pdh->samples= " + std::to_string(pdh->samples) + " bytesread= " + std::to_string(bytesread);
-            //std::cout << tracebuf << "\n";
-            // Wrong number of samples
-            retvalue = -7;
-        }
-    }
-    else
-    {
-        retvalue = -1;
-    }
-
-    return retvalue;
+    return frameassembler->GetLine(linebuf, static_cast<std::size_t>(SCANSONAR_MAX_LINE_SIZE));
 }
 
 int ThreadSonarSerial::MRS900_GetFWVersion(char *version)
@@ -1043,7 +797,7 @@ int ThreadSonarSerial::MRS900_SetParams(const PDATAGCOMMONSONARPARAM pdcsp, cons
     int result = -2;
 
     // Clean RS/MRS input buffer
-    std::size_t bw = serialport->write(std::string("         \r"));
+    std::size_t bw = serialport->Write(std::string("         \r"));
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
     MRS900_Responsecheck();
@@ -1090,7 +844,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(DATAGCOMMONSONARPARAM) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_COMMONSETTINGS;
             devcommand.size = sizeof(DATAGCOMMONSONARPARAM);
             devcommand.checksum = Crc32_ComputeBuf(crc, devcommand.data, sizeof(DATAGCOMMONSONARPARAM));
@@ -1105,7 +859,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(DATAGSCANSONARPARAM) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_SCANSETTINGS;
             devcommand.size = sizeof(DATAGSCANSONARPARAM);
             devcommand.checksum = Crc32_ComputeBuf(crc, devcommand.data, sizeof(DATAGSCANSONARPARAM));
@@ -1125,7 +879,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(int32_t) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_START;
             devcommand.size = sizeof(data);
             devcommand.checksum = Crc32_ComputeBuf(crc, &data, sizeof(data));
@@ -1140,7 +894,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(int32_t) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_STOP;
             devcommand.size = sizeof(data);
             devcommand.checksum = Crc32_ComputeBuf(crc, &data, sizeof(data));
@@ -1155,7 +909,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(int32_t) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_RESET;
             devcommand.size = sizeof(data);
             devcommand.checksum = Crc32_ComputeBuf(crc, &data, sizeof(data));
@@ -1170,7 +924,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(int32_t) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_FWVERSION;
             devcommand.size = sizeof(data);
             devcommand.checksum = Crc32_ComputeBuf(crc, &data, sizeof(data));
@@ -1185,7 +939,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(int32_t) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_DEVICETYPE;
             devcommand.size = sizeof(data);
             devcommand.checksum = Crc32_ComputeBuf(crc, &data, sizeof(data));
@@ -1200,7 +954,7 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
             std::fill(devcommand.data, devcommand.data + sizeof(devcommand.data) / sizeof(int32_t), 0);
             std::copy(pdcsp, pdcsp + sizeof(EEPROMDIRECT) / sizeof(int32_t), devcommand.data);
 
-            devcommand.magic = 1145982275;
+            devcommand.magic = DEVICECOMMAND_MAGIC;
             devcommand.command = BIN_COMMAND_EEPROMDIRECT;
             devcommand.size = sizeof(EEPROMDIRECT);
             devcommand.checksum = Crc32_ComputeBuf(crc, devcommand.data, sizeof(EEPROMDIRECT));
@@ -1216,16 +970,257 @@ int ThreadSonarSerial::MRS900_SendCommand(int command, void *param) const
 
     if (false != isvalidcommand)
     {
-        auto encodeddata = std::make_unique<B64Encode>(&devcommand, 4 * sizeof(int32_t) + devcommand.size, "\r");
-        const std::string &b64cmd = encodeddata->GetEncodedData();
-        std::size_t bw = serialport->write(b64cmd);
-        serialport->flush();
+        // Encode on the stack, keep-alive is sent every second while working
+        char b64cmd[B64Encode::EncodedSize(sizeof(DEVICECOMMAND)) + 1];
+
+        std::size_t cmdlen = B64Encode::Encode(&devcommand, 4 * sizeof(int32_t) + devcommand.size, b64cmd, sizeof(b64cmd));
+        b64cmd[cmdlen++] = '\r';
+
+        std::size_t bw = serialport->Write(reinterpret_cast<const uint8_t *>(b64cmd), cmdlen);
+        serialport->Flush();
     }
 
     return retvalue;
 }
 
+void ThreadSonarSerial::SetFrameParseMode(FrameParseMode mode)
+{
+    frameassembler->SetParseMode(mode);
+}
+
+uint64_t ThreadSonarSerial::GetFrameResyncCount() const
+{
+    return frameassembler->GetResyncCount();
+}
+
+const FrameRing &ThreadSonarSerial::GetFrameRing() const
+{
+    return *framering;
+}
+
+const FramePool &ThreadSonarSerial::GetFramePool() const
+{
+    return *framepool;
+}
+
+Recorder &ThreadSonarSerial::GetRecorder() const
+{
+    return *recorder;
+}
+
 uint16_t* ThreadSonarSerial::GetSonarData() const
 {
+    std::lock_guard<std::mutex> lock(sonardatalock);
     return sonarData->GetRawSonarData();
 }
+
+std::shared_ptr<const SonarData> ThreadSonarSerial::GetSonarImage() const
+{
+    std::lock_guard<std::mutex> lock(sonardatalock);
+    return sonarData;
+}
+
+uint32_t ThreadSonarSerial::GetSonarImageGeneration() const
+{
+    return sonardatageneration;
+}
+
+void ThreadSonarSerial::ResizeSonarData(int samplesperline, int linesperfullturn)
+{
+    std::unique_lock<std::mutex> lock(sonardatalock);
+
+    if ((samplesperline == sonarData->GetSamplesPerLine()) && (linesperfullturn == sonarData->GetLinesPerFullTurn()))
+    {
+        return;
+    }
+
+    if (linesperfullturn == sonarData->GetLinesPerFullTurn())
+    {
+        // Same lines, the image is kept. Copied under the lock so no line stored meanwhile is lost.
+        ReplaceSonarData(std::make_shared<SonarData>(*sonarData, samplesperline));
+        return;
+    }
+
+    int levels = pyramidlevels;
+    DecimationMode mode = decimation;
+    PersistenceSettings settings = persistence;
+
+    lock.unlock();
+
+    // Allocated and cleared without the lock, the processing thread keeps storing lines meanwhile
+    auto resized = std::make_shared<SonarData>(samplesperline, linesperfullturn, levels, mode, settings);
+
+    lock.lock();
+
+    ReplaceSonarData(std::move(resized));
+    prev_angle = -1;
+}
+
+void ThreadSonarSerial::SetSonarPyramid(int levels, DecimationMode mode)
+{
+    std::lock_guard<std::mutex> lock(sonardatalock);
+
+    pyramidlevels = levels;
+    decimation = mode;
+
+    if ((levels == sonarData->GetPyramidLevels()) && ((0 == levels) || (mode == sonarData->GetDecimation())))
+    {
+        return;
+    }
+
+    // Copied under the lock as for a line length change, the levels are built from the stored rows
+    ReplaceSonarData(std::make_shared<SonarData>(*sonarData, sonarData->GetSamplesPerLine(), levels, mode, persistence));
+}
+
+void ThreadSonarSerial::SetSonarPersistence(const PersistenceSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(sonardatalock);
+
+    persistence = settings;
+
+    PersistenceSettings current = sonarData->GetPersistence();
+
+    // Unchanged settings keep the image, pointers to it stay valid
+    if ((settings.mode == current.mode) &&
+        ((PersistenceMode::PMode_Off == settings.mode) || ((settings.weight == current.weight) && (settings.decay == current.decay))))
+    {
+        return;
+    }
+
+    // Copied under the lock as the pyramid, the persistence of the current image is kept when only the weight or the decay change
+    ReplaceSonarData(std::make_shared<SonarData>(*sonarData, sonarData->GetSamplesPerLine(), pyramidlevels, decimation, settings));
+}
+
+void ThreadSonarSerial::SetTvgCompensation(bool enabled, const TvgModel &model)
+{
+    {
+        std::lock_guard<std::mutex> lock(sonardatalock);
+
+        tvgenabled = enabled;
+        tvgmodel = model;
+        tvggeneration++;
+    }
+
+    UpdateTvgTable();
+}
+
+void ThreadSonarSerial::SetSoundSpeed(float soundspeed)
+{
+    {
+        std::lock_guard<std::mutex> lock(sonardatalock);
+
+        this->soundspeed = soundspeed;
+        tvggeneration++;
+    }
+
+    // A table being built for the previous sound speed is dropped
+    UpdateTvgTable();
+}
+
+void ThreadSonarSerial::UpdateTvgTable()
+{
+    std::unique_lock<std::mutex> lock(sonardatalock);
+
+    // A build started earlier must not replace the table built here
+    uint32_t generation = ++tvggeneration;
+
+    if (false == tvgenabled)
+    {
+        tvgtable.reset();
+        return;
+    }
+
+    DATAGCOMMONSONARPARAM params = dcsp;
+    TvgModel model = tvgmodel;
+    TvgSonarSettings settings =
+    {
+        static_cast<float>(params.sample_frequency), soundspeed, static_cast<float>(params.central_frequency),
+        params.gain, static_cast<float>(params.tvg_time)
+    };
+
+    lock.unlock();
+
+    // Covers every line length, lines longer than configured are stored as well
+    auto table = std::make_shared<const std::vector<uint16_t>>(Tvg_BuildTable(model, settings, SCANSONAR_MAX_LINE_SIZE));
+
+    lock.lock();
+
+    // Settings changed while building: the table is stale, the newer call builds its own
+    if ((generation != tvggeneration) || (false == tvgenabled))
+    {
+        return;
+    }
+
+    tvgtable = std::move(table);
+}
+
+void ThreadSonarSerial::ReplaceSonarData(std::shared_ptr<SonarData> image)
+{
+    // Raw pointers to the previous image stay valid until the next replacement, shared references keep it longer
+    retiredData = std::move(sonarData);
+    sonarData = std::move(image);
+    sonardatageneration++;
+}
+
+void ThreadSonarSerial::SetDetector(DetectMode mode, std::function<void(const Detection &)> callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(sonardatalock);
+        detectorsettings.mode = mode;
+    }
+
+    detector->SetCallback(std::move(callback));
+    UpdateDetectorSettings();
+}
+
+void ThreadSonarSerial::SetDetectorLimits(float threshold, float deadzone, float range)
+{
+    std::lock_guard<std::mutex> lock(sonardatalock);
+
+    detectorsettings.threshold = threshold;
+    detectorsettings.deadzone = deadzone;
+    detectorsettings.range = range;
+}
+
+LineDetector &ThreadSonarSerial::GetDetector() const
+{
+    return *detector;
+}
+
+void ThreadSonarSerial::SetChangeDetection(const ChangeSettings &settings, std::function<void(const ChangeSegment *, std::size_t)> callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(sonardatalock);
+
+        changesettings.enabled = settings.enabled;
+        changesettings.threshold = settings.threshold;
+        changesettings.learning = settings.learning;
+        changesettings.minlength = settings.minlength;
+        changesettings.mingap = settings.mingap;
+    }
+
+    changedetector->SetCallback(std::move(callback));
+    UpdateDetectorSettings();
+}
+
+ChangeDetector &ThreadSonarSerial::GetChangeDetector() const
+{
+    return *changedetector;
+}
+
+void ThreadSonarSerial::UpdateDetectorSettings()
+{
+    std::lock_guard<std::mutex> lock(sonardatalock);
+
+    DATAGCOMMONSONARPARAM params = dcsp;
+
+    detectorsettings.soundspeed = soundspeed;
+    detectorsettings.samplefrequency = static_cast<float>(params.sample_frequency);
+
+    changesettings.deadzone = detectorsettings.deadzone;
+    changesettings.soundspeed = detectorsettings.soundspeed;
+    changesettings.samplefrequency = detectorsettings.samplefrequency;
+
+    detector->SetSettings(detectorsettings);
+    changedetector->SetSettings(changesettings);
+}
@@ -0,0 +1,75 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <cstdlib>
+
+#include "Transport.h"
+#include "SerialTransport.h"
+#include "SocketTransport.h"
+#include "FileTransport.h"
+#include "LoopbackTransport.h"
+
+std::shared_ptr<Transport> Transport::Open(const std::string &uri, uint32_t baudrate, uint32_t timeoutms)
+{
+    std::string scheme;
+    std::string path = uri;
+
+    std::size_t pos = uri.find("://");
+
+    if (std::string::npos != pos)
+    {
+        scheme = uri.substr(0, pos);
+        path = uri.substr(pos + 3);
+    }
+
+    if (("tcp" == scheme) || ("udp" == scheme))
+    {
+        // host:port, IPv6 host is enclosed in brackets
+        std::size_t colon = path.rfind(':');
+
+        if ((std::string::npos == colon) || (colon + 1 == path.length()))
+        {
+            throw TransportException("Port is missing in " + uri);
+        }
+
+        std::string host = path.substr(0, colon);
+        std::string port = path.substr(colon + 1);
+
+        if ((host.length() >= 2) && ('[' == host.front()) && (']' == host.back()))
+        {
+            host = host.substr(1, host.length() - 2);
+        }
+
+        if ("tcp" == scheme)
+        {
+            return std::make_shared<TcpTransport>(host, port, baudrate, timeoutms);
+        }
+
+        return std::make_shared<UdpTransport>(host, port, baudrate, timeoutms);
+    }
+
+    if ("file" == scheme)
+    {
+        // file://path?speed=N, replay speed as in FileTransport::SetSpeed
+        double speed = 0.0;
+        std::size_t query = path.rfind("?speed=");
+
+        if (std::string::npos != query)
+        {
+            speed = std::strtod(path.c_str() + query + 7, nullptr);
+            path = path.substr(0, query);
+        }
+
+        return std::make_shared<FileTransport>(path, baudrate, timeoutms, speed);
+    }
+
+    if ("loop" == scheme)
+    {
+        return std::make_shared<LoopbackTransport>(baudrate, timeoutms);
+    }
+
+    if (scheme.empty() || ("serial" == scheme))
+    {
+        return std::make_shared<SerialTransport>(path, baudrate, timeoutms);
+    }
+
+    throw TransportException("Unknown transport " + scheme);
+}
@@ -0,0 +1,197 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <cmath>
+
+#include "CpuFeatures.h"
+#include "SampleRange.h"
+#include "Tvg.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(CPUFEATURES_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // Spreading is compensated from 1 m, closer samples keep the gain of 1 m
+    constexpr double REFERENCE_RANGE_M = 1.0;
+
+    /**
+     *   @brief Thorp's absorption of sea water
+     *   @param frequency - Hz
+     *   @return dB/km
+     */
+    double ThorpAbsorption(double frequency)
+    {
+        double f2 = (frequency / 1000.0) * (frequency / 1000.0);
+
+        return 0.11 * f2 / (1.0 + f2) + 44.0 * f2 / (4100.0 + f2) + 2.75e-4 * f2 + 0.003;
+    }
+
+    void TvgScalar(uint16_t *samples, const uint16_t *gain, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            uint32_t value = (static_cast<uint32_t>(samples[i]) * gain[i] + 128) >> 8;
+            samples[i] = static_cast<uint16_t>(std::min<uint32_t>(value, TVG_SAMPLE_MAX));
+        }
+    }
+
+#if defined(CPUFEATURES_X86)
+    /*
+     *  Sample and gain pairs (x, 1) and (g, 128) make madd return x * g + 128, the rounded product before the shift.
+     *  Both are below 0x8000, so the signed multiply is exact. Unpack and pack work inside 128-bit lanes,
+     *  unpacklo/unpackhi followed by pack keep the samples in order.
+     */
+    CPUFEATURES_TARGET("sse2")
+    void TvgSSE2(uint16_t *samples, const uint16_t *gain, std::size_t count)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i rounding = _mm_set1_epi16(128);
+        const __m128i maximum = _mm_set1_epi16(TVG_SAMPLE_MAX);
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i]));
+            __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&gain[i]));
+
+            __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(x, one), _mm_unpacklo_epi16(g, rounding)), 8);
+            __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(x, one), _mm_unpackhi_epi16(g, rounding)), 8);
+
+            __m128i y = _mm_min_epi16(_mm_packs_epi32(lo, hi), maximum);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&samples[i]), y);
+        }
+
+        TvgScalar(&samples[i], &gain[i], count - i);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void TvgAVX2(uint16_t *samples, const uint16_t *gain, std::size_t count)
+    {
+        const __m256i one = _mm256_set1_epi16(1);
+        const __m256i rounding = _mm256_set1_epi16(128);
+        const __m256i maximum = _mm256_set1_epi16(TVG_SAMPLE_MAX);
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i]));
+            __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&gain[i]));
+
+            __m256i lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(x, one), _mm256_unpacklo_epi16(g, rounding)), 8);
+            __m256i hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(x, one), _mm256_unpackhi_epi16(g, rounding)), 8);
+
+            __m256i y = _mm256_min_epi16(_mm256_packs_epi32(lo, hi), maximum);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&samples[i]), y);
+        }
+
+        TvgScalar(&samples[i], &gain[i], count - i);
+    }
+#endif
+
+#if defined(CPUFEATURES_NEON)
+    void TvgNEON(uint16_t *samples, const uint16_t *gain, std::size_t count)
+    {
+        const uint16x8_t maximum = vdupq_n_u16(TVG_SAMPLE_MAX);
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            uint16x8_t x = vld1q_u16(&samples[i]);
+            uint16x8_t g = vld1q_u16(&gain[i]);
+
+            // Rounding narrow shift, saturated to 16 bits before the 12-bit limit
+            uint16x4_t lo = vqrshrn_n_u32(vmull_u16(vget_low_u16(x), vget_low_u16(g)), 8);
+            uint16x4_t hi = vqrshrn_n_u32(vmull_u16(vget_high_u16(x), vget_high_u16(g)), 8);
+
+            vst1q_u16(&samples[i], vminq_u16(vcombine_u16(lo, hi), maximum));
+        }
+
+        TvgScalar(&samples[i], &gain[i], count - i);
+    }
+#endif
+
+    const KernelInfo<TvgKernels> &GetDispatch()
+    {
+        static const KernelInfo<TvgKernels> dispatch = Kernel_Select<TvgKernels>();
+        return dispatch;
+    }
+}
+
+std::vector<uint16_t> Tvg_BuildTable(const TvgModel &model, const TvgSonarSettings &settings, int samples)
+{
+    std::vector<uint16_t> table(std::max(0, samples), TVG_GAIN_ONE);
+
+    if ((settings.samplefrequency <= 0.0F) || (settings.soundspeed <= 0.0F))
+    {
+        return table;
+    }
+
+    double spreading = (TvgSpreading::TSpreading_40LogR == model.spreading) ? 40.0 :
+                       (TvgSpreading::TSpreading_30LogR == model.spreading) ? 30.0 : 20.0;
+
+    double absorption = 0.0;
+
+    if (TvgAbsorption::TAbsorption_Fixed == model.absorption)
+    {
+        absorption = model.absorptiondbkm / 1000.0;
+    }
+    else if ((TvgAbsorption::TAbsorption_Thorp == model.absorption) && (settings.centralfrequency > 0.0F))
+    {
+        absorption = ThorpAbsorption(settings.centralfrequency) / 1000.0;
+    }
+
+    double binrange = SampleRange_MetresPerSample(settings.soundspeed, settings.samplefrequency);
+    double reference = REFERENCE_RANGE_M;
+
+    if (false != model.aftersonartvg)
+    {
+        reference = std::max(reference, settings.soundspeed * settings.tvgtime / 1000.0 / 2.0);
+    }
+
+    for (int i = 0; i < samples; i++)
+    {
+        double range = std::max((i + 0.5) * binrange, reference);
+        double db = spreading * std::log10(range / reference) + 2.0 * absorption * (range - reference) - settings.gain;
+        double value = std::round(TVG_GAIN_ONE * std::pow(10.0, db / 20.0));
+
+        table[i] = static_cast<uint16_t>(std::min(value, static_cast<double>(TVG_GAIN_MAX)));
+    }
+
+    return table;
+}
+
+void Tvg_Apply(uint16_t *samples, const uint16_t *gain, std::size_t count)
+{
+    GetDispatch().functions.apply(samples, gain, count);
+}
+
+const char *Tvg_KernelName()
+{
+    return GetDispatch().name;
+}
+
+template<>
+const std::vector<KernelInfo<TvgKernels>> &Kernel_GetAll<TvgKernels>()
+{
+    static const std::vector<KernelInfo<TvgKernels>> kernels =
+    {
+        { { TvgScalar }, "scalar", nullptr },
+#if defined(CPUFEATURES_X86)
+        { { TvgSSE2 }, "sse2", CpuFeatures_HasSSE2 },
+        { { TvgAVX2 }, "avx2", CpuFeatures_HasAVX2 },
+#endif
+#if defined(CPUFEATURES_NEON)
+        { { TvgNEON }, "neon", nullptr },
+#endif
+    };
+
+    return kernels;
+}
@@ -0,0 +1,190 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include "CpuFeatures.h"
+#include "Uncompand.h"
+
+#if defined(CPUFEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(CPUFEATURES_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // *INDENT-OFF*
+
+    const uint16_t uncompand8to12b[256] =
+    {
+           0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,   15, //   0 ~ 15
+          16,   17,   18,   19,   20,   21,   22,   23,   24,   25,   26,   27,   28,   29,   30,   31, //  16 ~ 31
+          32,   33,   34,   35,   36,   37,   38,   39,   40,   41,   42,   43,   44,   45,   46,   47, //  32 ~ 47
+          48,   49,   50,   51,   52,   53,   54,   55,   56,   57,   58,   59,   60,   61,   62,   63, //  48 ~ 63
+          65,   67,   69,   71,   73,   75,   77,   79,   81,   83,   85,   87,   89,   91,   93,   95, //  64 ~ 79
+          97,   99,  101,  103,  105,  107,  109,  111,  113,  115,  117,  119,  121,  123,  125,  127, //  80 ~ 95
+         131,  135,  139,  143,  147,  151,  155,  159,  163,  167,  171,  175,  179,  183,  187,  191, //  96 ~ 111
+         195,  199,  203,  207,  211,  215,  219,  223,  227,  231,  235,  239,  243,  247,  251,  255, // 112 ~ 127
+         263,  271,  279,  287,  295,  303,  311,  319,  327,  335,  343,  351,  359,  367,  375,  383, // 128 ~ 143
+         391,  399,  407,  415,  423,  431,  439,  447,  455,  463,  471,  479,  487,  495,  503,  511, // 144 ~ 159
+         527,  543,  559,  575,  591,  607,  623,  639,  655,  671,  687,  703,  719,  735,  751,  767, // 160 ~ 175
+         783,  799,  815,  831,  847,  863,  879,  895,  911,  927,  943,  959,  975,  991, 1007, 1023, // 176 ~ 191
+        1055, 1087, 1119, 1151, 1183, 1215, 1247, 1279, 1311, 1343, 1375, 1407, 1439, 1471, 1503, 1535, // 192 ~ 207
+        1567, 1599, 1631, 1663, 1695, 1727, 1759, 1791, 1823, 1855, 1887, 1919, 1951, 1983, 2015, 2047, // 208 ~ 223
+        2111, 2175, 2239, 2303, 2367, 2431, 2495, 2559, 2623, 2687, 2751, 2815, 2879, 2943, 3007, 3071, // 224 ~ 239
+        3135, 3199, 3263, 3327, 3391, 3455, 3519, 3583, 3647, 3711, 3775, 3839, 3903, 3967, 4031, 4095  // 240 ~ 255
+    };
+
+    // *INDENT-ON*
+
+    /*
+     *  The curve is linear inside each segment selected by the top 3 bits s of the sample:
+     *      y = (x & 31) * SEGMENT_SLOPE[s] + SEGMENT_BASE[s]
+     *  8-entry segment tables fit one pshufb/vtbl lookup, the base is looked up as low and high bytes.
+     */
+    const uint8_t SEGMENT_SLOPE[8] = { 1, 1, 2, 4, 8, 16, 32, 64 };
+    const uint8_t SEGMENT_BASE_LO[8] = { 0, 32, 65, 131, 263 & 0xFF, 527 & 0xFF, 1055 & 0xFF, 2111 & 0xFF };
+    const uint8_t SEGMENT_BASE_HI[8] = { 0, 0, 0, 0, 263 >> 8, 527 >> 8, 1055 >> 8, 2111 >> 8 };
+
+    void UncompandScalar(const uint8_t *src, uint16_t *dst, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            dst[i] = uncompand8to12b[src[i]];
+        }
+    }
+
+#if defined(CPUFEATURES_X86)
+    CPUFEATURES_TARGET("ssse3")
+    void UncompandSSSE3(const uint8_t *src, uint16_t *dst, std::size_t count)
+    {
+        const __m128i slopes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_SLOPE));
+        const __m128i baselo = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_BASE_LO));
+        const __m128i basehi = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_BASE_HI));
+        const __m128i segmask = _mm_set1_epi8(7);
+        const __m128i offsetmask = _mm_set1_epi8(31);
+        const __m128i zero = _mm_setzero_si128();
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&src[i]));
+
+            __m128i segment = _mm_and_si128(_mm_srli_epi16(x, 5), segmask);
+            __m128i offset = _mm_and_si128(x, offsetmask);
+            __m128i slope = _mm_shuffle_epi8(slopes, segment);
+            __m128i lo = _mm_shuffle_epi8(baselo, segment);
+            __m128i hi = _mm_shuffle_epi8(basehi, segment);
+
+            __m128i y0 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(offset, zero), _mm_unpacklo_epi8(slope, zero)),
+                                       _mm_unpacklo_epi8(lo, hi));
+            __m128i y1 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(offset, zero), _mm_unpackhi_epi8(slope, zero)),
+                                       _mm_unpackhi_epi8(lo, hi));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst[i]), y0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst[i + 8]), y1);
+        }
+
+        UncompandScalar(&src[i], &dst[i], count - i);
+    }
+
+    CPUFEATURES_TARGET("avx2")
+    void UncompandAVX2(const uint8_t *src, uint16_t *dst, std::size_t count)
+    {
+        const __m256i slopes = _mm256_broadcastsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_SLOPE)));
+        const __m256i baselo = _mm256_broadcastsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_BASE_LO)));
+        const __m256i basehi = _mm256_broadcastsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(SEGMENT_BASE_HI)));
+        const __m256i segmask = _mm256_set1_epi8(7);
+        const __m256i offsetmask = _mm256_set1_epi8(31);
+        const __m256i zero = _mm256_setzero_si256();
+
+        std::size_t i = 0;
+
+        for (; i + 32 <= count; i += 32)
+        {
+            // Unpack works inside 128-bit lanes, quadwords 0,2 | 1,3 keep the output in order
+            __m256i x = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(&src[i])), 0xD8);
+
+            __m256i segment = _mm256_and_si256(_mm256_srli_epi16(x, 5), segmask);
+            __m256i offset = _mm256_and_si256(x, offsetmask);
+            __m256i slope = _mm256_shuffle_epi8(slopes, segment);
+            __m256i lo = _mm256_shuffle_epi8(baselo, segment);
+            __m256i hi = _mm256_shuffle_epi8(basehi, segment);
+
+            __m256i y0 = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(offset, zero), _mm256_unpacklo_epi8(slope, zero)),
+                                          _mm256_unpacklo_epi8(lo, hi));
+            __m256i y1 = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(offset, zero), _mm256_unpackhi_epi8(slope, zero)),
+                                          _mm256_unpackhi_epi8(lo, hi));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&dst[i]), y0);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&dst[i + 16]), y1);
+        }
+
+        UncompandScalar(&src[i], &dst[i], count - i);
+    }
+#endif
+
+#if defined(CPUFEATURES_NEON)
+    void UncompandNEON(const uint8_t *src, uint16_t *dst, std::size_t count)
+    {
+        const uint8x8_t slopes = vld1_u8(SEGMENT_SLOPE);
+        const uint8x8_t baselo = vld1_u8(SEGMENT_BASE_LO);
+        const uint8x8_t basehi = vld1_u8(SEGMENT_BASE_HI);
+        const uint8x8_t offsetmask = vdup_n_u8(31);
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            uint8x8_t x = vld1_u8(&src[i]);
+
+            uint8x8_t segment = vshr_n_u8(x, 5);
+            uint16x8_t base = vaddw_u8(vshll_n_u8(vtbl1_u8(basehi, segment), 8), vtbl1_u8(baselo, segment));
+
+            vst1q_u16(&dst[i], vmlal_u8(base, vand_u8(x, offsetmask), vtbl1_u8(slopes, segment)));
+        }
+
+        UncompandScalar(&src[i], &dst[i], count - i);
+    }
+#endif
+
+    const KernelInfo<UncompandKernels> &GetDispatch()
+    {
+        static const KernelInfo<UncompandKernels> dispatch = Kernel_Select<UncompandKernels>();
+        return dispatch;
+    }
+}
+
+void Uncompand_Line(const uint8_t *src, uint16_t *dst, std::size_t count)
+{
+    GetDispatch().functions.line(src, dst, count);
+}
+
+const char *Uncompand_KernelName()
+{
+    return GetDispatch().name;
+}
+
+uint16_t Uncompand_Sample(uint8_t sample)
+{
+    return uncompand8to12b[sample];
+}
+
+template<>
+const std::vector<KernelInfo<UncompandKernels>> &Kernel_GetAll<UncompandKernels>()
+{
+    static const std::vector<KernelInfo<UncompandKernels>> kernels =
+    {
+        { { UncompandScalar }, "scalar", nullptr },
+#if defined(CPUFEATURES_X86)
+        { { UncompandSSSE3 }, "ssse3", CpuFeatures_HasSSSE3 },
+        { { UncompandAVX2 }, "avx2", CpuFeatures_HasAVX2 },
+#endif
+#if defined(CPUFEATURES_NEON)
+        { { UncompandNEON }, "neon", nullptr },
+#endif
+    };
+
+    return kernels;
+}
+
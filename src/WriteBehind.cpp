@@ -0,0 +1,360 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if !defined( _WIN32 )
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "WriteBehind.h"
+
+constexpr std::size_t WriteBehind::BUFFER_ALIGNMENT;
+constexpr std::size_t WriteBehind::DEFAULT_BUFFER_BYTES;
+constexpr int WriteBehind::DEFAULT_BUFFERS;
+
+WriteBehind::WriteBehind(std::size_t bufferbytes, int buffers) :
+    bufferbytes(std::max<std::size_t>(BUFFER_ALIGNMENT, (bufferbytes + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT)),
+    bufferscount(std::max(buffers, 2)),
+#if !defined( _WIN32 )
+    fd(-1),
+#endif
+    stopping(false),
+    current(nullptr),
+    fileoffset(0),
+    policy(BacklogPolicy::BPolicy_Drop),
+    direct(false),
+    queued(0),
+    highwater(0),
+    frames(0),
+    dropped(0),
+    bytes(0),
+    writes(0),
+    latencyus(0),
+    maxlatencyus(0),
+    errors(0)
+{
+}
+
+WriteBehind::WriteBehind(const std::string &filename, std::size_t bufferbytes, int buffers, bool direct) :
+    WriteBehind(bufferbytes, buffers)
+{
+#if defined( _WIN32 )
+    (void)direct;
+    stream = std::make_unique<std::ofstream>(filename, std::ofstream::binary);
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#if defined( O_DIRECT )
+    // Not every file system takes O_DIRECT, e.g. tmpfs
+    if (false != direct)
+    {
+        fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+        this->direct = (fd >= 0);
+    }
+#else
+    (void)direct;
+#endif
+
+    if (fd < 0)
+    {
+        fd = open(filename.c_str(), flags, 0644);
+    }
+#endif
+
+    Start();
+}
+
+#if !defined (__linux__)
+WriteBehind::WriteBehind(const std::wstring &filename, std::size_t bufferbytes, int buffers, bool direct) :
+    WriteBehind(bufferbytes, buffers)
+{
+    (void)direct;
+    stream = std::make_unique<std::ofstream>(filename, std::ofstream::binary);
+
+    Start();
+}
+#endif
+
+WriteBehind::~WriteBehind()
+{
+    if (nullptr != thread)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queuelock);
+
+            if ((nullptr != current) && (0 != current->used))
+            {
+                queue.push_back(current);
+                current = nullptr;
+            }
+
+            stopping = true;
+        }
+
+        queuecv.notify_all();
+        thread->join();
+    }
+
+#if !defined( _WIN32 )
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+}
+
+void WriteBehind::Start()
+{
+    if (false == IsOpen())
+    {
+        return;
+    }
+
+    // Allocated once, pages are touched by the first frames
+    buffers.resize(bufferscount);
+
+    for (Buffer &buffer : buffers)
+    {
+        buffer.storage.reset(new uint8_t[bufferbytes + BUFFER_ALIGNMENT]);
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(buffer.storage.get());
+        address = (address + BUFFER_ALIGNMENT - 1) & ~static_cast<uintptr_t>(BUFFER_ALIGNMENT - 1);
+
+        buffer.data = reinterpret_cast<uint8_t *>(address);
+        buffer.used = 0;
+
+        freebuffers.push_back(&buffer);
+    }
+
+    thread = std::make_unique<std::thread>(&WriteBehind::WriterThread, this);
+}
+
+bool WriteBehind::IsOpen() const
+{
+#if defined( _WIN32 )
+    return (nullptr != stream) && (false != stream->is_open());
+#else
+    return fd >= 0;
+#endif
+}
+
+void WriteBehind::SetPolicy(BacklogPolicy policy)
+{
+    // A frame already waiting is still written whole
+    this->policy = policy;
+}
+
+BacklogPolicy WriteBehind::GetPolicy() const
+{
+    return policy;
+}
+
+bool WriteBehind::WriteFrame(const void *header, std::size_t headersize, const void *data, std::size_t datasize)
+{
+    if (false == IsOpen())
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(queuelock);
+
+    if (BacklogPolicy::BPolicy_Drop == policy)
+    {
+        // Only the producer takes free buffers, the room checked here can only grow
+        std::size_t room = freebuffers.size() * bufferbytes;
+
+        if (nullptr != current)
+        {
+            room += bufferbytes - current->used;
+        }
+
+        if (room < headersize + datasize)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    Append(reinterpret_cast<const uint8_t *>(header), headersize, lock);
+    Append(reinterpret_cast<const uint8_t *>(data), datasize, lock);
+
+    frames.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void WriteBehind::Append(const uint8_t *src, std::size_t size, std::unique_lock<std::mutex> &lock)
+{
+    while (size > 0)
+    {
+        if (nullptr == current)
+        {
+            freecv.wait(lock, [this]() { return false == freebuffers.empty(); });
+
+            current = freebuffers.back();
+            freebuffers.pop_back();
+        }
+
+        std::size_t count = std::min(size, bufferbytes - current->used);
+
+        // The open buffer belongs to the producer
+        lock.unlock();
+        std::memcpy(current->data + current->used, src, count);
+        lock.lock();
+
+        current->used += count;
+        src += count;
+        size -= count;
+
+        if (bufferbytes == current->used)
+        {
+            queue.push_back(current);
+            current = nullptr;
+
+            uint32_t depth = static_cast<uint32_t>(queue.size());
+
+            queued = depth;
+
+            if (depth > highwater)
+            {
+                highwater = depth;
+            }
+
+            queuecv.notify_one();
+        }
+    }
+}
+
+void WriteBehind::WriterThread()
+{
+    for (;;)
+    {
+        Buffer *buffer;
+
+        {
+            std::unique_lock<std::mutex> lock(queuelock);
+            queuecv.wait(lock, [this]() { return (false == queue.empty()) || (false != stopping); });
+
+            // Queued buffers are written before stopping
+            if (false != queue.empty())
+            {
+                break;
+            }
+
+            buffer = queue.front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool written = WriteBuffer(*buffer);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+        latencyus.fetch_add(us, std::memory_order_relaxed);
+        writes.fetch_add(1, std::memory_order_relaxed);
+
+        if (us > maxlatencyus)
+        {
+            maxlatencyus = us;
+        }
+
+        if (false != written)
+        {
+            bytes.fetch_add(buffer->used, std::memory_order_relaxed);
+        }
+        else
+        {
+            errors.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // A failed buffer leaves a gap, the following ones keep their offsets
+        fileoffset += buffer->used;
+        buffer->used = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(queuelock);
+
+            // Dequeued only now, so queued counts the buffer being written
+            queue.pop_front();
+            queued = static_cast<uint32_t>(queue.size());
+            freebuffers.push_back(buffer);
+        }
+
+        freecv.notify_one();
+    }
+}
+
+bool WriteBehind::WriteBuffer(const Buffer &buffer)
+{
+#if defined( _WIN32 )
+    stream->write(reinterpret_cast<const char *>(buffer.data), buffer.used);
+
+    return false == stream->fail();
+#else
+    const uint8_t *src = buffer.data;
+    std::size_t left = buffer.used;
+    uint64_t offset = fileoffset;
+
+    while (left > 0)
+    {
+#if defined( O_DIRECT )
+        // The last buffer is not a whole number of blocks
+        if ((false != direct) && ((0 != left % BUFFER_ALIGNMENT) || (0 != offset % BUFFER_ALIGNMENT)))
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+        }
+#endif
+
+        ssize_t count = pwrite(fd, src, left, static_cast<off_t>(offset));
+
+        if (count < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+#if defined( O_DIRECT )
+            // Opened with O_DIRECT but the device block is larger than BUFFER_ALIGNMENT
+            if ((EINVAL == errno) && (false != direct))
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                direct = false;
+                continue;
+            }
+#endif
+
+            return false;
+        }
+
+        src += count;
+        left -= static_cast<std::size_t>(count);
+        offset += static_cast<uint64_t>(count);
+    }
+
+    return true;
+#endif
+}
+
+WriteBehindStats WriteBehind::GetStats() const
+{
+    WriteBehindStats stats;
+
+    stats.capacity = static_cast<uint32_t>(bufferscount);
+    stats.queued = queued;
+    stats.highwater = highwater;
+    stats.frames = frames;
+    stats.dropped = dropped;
+    stats.bytes = bytes;
+    stats.writes = writes;
+    stats.latencyus = latencyus;
+    stats.maxlatencyus = maxlatencyus;
+    stats.errors = errors;
+    stats.direct = direct;
+
+    return stats;
+}
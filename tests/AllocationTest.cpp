@@ -0,0 +1,154 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+//
+// Replays a generated recording through the acquisition threads and counts heap allocations
+// of the whole process while lines are received. Acquisition must not allocate per line.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ScansonarCWrapper.h"
+#include "SonarStructures.h"
+#include "FrameScanner.h"
+
+namespace
+{
+    constexpr int LINE_SIZE = 1376;
+    constexpr int LINES = 4000;
+    constexpr int WARMUP_LINES = 500;       // Lines before counting starts, e.g. the first turn
+    constexpr int MEASURED_LINES = 3000;
+
+    const char *RECORDING_FILE = "scansonar_allocation_test.bin";
+
+    std::atomic<uint64_t> allocations(0);
+    std::atomic<int> lines(0);
+    std::atomic<uint64_t> allocationsatstart(0);
+    std::atomic<uint64_t> allocationsatend(0);
+
+    void LineCallback(char *line, int size)
+    {
+        (void)line;
+        (void)size;
+
+        int count = ++lines;
+
+        if (WARMUP_LINES == count)
+        {
+            allocationsatstart = allocations.load();
+        }
+        else if (WARMUP_LINES + MEASURED_LINES == count)
+        {
+            allocationsatend = allocations.load();
+        }
+    }
+
+    bool WriteRecording()
+    {
+        std::ofstream file(RECORDING_FILE, std::ofstream::binary | std::ofstream::trunc);
+        std::vector<uint8_t> line(LINE_SIZE);
+
+        for (int i = 0; i < LINES; i++)
+        {
+            DATAHEADERV3 header{};
+            header.magic = FRAME_MAGIC_DATA;
+            header.dataoffset = sizeof(DATAHEADERV3);
+            header.datasize = 1;
+            header.samples = LINE_SIZE;
+            header.angle = (i % 3200) * 9;
+
+            std::memcpy(line.data(), &header, sizeof(header));
+
+            for (int j = sizeof(DATAHEADERV3); j < LINE_SIZE - static_cast<int>(sizeof(DATAFOOTER)); j++)
+            {
+                line[j] = static_cast<uint8_t>(i + j);
+            }
+
+            DATAFOOTER footer = { static_cast<uint32_t>(i), FRAME_MAGIC_END0 };
+            std::memcpy(&line[LINE_SIZE - sizeof(DATAFOOTER)], &footer, sizeof(DATAFOOTER));
+
+            file.write(reinterpret_cast<const char *>(line.data()), LINE_SIZE);
+        }
+
+        return false == file.fail();
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *p = std::malloc((0 == size) ? 1 : size);
+
+    if (nullptr == p)
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+int main()
+{
+    if (false == WriteRecording())
+    {
+        std::printf("FAIL: cannot write %s\n", RECORDING_FILE);
+        return 1;
+    }
+
+    std::string uri = std::string("file://") + RECORDING_FILE;
+
+#if defined( _WIN32 )
+    pSnrCtx ctx = ScansonarOpenUri(uri.c_str(), 115200, L"", LineCallback);
+#else
+    pSnrCtx ctx = ScansonarOpenUri(uri.c_str(), 115200, "", LineCallback);
+#endif
+
+    if (nullptr == ctx)
+    {
+        std::printf("FAIL: cannot open %s\n", uri.c_str());
+        return 1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+    while ((lines < WARMUP_LINES + MEASURED_LINES) && (std::chrono::steady_clock::now() < deadline))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    int received = lines;
+
+    ScansonarClose(ctx);
+    std::remove(RECORDING_FILE);
+
+    if (received < WARMUP_LINES + MEASURED_LINES)
+    {
+        std::printf("FAIL: %d of %d lines received\n", received, WARMUP_LINES + MEASURED_LINES);
+        return 1;
+    }
+
+    uint64_t count = allocationsatend - allocationsatstart;
+
+    std::printf("%s: %llu heap allocations while receiving %d lines\n", (0 == count) ? "PASS" : "FAIL",
+                static_cast<unsigned long long>(count), MEASURED_LINES);
+
+    return (0 == count) ? 0 : 1;
+}
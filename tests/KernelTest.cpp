@@ -0,0 +1,532 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+//
+// Runs every SIMD kernel this CPU can run against the reference of its module, at lengths covering
+// the vector bodies and every tail:
+//  uncompand   - the lookup table, all 256 sample values in every lane, from unaligned addresses
+//  persistence - the average and max-hold formulas, every 12-bit sample against states across the range
+//  change mask - the definition of Change_Mask(), every 12-bit sample against backgrounds across the range
+//  tvg         - the rounded Q8.8 product saturated at TVG_SAMPLE_MAX, every gain up to TVG_GAIN_MAX
+//  detector    - first sample at or above the threshold and the largest sample, thresholds and samples at the
+//                16-bit edges, all-equal lines, the sample found at every position
+
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+#include "KernelInfo.h"
+#include "Uncompand.h"
+#include "Persistence.h"
+#include "ChangeDetector.h"
+#include "Tvg.h"
+#include "LineDetector.h"
+
+namespace
+{
+    constexpr int SAMPLE_RANGE = 4096;              // 12-bit samples
+    constexpr int MAX_TAIL_LENGTH = 160;            // Several bodies of the widest kernel, every tail length
+    constexpr uint16_t GUARD = 0xDEAD;
+    constexpr uint32_t GUARD_WORD = 0xDEADBEEF;
+
+    /**
+     *   @brief Check every kernel of a module this CPU can run
+     *   @return number of failed kernels
+     */
+    template<typename Functions>
+    int RunKernels(const char *module, bool (*check)(const KernelInfo<Functions> &kernel), const char *selected)
+    {
+        int failures = 0;
+
+        std::vector<KernelInfo<Functions>> kernels = Kernel_GetSupported<Functions>();
+
+        for (const KernelInfo<Functions> &kernel : kernels)
+        {
+            bool passed = check(kernel);
+
+            std::printf("%s: %s %s\n", (false != passed) ? "PASS" : "FAIL", module, kernel.name);
+
+            failures += (false != passed) ? 0 : 1;
+        }
+
+        std::printf("%s: %s, %zu kernels, %s selected\n", (0 == failures) ? "PASS" : "FAIL", module, kernels.size(), selected);
+
+        return failures;
+    }
+
+    // Uncompand
+
+    constexpr std::size_t UNCOMPAND_LINE_LENGTHS[] = { 255, 256, 257, 1340, 4096 };
+    constexpr std::size_t MAX_MISALIGNMENT = 3;
+
+    /**
+     *   @return false - the kernel differs from Uncompand_Sample() or writes past count
+     */
+    bool CheckUncompandLength(const KernelInfo<UncompandKernels> &kernel, std::size_t count)
+    {
+        std::vector<uint8_t> src(count + MAX_MISALIGNMENT);
+        std::vector<uint16_t> dst(count + MAX_MISALIGNMENT + 1);
+
+        for (std::size_t misalignment = 0; misalignment <= MAX_MISALIGNMENT; misalignment++)
+        {
+            // Every value reaches every position
+            for (int first = 0; first < 256; first++)
+            {
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    src[misalignment + i] = static_cast<uint8_t>(first + i);
+                }
+
+                std::fill(dst.begin(), dst.end(), GUARD);
+
+                kernel.functions.line(&src[misalignment], &dst[misalignment], count);
+
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    uint8_t sample = src[misalignment + i];
+
+                    if (dst[misalignment + i] != Uncompand_Sample(sample))
+                    {
+                        std::printf("FAIL: uncompand %s, length %zu, offset %zu, position %zu: sample %u gives %u, expected %u\n",
+                                    kernel.name, count, misalignment, i, sample, dst[misalignment + i], Uncompand_Sample(sample));
+                        return false;
+                    }
+                }
+
+                if (GUARD != dst[misalignment + count])
+                {
+                    std::printf("FAIL: uncompand %s, length %zu, offset %zu: written past the end\n", kernel.name, count, misalignment);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool CheckUncompand(const KernelInfo<UncompandKernels> &kernel)
+    {
+        for (std::size_t count = 0; count <= MAX_TAIL_LENGTH; count++)
+        {
+            if (false == CheckUncompandLength(kernel, count))
+            {
+                return false;
+            }
+        }
+
+        for (std::size_t count : UNCOMPAND_LINE_LENGTHS)
+        {
+            if (false == CheckUncompandLength(kernel, count))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Persistence
+
+    constexpr uint32_t STATE_STEP = 13;             // States checked against every sample
+
+    const int16_t WEIGHTS[] = { 1, 2, 3277, 0x4000, 32766, 32767 };
+    const uint16_t DECAYS[] = { 0, 1, 7, 4095, 4096, 0xFFFF };
+
+    uint16_t ReferenceAverage(uint16_t state, uint16_t sample, int16_t weight)
+    {
+        int32_t difference = static_cast<int32_t>(sample) - static_cast<int32_t>(state);
+
+        // Arithmetic shift rounds half up
+        return static_cast<uint16_t>(state + ((difference * weight + 0x4000) >> 15));
+    }
+
+    uint16_t ReferenceMaxHold(uint16_t state, uint16_t sample, uint16_t decay)
+    {
+        int32_t held = std::max(0, static_cast<int32_t>(state) - static_cast<int32_t>(decay));
+
+        return static_cast<uint16_t>(std::max(static_cast<int32_t>(sample), held));
+    }
+
+    /**
+     *   @brief Samples 0 ~ 4095 rotated by first, state from its own sequence
+     *   @return false - the kernel result differs at some position or the state is written past count
+     */
+    template<typename Parameter, typename Kernel, typename Reference>
+    bool CheckPersist(const char *kernelname, const char *operation, Kernel kernel, Reference reference, Parameter parameter,
+                      std::size_t count, uint32_t first, uint32_t statefirst)
+    {
+        std::vector<uint16_t> state(count + 1, GUARD);
+        std::vector<uint16_t> samples(count + 1, GUARD);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            samples[i] = static_cast<uint16_t>((first + i) % SAMPLE_RANGE);
+            state[i] = static_cast<uint16_t>((statefirst + i * 7) % SAMPLE_RANGE);
+        }
+
+        std::vector<uint16_t> initial(state);
+
+        kernel(state.data(), samples.data(), count, parameter);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            uint16_t expected = reference(initial[i], samples[i], parameter);
+
+            if (state[i] != expected)
+            {
+                std::printf("FAIL: persistence %s %s, parameter %d, length %zu, position %zu: state %u sample %u gives %u, expected %u\n",
+                            kernelname, operation, static_cast<int>(parameter), count, i, initial[i], samples[i], state[i], expected);
+                return false;
+            }
+        }
+
+        if (GUARD != state[count])
+        {
+            std::printf("FAIL: persistence %s %s, length %zu: written past the end\n", kernelname, operation, count);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CheckPersistence(const KernelInfo<PersistKernels> &kernel)
+    {
+        for (int16_t weight : WEIGHTS)
+        {
+            // Every sample against states across the range, differences of both signs up to +-4095
+            for (uint32_t statefirst = 0; statefirst < SAMPLE_RANGE; statefirst += STATE_STEP)
+            {
+                if (false == CheckPersist(kernel.name, "average", kernel.functions.average, ReferenceAverage, weight, SAMPLE_RANGE,
+                                          statefirst * 3, statefirst))
+                {
+                    return false;
+                }
+            }
+
+            for (std::size_t count = 0; count <= MAX_TAIL_LENGTH; count++)
+            {
+                if (false == CheckPersist(kernel.name, "average", kernel.functions.average, ReferenceAverage, weight, count,
+                                          static_cast<uint32_t>(4095 - count), 0))
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (uint16_t decay : DECAYS)
+        {
+            for (uint32_t statefirst = 0; statefirst < SAMPLE_RANGE; statefirst += STATE_STEP)
+            {
+                if (false == CheckPersist(kernel.name, "maxhold", kernel.functions.maxhold, ReferenceMaxHold, decay, SAMPLE_RANGE,
+                                          statefirst * 3, statefirst))
+                {
+                    return false;
+                }
+            }
+
+            for (std::size_t count = 0; count <= MAX_TAIL_LENGTH; count++)
+            {
+                if (false == CheckPersist(kernel.name, "maxhold", kernel.functions.maxhold, ReferenceMaxHold, decay, count,
+                                          static_cast<uint32_t>(4095 - count), 4000))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Change mask
+
+    constexpr int BACKGROUND_STEP = 11;             // Backgrounds checked against every sample
+
+    const uint16_t CHANGE_THRESHOLDS[] = { 0, 1, 100, 4094, 4095, 0xFFFF };
+
+    /**
+     *   @return false - a mask bit differs, bits after count are set or the mask is written past its last word
+     */
+    bool CheckMask(const KernelInfo<ChangeKernels> &kernel, const std::vector<uint16_t> &samples, const std::vector<uint16_t> &background,
+                   int count, uint16_t threshold)
+    {
+        int words = (count + 31) / 32;
+        std::vector<uint32_t> mask(words + 1, GUARD_WORD);
+
+        kernel.functions.mask(samples.data(), background.data(), count, threshold, mask.data());
+
+        for (int i = 0; i < words * 32; i++)
+        {
+            bool expected = (i < count) && (static_cast<int>(samples[i]) - static_cast<int>(background[i]) > threshold);
+            bool marked = 0 != ((mask[i / 32] >> (i % 32)) & 1U);
+
+            if (marked != expected)
+            {
+                if (i < count)
+                {
+                    std::printf("FAIL: change mask %s, threshold %u, length %d, position %d: sample %u background %u marked %d\n",
+                                kernel.name, threshold, count, i, samples[i], background[i], marked ? 1 : 0);
+                }
+                else
+                {
+                    std::printf("FAIL: change mask %s, threshold %u, length %d: bit %d after count is set\n", kernel.name, threshold, count, i);
+                }
+
+                return false;
+            }
+        }
+
+        if (GUARD_WORD != mask[words])
+        {
+            std::printf("FAIL: change mask %s, threshold %u, length %d: written past the last word\n", kernel.name, threshold, count);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CheckChangeMask(const KernelInfo<ChangeKernels> &kernel)
+    {
+        std::vector<uint16_t> samples(SAMPLE_RANGE);
+        std::vector<uint16_t> background(SAMPLE_RANGE);
+
+        for (uint16_t threshold : CHANGE_THRESHOLDS)
+        {
+            // Every sample against backgrounds across the range, differences of both signs up to +-4095
+            for (int first = 0; first < SAMPLE_RANGE; first += BACKGROUND_STEP)
+            {
+                for (int i = 0; i < SAMPLE_RANGE; i++)
+                {
+                    samples[i] = static_cast<uint16_t>(i);
+                    background[i] = static_cast<uint16_t>((first + i * 5) % SAMPLE_RANGE);
+                }
+
+                if (false == CheckMask(kernel, samples, background, SAMPLE_RANGE, threshold))
+                {
+                    return false;
+                }
+            }
+
+            for (int count = 0; count <= MAX_TAIL_LENGTH; count++)
+            {
+                // Alternating changed and unchanged runs near the threshold
+                for (int i = 0; i < count; i++)
+                {
+                    background[i] = static_cast<uint16_t>((i * 37) % 2048);
+                    samples[i] = static_cast<uint16_t>(std::max(0, std::min(4095, background[i] + threshold + (i % 3) - 1)));
+                }
+
+                if (false == CheckMask(kernel, samples, background, count, threshold))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // TVG
+
+    constexpr uint32_t TVG_GAIN_STEP = 8;
+
+    uint16_t ReferenceTvg(uint16_t sample, uint16_t gain)
+    {
+        uint32_t value = (static_cast<uint32_t>(sample) * gain + 128) >> 8;
+
+        return static_cast<uint16_t>(std::min<uint32_t>(value, TVG_SAMPLE_MAX));
+    }
+
+    /**
+     *   @return false - a sample differs from ReferenceTvg() or the samples are written past count
+     */
+    bool CheckApply(const KernelInfo<TvgKernels> &kernel, const std::vector<uint16_t> &initial, const std::vector<uint16_t> &gain,
+                    std::size_t count)
+    {
+        std::vector<uint16_t> samples(initial.begin(), initial.begin() + count);
+
+        samples.push_back(GUARD);
+
+        kernel.functions.apply(samples.data(), gain.data(), count);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            uint16_t expected = ReferenceTvg(initial[i], gain[i]);
+
+            if (samples[i] != expected)
+            {
+                std::printf("FAIL: tvg %s, length %zu, position %zu: sample %u gain %u gives %u, expected %u\n",
+                            kernel.name, count, i, initial[i], gain[i], samples[i], expected);
+                return false;
+            }
+        }
+
+        if (GUARD != samples[count])
+        {
+            std::printf("FAIL: tvg %s, length %zu: written past the end\n", kernel.name, count);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CheckTvg(const KernelInfo<TvgKernels> &kernel)
+    {
+        std::vector<uint16_t> samples(SAMPLE_RANGE);
+        std::vector<uint16_t> gain(SAMPLE_RANGE);
+
+        // Sample i meets gain first + i: every gain against every eighth sample, every sample against a gain of
+        // every eight. From gain 257 up the largest samples saturate.
+        for (uint32_t first = 0; first <= TVG_GAIN_MAX; first += TVG_GAIN_STEP)
+        {
+            for (int i = 0; i < SAMPLE_RANGE; i++)
+            {
+                samples[i] = static_cast<uint16_t>(i);
+                gain[i] = static_cast<uint16_t>((first + i) % (TVG_GAIN_MAX + 1));
+            }
+
+            if (false == CheckApply(kernel, samples, gain, SAMPLE_RANGE))
+            {
+                return false;
+            }
+        }
+
+        for (std::size_t count = 0; count <= MAX_TAIL_LENGTH; count++)
+        {
+            // Products on both sides of TVG_SAMPLE_MAX
+            for (std::size_t i = 0; i < count; i++)
+            {
+                samples[i] = static_cast<uint16_t>(SAMPLE_RANGE - 1 - (i * 37) % 1024);
+                gain[i] = static_cast<uint16_t>(TVG_GAIN_ONE - 2 + i % 5);
+            }
+
+            if (false == CheckApply(kernel, samples, gain, count))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Detector
+
+    constexpr int DETECT_OVERREAD = 16;             // Samples after count that would change the result if read
+
+    // Edges of the 12-bit range and of the sign bit SSE2 flips
+    const uint16_t DETECT_LEVELS[] = { 0, 1, 4094, 4095, 4096, 0x7FFF, 0x8000, 0x8001, 0xFFFE, 0xFFFF };
+
+    int ReferenceFirstAbove(const std::vector<uint16_t> &samples, int count, uint16_t threshold)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (samples[i] >= threshold)
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    uint16_t ReferenceMaximum(const std::vector<uint16_t> &samples, int count)
+    {
+        return (count > 0) ? *std::max_element(samples.begin(), samples.begin() + count) : 0;
+    }
+
+    /**
+     *   @brief Samples after count are set to 0xFFFF, so a kernel reading past count finds them
+     *   @return false - firstabove or maximum differs from the reference
+     */
+    bool CheckLine(const KernelInfo<DetectKernels> &kernel, std::vector<uint16_t> &samples, int count, uint16_t threshold)
+    {
+        std::fill(samples.begin() + count, samples.end(), static_cast<uint16_t>(0xFFFF));
+
+        int first = kernel.functions.firstabove(samples.data(), count, threshold);
+        int expectedfirst = ReferenceFirstAbove(samples, count, threshold);
+
+        if (first != expectedfirst)
+        {
+            std::printf("FAIL: detector %s firstabove, threshold %u, length %d: gives %d, expected %d\n",
+                        kernel.name, threshold, count, first, expectedfirst);
+            return false;
+        }
+
+        uint16_t maximum = kernel.functions.maximum(samples.data(), count);
+        uint16_t expectedmaximum = ReferenceMaximum(samples, count);
+
+        if (maximum != expectedmaximum)
+        {
+            std::printf("FAIL: detector %s maximum, length %d: gives %u, expected %u\n", kernel.name, count, maximum, expectedmaximum);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CheckDetect(const KernelInfo<DetectKernels> &kernel)
+    {
+        std::vector<uint16_t> samples(SAMPLE_RANGE + DETECT_OVERREAD);
+
+        for (uint16_t threshold : DETECT_LEVELS)
+        {
+            for (int count = 0; count <= MAX_TAIL_LENGTH; count++)
+            {
+                // All-equal lines, at, below and above the threshold
+                for (uint16_t level : DETECT_LEVELS)
+                {
+                    std::fill(samples.begin(), samples.begin() + count, level);
+
+                    if (false == CheckLine(kernel, samples, count, threshold))
+                    {
+                        return false;
+                    }
+                }
+
+                // The first sample reaching the threshold and the largest one at every position
+                for (int position = 0; position < count; position++)
+                {
+                    for (int i = 0; i < count; i++)
+                    {
+                        uint16_t below = (0 == threshold) ? 0 : static_cast<uint16_t>(threshold - 1 - (i * 7) % threshold);
+
+                        samples[i] = (i < position) ? below : static_cast<uint16_t>((i * 40503) & 0xFFFF);
+                    }
+
+                    // Even positions hold 0xFFFF, odd ones exactly the threshold
+                    samples[position] = static_cast<uint16_t>(0xFFFF - (position & 1) * (0xFFFF - threshold));
+
+                    if (false == CheckLine(kernel, samples, count, threshold))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            // Whole lines, every 12-bit value against the threshold
+            for (int i = 0; i < SAMPLE_RANGE; i++)
+            {
+                samples[i] = static_cast<uint16_t>((i * 1367) % SAMPLE_RANGE);
+            }
+
+            if (false == CheckLine(kernel, samples, SAMPLE_RANGE, threshold))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main()
+{
+    int failures = 0;
+
+    failures += RunKernels<UncompandKernels>("uncompand", CheckUncompand, Uncompand_KernelName());
+    failures += RunKernels<PersistKernels>("persistence", CheckPersistence, Persist_KernelName());
+    failures += RunKernels<ChangeKernels>("change mask", CheckChangeMask, Change_KernelName());
+    failures += RunKernels<TvgKernels>("tvg", CheckTvg, Tvg_KernelName());
+    failures += RunKernels<DetectKernels>("detector", CheckDetect, Detect_KernelName());
+
+    return (0 == failures) ? 0 : 1;
+}
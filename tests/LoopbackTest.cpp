@@ -0,0 +1,283 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+//
+// Runs Scansonar against a device stand-in on the other end of a LoopbackTransport pair.
+// The stand-in answers autobaud, the settings commands and START as the MRS900 does, then streams lines;
+// the test checks that the settings arrived with valid checksums and that every line is stored in SonarData,
+// then that an acquired image stays readable while the image is replaced.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeviceProtocol.h"
+#include "FrameScanner.h"
+#include "LoopbackTransport.h"
+#include "Scansonar.h"
+#include "ScansonarCWrapper.h"
+#include "SonarData.h"
+#include "SonarStructures.h"
+#include "Uncompand.h"
+
+namespace
+{
+    constexpr int LINES = 400;
+    constexpr uint32_t ANGLE_UNITS_PER_LINE = 9;
+    constexpr int64_t LINE_PERIOD_MS = 2;
+
+    uint8_t Sample(int line, uint32_t index)
+    {
+        return static_cast<uint8_t>(line * 7 + index * 3);
+    }
+
+    /**
+     *  @class DeviceStandIn
+     *  MRS900 side of the protocol, as in tools/Mrs900Simulator.cpp without fault injection
+     */
+    class DeviceStandIn final : public DeviceProtocol
+    {
+    public:
+
+        explicit DeviceStandIn(std::shared_ptr<Transport> Port) :
+            port(Port),
+            settings(0),
+            starts(0),
+            linessent(0),
+            stopping(false)
+        {
+            dcsp = {};
+        }
+
+        void Run()
+        {
+            auto nextline = std::chrono::steady_clock::now();
+
+            while (false == stopping)
+            {
+                if ((0 != port->Available()) || (false != port->WaitReadable(1)))
+                {
+                    uint8_t buffer[512];
+                    std::size_t br = port->Read(buffer, std::min<std::size_t>(sizeof(buffer), port->Available()));
+
+                    for (std::size_t i = 0; i < br; i++)
+                    {
+                        OnByte(static_cast<char>(buffer[i]));
+                    }
+                }
+
+                if ((DeviceState::DState_Work == GetState()) && (linessent < LINES) && (std::chrono::steady_clock::now() >= nextline))
+                {
+                    SendLine(linessent);
+                    linessent++;
+                    nextline += std::chrono::milliseconds(LINE_PERIOD_MS);
+                }
+            }
+        }
+
+        void Stop()
+        {
+            stopping = true;
+        }
+
+        uint32_t GetFrameSize() const
+        {
+            return std::min<uint32_t>(std::max<uint32_t>(dcsp.samples, sizeof(DATAHEADERV3) + sizeof(DATAFOOTER) + 1), 20400U);
+        }
+
+        std::shared_ptr<Transport> port;
+        std::atomic<int> settings;
+        std::atomic<int> starts;
+        std::atomic<int> linessent;
+        std::atomic<bool> stopping;
+
+        DATAGCOMMONSONARPARAM dcsp;
+
+    private:
+
+        void Send(const char *text) override
+        {
+            port->Write(reinterpret_cast<const uint8_t *>(text), std::strlen(text));
+        }
+
+        const char *OnCommand(const DEVICECOMMAND &command) override
+        {
+            if (BIN_COMMAND_COMMONSETTINGS == command.command)
+            {
+                std::memcpy(&dcsp, command.data, sizeof(dcsp));
+            }
+
+            if ((BIN_COMMAND_COMMONSETTINGS == command.command) || (BIN_COMMAND_SCANSETTINGS == command.command))
+            {
+                settings++;
+            }
+
+            return "#OK\n";
+        }
+
+        void OnStart() override
+        {
+            starts++;
+        }
+
+        void SendLine(int line)
+        {
+            uint32_t framesize = GetFrameSize();
+            std::vector<uint8_t> frame(framesize, 0);
+
+            DATAHEADERV3 header{};
+            header.magic = FRAME_MAGIC_DATA;
+            header.dataoffset = sizeof(DATAHEADERV3);
+            header.datasize = 1;
+            header.samples = framesize;
+            header.deviceid = 900;
+            header.angle = static_cast<uint32_t>(line) * ANGLE_UNITS_PER_LINE;
+
+            std::memcpy(frame.data(), &header, sizeof(header));
+
+            uint32_t count = framesize - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                frame[sizeof(DATAHEADERV3) + i] = Sample(line, i);
+            }
+
+            DATAFOOTER footer = { static_cast<uint32_t>(line * LINE_PERIOD_MS), FRAME_MAGIC_END0 };
+            std::memcpy(&frame[framesize - sizeof(DATAFOOTER)], &footer, sizeof(DATAFOOTER));
+
+            port->Write(frame.data(), frame.size());
+        }
+
+    };
+}
+
+int main()
+{
+    auto ends = LoopbackTransport::CreatePair(115200, 100);
+
+    DeviceStandIn device(ends.second);
+    std::thread devicethread(&DeviceStandIn::Run, &device);
+
+    std::atomic<int> received(0);
+    int failures = 0;
+
+    {
+        Scansonar sonar(ends.first, std::string(), [&received](char *line, int size)
+        {
+            (void)line;
+            (void)size;
+            received++;
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+        while ((received < LINES) && (std::chrono::steady_clock::now() < deadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        // The callback runs before the line is stored
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::shared_ptr<const SonarData> image = sonar.GetSonarImage();
+
+        uint32_t count = device.GetFrameSize() - sizeof(DATAHEADERV3) - sizeof(DATAFOOTER);
+        int stored = std::min(static_cast<int>(count), image->GetSamplesPerLine());
+
+        std::vector<uint8_t> samples(count);
+        std::vector<uint16_t> expected(count);
+        int mismatches = 0;
+
+        int lines = std::min<int>(received, LINES);
+
+        for (int line = 0; line < lines; line++)
+        {
+            // Gap fill points the row of the previous line to the next one received, the last line keeps its own
+            int source = std::min(line + 1, lines - 1);
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                samples[i] = Sample(source, i);
+            }
+
+            Uncompand_Line(samples.data(), expected.data(), count);
+
+            // Angle / 9 is the row at stepping mode 1
+            if (0 != std::memcmp(image->GetLine(line), expected.data(), stored * sizeof(uint16_t)))
+            {
+                if (0 == mismatches)
+                {
+                    std::printf("FAIL: line %d is not stored as received\n", line);
+                }
+
+                mismatches++;
+            }
+        }
+
+        failures += (0 != mismatches) ? 1 : 0;
+
+        // An acquired image outlives replacements, unchanged persistence settings do not replace it
+        pSnrCtx snrctx = reinterpret_cast<pSnrCtx>(&sonar);
+        pScansonarImage acquired = ScansonarImageAcquire(snrctx);
+        std::vector<uint16_t> row(image->GetLine(lines - 1), image->GetLine(lines - 1) + stored);
+        image.reset();
+
+        uint32_t generation = sonar.GetSonarImageGeneration();
+
+        ScansonarSetPersistence(snrctx, SCANSONAR_PERSISTENCE_OFF, 1.0F, 0);
+        ScansonarSetPersistence(snrctx, SCANSONAR_PERSISTENCE_OFF, 0.5F, 0);
+
+        if (generation != sonar.GetSonarImageGeneration())
+        {
+            std::printf("FAIL: unchanged persistence replaced the image\n");
+            failures++;
+        }
+
+        ScansonarSetPersistence(snrctx, SCANSONAR_PERSISTENCE_AVERAGE, 0.5F, 0);
+        ScansonarSetPersistence(snrctx, SCANSONAR_PERSISTENCE_MAXHOLD, 1.0F, 1);
+        ScansonarSetPersistence(snrctx, SCANSONAR_PERSISTENCE_OFF, 1.0F, 0);
+
+        ScansonarGeometry geometry;
+        const uint16_t *kept = ScansonarImageGetLine(acquired, lines - 1);
+
+        if ((generation + 3 != sonar.GetSonarImageGeneration()) || (0 != ScansonarImageGetGeometry(acquired, &geometry)) ||
+            (generation != geometry.generation) || (nullptr == kept) || (0 != std::memcmp(kept, row.data(), stored * sizeof(uint16_t))))
+        {
+            std::printf("FAIL: acquired image is not kept across replacements\n");
+            failures++;
+        }
+
+        ScansonarImageRelease(acquired);
+    }
+
+    device.Stop();
+    devicethread.join();
+
+    if ((0 == device.GetSyncsCount()) || (0 == device.starts))
+    {
+        std::printf("FAIL: autobaud %d, START %d\n", static_cast<int>(device.GetSyncsCount()), device.starts.load());
+        failures++;
+    }
+
+    if ((device.settings < 2) || (0 != device.GetCrcErrorsCount()))
+    {
+        std::printf("FAIL: %d settings commands, %d checksum errors\n", device.settings.load(), static_cast<int>(device.GetCrcErrorsCount()));
+        failures++;
+    }
+
+    if (received < LINES)
+    {
+        std::printf("FAIL: %d of %d lines received\n", received.load(), LINES);
+        failures++;
+    }
+
+    std::printf("%s: %d lines of %u bytes, autobaud %d, settings %d, START %d\n", (0 == failures) ? "PASS" : "FAIL",
+                received.load(), device.GetFrameSize(), static_cast<int>(device.GetSyncsCount()), device.settings.load(), device.starts.load());
+
+    return (0 == failures) ? 0 : 1;
+}
@@ -0,0 +1,553 @@
+// Copyright (c) EofE Ultrasonics Co., Ltd., 2024
+//
+// MRS900 scanning sonar simulator.
+// Opens a pseudo-terminal and speaks the serial protocol used by ThreadSonarSerial,
+// so the library can be run and measured without hardware:
+//
+//     mrs900sim --link /tmp/ttySONAR --rate 50 --garbage 100 --stall 500:3000
+//     ScansonarOpen("/tmp/ttySONAR", 115200, ...)
+//
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <pty.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "SonarStructures.h"
+#include "FrameScanner.h"
+#include "DeviceProtocol.h"
+
+namespace
+{
+    constexpr uint32_t ANGLE_UNITS_PER_TURN = 28800;
+    constexpr uint32_t ANGLE_UNITS_PER_LINE = 9;
+    constexpr uint32_t MAX_FRAME_SIZE = 20400;
+
+    struct SimOptions
+    {
+        std::string link;
+        uint32_t baudrate = 115200;
+        uint32_t samples = 0;           // frame size, 0 - as set by the host
+        int stepping = -1;              // -1 - as set by the host
+        double rate = 0.0;              // lines per second, 0 - host ping interval
+        int header = 3;                 // DATAHEADER version
+        bool throttle = true;           // limit output to baudrate
+        uint32_t keepalivems = 1000;    // END1 is sent when no START was received for this long
+        uint32_t keepalivetimeoutms = 5000;
+        uint32_t garbageevery = 0;
+        uint32_t truncateevery = 0;
+        uint32_t stallevery = 0;
+        uint32_t stallms = 0;
+        uint32_t seed = 1;
+        bool verbose = false;
+    };
+
+    struct SimStats
+    {
+        uint64_t lines = 0;
+        uint64_t bytes = 0;
+        uint64_t garbage = 0;
+        uint64_t truncated = 0;
+        uint64_t stalls = 0;
+    };
+
+    volatile std::sig_atomic_t stoprequested = 0;
+
+    void OnSignal(int)
+    {
+        stoprequested = 1;
+    }
+
+    uint32_t ParseUint(const char *text)
+    {
+        return static_cast<uint32_t>(std::strtoul(text, nullptr, 10));
+    }
+
+    void Usage(const char *name)
+    {
+        std::printf("Usage: %s [options]\n"
+                    "  --link PATH         create symlink PATH to the pty slave\n"
+                    "  --baud N            line rate, used for output throttling (115200)\n"
+                    "  --no-throttle       send lines as fast as the pty accepts them\n"
+                    "  --samples N         frame size in bytes, overrides the host setting\n"
+                    "  --step N            stepping mode 0,1,2,4,8,16, overrides the host setting\n"
+                    "  --rate HZ           lines per second, overrides the host ping interval\n"
+                    "  --header 1|2|3      DATAHEADER version (3)\n"
+                    "  --keepalive MS      request keep-alive (END1) after MS without START (1000)\n"
+                    "  --keepalive-timeout MS  return to command mode after MS without START (5000)\n"
+                    "  --garbage N         send garbage bytes every N lines\n"
+                    "  --truncate N        truncate every N-th line\n"
+                    "  --stall N:MS        stop sending for MS every N lines\n"
+                    "  --seed N            fault injection seed (1)\n"
+                    "  --verbose           log protocol events\n", name);
+    }
+
+    bool ParseOptions(int argc, char **argv, SimOptions &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+            if ("--no-throttle" == arg)
+            {
+                options.throttle = false;
+                continue;
+            }
+
+            if ("--verbose" == arg)
+            {
+                options.verbose = true;
+                continue;
+            }
+
+            if (nullptr == value)
+            {
+                return false;
+            }
+
+            i++;
+
+            if ("--link" == arg)                   options.link = value;
+            else if ("--baud" == arg)              options.baudrate = ParseUint(value);
+            else if ("--samples" == arg)           options.samples = ParseUint(value);
+            else if ("--step" == arg)              options.stepping = static_cast<int>(ParseUint(value));
+            else if ("--rate" == arg)              options.rate = std::strtod(value, nullptr);
+            else if ("--header" == arg)            options.header = static_cast<int>(ParseUint(value));
+            else if ("--keepalive" == arg)         options.keepalivems = ParseUint(value);
+            else if ("--keepalive-timeout" == arg) options.keepalivetimeoutms = ParseUint(value);
+            else if ("--garbage" == arg)           options.garbageevery = ParseUint(value);
+            else if ("--truncate" == arg)          options.truncateevery = ParseUint(value);
+            else if ("--seed" == arg)              options.seed = ParseUint(value);
+            else if ("--stall" == arg)
+            {
+                const char *colon = std::strchr(value, ':');
+
+                if (nullptr == colon)
+                {
+                    return false;
+                }
+
+                options.stallevery = ParseUint(value);
+                options.stallms = ParseUint(colon + 1);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return (options.header >= 1) && (options.header <= 3);
+    }
+
+    class Mrs900Simulator final : public DeviceProtocol
+    {
+    public:
+
+        Mrs900Simulator(int MasterFd, const SimOptions &Options) :
+            masterfd(MasterFd),
+            options(Options),
+            angle(0),
+            random(Options.seed)
+        {
+            dcsp = {};
+            dssp = {};
+
+            dcsp.samples = 1376;
+            dcsp.ping_interval = 10000;
+            dssp.stepping_mode = 1;
+
+            starttime = std::chrono::steady_clock::now();
+            lastkeepalive = starttime;
+            nextline = starttime;
+        }
+
+        void Run()
+        {
+            while (0 == stoprequested)
+            {
+                int timeoutms = 100;
+
+                if (DeviceState::DState_Work == GetState())
+                {
+                    auto now = std::chrono::steady_clock::now();
+                    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(nextline - now).count();
+
+                    timeoutms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(left, 100)));
+                }
+
+                struct pollfd pfd = { masterfd, POLLIN, 0 };
+
+                if (poll(&pfd, 1, timeoutms) > 0)
+                {
+                    uint8_t buffer[512];
+                    ssize_t br = read(masterfd, buffer, sizeof(buffer));
+
+                    if (br > 0)
+                    {
+                        for (ssize_t i = 0; i < br; i++)
+                        {
+                            OnByte(static_cast<char>(buffer[i]));
+                        }
+                    }
+                    else if ((br < 0) && (EIO == errno))
+                    {
+                        // No client has the slave open
+                        usleep(10000);
+                    }
+                }
+
+                if (DeviceState::DState_Work == GetState())
+                {
+                    Stream();
+                }
+            }
+        }
+
+        const SimStats &GetStats() const
+        {
+            return stats;
+        }
+
+    private:
+
+        void Log(const char *format, const char *text = "")
+        {
+            if (false != options.verbose)
+            {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - starttime).count();
+                std::fprintf(stderr, "[%10.3f] ", seconds);
+                std::fprintf(stderr, format, text);
+                std::fprintf(stderr, "\n");
+            }
+        }
+
+        void Send(const void *data, std::size_t size)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+            std::size_t written = 0;
+
+            while ((written < size) && (0 == stoprequested))
+            {
+                ssize_t bw = write(masterfd, &bytes[written], size - written);
+
+                if (bw > 0)
+                {
+                    written += static_cast<std::size_t>(bw);
+                    continue;
+                }
+
+                // pty buffer is full or nobody reads the slave
+                struct pollfd pfd = { masterfd, POLLOUT, 0 };
+                poll(&pfd, 1, 10);
+            }
+
+            stats.bytes += written;
+        }
+
+        void Send(const char *text) override
+        {
+            Send(text, std::strlen(text));
+        }
+
+        const char *OnCommand(const DEVICECOMMAND &command) override
+        {
+            switch (command.command)
+            {
+                case BIN_COMMAND_COMMONSETTINGS:
+                    std::memcpy(&dcsp, command.data, sizeof(dcsp));
+                    Log("common settings");
+                    break;
+
+                case BIN_COMMAND_SCANSETTINGS:
+                    std::memcpy(&dssp, command.data, sizeof(dssp));
+                    Log("scan settings");
+                    break;
+
+                case BIN_COMMAND_FWVERSION:
+                    return "<1.00 SIM>#OK\n";
+
+                case BIN_COMMAND_DEVICETYPE:
+                    return "<MRS900 SIM>#OK\n";
+
+                default:
+                    break;
+            }
+
+            return "#OK\n";
+        }
+
+        void OnSync() override
+        {
+            Log("autobaud");
+        }
+
+        void OnBaudrate(const std::string &baudrate) override
+        {
+            Log("baudrate %s, command mode", baudrate.c_str());
+        }
+
+        void OnStart() override
+        {
+            lastkeepalive = std::chrono::steady_clock::now();
+            nextline = lastkeepalive;
+            Log("start, work mode");
+        }
+
+        void OnStop() override
+        {
+            Log("stop, command mode");
+        }
+
+        void OnKeepAlive() override
+        {
+            lastkeepalive = std::chrono::steady_clock::now();
+        }
+
+        void OnInvalidCommand() override
+        {
+            Log("invalid command");
+        }
+
+        uint32_t FrameSize() const
+        {
+            uint32_t headersize = (1 == options.header) ? sizeof(DATAHEADERV1) : (2 == options.header) ? sizeof(DATAHEADERV2) : sizeof(DATAHEADERV3);
+            uint32_t size = (0 != options.samples) ? options.samples : dcsp.samples;
+
+            return std::min(std::max(size, static_cast<uint32_t>(headersize + sizeof(DATAFOOTER) + 1)), MAX_FRAME_SIZE);
+        }
+
+        std::chrono::microseconds LinePeriod() const
+        {
+            int64_t periodus = (options.rate > 0.0) ? static_cast<int64_t>(1000000.0 / options.rate) : dcsp.ping_interval;
+
+            if (false != options.throttle)
+            {
+                // 10 bits per byte on the wire
+                int64_t wireus = static_cast<int64_t>(FrameSize()) * 10 * 1000000 / std::max<uint32_t>(options.baudrate, 1);
+                periodus = std::max(periodus, wireus);
+            }
+
+            return std::chrono::microseconds(std::max<int64_t>(periodus, 100));
+        }
+
+        void Stream()
+        {
+            auto now = std::chrono::steady_clock::now();
+
+            auto silence = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastkeepalive).count();
+
+            if (silence > options.keepalivetimeoutms)
+            {
+                EnterCommandMode();
+                Log("keep-alive timeout, command mode");
+                return;
+            }
+
+            if (now < nextline)
+            {
+                return;
+            }
+
+            nextline += LinePeriod();
+
+            // Do not try to catch up after a long stall
+            if (nextline < now)
+            {
+                nextline = now;
+            }
+
+            uint64_t linenumber = stats.lines + 1;
+
+            if ((0 != options.stallevery) && (0 == linenumber % options.stallevery))
+            {
+                stats.stalls++;
+                Log("stall");
+                usleep(options.stallms * 1000U);
+                nextline = std::chrono::steady_clock::now();
+            }
+
+            if ((0 != options.garbageevery) && (0 == linenumber % options.garbageevery))
+            {
+                SendGarbage();
+            }
+
+            std::vector<uint8_t> frame;
+            BuildFrame(frame, silence > options.keepalivems);
+
+            std::size_t size = frame.size();
+
+            if ((0 != options.truncateevery) && (0 == linenumber % options.truncateevery))
+            {
+                stats.truncated++;
+                size = std::uniform_int_distribution<std::size_t>(1, frame.size() - 1)(random);
+            }
+
+            Send(frame.data(), size);
+            stats.lines++;
+
+            // Stepping mode 0 is continuous as 1, as the library reads it
+            int step = std::max(1, (options.stepping >= 0) ? options.stepping : static_cast<int>(dssp.stepping_mode));
+            angle = (angle + static_cast<uint32_t>(step) * ANGLE_UNITS_PER_LINE) % ANGLE_UNITS_PER_TURN;
+        }
+
+        void SendGarbage()
+        {
+            std::size_t count = std::uniform_int_distribution<std::size_t>(8, 256)(random);
+            std::vector<uint8_t> garbage(count);
+
+            for (auto &b : garbage)
+            {
+                b = static_cast<uint8_t>(random());
+            }
+
+            // A false start and a stray end token exercise the resync path
+            if (count > 16)
+            {
+                std::memcpy(&garbage[count / 2], "DATA", 4);
+                std::memcpy(&garbage[count - 4], "END0", 4);
+            }
+
+            stats.garbage++;
+            Send(garbage.data(), garbage.size());
+        }
+
+        void BuildFrame(std::vector<uint8_t> &frame, bool requestkeepalive)
+        {
+            uint32_t framesize = FrameSize();
+            frame.assign(framesize, 0);
+
+            DATAHEADERV3 header{};
+            header.magic = FRAME_MAGIC_DATA;
+            header.dataoffset = (1 == options.header) ? sizeof(DATAHEADERV1) : (2 == options.header) ? sizeof(DATAHEADERV2) : sizeof(DATAHEADERV3);
+            header.datasize = 1;
+            header.samples = framesize;
+            header.deviceid = 900;
+            header.angle = angle;
+            header.commandid = dcsp.commandid;
+
+            std::memcpy(frame.data(), &header, header.dataoffset);
+
+            // Companded samples: noise floor, a ring at fixed range and a target sweeping with the angle
+            uint32_t count = framesize - header.dataoffset - sizeof(DATAFOOTER);
+            uint32_t target = (angle / ANGLE_UNITS_PER_LINE) % count;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t value = 20 + (random() & 15);
+
+                if ((i > count / 2) && (i < count / 2 + 8))
+                {
+                    value = 180;
+                }
+
+                if ((i >= target) && (i < target + 4))
+                {
+                    value = 240;
+                }
+
+                frame[header.dataoffset + i] = static_cast<uint8_t>(value);
+            }
+
+            DATAFOOTER footer;
+            footer.timestamp = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - starttime).count());
+            footer.magic = (false != requestkeepalive) ? FRAME_MAGIC_END1 : FRAME_MAGIC_END0;
+
+            std::memcpy(&frame[framesize - sizeof(DATAFOOTER)], &footer, sizeof(DATAFOOTER));
+        }
+
+        int masterfd;
+        SimOptions options;
+        SimStats stats;
+
+        DATAGCOMMONSONARPARAM dcsp;
+        DATAGSCANSONARPARAM dssp;
+
+        uint32_t angle;
+
+        std::mt19937 random;
+
+        std::chrono::steady_clock::time_point starttime;
+        std::chrono::steady_clock::time_point lastkeepalive;
+        std::chrono::steady_clock::time_point nextline;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    SimOptions options;
+
+    if (false == ParseOptions(argc, argv, options))
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    int masterfd = -1;
+    int slavefd = -1;
+    char slavename[256] = { 0 };
+
+    if (0 != openpty(&masterfd, &slavefd, slavename, nullptr, nullptr))
+    {
+        std::perror("openpty");
+        return 1;
+    }
+
+    // Raw line discipline, the protocol is binary. The slave stays open so the pty survives client reconnects.
+    struct termios tio;
+    tcgetattr(slavefd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slavefd, TCSANOW, &tio);
+
+    fcntl(masterfd, F_SETFL, fcntl(masterfd, F_GETFL) | O_NONBLOCK);
+
+    if (false == options.link.empty())
+    {
+        unlink(options.link.c_str());
+
+        if (0 != symlink(slavename, options.link.c_str()))
+        {
+            std::perror("symlink");
+            return 1;
+        }
+    }
+
+    std::printf("%s\n", options.link.empty() ? slavename : options.link.c_str());
+    std::fflush(stdout);
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    Mrs900Simulator simulator(masterfd, options);
+    simulator.Run();
+
+    const SimStats &stats = simulator.GetStats();
+
+    std::fprintf(stderr, "lines %llu, bytes %llu, commands %llu, crc errors %llu, keep-alives %llu, syncs %llu, "
+                         "garbage %llu, truncated %llu, stalls %llu\n",
+                 (unsigned long long)stats.lines, (unsigned long long)stats.bytes, (unsigned long long)simulator.GetCommandsCount(),
+                 (unsigned long long)simulator.GetCrcErrorsCount(), (unsigned long long)simulator.GetKeepAlivesCount(),
+                 (unsigned long long)simulator.GetSyncsCount(),
+                 (unsigned long long)stats.garbage, (unsigned long long)stats.truncated, (unsigned long long)stats.stalls);
+
+    if (false == options.link.empty())
+    {
+        unlink(options.link.c_str());
+    }
+
+    close(slavefd);
+    close(masterfd);
+
+    return 0;
+}